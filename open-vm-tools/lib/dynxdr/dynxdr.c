@@ -398,6 +398,66 @@ DynXdr_AppendRaw(XDR *xdrs,         // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_Reserve --
+ *
+ *    Makes sure the XDR stream's buffer can take "len" more bytes without
+ *    being reallocated. Callers that know how much data they're about to
+ *    encode (see xdr_sizeof()) can use this to avoid growing the buffer
+ *    piecemeal.
+ *
+ * Results:
+ *    Whether enough space is available.
+ *
+ * Side effects:
+ *    The buffer may be enlarged.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+DynXdr_Reserve(XDR *xdrs,   // IN
+               size_t len)  // IN
+{
+   DynBuf *buf = &((DynXdrData *) xdrs->x_private)->data;
+
+   if (buf->allocated - buf->size >= len) {
+      return TRUE;
+   }
+   if (buf->size + len < buf->size) {
+      return FALSE;
+   }
+   return DynBuf_Enlarge(buf, buf->size + len);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_Reset --
+ *
+ *    Discards the data in the XDR stream, keeping its buffer, so that the
+ *    stream can be reused to encode another message without allocating
+ *    memory again.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynXdr_Reset(XDR *xdrs)  // IN
+{
+   DynBuf_SetSize(&((DynXdrData *) xdrs->x_private)->data, 0);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -144,6 +144,51 @@
    #endif
 #endif
 
+/*
+ * copy_file_range() appeared in linux kernel-4.5 and glibc-2.27, FICLONE in
+ * kernel-4.5 and SEEK_DATA/SEEK_HOLE in kernel-3.1; none of them are known
+ * to the toolchain headers, so provide the definitions ourselves. All of
+ * them fail cleanly (ENOSYS, ENOTTY, EINVAL) on older kernels.
+ */
+#if defined(__linux__)
+   #include <sys/ioctl.h>
+   #include <sys/sendfile.h>
+   #if !defined(SYS_copy_file_range)
+      #if defined(__i386__)
+         #define SYS_copy_file_range 377
+      #elif __x86_64__
+         #define SYS_copy_file_range 326
+      #elif __arm__
+         #define SYS_copy_file_range (__NR_SYSCALL_BASE+391)
+      #elif __aarch64__
+         #define SYS_copy_file_range 285
+      #endif
+   #endif
+   #if !defined(FICLONE)
+      #define FICLONE _IOW(0x94, 9, int)
+   #endif
+   #if !defined(SEEK_DATA)
+      #define SEEK_DATA 3
+   #endif
+   #if !defined(SEEK_HOLE)
+      #define SEEK_HOLE 4
+   #endif
+
+/*
+ * Largest amount of data handed to the kernel by a single copy_file_range()
+ * or sendfile() call, and size of the bounce buffer used when neither is
+ * available.
+ */
+#define FILEIO_COPY_CHUNK_SIZE   (1024 * 1024 * 1024)
+#define FILEIO_COPY_BUFFER_SIZE  (1024 * 1024)
+
+typedef enum {
+   FILEIO_COPY_METHOD_COPY_RANGE,
+   FILEIO_COPY_METHOD_SENDFILE,
+   FILEIO_COPY_METHOD_BUFFER,
+} FileIOCopyMethod;
+#endif
+
 static const unsigned int FileIO_SeekOrigins[] = {
    SEEK_SET,
    SEEK_CUR,
@@ -1307,6 +1352,364 @@ FileIO_Read(FileIODescriptor *fd,  // IN:
 }
 
 
+#if defined(__linux__)
+/*
+ *----------------------------------------------------------------------
+ *
+ * FileIOCopyIsFallbackError --
+ *
+ *      Determine whether an error returned by copy_file_range() or
+ *      sendfile() means that the mechanism is not usable for this pair of
+ *      files, in which case the next (slower) mechanism should be tried.
+ *
+ * Results:
+ *      TRUE if the copy should be retried with another mechanism.
+ *
+ * Side effects:
+ *      None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+FileIOCopyIsFallbackError(int error)  // IN:
+{
+   switch (error) {
+   case ENOSYS:
+   case EXDEV:
+   case EINVAL:
+   case EOPNOTSUPP:
+#if EOPNOTSUPP != ENOTSUP
+   case ENOTSUP:
+#endif
+   case EBADF:
+   case ETXTBSY:
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FileIOCopyExtent --
+ *
+ *      Copy 'length' bytes at 'srcOffset' in 'srcFd' to 'dstOffset' in
+ *      'dstFd', using the fastest mechanism that works for the pair of
+ *      files. '*method' is downgraded as mechanisms turn out to be
+ *      unsupported, so that callers copying several extents only probe
+ *      once. The bounce buffer is allocated on demand into '*buf'.
+ *
+ * Results:
+ *      FILEIO_SUCCESS on success: '*copied' bytes have been copied, which
+ *       is less than 'length' only if the source file ended early.
+ *      Other FileIOResult values on failure, with '*copied' set to the
+ *       number of bytes copied before the error.
+ *
+ * Side effects:
+ *      The current position of 'dstFd' may be modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static FileIOResult
+FileIOCopyExtent(int srcFd,                 // IN:
+                 int dstFd,                 // IN:
+                 uint64 srcOffset,          // IN:
+                 uint64 dstOffset,          // IN:
+                 uint64 length,             // IN:
+                 FileIOCopyMethod *method,  // IN/OUT:
+                 void **buf,                // IN/OUT:
+                 uint64 *copied)            // OUT:
+{
+   uint64 done = 0;
+   FileIOResult fret = FILEIO_SUCCESS;
+
+   *copied = 0;
+
+   while (done < length) {
+      size_t chunk = MIN(length - done, FILEIO_COPY_CHUNK_SIZE);
+      ssize_t res;
+
+      switch (*method) {
+      case FILEIO_COPY_METHOD_COPY_RANGE: {
+#if defined(SYS_copy_file_range)
+         loff_t inOff = srcOffset + done;
+         loff_t outOff = dstOffset + done;
+
+         res = syscall(SYS_copy_file_range, srcFd, &inOff, dstFd, &outOff,
+                       chunk, 0);
+#else
+         res = -1;
+         errno = ENOSYS;
+#endif
+         if (res == -1 && FileIOCopyIsFallbackError(errno)) {
+            *method = FILEIO_COPY_METHOD_SENDFILE;
+            continue;
+         }
+         break;
+      }
+      case FILEIO_COPY_METHOD_SENDFILE: {
+         off_t inOff = srcOffset + done;
+
+         /* sendfile() writes at the current position of the output. */
+         if (lseek(dstFd, dstOffset + done, SEEK_SET) == (off_t) -1) {
+            *copied = done;
+            return FileIOErrno2Result(errno);
+         }
+
+         res = sendfile(dstFd, srcFd, &inOff, chunk);
+         if (res == -1 && FileIOCopyIsFallbackError(errno)) {
+            *method = FILEIO_COPY_METHOD_BUFFER;
+            continue;
+         }
+         break;
+      }
+      default: {
+         ssize_t written = 0;
+
+         if (*buf == NULL) {
+            *buf = FileIOAligned_Malloc(FILEIO_COPY_BUFFER_SIZE);
+         }
+
+         chunk = MIN(chunk, FILEIO_COPY_BUFFER_SIZE);
+         res = pread(srcFd, *buf, chunk, srcOffset + done);
+
+         while (res > 0 && written < res) {
+            ssize_t w = pwrite(dstFd, (uint8 *) *buf + written, res - written,
+                               dstOffset + done + written);
+
+            if (w == -1) {
+               if (errno == EINTR) {
+                  continue;
+               }
+               *copied = done + written;
+               return FileIOErrno2Result(errno);
+            }
+            written += w;
+         }
+         break;
+      }
+      }
+
+      if (res == -1) {
+         if (errno == EINTR) {
+            continue;
+         }
+         fret = FileIOErrno2Result(errno);
+         break;
+      }
+
+      if (res == 0) {
+         /* The source file shrank while we were copying it. */
+         break;
+      }
+
+      done += res;
+   }
+
+   *copied = done;
+
+   return fret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FileIOCopyStream --
+ *
+ *      Copy all data from the current position of 'src' to the current
+ *      position of 'dst' with read/write, for files that can't be
+ *      addressed by offset (pipes, sockets, character devices).
+ *
+ * Results:
+ *      FILEIO_SUCCESS on success, other FileIOResult values on failure.
+ *
+ * Side effects:
+ *      The current positions of both files are modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static FileIOResult
+FileIOCopyStream(FileIODescriptor *src,  // IN:
+                 FileIODescriptor *dst)  // IN:
+{
+   void *buf = FileIOAligned_Malloc(FILEIO_COPY_BUFFER_SIZE);
+   FileIOResult fretR;
+   FileIOResult fretW = FILEIO_SUCCESS;
+
+   do {
+      size_t actual;
+
+      fretR = FileIO_Read(src, buf, FILEIO_COPY_BUFFER_SIZE, &actual);
+      if (!FileIO_IsSuccess(fretR) && (fretR != FILEIO_READ_ERROR_EOF)) {
+         break;
+      }
+
+      fretW = FileIO_Write(dst, buf, actual, NULL);
+   } while (FileIO_IsSuccess(fretW) && fretR != FILEIO_READ_ERROR_EOF);
+
+   FileIOAligned_Free(buf);
+
+   if (!FileIO_IsSuccess(fretW)) {
+      return fretW;
+   }
+
+   return fretR == FILEIO_READ_ERROR_EOF ? FILEIO_SUCCESS : fretR;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FileIOCopyFdToFd --
+ *
+ *      Copy all data between the current position in 'src' and the end of
+ *      'src' to the current position in 'dst', doing as much of the work
+ *      as possible inside the kernel. In decreasing order of preference:
+ *
+ *       - the whole file is cloned with FICLONE (reflink) when a complete
+ *         file is copied into an empty one on a filesystem that supports
+ *         it (btrfs, xfs, ...),
+ *       - data extents are copied with copy_file_range(), which may be
+ *         offloaded to the filesystem or the storage,
+ *       - data extents are copied with sendfile(),
+ *       - data extents are copied through a large aligned buffer.
+ *
+ *      Holes in the source (found with SEEK_DATA/SEEK_HOLE) are preserved
+ *      when nothing in 'dst' would be left behind by skipping them, i.e.
+ *      when 'dst' ends at or before its current position.
+ *
+ * Results:
+ *      FILEIO_SUCCESS on success, other FileIOResult values on failure
+ *      with errno set.
+ *
+ * Side effects:
+ *      The current position in 'src' and 'dst' are moved past the copied
+ *      data, as if it had been read and written.
+ *
+ *----------------------------------------------------------------------
+ */
+
+FileIOResult
+FileIOCopyFdToFd(FileIODescriptor *src,  // IN:
+                 FileIODescriptor *dst)  // IN:
+{
+   struct stat srcStat;
+   struct stat dstStat;
+   off_t srcPos;
+   off_t dstPos;
+   uint64 offset;
+   uint64 end;
+   Bool extend;
+   Bool sparse;
+   FileIOCopyMethod method = FILEIO_COPY_METHOD_COPY_RANGE;
+   void *buf = NULL;
+   FileIOResult fret = FILEIO_SUCCESS;
+
+   ASSERT(src);
+   ASSERT(dst);
+
+   if (fstat(src->posix, &srcStat) == -1 ||
+       fstat(dst->posix, &dstStat) == -1) {
+      return FileIOErrno2Result(errno);
+   }
+
+   srcPos = lseek(src->posix, 0, SEEK_CUR);
+   dstPos = lseek(dst->posix, 0, SEEK_CUR);
+
+   if (!S_ISREG(srcStat.st_mode) || srcPos == (off_t) -1 ||
+       dstPos == (off_t) -1 || (dst->flags & FILEIO_OPEN_APPEND) != 0) {
+      return FileIOCopyStream(src, dst);
+   }
+
+   if (srcPos >= srcStat.st_size) {
+      return FILEIO_SUCCESS;
+   }
+
+   extend = S_ISREG(dstStat.st_mode) && dstStat.st_size <= dstPos;
+   sparse = extend;
+
+   if (sparse && srcPos == 0 && dstPos == 0 &&
+       ioctl(dst->posix, FICLONE, src->posix) == 0) {
+      end = srcStat.st_size;
+      goto done;
+   }
+
+   offset = srcPos;
+   end = srcStat.st_size;
+
+   while (offset < end) {
+      uint64 dataStart = offset;
+      uint64 dataEnd = end;
+      uint64 copied;
+
+      if (sparse) {
+         off_t data = lseek(src->posix, offset, SEEK_DATA);
+
+         if (data == (off_t) -1) {
+            if (errno == ENXIO) {
+               /* Only a hole is left. */
+               break;
+            }
+
+            /* SEEK_DATA is not supported, treat everything as data. */
+            sparse = FALSE;
+         } else {
+            off_t hole = lseek(src->posix, data, SEEK_HOLE);
+
+            dataStart = data;
+            if (hole != (off_t) -1) {
+               dataEnd = MIN((uint64) hole, end);
+            }
+         }
+      }
+
+      if (dataStart >= end) {
+         break;
+      }
+
+      fret = FileIOCopyExtent(src->posix, dst->posix, dataStart,
+                              dstPos + (dataStart - srcPos),
+                              dataEnd - dataStart, &method, &buf, &copied);
+      if (!FileIO_IsSuccess(fret)) {
+         goto exit;
+      }
+
+      if (copied < dataEnd - dataStart) {
+         end = dataStart + copied;
+         break;
+      }
+
+      offset = dataEnd;
+   }
+
+   /* Materialize a trailing hole. */
+   if (extend && ftruncate(dst->posix, dstPos + (end - srcPos)) == -1) {
+      fret = FileIOErrno2Result(errno);
+      goto exit;
+   }
+
+done:
+   if (lseek(src->posix, end, SEEK_SET) == (off_t) -1 ||
+       lseek(dst->posix, dstPos + (end - srcPos), SEEK_SET) == (off_t) -1) {
+      fret = FileIOErrno2Result(errno);
+   }
+
+exit:
+   if (buf != NULL) {
+      FileIOAligned_Free(buf);
+   }
+
+   return fret;
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -313,6 +313,11 @@ FileIOAligned_Free(void *ptr)  // IN:
    }
 }
 
+#if defined(__linux__)
+FileIOResult FileIOCopyFdToFd(FileIODescriptor *src,
+                              FileIODescriptor *dst);
+#endif
+
 #if defined(__APPLE__)
 int PosixFileOpener(ConstUnicode pathName,
                     int flags,
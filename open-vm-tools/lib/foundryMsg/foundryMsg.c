@@ -1230,51 +1230,30 @@ VixMsgEncodeBuffer(const uint8 *buffer,     // IN
                    char ** result)          // OUT
 {
    VixError err = VIX_OK;
-   char *base64String = NULL;
    char *resultString = NULL;
-   size_t resultBufferLength = 0;
-   char *srcPtr;
-   char *endSrcPtr;
+   size_t resultBufferLength;
    char *destPtr;
    size_t base64Length;
-   
-   base64Length = Base64_EncodedLength((uint8 const *) buffer,
-                                       bufferLength);
-   base64String = VixMsg_MallocClientData(base64Length);
-   if (base64String == NULL) {
-      err = VIX_E_OUT_OF_MEMORY;
-      goto abort;
-   }
-
-   if (!(Base64_Encode((uint8 const *) buffer,
-                       bufferLength,
-                       base64String, 
-                       base64Length,
-                       &base64Length))) {
-      err = VIX_E_FAIL;
-      goto abort;
-   }
-
-   VixMsgInitializeObfuscationMapping();
 
    /*
-    * Expand it to make space for escaping some characters.
+    * The characters we escape (backslash, quotes and whitespace) are not in
+    * the base64 alphabet, so the encoded data never needs escaping and is
+    * written straight into the result.
     */
-   resultBufferLength = base64Length * 2;
+   base64Length = Base64_EncodedLength((uint8 const *) buffer,
+                                       bufferLength);
+   resultBufferLength = base64Length;
    if (includeEncodingId) {
       resultBufferLength++;
    }
 
-   resultString = VixMsg_MallocClientData(resultBufferLength + 1);
+   resultString = VixMsg_MallocClientData(resultBufferLength);
    if (resultString == NULL) {
       err = VIX_E_OUT_OF_MEMORY;
       goto abort;
    }
 
    destPtr = resultString;
-   srcPtr = base64String;
-   endSrcPtr = base64String + base64Length;
-
    if (includeEncodingId) {
       /*
        * Start with the character-set type. 
@@ -1283,27 +1262,18 @@ VixMsgEncodeBuffer(const uint8 *buffer,     // IN
       *(destPtr++) = 'a';
    }
 
-   /*
-    * Now, escape problematic characters.
-    */
-   while (srcPtr < endSrcPtr)
-   {
-      if (PlainToObfuscatedCharMap[(unsigned int) (*srcPtr)]) {
-         *(destPtr++) = '\\';
-         *(destPtr++) = PlainToObfuscatedCharMap[(unsigned int) (*srcPtr)];
-      } else {
-         *(destPtr++) = *srcPtr;
-      }
-
-      srcPtr++;
+   if (!(Base64_Encode((uint8 const *) buffer,
+                       bufferLength,
+                       destPtr,
+                       base64Length,
+                       NULL))) {
+      free(resultString);
+      resultString = NULL;
+      err = VIX_E_FAIL;
+      goto abort;
    }
 
-   ASSERT_NOT_IMPLEMENTED((destPtr - resultString) <= resultBufferLength);
-   *destPtr = 0;
-
 abort:
-   free(base64String);
-
    if (err == VIX_OK) {
       *result = resultString;
    }
@@ -1370,61 +1340,76 @@ VixMsgDecodeBuffer(const char *str,           // IN
 {
    VixError err = VIX_OK;
    char *base64String = NULL;
+   const char *base64Src;
+   size_t base64Length;
    char *resultStr = NULL;
-   char *srcPtr;
-   char *destPtr;
    size_t resultStrAllocatedLength;
    size_t resultStrLogicalLength;
-   Bool allocateFailed;
 
    if (NULL != bufferLength) {
       *bufferLength = 0;
    }
 
-   /*
-    * Remove escaped special characters.
-    * Do this in a private copy because we will change the string in place.
-    */
-   VixMsgInitializeObfuscationMapping();
-   base64String = VixMsg_StrdupClientData(str, &allocateFailed);
-   if (allocateFailed) {
-      err = VIX_E_OUT_OF_MEMORY;
-      goto abort;
-   }
-   destPtr = base64String;
-   srcPtr = base64String;
+   if (strchr(str, '\\') == NULL) {
+      /*
+       * VixMsgEncodeBuffer never escapes anything, so the string can
+       * normally be decoded where it is.
+       */
+      base64Src = str;
+      base64Length = strlen(str);
+   } else {
+      char *srcPtr;
+      char *destPtr;
+      Bool allocateFailed;
 
-   while (*srcPtr) {
-      if ('\\' == *srcPtr) {
-         srcPtr++;
-         /*
-          * There should never be a null byte as part of an escape character or
-          * an escape character than translates into a null byte.
-          */
-         if ((0 == *srcPtr)
-                || (0 == ObfuscatedToPlainCharMap[(unsigned int) (*srcPtr)])) {
-            goto abort;
+      /*
+       * Remove escaped special characters.
+       * Do this in a private copy because we will change the string in place.
+       */
+      VixMsgInitializeObfuscationMapping();
+      base64String = VixMsg_StrdupClientData(str, &allocateFailed);
+      if (allocateFailed) {
+         err = VIX_E_OUT_OF_MEMORY;
+         goto abort;
+      }
+      destPtr = base64String;
+      srcPtr = base64String;
+
+      while (*srcPtr) {
+         if ('\\' == *srcPtr) {
+            srcPtr++;
+            /*
+             * There should never be a null byte as part of an escape
+             * character or an escape character than translates into a null
+             * byte.
+             */
+            if ((0 == *srcPtr)
+                   || (0 == ObfuscatedToPlainCharMap[(unsigned int) (*srcPtr)])) {
+               goto abort;
+            }
+            *(destPtr++) = ObfuscatedToPlainCharMap[(unsigned int) (*srcPtr)];
+         } else {
+            *(destPtr++) = *srcPtr;
          }
-         *(destPtr++) = ObfuscatedToPlainCharMap[(unsigned int) (*srcPtr)];
-      } else {
-         *(destPtr++) = *srcPtr;
+         srcPtr++;
       }
-      srcPtr++;
+      *destPtr = 0;
+
+      base64Src = base64String;
+      base64Length = destPtr - base64String;
    }
-   *destPtr = 0;
 
    /*
     * Add 1 to the Base64_DecodedLength(), since we base64 encoded the string
     * without the NUL terminator and need to add one.
     */
-   resultStrAllocatedLength = Base64_DecodedLength(base64String,
-                                                   destPtr - base64String);
+   resultStrAllocatedLength = Base64_DecodedLength(base64Src, base64Length);
    if (nullTerminateResult) {
       resultStrAllocatedLength += 1;
    }
 
    resultStr = Util_SafeMalloc(resultStrAllocatedLength);
-   if (!Base64_Decode(base64String,
+   if (!Base64_Decode(base64Src,
                       resultStr,
                       resultStrAllocatedLength,
                       &resultStrLogicalLength)
@@ -47,6 +47,41 @@
 #include "vm_assert.h"
 #include "hgfsEscape.h"
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * CPNameFindNul --
+ *
+ *    Find the first NUL in [begin, end). Userlevel and most kernels
+ *    provide a memchr() that examines a word or vector at a time,
+ *    which matters for the long component names of deep paths.
+ *
+ * Results:
+ *    Pointer to the NUL, or end if there is none.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static INLINE char const *
+CPNameFindNul(char const *begin,   // IN: Beginning of buffer
+              char const *end)     // IN: End of buffer
+{
+#if defined sun && defined _KERNEL
+   while (begin != end && *begin != '\0') {
+      begin++;
+   }
+   return begin;
+#else
+   char const *nul = memchr(begin, '\0', end - begin);
+
+   return nul != NULL ? nul : end;
+#endif
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -84,34 +119,28 @@ CPName_GetComponent(char const *begin,   // IN: Beginning of buffer
    ASSERT(next);
    ASSERT(begin <= end);
 
-   for (walk = begin; ; walk++) {
-      if (walk == end) {
-         /* End of buffer. No NUL was found */
-
-         myNext = end;
-         break;
-      }
+   walk = CPNameFindNul(begin, end);
+   if (walk == end) {
+      /* End of buffer. No NUL was found */
 
-      if (*walk == '\0') {
-         /* Found a NUL */
-
-         if (walk == begin) {
-            Log("%s: error: first char can't be NUL\n", __FUNCTION__);
-            return -1;
-         }
+      myNext = end;
+   } else {
+      /* Found a NUL */
 
-         myNext = walk + 1;
-         /* Skip consecutive path delimiters. */
-         while ((*myNext == '\0') && (myNext != end)) {
-            myNext++;
-         }
-         if (myNext == end) {
-            /* Last character in the buffer is not allowed to be NUL */
-            Log("%s: error: last char can't be NUL\n", __FUNCTION__);
-            return -1;
-         }
+      if (walk == begin) {
+         Log("%s: error: first char can't be NUL\n", __FUNCTION__);
+         return -1;
+      }
 
-         break;
+      myNext = walk + 1;
+      /* Skip consecutive path delimiters. */
+      while ((*myNext == '\0') && (myNext != end)) {
+         myNext++;
+      }
+      if (myNext == end) {
+         /* Last character in the buffer is not allowed to be NUL */
+         Log("%s: error: last char can't be NUL\n", __FUNCTION__);
+         return -1;
       }
    }
 
@@ -443,15 +472,22 @@ CPNameConvertTo(char const *nameIn, // IN:  Buf to convert
      */
    while (*nameIn != '\0' && bufOut < endOut) {
       if (*nameIn == pathSep) {
-         *bufOut = '\0';
+         *bufOut++ = '\0';
          do {
             nameIn++;
          } while (*nameIn == pathSep);
       } else {
-         *bufOut = *nameIn;
-         nameIn++;
+         /* Copy the whole component up to the next separator at once. */
+         char const *sep = strchr(nameIn, pathSep);
+         size_t len = (sep != NULL) ? sep - nameIn : strlen(nameIn);
+
+         if (len > (size_t)(endOut - bufOut)) {
+            len = endOut - bufOut;
+         }
+         memcpy(bufOut, nameIn, len);
+         nameIn += len;
+         bufOut += len;
       }
-      bufOut++;
    }
 
    /*
@@ -61,6 +61,17 @@
 #include "hgfsEscape.h"
 #include "cpName.h"
 
+/*
+ * Userlevel x86 builds scan names 16 bytes at a time looking for characters
+ * that may need escaping. Kernel builds keep to the portable scalar loop.
+ */
+#if (defined __i386__ || defined __x86_64__) && defined __SSE2__ && \
+    !defined __KERNEL__ && !defined _KERNEL && !defined KERNEL
+#  include <emmintrin.h>
+#  include "vm_basic_asm.h"
+#  define HGFS_ESCAPE_SCAN_SSE2
+#endif
+
 #ifdef _WIN32
 
 #define UNREFERENCED_PARAMETER(P) (P)
@@ -598,6 +609,94 @@ HgfsIsEscapeSequence(char const *bufIn,   // IN: input name
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsIsSpecialCharacter --
+ *
+ *    Verifies if the character may require escaping: it is either one of the
+ *    illegal characters or the escape character itself.
+ *
+ *    NUL is reported as special as well, matching the strchr() test that
+ *    HgfsEscapeEnumerate has always used for illegal characters.
+ *
+ * Results:
+ *    TRUE if the character needs closer inspection, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+HgfsIsSpecialCharacter(char c)   // IN: character to check
+{
+   return c == HGFS_ESCAPE_CHAR || strchr(HGFS_ILLEGAL_CHARS, c) != NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsEscapeFindSpecial --
+ *
+ *    Finds the first character at or after offset that may require escaping.
+ *    Most names contain no such characters at all, so this lets
+ *    HgfsEscapeEnumerate skip over plain runs of the name without examining
+ *    them one character at a time.
+ *
+ * Results:
+ *    Offset of the first special character, or sizeIn if there is none.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsEscapeFindSpecial(char const *bufIn,   // IN: input name
+                      uint32 offset,       // IN: offset to start at
+                      uint32 sizeIn)       // IN: length of the name in characters
+{
+#ifdef HGFS_ESCAPE_SCAN_SSE2
+   if (sizeIn - offset >= sizeof(__m128i)) {
+      __m128i special[16];
+      uint32 numSpecial = 0;
+      char const *illegal;
+
+      special[numSpecial++] = _mm_set1_epi8(HGFS_ESCAPE_CHAR);
+      special[numSpecial++] = _mm_setzero_si128();
+      for (illegal = HGFS_ILLEGAL_CHARS; *illegal != '\0'; illegal++) {
+         ASSERT(numSpecial < ARRAYSIZE(special));
+         special[numSpecial++] = _mm_set1_epi8(*illegal);
+      }
+
+      for (; sizeIn - offset >= sizeof(__m128i); offset += sizeof(__m128i)) {
+         __m128i chunk = _mm_loadu_si128((__m128i const *)(bufIn + offset));
+         __m128i hits = _mm_cmpeq_epi8(chunk, special[0]);
+         uint32 mask;
+         uint32 i;
+
+         for (i = 1; i < numSpecial; i++) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, special[i]));
+         }
+         mask = (uint32)_mm_movemask_epi8(hits);
+         if (mask != 0) {
+            return offset + lssb32_0(mask);
+         }
+      }
+   }
+#endif
+
+   while (offset < sizeIn && !HgfsIsSpecialCharacter(bufIn[offset])) {
+      offset++;
+   }
+   return offset;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -650,7 +749,9 @@ HgfsEscapeEnumerate(char const *bufIn,              // IN:  Buffer with unescape
 
    PROCESS_RESERVED_NAME(bufIn, sizeIn, processEscape, &offset, context);
 
-   for (i = offset; i < sizeIn; i++) {
+   for (i = HgfsEscapeFindSpecial(bufIn, offset, sizeIn);
+        i < sizeIn;
+        i = HgfsEscapeFindSpecial(bufIn, i + 1, sizeIn)) {
       if (strchr(HGFS_ILLEGAL_CHARS, bufIn[i]) != NULL) {
          if (!processEscape(bufIn, i, HGFS_ESCAPE_ILLEGAL_CHARACTER, context)) {
             return FALSE;
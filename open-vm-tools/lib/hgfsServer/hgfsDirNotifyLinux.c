@@ -0,0 +1,1661 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDirNotifyLinux.c --
+ *
+ *	Directory change notification for Linux, built on inotify.
+ *
+ *	A notifier thread reads the inotify queue, turns every event into an
+ *	HGFS event and queues it on each subscriber whose directory (or tree,
+ *	for recursive subscribers) contains the changed file. Queues are
+ *	bounded: once a subscriber's queue is full further events are dropped
+ *	and the subscriber gets a single HGFS_NOTIFY_EVENTS_DROPPED event after
+ *	the queued ones. Events for the same name that only report a change of
+ *	the contents or attributes are merged while they wait in the queue.
+ *	Queues are drained after each burst of events, with the subscriber
+ *	callbacks invoked from the notifier thread.
+ *
+ *	Recursive subscribers normally watch every directory of their tree.
+ *	With "hgfs.notify.fanotify" set, and where the kernel supports
+ *	fanotify with directory file handles (2.6.x fanotify is not enough),
+ *	they are served by a single filesystem-wide fanotify mark per shared
+ *	folder instead, which needs no per-directory watches.
+ */
+
+#define _GNU_SOURCE // for open_by_handle_at
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/vfs.h>
+
+#if !defined(USING_AUTOCONF) || defined(HAVE_SYS_FANOTIFY_H)
+#   include <sys/fanotify.h>
+#   if defined(FAN_REPORT_DFID_NAME)
+#      define HGFS_NOTIFY_FANOTIFY
+#   endif
+#endif
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsUtil.h"
+#include "hgfsDirNotify.h"
+#include "config.h"
+#include "dbllnklst.h"
+#include "hashTable.h"
+#include "mutexRankLib.h"
+#include "str.h"
+#include "userlock.h"
+#include "util.h"
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
+/* Default bound of the per subscriber event queue. */
+#define HGFS_NOTIFY_DEFAULT_MAX_EVENTS  256
+
+/*
+ * After an event arrives the notifier keeps reading for up to
+ * HGFS_NOTIFY_COALESCE_ROUNDS periods of HGFS_NOTIFY_COALESCE_MS, as long as
+ * events keep coming, before delivering. This lets bursts coalesce.
+ */
+#define HGFS_NOTIFY_COALESCE_MS         10
+#define HGFS_NOTIFY_COALESCE_ROUNDS     5
+
+#define HGFS_NOTIFY_READ_BUFFER_SIZE    (64 * 1024)
+
+/* Events that may be merged with a queued event for the same name. */
+#define HGFS_NOTIFY_COALESCE_MASK  (HGFS_NOTIFY_ACCESS | HGFS_NOTIFY_ATTRIB |    \
+                                    HGFS_NOTIFY_SIZE | HGFS_NOTIFY_ATIME |       \
+                                    HGFS_NOTIFY_MTIME | HGFS_NOTIFY_CTIME |      \
+                                    HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_OPEN |      \
+                                    HGFS_NOTIFY_CLOSE_WRITE |                    \
+                                    HGFS_NOTIFY_CLOSE_NOWRITE |                  \
+                                    HGFS_NOTIFY_CHANGE_EA |                      \
+                                    HGFS_NOTIFY_CHANGE_SECURITY)
+
+#define HGFS_NOTIFY_SELF_MASK      (HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_MOVE_SELF)
+
+#define HGFS_NOTIFY_INOTIFY_FLAGS  (IN_MASK_ADD | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+#ifdef HGFS_NOTIFY_FANOTIFY
+#define HGFS_NOTIFY_FANOTIFY_MASK  (FAN_MODIFY | FAN_ATTRIB | FAN_CLOSE_WRITE |   \
+                                    FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM |   \
+                                    FAN_MOVED_TO | FAN_ONDIR)
+#endif
+
+typedef struct HgfsNotifyFolder {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle handle;
+   char *path;                      // Normalized absolute path
+   int fd;                          // Folder root, if marked with fanotify
+   fsid_t fsid;                     // Filesystem of the folder, if marked
+} HgfsNotifyFolder;
+
+typedef struct HgfsNotifyEvent {
+   char *name;                      // Relative to the subscriber's directory
+   uint32 mask;
+} HgfsNotifyEvent;
+
+typedef struct HgfsNotifySubscriber {
+   DblLnkLst_Links links;
+   HgfsSubscriberHandle handle;
+   HgfsNotifyFolder *folder;
+   char *path;                      // Normalized absolute path
+   size_t pathLen;
+   uint32 eventFilter;
+   Bool recursive;
+   Bool useFanotify;                // Tree events come from fanotify
+   HgfsNotifyEventReceiveCb *eventCb;
+   struct HgfsSessionInfo *session;
+
+   int *wds;                        // inotify watches held
+   uint32 numWds;
+   uint32 maxWds;
+
+   HgfsNotifyEvent *events;         // Queued events, up to maxEvents
+   uint32 numEvents;
+   Bool overflow;                   // Events were dropped
+} HgfsNotifySubscriber;
+
+typedef struct HgfsNotifyWatch {
+   int wd;
+   char *path;                      // Normalized absolute path
+   uint32 refCount;                 // Subscribers holding the watch
+} HgfsNotifyWatch;
+
+/* A drained subscriber queue, delivered without holding the state lock. */
+typedef struct HgfsNotifyDelivery {
+   HgfsSharedFolderHandle folder;
+   HgfsSubscriberHandle subscriber;
+   HgfsNotifyEventReceiveCb *eventCb;
+   struct HgfsSessionInfo *session;
+   HgfsNotifyEvent *events;
+   uint32 numEvents;
+   Bool overflow;
+} HgfsNotifyDelivery;
+
+typedef struct HgfsNotifyState {
+   /*
+    * The dispatch lock is held while subscriber callbacks run, so that
+    * removing a subscriber guarantees no callback is still using its
+    * session. The state lock protects everything else.
+    */
+   MXUserExclLock *dispatchLock;
+   MXUserExclLock *lock;
+
+   int inotifyFd;
+   int fanotifyFd;
+   int wakeFds[2];                  // Wakes up the notifier thread
+   pthread_t thread;
+   Bool threadStarted;
+   Bool exiting;
+
+   uint32 deactivated;              // Bitmask of HgfsNotifyActivateReason
+   uint32 maxEvents;
+
+   HashTable *watches;              // wd -> HgfsNotifyWatch
+   DblLnkLst_Links folders;
+   DblLnkLst_Links subscribers;
+   uint32 numSubscribers;
+   HgfsSharedFolderHandle nextFolder;
+   HgfsSubscriberHandle nextSubscriber;
+} HgfsNotifyState;
+
+static HgfsNotifyState gNotify = {
+   .inotifyFd = -1,
+   .fanotifyFd = -1,
+   .wakeFds = { -1, -1 },
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyBuildPath --
+ *
+ *    Joins two path components and normalizes the result: duplicate and
+ *    trailing separators are removed, and an empty path becomes "/".
+ *
+ * Results:
+ *    The path, to be freed by the caller.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsNotifyBuildPath(const char *dir,   // IN
+                    const char *name)  // IN
+{
+   char *path = Str_SafeAsprintf(NULL, "/%s/%s", dir, name);
+   char *in;
+   char *out = path;
+
+   for (in = path; *in != '\0'; in++) {
+      if (*in == '/' && out > path && out[-1] == '/') {
+         continue;
+      }
+      *out++ = *in;
+   }
+   if (out - path > 1 && out[-1] == '/') {
+      out--;
+   }
+   *out = '\0';
+
+   return path;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyTranslateMask --
+ *
+ *    Converts an inotify event mask to HGFS event flags. fanotify uses the
+ *    same values for the events it shares with inotify.
+ *
+ * Results:
+ *    The HGFS event flags.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyTranslateMask(uint32 mask)  // IN: inotify mask
+{
+   Bool isDir = (mask & IN_ISDIR) != 0;
+   uint32 events = 0;
+
+   if (mask & IN_ACCESS) {
+      events |= HGFS_NOTIFY_ACCESS | HGFS_NOTIFY_ATIME;
+   }
+   if (mask & IN_ATTRIB) {
+      events |= HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_CTIME |
+                HGFS_NOTIFY_CHANGE_SECURITY;
+   }
+   if (mask & IN_MODIFY) {
+      events |= HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME;
+   }
+   if (mask & IN_OPEN) {
+      events |= HGFS_NOTIFY_OPEN;
+   }
+   if (mask & IN_CLOSE_WRITE) {
+      events |= HGFS_NOTIFY_CLOSE_WRITE;
+   }
+   if (mask & IN_CLOSE_NOWRITE) {
+      events |= HGFS_NOTIFY_CLOSE_NOWRITE;
+   }
+   if (mask & IN_CREATE) {
+      events |= isDir ? HGFS_NOTIFY_CREATE_DIR : HGFS_NOTIFY_CREATE_FILE;
+   }
+   if (mask & IN_DELETE) {
+      events |= isDir ? HGFS_NOTIFY_DELETE_DIR : HGFS_NOTIFY_DELETE_FILE;
+   }
+   if (mask & IN_MOVED_FROM) {
+      events |= isDir ? HGFS_NOTIFY_OLD_DIR_NAME : HGFS_NOTIFY_OLD_FILE_NAME;
+   }
+   if (mask & IN_MOVED_TO) {
+      events |= isDir ? HGFS_NOTIFY_NEW_DIR_NAME : HGFS_NOTIFY_NEW_FILE_NAME;
+   }
+   if (mask & IN_DELETE_SELF) {
+      events |= HGFS_NOTIFY_DELETE_SELF;
+   }
+   if (mask & IN_MOVE_SELF) {
+      events |= HGFS_NOTIFY_MOVE_SELF;
+   }
+
+   return events;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyWatchMask --
+ *
+ *    Converts a subscriber's HGFS event filter to the inotify events that
+ *    need to be watched for it.
+ *
+ * Results:
+ *    The inotify mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyWatchMask(uint32 eventFilter,  // IN
+                    Bool recursive)      // IN
+{
+   uint32 mask = IN_DELETE_SELF | IN_MOVE_SELF;
+
+   if (eventFilter & (HGFS_NOTIFY_ACCESS | HGFS_NOTIFY_ATIME)) {
+      mask |= IN_ACCESS;
+   }
+   if (eventFilter & (HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_CTIME |
+                      HGFS_NOTIFY_CHANGE_SECURITY)) {
+      mask |= IN_ATTRIB;
+   }
+   if (eventFilter & (HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE |
+                      HGFS_NOTIFY_MTIME)) {
+      mask |= IN_MODIFY;
+   }
+   if (eventFilter & HGFS_NOTIFY_OPEN) {
+      mask |= IN_OPEN;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_WRITE) {
+      mask |= IN_CLOSE_WRITE;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_NOWRITE) {
+      mask |= IN_CLOSE_NOWRITE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_CREATE_FILE | HGFS_NOTIFY_CREATE_DIR)) {
+      mask |= IN_CREATE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_DELETE_FILE | HGFS_NOTIFY_DELETE_DIR)) {
+      mask |= IN_DELETE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_OLD_FILE_NAME | HGFS_NOTIFY_OLD_DIR_NAME)) {
+      mask |= IN_MOVED_FROM;
+   }
+   if (eventFilter & (HGFS_NOTIFY_NEW_FILE_NAME | HGFS_NOTIFY_NEW_DIR_NAME)) {
+      mask |= IN_MOVED_TO;
+   }
+
+   /* New subdirectories of a tree must be watched as they appear. */
+   if (recursive) {
+      mask |= IN_CREATE | IN_MOVED_TO;
+   }
+
+   return mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeWatch --
+ *
+ *    Watch table free callback.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeWatch(void *data)  // IN
+{
+   HgfsNotifyWatch *watch = data;
+
+   free(watch->path);
+   free(watch);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddWatch --
+ *
+ *    Adds an inotify watch on a directory for a subscriber. The kernel
+ *    returns the same watch for the same directory, so watches are shared
+ *    between subscribers and reference counted. Called with the state lock.
+ *
+ * Results:
+ *    TRUE if the directory is watched.
+ *
+ * Side effects:
+ *    Adds the watch to the subscriber's list.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyAddWatch(HgfsNotifySubscriber *subscriber,  // IN/OUT
+                   const char *path)                  // IN: normalized path
+{
+   HgfsNotifyWatch *watch;
+   uint32 i;
+   int wd;
+
+   wd = inotify_add_watch(gNotify.inotifyFd, path,
+                          HgfsNotifyWatchMask(subscriber->eventFilter,
+                                              subscriber->recursive) |
+                          HGFS_NOTIFY_INOTIFY_FLAGS);
+   if (wd < 0) {
+      LOG(4, ("%s: failed to watch %s: %d\n", __FUNCTION__, path, errno));
+      return FALSE;
+   }
+
+   if (HashTable_Lookup(gNotify.watches, (void *)(uintptr_t)wd,
+                        (void **)&watch)) {
+      if (strcmp(watch->path, path) != 0) {
+         /* The directory was moved since it was first watched. */
+         free(watch->path);
+         watch->path = Util_SafeStrdup(path);
+      }
+      for (i = 0; i < subscriber->numWds; i++) {
+         if (subscriber->wds[i] == wd) {
+            return TRUE;
+         }
+      }
+      watch->refCount++;
+   } else {
+      watch = Util_SafeMalloc(sizeof *watch);
+      watch->wd = wd;
+      watch->path = Util_SafeStrdup(path);
+      watch->refCount = 1;
+      HashTable_Insert(gNotify.watches, (void *)(uintptr_t)wd, watch);
+   }
+
+   if (subscriber->numWds == subscriber->maxWds) {
+      subscriber->maxWds = MAX(8, subscriber->maxWds * 2);
+      subscriber->wds = Util_SafeRealloc(subscriber->wds,
+                                         subscriber->maxWds *
+                                         sizeof *subscriber->wds);
+   }
+   subscriber->wds[subscriber->numWds++] = wd;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReleaseWatches --
+ *
+ *    Drops the subscriber's references on its watches, removing the ones
+ *    no other subscriber uses. Called with the state lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyReleaseWatches(HgfsNotifySubscriber *subscriber)  // IN/OUT
+{
+   uint32 i;
+
+   for (i = 0; i < subscriber->numWds; i++) {
+      HgfsNotifyWatch *watch;
+      int wd = subscriber->wds[i];
+
+      /* Watches of deleted directories are already gone. */
+      if (HashTable_Lookup(gNotify.watches, (void *)(uintptr_t)wd,
+                           (void **)&watch) &&
+          --watch->refCount == 0) {
+         inotify_rm_watch(gNotify.inotifyFd, wd);
+         HashTable_Delete(gNotify.watches, (void *)(uintptr_t)wd);
+      }
+   }
+
+   free(subscriber->wds);
+   subscriber->wds = NULL;
+   subscriber->numWds = 0;
+   subscriber->maxWds = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddTree --
+ *
+ *    Watches a directory and all directories below it for a recursive
+ *    subscriber. Called with the state lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyAddTree(HgfsNotifySubscriber *subscriber,  // IN/OUT
+                  const char *path)                  // IN: normalized path
+{
+   DIR *dir;
+   struct dirent *entry;
+
+   if (!HgfsNotifyAddWatch(subscriber, path)) {
+      return;
+   }
+
+   dir = opendir(path);
+   if (dir == NULL) {
+      return;
+   }
+
+   while ((entry = readdir(dir)) != NULL) {
+      char *child;
+      Bool isDir;
+
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+         continue;
+      }
+
+      child = HgfsNotifyBuildPath(path, entry->d_name);
+      if (entry->d_type == DT_UNKNOWN) {
+         struct stat st;
+
+         isDir = lstat(child, &st) == 0 && S_ISDIR(st.st_mode);
+      } else {
+         isDir = entry->d_type == DT_DIR;
+      }
+      if (isDir) {
+         HgfsNotifyAddTree(subscriber, child);
+      }
+      free(child);
+   }
+
+   closedir(dir);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueEvent --
+ *
+ *    Queues an event on a subscriber. The event is merged into the last
+ *    queued event for the same name if both only report changes to the
+ *    contents or attributes. If the queue is full the event is dropped and
+ *    the subscriber is marked as having overflowed. Called with the state
+ *    lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueEvent(HgfsNotifySubscriber *subscriber,  // IN/OUT
+                     const char *name,                  // IN: relative name
+                     uint32 mask)                       // IN: HGFS events
+{
+   uint32 i;
+
+   mask &= subscriber->eventFilter;
+   if (mask == 0) {
+      return;
+   }
+
+   for (i = subscriber->numEvents; i > 0; i--) {
+      HgfsNotifyEvent *event = &subscriber->events[i - 1];
+
+      if (strcmp(event->name, name) == 0) {
+         if ((event->mask & ~HGFS_NOTIFY_COALESCE_MASK) == 0 &&
+             (mask & ~HGFS_NOTIFY_COALESCE_MASK) == 0) {
+            event->mask |= mask;
+            return;
+         }
+         break;
+      }
+   }
+
+   if (subscriber->numEvents == gNotify.maxEvents) {
+      subscriber->overflow = TRUE;
+      return;
+   }
+
+   if (subscriber->events == NULL) {
+      subscriber->events = Util_SafeMalloc(gNotify.maxEvents *
+                                           sizeof *subscriber->events);
+   }
+   subscriber->events[subscriber->numEvents].name = Util_SafeStrdup(name);
+   subscriber->events[subscriber->numEvents].mask = mask;
+   subscriber->numEvents++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDispatchEvent --
+ *
+ *    Queues an event that happened to "name" in directory "dirPath" on every
+ *    subscriber watching it. Subscribers get names relative to the directory
+ *    they watch. New directories below a recursive subscriber's tree are
+ *    watched as they appear. Called with the state lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May add watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDispatchEvent(const char *dirPath,  // IN: normalized path
+                        const char *name,     // IN: "" for the directory itself
+                        uint32 mask,          // IN: HGFS events
+                        Bool fromFanotify)    // IN: event source
+{
+   DblLnkLst_Links *link;
+   size_t dirPathLen = strlen(dirPath);
+
+   DblLnkLst_ForEach(link, &gNotify.subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+      const char *subPath;
+      char *relName;
+
+      if (mask & HGFS_NOTIFY_SELF_MASK) {
+         /* Only the watched directory itself going away is reported. */
+         if (!fromFanotify && strcmp(dirPath, subscriber->path) == 0) {
+            HgfsNotifyQueueEvent(subscriber, "", mask & HGFS_NOTIFY_SELF_MASK);
+         }
+         continue;
+      }
+
+      /*
+       * Tree events of fanotify subscribers come from fanotify only, and
+       * fanotify events are only for them.
+       */
+      if (fromFanotify != subscriber->useFanotify) {
+         continue;
+      }
+
+      if (dirPathLen == subscriber->pathLen &&
+          strcmp(dirPath, subscriber->path) == 0) {
+         subPath = "";
+      } else if (subscriber->recursive &&
+                 dirPathLen > subscriber->pathLen &&
+                 strncmp(dirPath, subscriber->path, subscriber->pathLen) == 0 &&
+                 (dirPath[subscriber->pathLen] == '/' ||
+                  subscriber->pathLen == 1)) {
+         subPath = dirPath + subscriber->pathLen;
+         if (*subPath == '/') {
+            subPath++;
+         }
+      } else {
+         continue;
+      }
+
+      relName = *subPath == '\0' ? Util_SafeStrdup(name) :
+                                   Str_SafeAsprintf(NULL, "%s/%s", subPath, name);
+      HgfsNotifyQueueEvent(subscriber, relName, mask);
+      free(relName);
+
+      if (subscriber->recursive && !subscriber->useFanotify &&
+          (mask & (HGFS_NOTIFY_CREATE_DIR | HGFS_NOTIFY_NEW_DIR_NAME))) {
+         char *newDir = HgfsNotifyBuildPath(dirPath, name);
+
+         /*
+          * Changes made inside the directory before its watch is in place
+          * are not reported.
+          */
+         HgfsNotifyAddTree(subscriber, newDir);
+         free(newDir);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifySetOverflow --
+ *
+ *    Marks subscribers as having lost events, after the kernel queue
+ *    overflowed. Called with the state lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifySetOverflow(Bool fromFanotify)  // IN: which queue overflowed
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gNotify.subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (!fromFanotify || subscriber->useFanotify) {
+         subscriber->overflow = TRUE;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReadInotify --
+ *
+ *    Reads the pending inotify events and queues them on the subscribers.
+ *
+ * Results:
+ *    TRUE if any events were read.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyReadInotify(char *buf,       // IN: scratch buffer
+                      size_t bufSize)  // IN
+{
+   Bool gotEvents = FALSE;
+
+   for (;;) {
+      ssize_t len = read(gNotify.inotifyFd, buf, bufSize);
+      char *p;
+
+      if (len <= 0) {
+         if (len < 0 && errno == EINTR) {
+            continue;
+         }
+         break;
+      }
+      gotEvents = TRUE;
+
+      MXUser_AcquireExclLock(gNotify.lock);
+      for (p = buf; p < buf + len; ) {
+         struct inotify_event *event = (struct inotify_event *)p;
+         HgfsNotifyWatch *watch;
+
+         p += sizeof *event + event->len;
+
+         if (event->mask & IN_Q_OVERFLOW) {
+            LOG(4, ("%s: inotify queue overflow\n", __FUNCTION__));
+            HgfsNotifySetOverflow(FALSE);
+            continue;
+         }
+         if (!HashTable_Lookup(gNotify.watches, (void *)(uintptr_t)event->wd,
+                               (void **)&watch)) {
+            continue;
+         }
+         if (event->mask & IN_IGNORED) {
+            /* The directory is gone. */
+            HashTable_Delete(gNotify.watches, (void *)(uintptr_t)event->wd);
+            continue;
+         }
+
+         /*
+          * Other than it going away, changes to the watched directory itself
+          * (such as it being listed) are not reported.
+          */
+         if (event->len == 0 &&
+             (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) == 0) {
+            continue;
+         }
+
+         HgfsNotifyDispatchEvent(watch->path, event->len > 0 ? event->name : "",
+                                 HgfsNotifyTranslateMask(event->mask), FALSE);
+      }
+      MXUser_ReleaseExclLock(gNotify.lock);
+   }
+
+   return gotEvents;
+}
+
+
+#ifdef HGFS_NOTIFY_FANOTIFY
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyResolveDir --
+ *
+ *    Finds the path of the directory a fanotify event refers to. Called with
+ *    the state lock.
+ *
+ * Results:
+ *    The normalized path, to be freed by the caller, or NULL if the
+ *    directory is not in a marked shared folder or is gone.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsNotifyResolveDir(const __kernel_fsid_t *fsid,  // IN
+                     struct file_handle *handle)   // IN
+{
+   DblLnkLst_Links *link;
+
+   ASSERT_ON_COMPILE(sizeof *fsid == sizeof (fsid_t));
+
+   DblLnkLst_ForEach(link, &gNotify.folders) {
+      HgfsNotifyFolder *folder = DblLnkLst_Container(link, HgfsNotifyFolder,
+                                                     links);
+      char procPath[64];
+      char target[PATH_MAX];
+      ssize_t len;
+      int fd;
+
+      if (folder->fd < 0 || memcmp(&folder->fsid, fsid, sizeof *fsid) != 0) {
+         continue;
+      }
+
+      fd = open_by_handle_at(folder->fd, handle, O_PATH | O_CLOEXEC);
+      if (fd < 0) {
+         return NULL;
+      }
+      Str_Sprintf(procPath, sizeof procPath, "/proc/self/fd/%d", fd);
+      len = readlink(procPath, target, sizeof target - 1);
+      close(fd);
+      if (len <= 0) {
+         return NULL;
+      }
+      target[len] = '\0';
+
+      return HgfsNotifyBuildPath(target, "");
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReadFanotify --
+ *
+ *    Reads the pending fanotify events and queues them on the subscribers.
+ *
+ * Results:
+ *    TRUE if any events were read.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyReadFanotify(char *buf,       // IN: scratch buffer
+                       size_t bufSize)  // IN
+{
+   Bool gotEvents = FALSE;
+
+   for (;;) {
+      ssize_t len = read(gNotify.fanotifyFd, buf, bufSize);
+      struct fanotify_event_metadata *metadata;
+
+      if (len <= 0) {
+         if (len < 0 && errno == EINTR) {
+            continue;
+         }
+         break;
+      }
+      gotEvents = TRUE;
+
+      MXUser_AcquireExclLock(gNotify.lock);
+      for (metadata = (struct fanotify_event_metadata *)buf;
+           FAN_EVENT_OK(metadata, len);
+           metadata = FAN_EVENT_NEXT(metadata, len)) {
+         struct fanotify_event_info_fid *fid;
+         struct file_handle *handle;
+         const char *name;
+         char *dirPath;
+
+         if (metadata->fd >= 0) {
+            close(metadata->fd);
+         }
+         if (metadata->vers != FANOTIFY_METADATA_VERSION) {
+            break;
+         }
+         if (metadata->mask & FAN_Q_OVERFLOW) {
+            LOG(4, ("%s: fanotify queue overflow\n", __FUNCTION__));
+            HgfsNotifySetOverflow(TRUE);
+            continue;
+         }
+
+         fid = (struct fanotify_event_info_fid *)(metadata + 1);
+         if (metadata->event_len < sizeof *metadata + sizeof *fid ||
+             fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+            continue;
+         }
+         handle = (struct file_handle *)fid->handle;
+         name = (const char *)handle->f_handle + handle->handle_bytes;
+         if (strcmp(name, ".") == 0) {
+            continue;
+         }
+
+         dirPath = HgfsNotifyResolveDir(&fid->fsid, handle);
+         if (dirPath != NULL) {
+            HgfsNotifyDispatchEvent(dirPath, name,
+                                    HgfsNotifyTranslateMask(metadata->mask),
+                                    TRUE);
+            free(dirPath);
+         }
+      }
+      MXUser_ReleaseExclLock(gNotify.lock);
+   }
+
+   return gotEvents;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDeliver --
+ *
+ *    Drains the subscriber queues and calls the subscribers with the
+ *    queued events, followed by an HGFS_NOTIFY_EVENTS_DROPPED event for
+ *    those that lost events. Nothing is delivered while notification is
+ *    deactivated.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDeliver(void)
+{
+   HgfsNotifyDelivery *deliveries = NULL;
+   uint32 numDeliveries = 0;
+   DblLnkLst_Links *link;
+   uint32 i;
+
+   MXUser_AcquireExclLock(gNotify.dispatchLock);
+   MXUser_AcquireExclLock(gNotify.lock);
+
+   if (gNotify.deactivated == 0 && gNotify.numSubscribers > 0) {
+      deliveries = Util_SafeMalloc(gNotify.numSubscribers * sizeof *deliveries);
+
+      DblLnkLst_ForEach(link, &gNotify.subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+         HgfsNotifyDelivery *delivery;
+
+         if (subscriber->numEvents == 0 && !subscriber->overflow) {
+            continue;
+         }
+
+         delivery = &deliveries[numDeliveries++];
+         delivery->folder = subscriber->folder->handle;
+         delivery->subscriber = subscriber->handle;
+         delivery->eventCb = subscriber->eventCb;
+         delivery->session = subscriber->session;
+         delivery->events = subscriber->events;
+         delivery->numEvents = subscriber->numEvents;
+         delivery->overflow = subscriber->overflow;
+
+         subscriber->events = NULL;
+         subscriber->numEvents = 0;
+         subscriber->overflow = FALSE;
+      }
+   }
+
+   MXUser_ReleaseExclLock(gNotify.lock);
+
+   for (i = 0; i < numDeliveries; i++) {
+      HgfsNotifyDelivery *delivery = &deliveries[i];
+      uint32 j;
+
+      for (j = 0; j < delivery->numEvents; j++) {
+         delivery->eventCb(delivery->folder, delivery->subscriber,
+                           delivery->events[j].name, delivery->events[j].mask,
+                           delivery->session);
+         free(delivery->events[j].name);
+      }
+      if (delivery->overflow) {
+         delivery->eventCb(delivery->folder, delivery->subscriber, "",
+                           HGFS_NOTIFY_EVENTS_DROPPED, delivery->session);
+      }
+      free(delivery->events);
+   }
+
+   MXUser_ReleaseExclLock(gNotify.dispatchLock);
+
+   free(deliveries);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyThread --
+ *
+ *    The notifier thread. Waits for file system events, lets a burst of
+ *    them coalesce in the subscriber queues and delivers them.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    Calls the subscriber callbacks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsNotifyThread(void *data)  // IN: unused
+{
+   char *buf = Util_SafeMalloc(HGFS_NOTIFY_READ_BUFFER_SIZE);
+   struct pollfd fds[3];
+   nfds_t numFds = 0;
+
+   fds[numFds].fd = gNotify.wakeFds[0];
+   fds[numFds++].events = POLLIN;
+   fds[numFds].fd = gNotify.inotifyFd;
+   fds[numFds++].events = POLLIN;
+   if (gNotify.fanotifyFd >= 0) {
+      fds[numFds].fd = gNotify.fanotifyFd;
+      fds[numFds++].events = POLLIN;
+   }
+
+   while (!gNotify.exiting) {
+      Bool gotEvents = TRUE;
+      uint32 round;
+      char c;
+
+      if (poll(fds, numFds, -1) < 0 && errno != EINTR) {
+         Warning("%s: poll failed: %d\n", __FUNCTION__, errno);
+         break;
+      }
+
+      while (read(gNotify.wakeFds[0], &c, sizeof c) > 0) {
+         /* Drain the wake up pipe. */
+      }
+
+      for (round = 0;
+           gotEvents && round < HGFS_NOTIFY_COALESCE_ROUNDS && !gNotify.exiting;
+           round++) {
+         gotEvents = HgfsNotifyReadInotify(buf, HGFS_NOTIFY_READ_BUFFER_SIZE);
+#ifdef HGFS_NOTIFY_FANOTIFY
+         if (gNotify.fanotifyFd >= 0) {
+            gotEvents |= HgfsNotifyReadFanotify(buf,
+                                                HGFS_NOTIFY_READ_BUFFER_SIZE);
+         }
+#endif
+         if (gotEvents) {
+            poll(fds + 1, numFds - 1, HGFS_NOTIFY_COALESCE_MS);
+         }
+      }
+
+      HgfsNotifyDeliver();
+   }
+
+   free(buf);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyWake --
+ *
+ *    Wakes up the notifier thread.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyWake(void)
+{
+   char c = 0;
+
+   if (write(gNotify.wakeFds[1], &c, sizeof c) < 0 && errno != EAGAIN) {
+      LOG(4, ("%s: failed to wake the notifier: %d\n", __FUNCTION__, errno));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeSubscriber --
+ *
+ *    Unlinks a subscriber and frees it, along with its watches and any
+ *    undelivered events. Called with the state lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeSubscriber(HgfsNotifySubscriber *subscriber)  // IN
+{
+   uint32 i;
+
+   DblLnkLst_Unlink1(&subscriber->links);
+   gNotify.numSubscribers--;
+
+   HgfsNotifyReleaseWatches(subscriber);
+   for (i = 0; i < subscriber->numEvents; i++) {
+      free(subscriber->events[i].name);
+   }
+   free(subscriber->events);
+   free(subscriber->path);
+   free(subscriber);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Init --
+ *
+ *    Initialization for the notification component: sets up inotify (and
+ *    fanotify if enabled) and starts the notifier thread.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS, or the error that prevented initialization.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_Init(void)
+{
+   HgfsInternalStatus status;
+   int err;
+
+   gNotify.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (gNotify.inotifyFd < 0) {
+      status = errno;
+      LOG(4, ("%s: inotify is not available: %d\n", __FUNCTION__, status));
+      return status;
+   }
+
+   if (pipe2(gNotify.wakeFds, O_NONBLOCK | O_CLOEXEC) < 0) {
+      status = errno;
+      goto error;
+   }
+
+#ifdef HGFS_NOTIFY_FANOTIFY
+   if (Config_GetBool(FALSE, "hgfs.notify.fanotify")) {
+      gNotify.fanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC |
+                                         FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+                                         O_RDONLY | O_LARGEFILE);
+      if (gNotify.fanotifyFd < 0) {
+         Log("%s: fanotify is not available (%d), using inotify only.\n",
+             __FUNCTION__, errno);
+      }
+   }
+#endif
+
+   gNotify.maxEvents = Config_GetLong(HGFS_NOTIFY_DEFAULT_MAX_EVENTS,
+                                      "hgfs.notify.maxQueuedEvents");
+   if (gNotify.maxEvents == 0) {
+      gNotify.maxEvents = HGFS_NOTIFY_DEFAULT_MAX_EVENTS;
+   }
+
+   gNotify.dispatchLock = MXUser_CreateExclLock("hgfsNotifyDispatchLock",
+                                                RANK_hgfsNotifyDispatchLock);
+   gNotify.lock = MXUser_CreateExclLock("hgfsNotifyLock", RANK_hgfsNotifyLock);
+   gNotify.watches = HashTable_Alloc(1024, HASH_INT_KEY, HgfsNotifyFreeWatch);
+   DblLnkLst_Init(&gNotify.folders);
+   DblLnkLst_Init(&gNotify.subscribers);
+   gNotify.numSubscribers = 0;
+   gNotify.nextFolder = 0;
+   gNotify.nextSubscriber = 0;
+   gNotify.deactivated = 0;
+   gNotify.exiting = FALSE;
+
+   err = pthread_create(&gNotify.thread, NULL, HgfsNotifyThread, NULL);
+   if (err != 0) {
+      status = err;
+      goto error;
+   }
+   gNotify.threadStarted = TRUE;
+
+   return HGFS_ERROR_SUCCESS;
+
+error:
+   LOG(4, ("%s: failed to start the notifier: %d\n", __FUNCTION__, status));
+   HgfsNotify_Exit();
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Exit --
+ *
+ *    Exit for the notification component. Stops the notifier thread and
+ *    frees all shared folders and subscribers.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Exit(void)
+{
+   DblLnkLst_Links *link, *nextElem;
+
+   if (gNotify.threadStarted) {
+      gNotify.exiting = TRUE;
+      HgfsNotifyWake();
+      pthread_join(gNotify.thread, NULL);
+      gNotify.threadStarted = FALSE;
+   }
+
+   if (gNotify.lock != NULL) {
+      DblLnkLst_ForEachSafe(link, nextElem, &gNotify.folders) {
+         HgfsNotifyFolder *folder = DblLnkLst_Container(link, HgfsNotifyFolder,
+                                                        links);
+         HgfsNotify_RemoveSharedFolder(folder->handle);
+      }
+   }
+
+   if (gNotify.watches != NULL) {
+      HashTable_Free(gNotify.watches);
+      gNotify.watches = NULL;
+   }
+   if (gNotify.lock != NULL) {
+      MXUser_DestroyExclLock(gNotify.lock);
+      gNotify.lock = NULL;
+   }
+   if (gNotify.dispatchLock != NULL) {
+      MXUser_DestroyExclLock(gNotify.dispatchLock);
+      gNotify.dispatchLock = NULL;
+   }
+   if (gNotify.fanotifyFd >= 0) {
+      close(gNotify.fanotifyFd);
+      gNotify.fanotifyFd = -1;
+   }
+   if (gNotify.wakeFds[0] >= 0) {
+      close(gNotify.wakeFds[0]);
+      close(gNotify.wakeFds[1]);
+      gNotify.wakeFds[0] = gNotify.wakeFds[1] = -1;
+   }
+   if (gNotify.inotifyFd >= 0) {
+      close(gNotify.inotifyFd);
+      gNotify.inotifyFd = -1;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Deactivate --
+ *
+ *    Deactivates generating file system change notifications. Events keep
+ *    being queued, within the queue bounds, and are delivered once
+ *    notifications are activated again.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Deactivate(HgfsNotifyActivateReason reason) // IN
+{
+   MXUser_AcquireExclLock(gNotify.lock);
+   gNotify.deactivated |= 1 << reason;
+   MXUser_ReleaseExclLock(gNotify.lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Activate --
+ *
+ *    Activates generating file system change notifications.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Delivers events queued while deactivated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Activate(HgfsNotifyActivateReason reason) // IN
+{
+   MXUser_AcquireExclLock(gNotify.lock);
+   gNotify.deactivated &= ~(1 << reason);
+   MXUser_ReleaseExclLock(gNotify.lock);
+
+   HgfsNotifyWake();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSharedFolder --
+ *
+ *    Allocates memory and initializes new shared folder structure. With
+ *    fanotify enabled the folder's filesystem is marked for the recursive
+ *    subscribers.
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or HGFS_INVALID_FOLDER_HANDLE
+ *    if adding shared folder fails.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSharedFolderHandle
+HgfsNotify_AddSharedFolder(const char *path,       // IN: path in the host
+                           const char *shareName)  // IN: name of the shared folder
+{
+   HgfsNotifyFolder *folder = Util_SafeMalloc(sizeof *folder);
+   HgfsSharedFolderHandle result;
+
+   folder->path = HgfsNotifyBuildPath(path, "");
+   folder->fd = -1;
+
+#ifdef HGFS_NOTIFY_FANOTIFY
+   if (gNotify.fanotifyFd >= 0) {
+      struct statfs stfs;
+
+      folder->fd = open(folder->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (folder->fd >= 0 &&
+          (fstatfs(folder->fd, &stfs) < 0 ||
+           fanotify_mark(gNotify.fanotifyFd,
+                         FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                         HGFS_NOTIFY_FANOTIFY_MASK, folder->fd, NULL) < 0)) {
+         LOG(4, ("%s: cannot mark %s for fanotify: %d\n", __FUNCTION__,
+                 folder->path, errno));
+         close(folder->fd);
+         folder->fd = -1;
+      } else if (folder->fd >= 0) {
+         folder->fsid = stfs.f_fsid;
+      }
+   }
+#endif
+
+   MXUser_AcquireExclLock(gNotify.lock);
+   result = folder->handle = gNotify.nextFolder++;
+   DblLnkLst_Init(&folder->links);
+   DblLnkLst_LinkLast(&gNotify.folders, &folder->links);
+   MXUser_ReleaseExclLock(gNotify.lock);
+
+   LOG(8, ("%s: share %s path %s handle %u\n", __FUNCTION__, shareName,
+           folder->path, result));
+
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSubscriber --
+ *
+ *    Allocates memory and initializes new subscriber structure, and watches
+ *    the subscriber's directory (and, if recursive and not served by
+ *    fanotify, every directory below it).
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or HGFS_INVALID_SUBSCRIBER_HANDLE
+ *    if adding subscriber fails.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSubscriberHandle
+HgfsNotify_AddSubscriber(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                         const char *path,                    // IN: relative path
+                         uint32 eventFilter,                  // IN: event filter
+                         uint32 recursive,                    // IN: look in subfolders
+                         HgfsNotifyEventReceiveCb eventCb,    // IN notification callback
+                         struct HgfsSessionInfo *session)     // IN: server context
+{
+   HgfsSubscriberHandle result = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   HgfsNotifySubscriber *subscriber;
+   HgfsNotifyFolder *folder = NULL;
+   DblLnkLst_Links *link;
+
+   MXUser_AcquireExclLock(gNotify.lock);
+
+   DblLnkLst_ForEach(link, &gNotify.folders) {
+      HgfsNotifyFolder *curr = DblLnkLst_Container(link, HgfsNotifyFolder,
+                                                   links);
+      if (curr->handle == sharedFolder) {
+         folder = curr;
+         break;
+      }
+   }
+   if (folder == NULL) {
+      LOG(4, ("%s: unknown shared folder %u\n", __FUNCTION__, sharedFolder));
+      goto exit;
+   }
+
+   subscriber = Util_SafeCalloc(1, sizeof *subscriber);
+   subscriber->folder = folder;
+   subscriber->path = HgfsNotifyBuildPath(folder->path, path);
+   subscriber->pathLen = strlen(subscriber->path);
+   subscriber->eventFilter = eventFilter | HGFS_NOTIFY_EVENTS_DROPPED;
+   subscriber->recursive = recursive != 0;
+   subscriber->useFanotify = subscriber->recursive && folder->fd >= 0;
+   subscriber->eventCb = eventCb;
+   subscriber->session = session;
+
+   if (subscriber->recursive && !subscriber->useFanotify) {
+      HgfsNotifyAddTree(subscriber, subscriber->path);
+   } else {
+      HgfsNotifyAddWatch(subscriber, subscriber->path);
+   }
+   if (subscriber->numWds == 0) {
+      free(subscriber->path);
+      free(subscriber);
+      goto exit;
+   }
+
+   result = subscriber->handle = gNotify.nextSubscriber++;
+   DblLnkLst_Init(&subscriber->links);
+   DblLnkLst_LinkLast(&gNotify.subscribers, &subscriber->links);
+   gNotify.numSubscribers++;
+
+   LOG(8, ("%s: subscriber %"FMT64"u on %s, %u watches%s\n", __FUNCTION__,
+           result, subscriber->path, subscriber->numWds,
+           subscriber->useFanotify ? ", fanotify" : ""));
+
+exit:
+   MXUser_ReleaseExclLock(gNotify.lock);
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSharedFolder --
+ *
+ *    Deallcates memory used by shared folder and performs necessary cleanup.
+ *    Also deletes all subscribers that are defined for the shared folder.
+ *
+ * Results:
+ *    TRUE if the shared folder was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    Removes all subscribers that correspond to the shared folder and invalidates
+ *    thier handles.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSharedFolder(HgfsSharedFolderHandle sharedFolder) // IN
+{
+   DblLnkLst_Links *link, *nextElem;
+   HgfsNotifyFolder *folder = NULL;
+
+   MXUser_AcquireExclLock(gNotify.lock);
+
+   DblLnkLst_ForEach(link, &gNotify.folders) {
+      HgfsNotifyFolder *curr = DblLnkLst_Container(link, HgfsNotifyFolder,
+                                                   links);
+      if (curr->handle == sharedFolder) {
+         folder = curr;
+         break;
+      }
+   }
+
+   if (folder != NULL) {
+      DblLnkLst_ForEachSafe(link, nextElem, &gNotify.subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+         if (subscriber->folder == folder) {
+            HgfsNotifyFreeSubscriber(subscriber);
+         }
+      }
+
+      /*
+       * The filesystem mark is left in place: other folders may share the
+       * filesystem, and events outside any folder are ignored.
+       */
+      if (folder->fd >= 0) {
+         close(folder->fd);
+      }
+      DblLnkLst_Unlink1(&folder->links);
+      free(folder->path);
+      free(folder);
+   }
+
+   MXUser_ReleaseExclLock(gNotify.lock);
+
+   return folder != NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSubscriber --
+ *
+ *    Deallcates memory used by NotificationSubscriber and performs necessary cleanup.
+ *
+ * Results:
+ *    TRUE if the subscriber was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    Waits for a delivery in progress to finish.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSubscriber(HgfsSubscriberHandle subscriber) // IN
+{
+   DblLnkLst_Links *link;
+   Bool found = FALSE;
+
+   MXUser_AcquireExclLock(gNotify.dispatchLock);
+   MXUser_AcquireExclLock(gNotify.lock);
+
+   DblLnkLst_ForEach(link, &gNotify.subscribers) {
+      HgfsNotifySubscriber *curr =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (curr->handle == subscriber) {
+         HgfsNotifyFreeSubscriber(curr);
+         found = TRUE;
+         break;
+      }
+   }
+
+   MXUser_ReleaseExclLock(gNotify.lock);
+   MXUser_ReleaseExclLock(gNotify.dispatchLock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSessionSubscribers --
+ *
+ *    Removes all entries that are related to a particular session.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Waits for a delivery in progress to finish, so that the session is no
+ *    longer referenced once this returns.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session) // IN
+{
+   DblLnkLst_Links *link, *nextElem;
+
+   MXUser_AcquireExclLock(gNotify.dispatchLock);
+   MXUser_AcquireExclLock(gNotify.lock);
+
+   DblLnkLst_ForEachSafe(link, nextElem, &gNotify.subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (subscriber->session == session) {
+         HgfsNotifyFreeSubscriber(subscriber);
+      }
+   }
+
+   MXUser_ReleaseExclLock(gNotify.lock);
+   MXUser_ReleaseExclLock(gNotify.dispatchLock);
+}
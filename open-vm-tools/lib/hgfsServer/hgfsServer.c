@@ -42,7 +42,9 @@
 #include "codeset.h"
 #include "config.h"
 #include "dbllnklst.h"
+#include "dynbuf.h"
 #include "file.h"
+#include "hostinfo.h"
 #include "util.h"
 #include "wiper.h"
 #include "hgfsServer.h"
@@ -191,6 +193,8 @@ static void HgfsServerSessionInvalidateObjects(void *clientData,
                                                DblLnkLst_Links *shares);
 static uint32 HgfsServerSessionInvalidateInactiveSessions(void *clientData);
 static void HgfsServerSessionSendComplete(HgfsPacket *packet, void *clientData);
+static void HgfsServerOpStatsAttach(HgfsTransportSessionInfo *transportSession);
+static void HgfsServerOpStatsDetach(HgfsTransportSessionInfo *transportSession);
 
 /*
  * Callback table passed to transport and any channels.
@@ -220,6 +224,53 @@ static Bool gHgfsInitialized = FALSE;
  */
 static Bool gHgfsDirNotifyActive = FALSE;
 
+/*
+ * Per-op statistics.
+ *
+ * Each transport session counts the ops it serves in its own array, so
+ * recording an op takes no locks. The lock only protects the list of
+ * transport sessions being reported and the totals of the sessions that
+ * have gone away.
+ */
+static Bool gHgfsOpStatsEnabled = FALSE;
+static MXUserExclLock *gHgfsOpStatsLock = NULL;
+static DblLnkLst_Links gHgfsOpStatsList;
+static HgfsServerOpStats gHgfsOpStatsRetired[HGFS_OP_MAX];
+
+/*
+ * Oplocks are only granted once the embedding process has enabled them, since
+ * it then has to deliver the host's lease break notifications to
+ * HgfsServer_ProcessOplockBreaks.
+ */
+static Bool gHgfsOplocksEnabled = FALSE;
+
+#ifdef HGFS_OPLOCKS
+/*
+ * Nodes holding a server lock.
+ *
+ * Every locked node is registered here by session and handle, with a
+ * generation number that tells apart successive locks on the same handle.
+ * The file descriptor is only used while the registry lock is held: nodes
+ * are unregistered before their descriptor is closed, so it can't have been
+ * reused. The lock ranks below the node array lock.
+ */
+typedef struct HgfsOplockEntry {
+   DblLnkLst_Links links;
+   HgfsSessionInfo *session;
+   HgfsHandle handle;
+   uint32 generation;
+   fileDesc fileDesc;
+   HgfsServerLock serverLock;    // Lock held
+   Bool breaking;                // A break was sent to the client
+   HgfsServerLock offeredLock;   // Lock left to the client by the break
+} HgfsOplockEntry;
+
+static MXUserExclLock *gHgfsOplockLock = NULL;
+static DblLnkLst_Links gHgfsOplockList;
+static unsigned int gHgfsOplockCount;
+static uint32 gHgfsOplockGeneration;
+#endif
+
 typedef struct HgfsSharedFolderProperties {
    DblLnkLst_Links links;
    char *name;                                /* Name of the share. */
@@ -278,6 +329,23 @@ static HgfsHandle HgfsFileNode2Handle(HgfsFileNode const *fileNode);
 static HgfsFileNode *HgfsHandle2FileNode(HgfsHandle handle,
                                          HgfsSessionInfo *session);
 static void HgfsServerExitSessionInternal(HgfsSessionInfo *session);
+#ifdef HGFS_OPLOCKS
+static Bool HgfsOplockRegister(HgfsFileNode *node,
+                               HgfsSessionInfo *session);
+static void HgfsOplockUnregister(HgfsHandle handle,
+                                 HgfsSessionInfo *session);
+static void HgfsOplockAck(HgfsSessionInfo *session,
+                          HgfsHandle handle,
+                          uint32 generation,
+                          HgfsServerLock replyLock);
+static Bool HgfsServerSendOplockBreak(HgfsHandle handle,
+                                      HgfsServerLock serverLock,
+                                      HgfsSessionInfo *session);
+static void HgfsServerOplockBreak(ServerLockData *lockData);
+#endif
+static Bool HgfsServerResolveLockConflicts(char const *utf8Name,
+                                           Bool readOnly,
+                                           HgfsSessionInfo *session);
 static Bool HgfsIsShareRoot(char const *cpName, size_t cpNameSize);
 static void HgfsServerCompleteRequest(HgfsInternalStatus status,
                                       size_t replyPayloadSize,
@@ -320,6 +388,24 @@ static void HgfsServerClose(HgfsInputParam *input);
 static void HgfsServerSearchClose(HgfsInputParam *input);
 static void HgfsServerSetDirNotifyWatch(HgfsInputParam *input);
 static void HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input);
+static void HgfsServerCompound(HgfsInputParam *input);
+
+/*
+ * State of a compound request while its sub-requests run. The replies of
+ * the sub-requests are collected here by HgfsServerCompleteRequest instead
+ * of being sent.
+ */
+typedef struct HgfsCompoundContext {
+   HgfsPacket packet;        // packet the sub-requests are processed in
+   char *request;            // header and payload of the running sub-request
+   char *reply;              // reply buffer of the running sub-request
+   DynBuf replies;           // packed HgfsCompoundReplyEntryV4s
+   size_t maxReplySize;      // limit for the packed replies
+   uint32 index;             // index of the running sub-request
+   uint32 count;             // number of packed replies
+   HgfsHandle lastHandle;    // handle from the last successful open
+   HgfsStatus status;        // status of the last sub-request
+} HgfsCompoundContext;
 
 
 /*
@@ -433,6 +519,9 @@ HgfsServerTransportSessionPut(HgfsTransportSessionInfo *transportSession)   // I
       }
 
       MXUser_ReleaseExclLock(transportSession->sessionArrayLock);
+
+      HgfsServerOpStatsDetach(transportSession);
+      HSPU_DestroyPacketPool(transportSession);
    }
 }
 
@@ -1317,7 +1406,7 @@ exit:
  *
  * HgfsUpdateNodeServerLock --
  *
- *    Given a file desc (OS handle), update the node with the new oplock
+ *    Given an hgfs file handle, update the node with the new oplock
  *    information.
  *
  * Results:
@@ -1331,12 +1420,11 @@ exit:
  */
 
 Bool
-HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
+HgfsUpdateNodeServerLock(HgfsHandle handle,          // IN: Hgfs file handle
                          HgfsSessionInfo *session,   // IN: Session info
                          HgfsServerLock serverLock)  // IN: new oplock
 {
-   unsigned int i;
-   HgfsFileNode *existingFileNode = NULL;
+   HgfsFileNode *node;
    Bool updated = FALSE;
 
    ASSERT(session);
@@ -1344,17 +1432,23 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      existingFileNode = &session->nodeArray[i];
-      if (existingFileNode->state != FILENODE_STATE_UNUSED) {
-         if (existingFileNode->fileDesc == fd) {
-            existingFileNode->serverLock = serverLock;
-            updated = TRUE;
-            break;
-         }
-      }
+   node = HgfsHandle2FileNode(handle, session);
+   if (node == NULL) {
+      goto exit;
    }
 
+   if (node->state == FILENODE_STATE_IN_USE_CACHED &&
+       node->serverLock != HGFS_LOCK_NONE &&
+       serverLock == HGFS_LOCK_NONE) {
+#ifdef HGFS_OPLOCKS
+      HgfsOplockUnregister(handle, session);
+#endif
+      session->numCachedLockedNodes--;
+   }
+   node->serverLock = serverLock;
+   updated = TRUE;
+
+exit:
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
    return updated;
@@ -1934,6 +2028,13 @@ HgfsAddToCacheInternal(HgfsHandle handle,         // IN: HGFS file handle
     * nodes in the cache.
     */
 
+#ifdef HGFS_OPLOCKS
+   if (node->serverLock != HGFS_LOCK_NONE &&
+       !HgfsOplockRegister(node, session)) {
+      /* The lock was broken before the open completed. */
+      node->serverLock = HGFS_LOCK_NONE;
+   }
+#endif
    if (node->serverLock != HGFS_LOCK_NONE) {
       session->numCachedLockedNodes++;
    }
@@ -1988,6 +2089,15 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
               __FUNCTION__, session->numCachedOpenNodes, node->utf8Name,
               node->localId.fileId, node->fileDesc));
 
+      /* Closing the file releases any server lock held on it. */
+      if (node->serverLock != HGFS_LOCK_NONE) {
+#ifdef HGFS_OPLOCKS
+         HgfsOplockUnregister(node->handle, session);
+#endif
+         node->serverLock = HGFS_LOCK_NONE;
+         session->numCachedLockedNodes--;
+      }
+
       /*
        * XXX: From this point and up in the call chain (i.e. this function and
        * all callers), Bool is returned instead of the HgfsInternalStatus.
@@ -2097,6 +2207,16 @@ HgfsIsServerLockAllowed(HgfsSessionInfo *session)  // IN: session info
 {
    Bool allowed;
 
+   if (!gHgfsOplocksEnabled) {
+      return FALSE;
+   }
+
+   /* Only shared memory channels can deliver oplock breaks to the client. */
+   if ((session->transportSession->channelCapabilities &
+        HGFS_CHANNEL_SHARED_MEM) == 0) {
+      return FALSE;
+   }
+
    MXUser_AcquireExclLock(session->nodeArrayLock);
    allowed = session->numCachedLockedNodes < MAX_LOCKED_FILENODES;
    MXUser_ReleaseExclLock(session->nodeArrayLock);
@@ -2105,6 +2225,204 @@ HgfsIsServerLockAllowed(HgfsSessionInfo *session)  // IN: session info
 }
 
 
+#ifdef HGFS_OPLOCKS
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockRegister --
+ *
+ *    Remember which session holds the server lock taken on a node, so that
+ *    a break of the lock can be sent to it. A lock whose break is already
+ *    pending is released instead: nobody could have seen the break yet.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    TRUE if the lock was registered.
+ *    FALSE if the lock was broken before it could be registered.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsOplockRegister(HgfsFileNode *node,        // IN: node holding the lock
+                   HgfsSessionInfo *session)  // IN: session holding the lock
+{
+   HgfsOplockEntry *entry;
+   HgfsServerLock newLock;
+
+   if (gHgfsOplockLock == NULL) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gHgfsOplockLock);
+   if (HgfsPendingOplockBreak(node->fileDesc, node->serverLock, &newLock)) {
+      HgfsAckOplockBreak(node->fileDesc, newLock, HGFS_LOCK_NONE);
+      MXUser_ReleaseExclLock(gHgfsOplockLock);
+      LOG(4, ("%s: lock on fh %u was broken during open\n", __FUNCTION__,
+              node->handle));
+
+      return FALSE;
+   }
+
+   entry = Util_SafeCalloc(1, sizeof *entry);
+   DblLnkLst_Init(&entry->links);
+   entry->session = session;
+   entry->handle = node->handle;
+   if (++gHgfsOplockGeneration == 0) {
+      gHgfsOplockGeneration = 1;
+   }
+   entry->generation = gHgfsOplockGeneration;
+   entry->fileDesc = node->fileDesc;
+   entry->serverLock = node->serverLock;
+   DblLnkLst_LinkLast(&gHgfsOplockList, &entry->links);
+   gHgfsOplockCount++;
+   MXUser_ReleaseExclLock(gHgfsOplockLock);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockFind --
+ *
+ *    Find the registered server lock of a node. A generation of 0 matches
+ *    any lock held on the handle.
+ *
+ *    The registry lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    The registry entry, or NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsOplockEntry *
+HgfsOplockFind(HgfsSessionInfo *session,  // IN: session holding the lock
+               HgfsHandle handle,         // IN: Hgfs file handle
+               uint32 generation)         // IN: lock generation or 0
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gHgfsOplockList) {
+      HgfsOplockEntry *entry = DblLnkLst_Container(link, HgfsOplockEntry, links);
+
+      if (entry->session == session && entry->handle == handle &&
+          (generation == 0 || entry->generation == generation)) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockUnregister --
+ *
+ *    Forget the server lock taken on a node. This must happen before the
+ *    node's file descriptor is closed.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockUnregister(HgfsHandle handle,         // IN: Hgfs file handle
+                     HgfsSessionInfo *session)  // IN: session holding the lock
+{
+   HgfsOplockEntry *entry;
+
+   if (gHgfsOplockLock == NULL) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsOplockLock);
+   entry = HgfsOplockFind(session, handle, 0);
+   if (entry != NULL) {
+      DblLnkLst_Unlink1(&entry->links);
+      gHgfsOplockCount--;
+      free(entry);
+   }
+   MXUser_ReleaseExclLock(gHgfsOplockLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockAck --
+ *
+ *    Release or downgrade the server lock of a node, either because the
+ *    client acknowledged a break or asked for it, or on the client's behalf.
+ *    If a break is outstanding, the lock is downgraded no further than the
+ *    break allows. A generation of 0 matches any lock held on the handle.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The node is updated with the lock that is left.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockAck(HgfsSessionInfo *session,   // IN: session holding the lock
+              HgfsHandle handle,          // IN: Hgfs file handle
+              uint32 generation,          // IN: lock generation or 0
+              HgfsServerLock replyLock)   // IN: lock the client keeps
+{
+   HgfsOplockEntry *entry;
+   HgfsServerLock actualLock = HGFS_LOCK_NONE;
+
+   if (gHgfsOplockLock == NULL) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsOplockLock);
+   entry = HgfsOplockFind(session, handle, generation);
+   if (entry == NULL) {
+      /* The file was closed, or the lock released, in the meantime. */
+      MXUser_ReleaseExclLock(gHgfsOplockLock);
+      return;
+   }
+
+   actualLock = HgfsAckOplockBreak(entry->fileDesc,
+                                   entry->breaking ? entry->offeredLock :
+                                                     replyLock,
+                                   replyLock);
+   if (actualLock == HGFS_LOCK_NONE) {
+      DblLnkLst_Unlink1(&entry->links);
+      gHgfsOplockCount--;
+      free(entry);
+   } else {
+      entry->serverLock = actualLock;
+      entry->breaking = FALSE;
+   }
+   MXUser_ReleaseExclLock(gHgfsOplockLock);
+
+   HgfsUpdateNodeServerLock(handle, session, actualLock);
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -2877,7 +3195,7 @@ static struct {
    { HgfsServerRename,           HGFS_SIZEOF_OP(HgfsRequestRenameV3),           REQ_SYNC },
    { HgfsServerQueryVolume,      HGFS_SIZEOF_OP(HgfsRequestQueryVolumeV3),      REQ_SYNC },
    { HgfsServerSymlinkCreate,    HGFS_SIZEOF_OP(HgfsRequestSymlinkCreateV3),    REQ_SYNC },
-   { HgfsServerServerLockChange, sizeof (HgfsRequestServerLockChange),          REQ_SYNC },
+   { HgfsServerServerLockChange, HGFS_SIZEOF_OP(HgfsRequestServerLockChangeV2), REQ_SYNC },
    { HgfsServerWriteWin32Stream, HGFS_SIZEOF_OP(HgfsRequestWriteWin32StreamV3), REQ_SYNC },
    /*
     * Starting from HGFS_OP_CREATE_SESSION_V4 (all V4 commands and above) the
@@ -2892,8 +3210,500 @@ static struct {
    { HgfsServerRemoveDirNotifyWatch, sizeof (HgfsRequestRemoveWatchV4),            REQ_SYNC},
    { NULL,                       0,                                                REQ_SYNC}, // No Op notify
    { HgfsServerSearchRead,       sizeof (HgfsRequestSearchReadV4),                 REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // Open
+   { NULL,                       0,                                                REQ_SYNC}, // Enumerate streams
+   { NULL,                       0,                                                REQ_SYNC}, // Getattr
+   { NULL,                       0,                                                REQ_SYNC}, // Setattr
+   { NULL,                       0,                                                REQ_SYNC}, // Delete
+   { NULL,                       0,                                                REQ_SYNC}, // Linkmove
+   { NULL,                       0,                                                REQ_SYNC}, // Fsctl
+   { NULL,                       0,                                                REQ_SYNC}, // Access check
+   { NULL,                       0,                                                REQ_SYNC}, // Fsync
+   { NULL,                       0,                                                REQ_SYNC}, // Query volume
+   { NULL,                       0,                                                REQ_SYNC}, // Oplock acquire
+   { NULL,                       0,                                                REQ_SYNC}, // Oplock break
+   { NULL,                       0,                                                REQ_SYNC}, // Lock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // Unlock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // Query EAs
+   { NULL,                       0,                                                REQ_SYNC}, // Set EAs
+   { HgfsServerCompound,         sizeof (HgfsRequestCompoundV4),                   REQ_SYNC},
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOpStatsAdd --
+ *
+ *    Adds the statistics of one array of per-op statistics to another.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerOpStatsAdd(HgfsServerOpStats *total,       // IN/OUT: totals
+                     const HgfsServerOpStats *stats, // IN: statistics to add
+                     uint32 numOps)                  // IN: entries in arrays
+{
+   uint32 i;
+
+   for (i = 0; i < numOps; i++) {
+      uint32 j;
+
+      total[i].count += stats[i].count;
+      total[i].errors += stats[i].errors;
+      total[i].bytesIn += stats[i].bytesIn;
+      total[i].bytesOut += stats[i].bytesOut;
+      total[i].totalTime += stats[i].totalTime;
+      total[i].maxTime = MAX(total[i].maxTime, stats[i].maxTime);
+      for (j = 0; j < HGFS_OP_STATS_BUCKETS; j++) {
+         total[i].latency[j] += stats[i].latency[j];
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOpCountersAdd --
+ *
+ *    Adds the counters of a transport session to an array of per-op
+ *    statistics. The counters are read while they may be updated, so the
+ *    statistics of an op may lag by a request.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerOpCountersAdd(HgfsServerOpStats *total,             // IN/OUT: totals
+                        HgfsServerOpCounters const *counters, // IN: counters to add
+                        uint32 numOps)                        // IN: entries in arrays
+{
+   uint32 i;
+
+   for (i = 0; i < numOps; i++) {
+      uint32 j;
+
+      total[i].count += Atomic_Read64(&counters[i].count);
+      total[i].errors += Atomic_Read64(&counters[i].errors);
+      total[i].bytesIn += Atomic_Read64(&counters[i].bytesIn);
+      total[i].bytesOut += Atomic_Read64(&counters[i].bytesOut);
+      total[i].totalTime += Atomic_Read64(&counters[i].totalTime);
+      total[i].maxTime = MAX(total[i].maxTime,
+                             Atomic_Read64(&counters[i].maxTime));
+      for (j = 0; j < HGFS_OP_STATS_BUCKETS; j++) {
+         total[i].latency[j] += Atomic_Read64(&counters[i].latency[j]);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOpStatsRecord --
+ *
+ *    Accounts a completed request in its transport session's statistics.
+ *    Requests of one session can complete concurrently on different
+ *    threads, so the counters are updated atomically.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerOpStatsRecord(HgfsInputParam *input,     // IN: request context
+                        HgfsInternalStatus status, // IN: request status
+                        size_t replySize)          // IN: reply packet size
+{
+   HgfsTransportSessionInfo *transportSession = input->transportSession;
+   HgfsServerOpCounters *counters;
+   uint64 latency;
+   uint64 maxTime;
+   int bucket;
+
+   if (input->op >= HGFS_OP_MAX || NULL == transportSession->opStats) {
+      return;
+   }
+
+   latency = Hostinfo_SystemTimerNS() - input->startTime;
+   bucket = MIN(mssb64_0(latency >> 10) + 1, HGFS_OP_STATS_BUCKETS - 1);
+
+   counters = &transportSession->opStats[input->op];
+   Atomic_Inc64(&counters->count);
+   if (HGFS_ERROR_SUCCESS != status) {
+      Atomic_Inc64(&counters->errors);
+   }
+   Atomic_Add64(&counters->bytesIn, input->metaPacketSize);
+   Atomic_Add64(&counters->bytesOut, replySize);
+   Atomic_Add64(&counters->totalTime, latency);
+   Atomic_Inc64(&counters->latency[bucket]);
+
+   do {
+      maxTime = Atomic_Read64(&counters->maxTime);
+   } while (latency > maxTime &&
+            Atomic_ReadIfEqualWrite64(&counters->maxTime, maxTime,
+                                      latency) != maxTime);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOpStatsAttach --
+ *
+ *    Adds a new transport session to the list of sessions whose statistics
+ *    are reported by HgfsServer_GetOpStats.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Allocates the session's statistics.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerOpStatsAttach(HgfsTransportSessionInfo *transportSession) // IN:
+{
+   /*
+    * The counters are allocated up front, whether or not statistics are
+    * enabled, since requests may already be completing on other threads
+    * when they get turned on.
+    */
+   transportSession->opStats = Util_SafeCalloc(HGFS_OP_MAX,
+                                               sizeof *transportSession->opStats);
+   DblLnkLst_Init(&transportSession->opStatsLinks);
+
+   if (NULL != gHgfsOpStatsLock) {
+      MXUser_AcquireExclLock(gHgfsOpStatsLock);
+      DblLnkLst_LinkLast(&gHgfsOpStatsList, &transportSession->opStatsLinks);
+      MXUser_ReleaseExclLock(gHgfsOpStatsLock);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOpStatsDetach --
+ *
+ *    Removes a transport session from the list of reported sessions, and
+ *    folds its statistics into the totals of the retired sessions.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Frees the session's statistics.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerOpStatsDetach(HgfsTransportSessionInfo *transportSession) // IN:
+{
+   if (NULL != gHgfsOpStatsLock) {
+      MXUser_AcquireExclLock(gHgfsOpStatsLock);
+      if (DblLnkLst_IsLinked(&transportSession->opStatsLinks)) {
+         DblLnkLst_Unlink1(&transportSession->opStatsLinks);
+      }
+      HgfsServerOpCountersAdd(gHgfsOpStatsRetired, transportSession->opStats,
+                              HGFS_OP_MAX);
+      MXUser_ReleaseExclLock(gHgfsOpStatsLock);
+   }
+
+   free(transportSession->opStats);
+   transportSession->opStats = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_EnableOpStats --
+ *
+ *    Turns collection of per-op statistics on or off. Statistics that were
+ *    already collected are kept.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_EnableOpStats(Bool enable)  // IN:
+{
+   gHgfsOpStatsEnabled = enable;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_OpStatsEnabled --
+ *
+ *    Tells whether per-op statistics are being collected.
+ *
+ * Results:
+ *    TRUE if they are, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServer_OpStatsEnabled(void)
+{
+   return gHgfsOpStatsEnabled;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_EnableOplocks --
+ *
+ *    Turns granting of oplocks on or off. A process that turns them on must
+ *    call HgfsServer_ProcessOplockBreaks whenever the host file system
+ *    notifies it of a lease break (with SIGIO on Linux). Locks that were
+ *    already granted are kept until they are released or broken.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_EnableOplocks(Bool enable)  // IN:
+{
+   gHgfsOplocksEnabled = enable;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_ProcessOplockBreaks --
+ *
+ *    Sends a break to the clients of all the locks that the host file
+ *    system wants back. The notification doesn't say reliably which file
+ *    it's about, and several may be coalesced, so every registered lock is
+ *    checked, with its descriptor still held by the node.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_ProcessOplockBreaks(void)
+{
+#ifdef HGFS_OPLOCKS
+   ServerLockData **breaks;
+   DblLnkLst_Links *link;
+   unsigned int numBreaks = 0;
+   unsigned int i;
+
+   if (gHgfsOplockLock == NULL) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsOplockLock);
+   if (gHgfsOplockCount == 0) {
+      MXUser_ReleaseExclLock(gHgfsOplockLock);
+      return;
+   }
+
+   breaks = Util_SafeMalloc(gHgfsOplockCount * sizeof *breaks);
+   DblLnkLst_ForEach(link, &gHgfsOplockList) {
+      HgfsOplockEntry *entry = DblLnkLst_Container(link, HgfsOplockEntry, links);
+      ServerLockData *lockData;
+      HgfsServerLock newLock;
+      uint32 refCount;
+
+      if (entry->breaking ||
+          !HgfsPendingOplockBreak(entry->fileDesc, entry->serverLock,
+                                  &newLock)) {
+         continue;
+      }
+
+      /*
+       * The session stays allocated while the entry is registered, but it
+       * may already be on its way out: never resurrect it.
+       */
+      do {
+         refCount = Atomic_Read(&entry->session->refCount);
+      } while (refCount != 0 &&
+               Atomic_ReadIfEqualWrite(&entry->session->refCount, refCount,
+                                       refCount + 1) != refCount);
+      if (refCount == 0) {
+         continue;
+      }
+
+      entry->breaking = TRUE;
+      entry->offeredLock = newLock;
+
+      lockData = Util_SafeMalloc(sizeof *lockData);
+      lockData->handle = entry->handle;
+      lockData->generation = entry->generation;
+      lockData->event = 0; // not needed
+      lockData->serverLock = newLock;
+      lockData->session = entry->session;
+      breaks[numBreaks++] = lockData;
+   }
+   MXUser_ReleaseExclLock(gHgfsOplockLock);
+
+   for (i = 0; i < numBreaks; i++) {
+      HgfsServerOplockBreak(breaks[i]);
+   }
+   free(breaks);
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_GetOpStats --
+ *
+ *    Returns the per-op statistics of all transport sessions, past and
+ *    present, indexed by HgfsOp. The counters of live sessions are read
+ *    while they are being updated, so they may lag by a request.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_GetOpStats(HgfsServerOpStats *stats,  // OUT: per-op statistics
+                      uint32 numOps)             // IN: entries in stats
+{
+   DblLnkLst_Links *curr;
+
+   ASSERT(stats);
+
+   memset(stats, 0, numOps * sizeof *stats);
+   numOps = MIN(numOps, HGFS_OP_MAX);
+
+   if (NULL == gHgfsOpStatsLock) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsOpStatsLock);
+   HgfsServerOpStatsAdd(stats, gHgfsOpStatsRetired, numOps);
+   DblLnkLst_ForEach(curr, &gHgfsOpStatsList) {
+      HgfsTransportSessionInfo *transportSession =
+         DblLnkLst_Container(curr, HgfsTransportSessionInfo, opStatsLinks);
+
+      HgfsServerOpCountersAdd(stats, transportSession->opStats, numOps);
+   }
+   MXUser_ReleaseExclLock(gHgfsOpStatsLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompoundAddReply --
+ *
+ *    Packs the reply of a compound sub-request into the compound reply.
+ *    A reply that does not fit within the reply size limit is replaced
+ *    by a protocol error.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Remembers the handle returned by a successful open.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCompoundAddReply(HgfsCompoundContext *context,  // IN/OUT: compound state
+                           HgfsOp op,                     // IN: sub-request opcode
+                           char const *reply,             // IN: sub-request reply
+                           size_t replySize)              // IN: sub-request reply size
+{
+   static const char padding[8] = { 0 };
+   HgfsReply const *header = (HgfsReply const *)reply;
+   HgfsCompoundReplyEntryV4 entry;
+   size_t available;
 
-};
+   ASSERT(replySize >= sizeof *header);
+
+   entry.index = context->index;
+   entry.op = op;
+   entry.status = header->status;
+   entry.size = replySize - sizeof *header;
+
+   if (HGFS_OP_OPEN_V3 == op && HGFS_STATUS_SUCCESS == entry.status &&
+       entry.size >= sizeof (HgfsReplyOpenV3)) {
+      context->lastHandle = ((HgfsReplyOpenV3 const *)(header + 1))->file;
+   }
+
+   available = context->maxReplySize - DynBuf_GetSize(&context->replies);
+   if (sizeof entry > available) {
+      LOG(4, ("%s: No room for the reply of sub-request %u\n", __FUNCTION__,
+              entry.index));
+      context->status = HGFS_STATUS_PROTOCOL_ERROR;
+      return;
+   }
+   if (HGFS_COMPOUND_ALIGN(entry.size) > available - sizeof entry) {
+      LOG(4, ("%s: Reply of sub-request %u is too large\n", __FUNCTION__,
+              entry.index));
+      entry.status = HGFS_STATUS_PROTOCOL_ERROR;
+      entry.size = 0;
+   }
+
+   DynBuf_SafeAppend(&context->replies, &entry, sizeof entry);
+   if (entry.size > 0) {
+      DynBuf_SafeAppend(&context->replies, header + 1, entry.size);
+      DynBuf_SafeAppend(&context->replies, padding,
+                        HGFS_COMPOUND_ALIGN(entry.size) - entry.size);
+   }
+   context->count++;
+   context->status = entry.status;
+}
 
 
 /*
@@ -2969,12 +3779,19 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
          HgfsPackLegacyReplyHeader(status, input->id, reply);
       }
    }
-   if (!HgfsPacketSend(input->packet, packetOut, replySize,
-                       input->transportSession, 0)) {
+   if (NULL != input->compound) {
+      /* Sub-request of a compound: the reply goes into the compound reply. */
+      HgfsServerCompoundAddReply(input->compound, input->op, packetOut, replySize);
+   } else if (!HgfsPacketSend(input->packet, packetOut, replySize,
+                              input->transportSession, 0)) {
       /* Send failed. Drop the reply. */
       LOG(4, ("Error sending reply\n"));
    }
 
+   if (0 != input->startTime) {
+      HgfsServerOpStatsRecord(input, status, replySize);
+   }
+
    if (NULL != input->session) {
       HgfsServerSessionPut(input->session);
    }
@@ -2983,6 +3800,251 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompoundSetHandle --
+ *
+ *    Replaces HGFS_COMPOUND_LAST_HANDLE in a compound sub-request with the
+ *    handle returned by the last successful open of the compound.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCompoundSetHandle(HgfsOp op,          // IN: sub-request opcode
+                            void *payload,      // IN/OUT: sub-request payload
+                            size_t payloadSize, // IN: sub-request payload size
+                            HgfsHandle handle)  // IN: last opened handle
+{
+   switch (op) {
+   case HGFS_OP_READ_V3:
+   case HGFS_OP_WRITE_V3:
+   case HGFS_OP_CLOSE_V3: {
+      /* All of these start with the file handle. */
+      HgfsRequestCloseV3 *request = payload;
+
+      if (payloadSize >= sizeof request->file &&
+          HGFS_COMPOUND_LAST_HANDLE == request->file) {
+         request->file = handle;
+      }
+      break;
+   }
+   case HGFS_OP_GETATTR_V3: {
+      HgfsRequestGetattrV3 *request = payload;
+
+      if (payloadSize >= offsetof(HgfsRequestGetattrV3, fileName.name) &&
+          (request->fileName.flags & HGFS_FILE_NAME_USE_FILE_DESC) != 0 &&
+          HGFS_COMPOUND_LAST_HANDLE == request->fileName.fid) {
+         request->fileName.fid = handle;
+      }
+      break;
+   }
+   default:
+      break;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompoundRun --
+ *
+ *    Runs one sub-request of a compound through its op handler, as if it
+ *    had arrived in a packet of its own.
+ *
+ * Results:
+ *    None. The status of the sub-request is in context->status.
+ *
+ * Side effects:
+ *    The reply is added to the compound reply.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCompoundRun(HgfsInputParam *input,         // IN: compound request
+                      HgfsCompoundContext *context,  // IN/OUT: compound state
+                      HgfsOp op,                     // IN: sub-request opcode
+                      void const *payload,           // IN: sub-request payload
+                      size_t payloadSize)            // IN: sub-request payload size
+{
+   HgfsRequest *header = (HgfsRequest *)context->request;
+   HgfsInputParam *subInput;
+
+   header->id = input->id;
+   header->op = op;
+   memcpy(header + 1, payload, payloadSize);
+   HgfsServerCompoundSetHandle(op, header + 1, payloadSize, context->lastHandle);
+
+   memset(&context->packet, 0, sizeof context->packet);
+   context->packet.guestInitiated = TRUE;
+   context->packet.metaPacket = header;
+   context->packet.metaPacketSize = sizeof *header + payloadSize;
+   context->packet.replyPacket = context->reply;
+   context->packet.replyPacketSize = HGFS_LARGE_PACKET_MAX;
+
+   subInput = Util_SafeCalloc(1, sizeof *subInput);
+   subInput->metaPacket = context->request;
+   subInput->metaPacketSize = context->packet.metaPacketSize;
+   subInput->session = input->session;
+   subInput->transportSession = input->transportSession;
+   subInput->packet = &context->packet;
+   subInput->payload = header + 1;
+   subInput->payloadOffset = sizeof *header;
+   subInput->payloadSize = payloadSize;
+   subInput->op = op;
+   subInput->id = input->id;
+   subInput->startTime = (0 != input->startTime) ? Hostinfo_SystemTimerNS() : 0;
+   subInput->compound = context;
+
+   /* Both references are dropped when the sub-request completes. */
+   HgfsServerSessionGet(subInput->session);
+   HgfsServerTransportSessionGet(subInput->transportSession);
+
+   switch (op) {
+   case HGFS_OP_OPEN_V3:
+   case HGFS_OP_READ_V3:
+   case HGFS_OP_WRITE_V3:
+   case HGFS_OP_CLOSE_V3:
+   case HGFS_OP_GETATTR_V3:
+      if (subInput->metaPacketSize >= handlers[op].minReqSize) {
+         (*handlers[op].handler)(subInput);
+         break;
+      }
+      /* Fallthrough. */
+   default:
+      LOG(4, ("%s: Invalid sub-request %u, op %u\n", __FUNCTION__,
+              context->index, op));
+      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, subInput);
+      break;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompound --
+ *
+ *    Handle a compound request: run its sub-requests back to back and
+ *    return all their replies in one packet.
+ *
+ *    The sub-requests are validated before any of them runs, so that a
+ *    malformed compound has no side effects. Once a sub-request fails the
+ *    remaining ones are skipped, except for closes, unless the client asked
+ *    to continue on errors.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Those of the sub-requests.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCompound(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   HgfsCompoundContext context;
+   void const *entries;
+   size_t entriesSize;
+   size_t maxReplySize;
+   size_t replyPayloadSize = 0;
+   uint32 count;
+   uint32 flags;
+
+   HGFS_ASSERT_INPUT(input);
+
+   memset(&context, 0, sizeof context);
+   DynBuf_Init(&context.replies);
+
+   if (!HgfsUnpackCompoundRequest(input->payload, input->payloadSize, &count,
+                                  &flags, &maxReplySize, &entries, &entriesSize)) {
+      LOG(4, ("%s: Failed to unpack a valid packet -> PROTOCOL_ERROR.\n", __FUNCTION__));
+      status = HGFS_ERROR_PROTOCOL;
+   } else {
+      size_t offset = 0;
+      HgfsOp op;
+      void const *payload;
+      size_t payloadSize;
+      uint32 i;
+
+      for (i = 0; i < count; i++) {
+         if (!HgfsUnpackCompoundEntry(entries, entriesSize, &offset, &op,
+                                      &payload, &payloadSize)) {
+            LOG(4, ("%s: Malformed sub-request %u -> PROTOCOL_ERROR.\n",
+                    __FUNCTION__, i));
+            status = HGFS_ERROR_PROTOCOL;
+            break;
+         }
+      }
+
+      context.maxReplySize = HGFS_LARGE_PACKET_MAX - sizeof (HgfsHeader);
+      if (0 != maxReplySize) {
+         context.maxReplySize = MIN(context.maxReplySize, maxReplySize);
+      }
+      if (context.maxReplySize < sizeof (HgfsReplyCompoundV4)) {
+         LOG(4, ("%s: Reply size limit too small -> PROTOCOL_ERROR.\n", __FUNCTION__));
+         status = HGFS_ERROR_PROTOCOL;
+      }
+      context.maxReplySize -= MIN(context.maxReplySize, sizeof (HgfsReplyCompoundV4));
+
+      if (HGFS_ERROR_SUCCESS == status) {
+         Bool failed = FALSE;
+
+         context.request = Util_SafeMalloc(sizeof (HgfsRequest) + entriesSize);
+         context.reply = Util_SafeMalloc(HGFS_LARGE_PACKET_MAX);
+         context.lastHandle = HGFS_INVALID_HANDLE;
+
+         for (offset = 0, i = 0; i < count; i++) {
+            HgfsUnpackCompoundEntry(entries, entriesSize, &offset, &op,
+                                    &payload, &payloadSize);
+            if (failed && HGFS_OP_CLOSE_V3 != op &&
+                (flags & HGFS_COMPOUND_CONTINUE_ON_ERROR) == 0) {
+               continue;
+            }
+            context.index = i;
+            HgfsServerCompoundRun(input, &context, op, payload, payloadSize);
+            failed = failed || HGFS_STATUS_SUCCESS != context.status;
+         }
+
+         free(context.request);
+         free(context.reply);
+      }
+   }
+
+   if (HGFS_ERROR_SUCCESS == status) {
+      HgfsReplyCompoundV4 *reply;
+      size_t repliesSize = DynBuf_GetSize(&context.replies);
+
+      replyPayloadSize = sizeof *reply + repliesSize;
+      if (HgfsAllocInitReply(input->packet, input->metaPacket, replyPayloadSize,
+                             (void **)&reply, input->session)) {
+         reply->count = context.count;
+         if (repliesSize > 0) {
+            memcpy(reply + 1, DynBuf_Get(&context.replies), repliesSize);
+         }
+      } else {
+         status = HGFS_ERROR_PROTOCOL;
+         replyPayloadSize = 0;
+      }
+   }
+
+   DynBuf_Destroy(&context.replies);
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -3052,6 +4114,7 @@ HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
    HgfsTransportSessionInfo *transportSession = (HgfsTransportSessionInfo *)clientData;
    HgfsInternalStatus status;
    HgfsInputParam *input = NULL;
+   VmTimeType startTime = gHgfsOpStatsEnabled ? Hostinfo_SystemTimerNS() : 0;
 
    ASSERT(transportSession);
 
@@ -3071,6 +4134,7 @@ HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
    }
 
    packet->id = input->id;
+   input->startTime = startTime;
    HGFS_ASSERT_MINIMUM_OP(input->op);
    if (HGFS_ERROR_SUCCESS == status) {
       HGFS_ASSERT_INPUT(input);
@@ -3508,6 +4572,10 @@ HgfsServer_InitState(HgfsServerSessionCallbacks **callbackTable,  // IN/OUT: our
 
    alwaysUseHostTime = Config_GetBool(FALSE, "hgfs.alwaysUseHostTime");
 
+   gHgfsOpStatsEnabled = Config_GetBool(FALSE, "hgfs.opStats.enable");
+
+   gHgfsOplocksEnabled = Config_GetBool(FALSE, "hgfs.oplocks.enable");
+
    /*
     * Initialize the globals for handling the active shared folders.
     */
@@ -3516,6 +4584,18 @@ HgfsServer_InitState(HgfsServerSessionCallbacks **callbackTable,  // IN/OUT: our
    gHgfsAsyncVar = NULL;
    Atomic_Write(&gHgfsAsyncCounter, 0);
 
+   DblLnkLst_Init(&gHgfsOpStatsList);
+   memset(gHgfsOpStatsRetired, 0, sizeof gHgfsOpStatsRetired);
+   gHgfsOpStatsLock = MXUser_CreateExclLock("hgfsOpStatsLock",
+                                            RANK_hgfsOpStatsLock);
+
+#ifdef HGFS_OPLOCKS
+   DblLnkLst_Init(&gHgfsOplockList);
+   gHgfsOplockCount = 0;
+   gHgfsOplockLock = MXUser_CreateExclLock("hgfsOplockLock",
+                                           RANK_hgfsOplockLock);
+#endif
+
    DblLnkLst_Init(&gHgfsSharedFoldersList);
    gHgfsSharedFoldersLock = MXUser_CreateExclLock("sharedFoldersLock",
                                                   RANK_hgfsSharedFolders);
@@ -3605,7 +4685,28 @@ HgfsServer_ExitState(void)
       gHgfsAsyncVar = NULL;
    }
 
+   if (NULL != gHgfsOpStatsLock) {
+      MXUser_DestroyExclLock(gHgfsOpStatsLock);
+      gHgfsOpStatsLock = NULL;
+   }
+
    HgfsServerPlatformDestroy();
+
+#ifdef HGFS_OPLOCKS
+   if (NULL != gHgfsOplockLock) {
+      DblLnkLst_Links *link, *nextElem;
+
+      DblLnkLst_ForEachSafe(link, nextElem, &gHgfsOplockList) {
+         HgfsOplockEntry *entry = DblLnkLst_Container(link, HgfsOplockEntry,
+                                                      links);
+         DblLnkLst_Unlink1(&entry->links);
+         free(entry);
+      }
+      gHgfsOplockCount = 0;
+      MXUser_DestroyExclLock(gHgfsOplockLock);
+      gHgfsOplockLock = NULL;
+   }
+#endif
 }
 
 
@@ -3783,6 +4884,8 @@ HgfsServerSessionConnect(void *transportData,                         // IN: tra
 
    Atomic_Write(&transportSession->refCount, 0);
 
+   HgfsServerOpStatsAttach(transportSession);
+
    /* Give our session a reference to hold while we are open. */
    HgfsServerTransportSessionGet(transportSession);
 
@@ -3937,6 +5040,15 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
       }
       HgfsServerSetSessionCapability(HGFS_OP_SEARCH_READ_V4,
                                      HGFS_REQUEST_SUPPORTED, session);
+#ifdef HGFS_OPLOCKS
+      /* Clients only ask for oplocks when these are offered. */
+      if (gHgfsOplocksEnabled) {
+         HgfsServerSetSessionCapability(HGFS_OP_SERVER_LOCK_CHANGE_V3,
+                                        HGFS_REQUEST_SUPPORTED, session);
+         HgfsServerSetSessionCapability(HGFS_OP_OPLOCK_BREAK_V4,
+                                        HGFS_REQUEST_SUPPORTED, session);
+      }
+#endif
    }
 
    *sessionData = session;
@@ -5629,8 +6741,9 @@ HgfsAllocInitReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
 
    if (HGFS_V4_LEGACY_OPCODE == request->op) {
       headerSize = sizeof(HgfsHeader);
-   } else if (request->op < HGFS_OP_CREATE_SESSION_V4 &&
-              request->op > HGFS_OP_RENAME_V2) {
+   } else if ((request->op < HGFS_OP_CREATE_SESSION_V4 &&
+               request->op > HGFS_OP_RENAME_V2) ||
+              request->op == HGFS_OP_COMPOUND_V4) {
       headerSize = sizeof(HgfsReply);
    }
    replyPacketSize = headerSize + payloadSize;
@@ -6326,7 +7439,6 @@ HgfsValidateRenameFile(Bool useHandle,            // IN:
 {
    HgfsInternalStatus status;
    Bool sharedFolderOpen = FALSE;
-   HgfsServerLock serverLock = HGFS_LOCK_NONE;
    HgfsNameStatus nameStatus;
 
 
@@ -6375,18 +7487,12 @@ HgfsValidateRenameFile(Bool useHandle,            // IN:
    ASSERT(*localFileName != NULL || HGFS_ERROR_SUCCESS != status);
 
    if (HGFS_ERROR_SUCCESS == status) {
-      if (HgfsFileHasServerLock(*localFileName, session, &serverLock, descr)) {
-         /*
-          * XXX: Before renaming the file, check to see if we are holding
-          * an oplock on both the old and new files. If one of them is oplocked, and
-          * we commence with the rename, we'll trigger an oplock break that'll
-          * deadlock us. The client should be smart enough to break necessary oplocks
-          * on the source and target files before calling rename, so we'll return
-          * an error.
-          */
-
-         LOG (4, ("%s: File has an outstanding oplock. Client "
-            "should remove this oplock and try again.\n", __FUNCTION__));
+      /*
+       * Before renaming the file, check to see if we are holding an oplock on
+       * it. If it is oplocked, and we commence with the rename, we'll trigger
+       * an oplock break that'll deadlock us.
+       */
+      if (!HgfsServerResolveLockConflicts(*localFileName, FALSE, session)) {
          status = HGFS_ERROR_PATH_BUSY;
       }
    }
@@ -6643,8 +7749,6 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
 {
    char *cpName;
    size_t cpNameSize;
-   HgfsServerLock serverLock = HGFS_LOCK_NONE;
-   fileDesc fileDesc;
    HgfsHandle file;
    HgfsDeleteHint hints = 0;
    HgfsInternalStatus status;
@@ -6677,14 +7781,8 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
                   status = HGFS_ERROR_ACCESS_DENIED;
                }
                LOG(4, ("HgfsServerDeleteFile: failed access check, error %d\n", status));
-            } else if (HgfsFileHasServerLock(utf8Name, input->session, &serverLock,
-                       &fileDesc)) {
-               /*
-                * XXX: If the file has an oplock, the client should have broken it on
-                * its own by now. Sorry!
-                */
-               LOG (4, ("%s: File has an outstanding oplock. Client should "
-                  "remove this oplock and try again.\n", __FUNCTION__));
+            } else if (!HgfsServerResolveLockConflicts(utf8Name, FALSE,
+                                                       input->session)) {
                status = HGFS_ERROR_PATH_BUSY;
             } else {
                LOG(4, ("%s: deleting \"%s\"\n", __FUNCTION__, utf8Name));
@@ -6821,9 +7919,10 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
  *
  * HgfsServerServerLockChange --
  *
- *    Called by the client when it wants to either acquire an oplock on a file
- *    that was previously opened, or when it wants to release/downgrade an
- *    oplock on a file that was previously oplocked.
+ *    Called by the client when it wants to release/downgrade an oplock on a
+ *    file that was previously oplocked, which is also how the client
+ *    acknowledges an oplock break. Acquiring an oplock on a file that was
+ *    previously opened is not supported: the reply carries the lock held.
  *
  * Results:
  *    None.
@@ -6837,10 +7936,51 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
 static void
 HgfsServerServerLockChange(HgfsInputParam *input)  // IN: Input params
 {
+#ifdef HGFS_OPLOCKS
+   HgfsHandle file;
+   HgfsServerLock requestedLock;
+   HgfsServerLock currentLock;
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   size_t replyPayloadSize = 0;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!HgfsUnpackServerLockChangeRequest(input->payload, input->payloadSize,
+                                          input->op, &file, &requestedLock)) {
+      status = HGFS_ERROR_PROTOCOL;
+   } else if (!HgfsHandle2ServerLock(file, input->session, &currentLock)) {
+      status = HGFS_ERROR_INVALID_HANDLE;
+   } else {
+      /*
+       * Locks are only released or downgraded here, either because the
+       * client no longer needs them or to acknowledge an oplock break.
+       * Asking for a stronger lock leaves the current one in place.
+       */
+      if (currentLock != HGFS_LOCK_NONE &&
+          (requestedLock == HGFS_LOCK_NONE ||
+           (requestedLock == HGFS_LOCK_SHARED &&
+            currentLock == HGFS_LOCK_EXCLUSIVE))) {
+         HgfsOplockAck(input->session, file, 0, requestedLock);
+         if (!HgfsHandle2ServerLock(file, input->session, &currentLock)) {
+            currentLock = HGFS_LOCK_NONE;
+         }
+      }
+      LOG(4, ("%s: fh %u asked for lock %d, holds %d\n", __FUNCTION__, file,
+              requestedLock, currentLock));
+
+      if (!HgfsPackServerLockChangeReply(input->packet, input->metaPacket,
+                                         input->op, currentLock,
+                                         &replyPayloadSize, input->session)) {
+         status = HGFS_ERROR_INTERNAL;
+      }
+   }
 
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+#else
    HGFS_ASSERT_INPUT(input);
 
    HgfsServerCompleteRequest(HGFS_ERROR_NOT_SUPPORTED, 0, input);
+#endif
 }
 
 
@@ -7357,14 +8497,11 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
          nameStatus = HgfsServerGetShareInfo(cpName, cpNameSize, caseFlags, &shareInfo,
                                              &utf8Name, &utf8NameLen);
          if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
-            fileDesc hFile;
-            HgfsServerLock serverLock = HGFS_LOCK_NONE;
             HgfsShareOptions configOptions;
 
             /*
-             * XXX: If the client has an oplock on this file, it must reuse the
-             * handle for the oplocked node (or break the oplock) prior to making
-             * a setattr request. Fail this request.
+             * If the client has an oplock on this file, the oplock must be
+             * broken prior to the setattr, or the request fails.
              */
             if (!HgfsServerPolicy_CheckMode(HGFS_OPEN_MODE_WRITE_ONLY,
                                             shareInfo.writePermissions,
@@ -7375,10 +8512,8 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
                        &configOptions)) {
                LOG(4, ("%s: no matching share: %s.\n", __FUNCTION__, cpName));
                status = HGFS_ERROR_FILE_NOT_FOUND;
-            } else if (HgfsFileHasServerLock(utf8Name, input->session, &serverLock, &hFile)) {
-               LOG(4, ("%s: An open, oplocked handle exists for "
-                      "this file. The client should retry with that handle\n",
-                      __FUNCTION__));
+            } else if (!HgfsServerResolveLockConflicts(utf8Name, FALSE,
+                                                       input->session)) {
                status = HGFS_ERROR_PATH_BUSY;
             } else {
                status = HgfsPlatformSetattrFromName(utf8Name, &attr, configOptions, hints);
@@ -7504,6 +8639,70 @@ HgfsServerValidateOpenParameters(HgfsFileOpenInfo *openInfo, // IN/OUT: openfile
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerResolveLockConflicts --
+ *
+ *    Check whether a session can access a file by name while it may hold
+ *    oplocks on the file. If it does, the access would trigger an oplock
+ *    break that the client cannot acknowledge while it waits for the reply,
+ *    and we'd deadlock.
+ *
+ *    Where oplock breaks can be sent to the client, the conflicting locks
+ *    are broken first, and acknowledged on the client's behalf: the client
+ *    is told to stop caching, and its own acknowledgement finds the lock
+ *    gone. Otherwise the access is refused, and the client drivers are
+ *    expected to break the oplocks on their own first.
+ *
+ * Results:
+ *    TRUE if the access can proceed, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsServerResolveLockConflicts(char const *utf8Name,      // IN: file name
+                               Bool readOnly,             // IN: access only reads
+                               HgfsSessionInfo *session)  // IN: session info
+{
+   HgfsServerLock serverLock;
+   fileDesc fd;
+
+#ifdef HGFS_OPLOCKS
+   while (HgfsFileHasServerLock(utf8Name, session, &serverLock, &fd)) {
+      HgfsHandle handle;
+
+      /* Reading the file does not break a shared lock. */
+      if (readOnly && serverLock == HGFS_LOCK_SHARED) {
+         break;
+      }
+
+      if (!HgfsFileDesc2Handle(fd, session, &handle)) {
+         LOG(4, ("%s: locked fd %d has no handle\n", __FUNCTION__, fd));
+         return FALSE;
+      }
+
+      HgfsServerSendOplockBreak(handle, HGFS_LOCK_NONE, session);
+      HgfsOplockAck(session, handle, 0, HGFS_LOCK_NONE);
+   }
+
+   return TRUE;
+#else
+   if (HgfsFileHasServerLock(utf8Name, session, &serverLock, &fd)) {
+      LOG(4, ("%s: File has an outstanding oplock. Client should "
+              "remove this oplock and try again.\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   return TRUE;
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -7527,8 +8726,6 @@ HgfsServerOpen(HgfsInputParam *input)  // IN: Input params
    fileDesc newHandle;
    HgfsLocalId localId;
    HgfsFileOpenInfo openInfo;
-   fileDesc fileDesc;
-   HgfsServerLock serverLock = HGFS_LOCK_NONE;
    size_t replyPayloadSize = 0;
 
    HGFS_ASSERT_INPUT(input);
@@ -7554,22 +8751,19 @@ HgfsServerOpen(HgfsInputParam *input)  // IN: Input params
              openInfo.otherPerms : 0,
              openInfo.mask & HGFS_OPEN_VALID_FILE_ATTR   ? (uint32)openInfo.attr : 0));
          /*
-          * XXX: Before opening the file, see if we already have this file opened on
-          * the server with an oplock on it. If we do, we must fail the new open
-          * request, otherwise we will trigger an oplock break that the guest cannot
-          * handle at this time (since the HGFS server is running in the context of
-          * the vcpu thread), and we'll deadlock.
-          *
-          * Until we overcome this limitation via Crosstalk, we will be extra smart
-          * in the client drivers so as to prevent open requests on handles that
-          * already have an oplock. And the server will protect itself like so.
-          *
-          * XXX: With some extra effort, we could allow a second open for read here,
-          * since that won't break a shared oplock, but the clients should already
-          * realize that the second open can be avoided via sharing handles, too.
+          * Before opening the file, see if we already have this file opened on
+          * the server with an oplock on it.
           */
-         if (!HgfsFileHasServerLock(openInfo.utf8Name, input->session, &serverLock,
-                                    &fileDesc)) {
+         Bool readOnly;
+
+         /* Only an open that neither writes nor truncates is read only. */
+         readOnly = HGFS_OPEN_MODE_ACCMODE(openInfo.mode) == HGFS_OPEN_MODE_READ_ONLY &&
+                    (!(openInfo.mask & HGFS_OPEN_VALID_FLAGS) ||
+                     openInfo.flags == HGFS_OPEN ||
+                     openInfo.flags == HGFS_OPEN_CREATE);
+
+         if (HgfsServerResolveLockConflicts(openInfo.utf8Name, readOnly,
+                                            input->session)) {
             /* See if the name is valid, and if so add it and return the handle. */
             status = HgfsPlatformValidateOpen(&openInfo, followSymlinks, input->session,
                                               &localId, &newHandle);
@@ -7583,6 +8777,11 @@ HgfsServerOpen(HgfsInputParam *input)  // IN: Input params
 
                if (HgfsCreateAndCacheFileNode(&openInfo, &localId, newHandle,
                                               FALSE, input->session)) {
+#ifdef HGFS_OPLOCKS
+                  /* The lock may have been broken before the node was cached. */
+                  HgfsHandle2ServerLock(openInfo.file, input->session,
+                                        &openInfo.acquiredLock);
+#endif
                   if (!HgfsPackOpenReply(input->packet, input->metaPacket, &openInfo,
                                          &replyPayloadSize, input->session)) {
                      status = HGFS_ERROR_INTERNAL;
@@ -8560,17 +9759,15 @@ HgfsIsShareRoot(char const *cpName,         // IN: name to test
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerOplockBreakReply --
+ * HgfsServerSendOplockBreak --
  *
- *      The client was sent an oplock break request, and responded with this
- *      reply. It contains the oplock status that the client is now in. Since
- *      the break could have actually been a degrade, it is well within the
- *      client's rights to transition to a non-broken state. We need to make
- *      sure that such a transition was legal, acknowledge the brea
- *      appropriately, and update our own state.
+ *      Build an oplock break request and queue it to be sent to the client.
+ *      Like change notifications, the break is a server initiated request
+ *      on the session's channel. The client acknowledges it with a server
+ *      lock change request.
  *
  * Results:
- *      None.
+ *      TRUE if the request was handed to the transport, FALSE otherwise.
  *
  * Side effects:
  *      None.
@@ -8578,30 +9775,43 @@ HgfsIsShareRoot(char const *cpName,         // IN: name to test
  *-----------------------------------------------------------------------------
  */
 
-void
-HgfsServerOplockBreakReply(const unsigned char *packetIn, // IN: Reply packet
-                           unsigned int packetSize,       // IN: Size of packet
-                           void *clientData)              // IN: From request
+static Bool
+HgfsServerSendOplockBreak(HgfsHandle handle,          // IN: file losing the lock
+                          HgfsServerLock serverLock,  // IN: lock left to the client
+                          HgfsSessionInfo *session)   // IN: session info
 {
-   HgfsReplyServerLockChange *reply;
-   ServerLockData *lockData;
-   ASSERT(packetIn);
-   ASSERT(clientData);
+   HgfsPacket *packet;
+   HgfsHeader *packetHeader;
+   size_t sizeNeeded = sizeof *packetHeader + sizeof (HgfsRequestOplockBreakV4);
 
-   if (packetSize < sizeof *reply) {
-      return;
+   packetHeader = Util_SafeCalloc(1, sizeNeeded);
+   packet = Util_SafeCalloc(1, sizeof *packet);
+   packet->guestInitiated = FALSE;
+   packet->metaPacketSize = sizeNeeded;
+   packet->metaPacket = packetHeader;
+   packet->dataPacketIsAllocated = TRUE;
+
+   if (!HgfsPackOplockBreakRequest(packetHeader, handle, serverLock, session,
+                                   &sizeNeeded)) {
+      LOG(4, ("%s: failed to pack oplock break request\n", __FUNCTION__));
+      goto error;
    }
-   reply = (HgfsReplyServerLockChange *)packetIn;
-   lockData = (ServerLockData *)clientData;
 
-   /*
-    * XXX: It should be safe to ignore the status and id from the actual
-    * HgfsReply. The only information we need to properly acknowledge the break
-    * is the original fd and the new lease, which, in the case of a degrade,
-    * is double checked in HgfsAckOplockBreak, so we'd be safe from a garbage
-    * value.
-    */
-   HgfsAckOplockBreak(lockData, reply->serverLock);
+   if (!HgfsPacketSend(packet, (char *)packetHeader, sizeNeeded,
+                       session->transportSession, 0)) {
+      LOG(4, ("%s: failed to send oplock break to the client\n", __FUNCTION__));
+      goto error;
+   }
+
+   /* The transport will call the server send complete callback to release the packets. */
+   LOG(4, ("%s: sent oplock break for fh %u lock %d\n", __FUNCTION__, handle,
+           serverLock));
+   return TRUE;
+
+error:
+   free(packet);
+   free(packetHeader);
+   return FALSE;
 }
 
 
@@ -8611,104 +9821,41 @@ HgfsServerOplockBreakReply(const unsigned char *packetIn, // IN: Reply packet
  * HgfsServerOplockBreak --
  *
  *      When the host FS needs to break the oplock so that another client
- *      can open the file, it signals the event in the overlapped structure
- *      that we used to request an oplock.
+ *      can open the file, HgfsServer_ProcessOplockBreaks calls this
+ *      function for the node holding the lock.
  *      This sets off the following chains of events:
- *      1. Send the oplock break request to the guest.
- *      2. Once the guest acknowledges the oplock break, the completion
- *      routine GuestRpcServerRequestCallback will fire, causing
- *      HgfsServerOplockBreakReply to also fire, which will break the oplock
- *      on the host FS.
+ *      1. Send the oplock break request to the client of the session holding
+ *      the lock.
+ *      2. The client flushes and drops its cached data, then acknowledges
+ *      the break with a server lock change request, which breaks or
+ *      downgrades the oplock on the host FS via HgfsOplockAck.
+ *
+ *      If the client never answers, the host FS breaks the lock on its own
+ *      once its lease break timeout expires.
  *
  * Results:
  *      None.
  *
  * Side effects:
- *      If successful, allocates memory for the rpc request.
+ *      Frees lockData and releases its session reference.
  *
  *-----------------------------------------------------------------------------
  */
 
-void
-HgfsServerOplockBreak(ServerLockData *lockData)
+static void
+HgfsServerOplockBreak(ServerLockData *lockData)  // IN: server lock info
 {
-   HgfsHandle hgfsHandle;
-   char *requestBuffer = NULL;
-   HgfsRequestServerLockChange *request;
-   HgfsServerLock lock;
-
-   LOG(4, ("%s: entered\n", __FUNCTION__));
-
-   /*
-    * XXX: Just because the file in not in the cache on the server,
-    * does not mean it was closed on the client. It is possible that
-    * we closed the file on the server because we ran out of space
-    * in cache. That's why for now as long as a file has a lock,
-    * we don't remove it from the node cache. This should be fixed.
-    *
-    * In any case, none of these cache-related failures should cause us to ack
-    * the oplock break locally. That is because if the file wasn't in the
-    * cache, or it had no lock, chances are someone else (maybe the VCPU
-    * thread) broke the oplock and/or closed the file.
-    */
-
-   if (!HgfsFileDesc2Handle(lockData->fileDesc, &hgfsHandle)) {
-      LOG(4, ("%s: file is not in the cache\n", __FUNCTION__));
-      goto free_and_exit;
-   }
+   LOG(4, ("%s: breaking lock on fh %u to %d\n", __FUNCTION__,
+           lockData->handle, lockData->serverLock));
 
-   if (!HgfsHandle2ServerLock(hgfsHandle, &lock)) {
-      LOG(4, ("%s: could not retrieve node's lock info.\n", __FUNCTION__));
-      goto free_and_exit;
+   /* If for some reason we fail, we'll acknowledge the oplock break immediately. */
+   if (!HgfsServerSendOplockBreak(lockData->handle, lockData->serverLock,
+                                  lockData->session)) {
+      HgfsOplockAck(lockData->session, lockData->handle, lockData->generation,
+                    HGFS_LOCK_NONE);
    }
 
-   if (lock == HGFS_LOCK_NONE) {
-      LOG(4, ("%s: the file does not have a server lock.\n", __FUNCTION__));
-      goto free_and_exit;
-   }
-
-   /*
-    * We need to setup the entire request here. The command prefix will be
-    * added later, so save some space for it.
-    *
-    * XXX: This should probably go into a common allocation function that
-    * other out-of-band requests can use.
-    */
-
-   requestBuffer = malloc(sizeof *request + HGFS_CLIENT_CMD_LEN);
-   if (requestBuffer == NULL) {
-      LOG(4, ("%s: could not allocate memory.\n", __FUNCTION__));
-      goto ack_and_exit;
-   }
-
-   /* Save space for the command prefix. */
-   request = (HgfsRequestServerLockChange *)
-      (requestBuffer + HGFS_CLIENT_CMD_LEN);
-   request->header.op = HGFS_OP_SERVER_LOCK_CHANGE;
-   request->header.id = 0; /* XXX */
-   request->file = hgfsHandle;
-   request->newServerLock = lockData->serverLock;
-
-   /*
-    * Just send the request size for our actual request; our callee will
-    * write in the command prefix and modify the request size appropriately.
-    *
-    * If for some reason we fail, we'll acknowledge the oplock break
-    * immediately.
-    */
-
-   if (HgfsServerManager_SendRequest(requestBuffer, sizeof *request,
-                                     HgfsServerOplockBreakReply, lockData)) {
-      return;
-   }
-   free(requestBuffer);
-
-  ack_and_exit:
-   HgfsAckOplockBreak(lockData, HGFS_LOCK_NONE);
-
-   return;
-
-  free_and_exit:
+   HgfsServerSessionPut(lockData->session);
    free(lockData);
 }
 #endif
@@ -80,11 +80,12 @@
 
 /*
  * Does this platform have oplock support? We define it here to avoid long
- * ifdefs all over the code. For now, Linux and Windows hosts only.
- *
- * XXX: Just kidding, no oplock support yet.
+ * ifdefs all over the code. Linux hosts implement oplocks with kernel
+ * leases. Oplocks are only granted once enabled at run time (see
+ * HgfsServer_EnableOplocks), and only to sessions whose channel can carry
+ * the break requests to the client.
  */
-#if 0
+#if defined(__linux__)
 #define HGFS_OPLOCKS
 #endif
 
@@ -284,6 +285,36 @@ typedef enum {
    HGFS_SESSION_STATE_CLOSED,
 } HgfsSessionInfoState;
 
+/*
+ * Reply packets and bounce buffers are recycled through small per transport
+ * session pools, one per power of two size class from 4KB to 64KB. Larger
+ * buffers are always allocated.
+ */
+
+#define HGFS_PACKET_POOL_MIN_SHIFT  12
+#define HGFS_PACKET_POOL_CLASSES    5
+#define HGFS_PACKET_POOL_DEPTH      4
+
+typedef struct HgfsPacketPool {
+   Atomic_Ptr bufs[HGFS_PACKET_POOL_CLASSES][HGFS_PACKET_POOL_DEPTH];
+} HgfsPacketPool;
+
+/*
+ * Per-op statistics of a transport session. Requests of one session can
+ * complete concurrently (e.g., asynchronous reads), so the counters are
+ * updated with atomic operations.
+ */
+
+typedef struct HgfsServerOpCounters {
+   Atomic_uint64 count;
+   Atomic_uint64 errors;
+   Atomic_uint64 bytesIn;
+   Atomic_uint64 bytesOut;
+   Atomic_uint64 totalTime;
+   Atomic_uint64 maxTime;
+   Atomic_uint64 latency[HGFS_OP_STATS_BUCKETS];
+} HgfsServerOpCounters;
+
 typedef struct HgfsTransportSessionInfo {
    /* Default session id. */
    uint64 defaultSessionId;
@@ -315,6 +346,15 @@ typedef struct HgfsTransportSessionInfo {
    Atomic_uint32 refCount;    /* Reference count for session. */
 
    uint32 channelCapabilities;
+
+   /* Per-op statistics (HGFS_OP_MAX entries). */
+   HgfsServerOpCounters *opStats;
+
+   /* Links into the list of sessions whose statistics are reported. */
+   DblLnkLst_Links opStatsLinks;
+
+   /* Free reply and bounce buffers. */
+   HgfsPacketPool packetPool;
 } HgfsTransportSessionInfo;
 
 typedef struct HgfsSessionInfo {
@@ -513,9 +553,11 @@ typedef struct HgfsCreateSessionInfo {
 
 /* Server lock related structure */
 typedef struct {
-   fileDesc fileDesc;
+   HgfsHandle handle;            // file losing the lock
+   uint32 generation;            // lock the break is for
    int32 event;
-   HgfsServerLock serverLock;
+   HgfsServerLock serverLock;    // lock left to the client
+   HgfsSessionInfo *session;
 } ServerLockData;
 
 typedef struct HgfsInputParam {
@@ -530,6 +572,8 @@ typedef struct HgfsInputParam {
    HgfsOp op;
    uint32 id;
    Bool v4header;
+   VmTimeType startTime;   // zero unless op statistics are enabled
+   struct HgfsCompoundContext *compound;  // set for sub-requests of a compound
 } HgfsInputParam;
 
 Bool
@@ -931,6 +975,40 @@ HgfsPackChangeNotificationRequest(void *packet,                    // IN/OUT: Hg
                                   uint32 flags,                    // IN: notify flags
                                   HgfsSessionInfo *session,        // IN: session
                                   size_t *bufferSize);             // IN/OUT: packet size
+Bool
+HgfsUnpackCompoundRequest(void const *packet,      // IN: HGFS packet
+                          size_t packetSize,       // IN: request packet size
+                          uint32 *count,           // OUT: number of entries
+                          uint32 *flags,           // OUT: compound flags
+                          size_t *maxReplySize,    // OUT: reply size limit or 0
+                          void const **entries,    // OUT: first entry
+                          size_t *entriesSize);    // OUT: size of all entries
+Bool
+HgfsUnpackCompoundEntry(void const *entries,       // IN: compound entries
+                        size_t entriesSize,        // IN: size of all entries
+                        size_t *offset,            // IN/OUT: offset of the entry
+                        HgfsOp *op,                // OUT: sub-request opcode
+                        void const **payload,      // OUT: sub-request payload
+                        size_t *payloadSize);      // OUT: sub-request payload size
+Bool
+HgfsPackOplockBreakRequest(void *packet,               // IN/OUT: Hgfs Packet
+                           HgfsHandle handle,          // IN: file losing the lock
+                           HgfsServerLock serverLock,  // IN: lock left to the client
+                           HgfsSessionInfo *session,   // IN: session
+                           size_t *bufferSize);        // IN/OUT: packet size
+Bool
+HgfsUnpackServerLockChangeRequest(void const *packet,        // IN: HGFS packet
+                                  size_t packetSize,         // IN: request packet size
+                                  HgfsOp op,                 // IN: request type
+                                  HgfsHandle *file,          // OUT: file handle
+                                  HgfsServerLock *serverLock); // OUT: lock kept
+Bool
+HgfsPackServerLockChangeReply(HgfsPacket *packet,          // IN/OUT: Hgfs Packet
+                              char const *packetHeader,    // IN: packet header
+                              HgfsOp op,                   // IN: request type
+                              HgfsServerLock serverLock,   // IN: lock held
+                              size_t *payloadSize,         // OUT: size of packet
+                              HgfsSessionInfo *session);   // IN: Session info
 /* Node cache functions. */
 
 Bool
@@ -998,7 +1076,7 @@ HgfsUpdateNodeFileDesc(HgfsHandle handle,        // IN: Hgfs file handle
                        void *fileCtx);           // IN: OS file context
 
 Bool
-HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
+HgfsUpdateNodeServerLock(HgfsHandle handle,          // IN: Hgfs file handle
                          HgfsSessionInfo *session,   // IN: session info
                          HgfsServerLock serverLock); // IN: new oplock
 
@@ -1075,12 +1153,15 @@ HgfsBuildRelativePath(const char* source,    // IN: source file name
 
 /* All oplock-specific functionality is defined here. */
 #ifdef HGFS_OPLOCKS
-void
-HgfsServerOplockBreak(ServerLockData *data); // IN: server lock info
+Bool
+HgfsPendingOplockBreak(fileDesc fileDesc,           // IN: OS handle
+                       HgfsServerLock serverLock,   // IN: lock held
+                       HgfsServerLock *newLock);    // OUT: lock left by the break
 
-void
-HgfsAckOplockBreak(ServerLockData *lockData,  // IN: server lock info
-                   HgfsServerLock replyLock); // IN: client has this lock
+HgfsServerLock
+HgfsAckOplockBreak(fileDesc fileDesc,           // IN: OS handle
+                   HgfsServerLock offeredLock,  // IN: lock the host allows
+                   HgfsServerLock replyLock);   // IN: client has this lock
 
 #endif
 
@@ -1286,4 +1367,7 @@ HSPU_GetReplyPacket(HgfsPacket *packet,        // IN/OUT: Hgfs Packet
 void
 HSPU_PutReplyPacket(HgfsPacket *packet,        // IN/OUT: Hgfs Packet
                     HgfsTransportSessionInfo *transportSession); // IN: Session Info
+
+void
+HSPU_DestroyPacketPool(HgfsTransportSessionInfo *transportSession); // IN: Session Info
 #endif /* __HGFS_SERVER_INT_H__ */
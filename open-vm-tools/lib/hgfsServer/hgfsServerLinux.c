@@ -96,7 +96,6 @@
 
 #ifdef HGFS_OPLOCKS
 #   include <signal.h>
-#   include "sig.h"
 #endif
 
 
@@ -353,14 +352,19 @@ static uint64 HgfsGetCreationTime(const struct stat *stats);
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSigOplockBreak --
+ * HgfsPendingOplockBreak --
  *
- *      Handle a pending oplock break. Called from the VMX poll loop context.
- *      All we really do is set up the state for an oplock break and call
- *      HgfsServerOplockBreak which will do the rest of the work.
+ *      Check whether the kernel wants to break the lease backing a server
+ *      lock. According to locks.c in kernel source, doing F_GETLEASE when a
+ *      lease break is pending will return the new lease we should use. It'll
+ *      be F_RDLCK if we can downgrade, or F_UNLCK if we should break
+ *      altogether.
+ *
+ *      The caller guarantees that fileDesc is still the node's descriptor.
  *
  * Results:
- *      None.
+ *      TRUE if a break is pending, with the lock left to the client.
+ *      FALSE otherwise.
  *
  * Side effects:
  *      None.
@@ -368,78 +372,32 @@ static uint64 HgfsGetCreationTime(const struct stat *stats);
  *-----------------------------------------------------------------------------
  */
 
-static void
-HgfsServerSigOplockBreak(int sigNum,       // IN: Signal number
-                         siginfo_t *info,  // IN: Additional info about signal
-                         ucontext_t *u,    // IN: Interrupted context (regs etc)
-                         void *clientData) // IN: Ignored
+Bool
+HgfsPendingOplockBreak(fileDesc fileDesc,          // IN: OS handle
+                       HgfsServerLock serverLock,  // IN: lock held
+                       HgfsServerLock *newLock)    // OUT: lock left by the break
 {
-   ServerLockData *lockData;
-   int newLease, fd;
-   HgfsServerLock newServerLock;
-
-   ASSERT(sigNum == SIGIO);
-   ASSERT(info);
-   ASSERT(clientData == NULL);
+   int heldLease = serverLock == HGFS_LOCK_SHARED ? F_RDLCK : F_WRLCK;
+   int newLease = fcntl(fileDesc, F_GETLEASE);
 
-   fd = info->si_fd;
-   LOG(4, ("%s: Received SIGIO for fd %d\n", __FUNCTION__, fd));
-
-   /*
-    * We've got all we need from the signal handler, let it continue handling
-    * signals of this type.
-    */
-   Sig_Continue(sigNum);
+   if (newLease == heldLease) {
+      return FALSE;
+   }
 
-   /*
-    * According to locks.c in kernel source, doing F_GETLEASE when a lease
-    * break is pending will return the new lease we should use. It'll be
-    * F_RDLCK if we can downgrade, or F_UNLCK if we should break altogether.
-    */
-   newLease = fcntl(fd, F_GETLEASE);
    if (newLease == F_RDLCK) {
-      newServerLock = HGFS_LOCK_SHARED;
+      *newLock = HGFS_LOCK_SHARED;
    } else if (newLease == F_UNLCK) {
-      newServerLock = HGFS_LOCK_NONE;
-   } else if (newLease == -1) {
-      int error = errno;
-      Log("%s: Could not get old lease for fd %d: %s\n", __FUNCTION__,
-          fd, strerror(error));
-      goto error;
+      *newLock = HGFS_LOCK_NONE;
    } else {
-      Log("%s: Unexpected reply to get lease for fd %d: %d\n",
-          __FUNCTION__, fd, newLease);
-      goto error;
-   }
-
-   /*
-    * Setup a ServerLockData struct so that we can make use of
-    * HgfsServerOplockBreak which does the heavy lifting of discovering which
-    * HGFS handle we're interested in breaking, sending the break, receiving
-    * the acknowledgement, and firing the platform-specific acknowledgement
-    * function (where we'll downgrade the lease).
-    */
-   lockData = malloc(sizeof *lockData);
-   if (lockData) {
-      lockData->fileDesc = fd;
-      lockData->serverLock = newServerLock;
-      lockData->event = 0; // not needed
-
-      /*
-       * Relinquish control of this data. It'll get freed later, when the RPC
-       * command completes.
-       */
-      HgfsServerOplockBreak(lockData);
-      return;
-   } else {
-      Log("%s: Could not allocate memory for lease break on behalf of fd %d\n",
-          __FUNCTION__, fd);
+      int error = errno;
+      Log("%s: Unexpected reply to get lease for fd %d: %d (%s)\n",
+          __FUNCTION__, fileDesc, newLease,
+          newLease == -1 ? strerror(error) : "");
+      return FALSE;
    }
 
-  error:
-   /* Clean up as best we can. */
-   fcntl(fd, F_SETLEASE, F_UNLCK);
-   HgfsUpdateNodeServerLock(fd, HGFS_LOCK_NONE);
+   LOG(4, ("%s: Lease break pending for fd %d\n", __FUNCTION__, fileDesc));
+   return TRUE;
 }
 #endif /* HGFS_OPLOCKS */
 
@@ -617,10 +575,10 @@ HgfsServerGetOpenFlags(HgfsOpenFlags flagsIn, // IN
 Bool
 HgfsServerPlatformInit(void)
 {
-#ifdef HGFS_OPLOCKS
-   /* Register a signal handler to catch oplock break signals. */
-   Sig_Callback(SIGIO, SIG_SAFE, HgfsServerSigOplockBreak, NULL);
-#endif
+   /*
+    * Lease breaks are delivered by the embedding process, which owns the
+    * signal disposition; see HgfsServer_ProcessOplockBreaks.
+    */
    return TRUE;
 }
 
@@ -644,10 +602,6 @@ HgfsServerPlatformInit(void)
 void
 HgfsServerPlatformDestroy(void)
 {
-#ifdef HGFS_OPLOCKS
-   /* Tear down oplock state, so we no longer catch signals. */
-   Sig_Callback(SIGIO, SIG_NOHANDLER, NULL, NULL);
-#endif
 }
 
 
@@ -1194,6 +1148,10 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
       return TRUE;
    }
 
+   /*
+    * Only when oplocks are enabled does the embedding process handle the
+    * SIGIO that a lease break raises.
+    */
    if (!HgfsIsServerLockAllowed(session)) {
       return FALSE;
    }
@@ -4372,14 +4330,14 @@ HgfsServerWriteWin32Stream(char const *packetIn,     // IN: incoming packet
  * HgfsAckOplockBreak --
  *
  *    Platform-dependent implementation of oplock break acknowledgement.
- *    This function gets called when the oplock break rpc command is completed.
- *    The rpc oplock break command (HgfsServerOplockBreak) is in hgfsServer.c
+ *    This function gets called when the client acknowledges the oplock break
+ *    sent by HgfsServerOplockBreak (in hgfsServer.c), when the break could
+ *    not be sent, or when the client releases the lock on its own.
  *
- *    On Linux, we use fcntl() to downgrade the lease. Then we update the node
- *    cache, free the clientData, and call it a day.
+ *    On Linux, we use fcntl() to downgrade the lease.
  *
  * Results:
- *    None
+ *    The lock left on the file.
  *
  * Side effects:
  *    None
@@ -4387,41 +4345,29 @@ HgfsServerWriteWin32Stream(char const *packetIn,     // IN: incoming packet
  *-----------------------------------------------------------------------------
  */
 
-void
-HgfsAckOplockBreak(ServerLockData *lockData, // IN: server lock info
-                   HgfsServerLock replyLock) // IN: client has this lock
+HgfsServerLock
+HgfsAckOplockBreak(fileDesc fileDesc,           // IN: OS handle
+                   HgfsServerLock offeredLock,  // IN: lock the host allows
+                   HgfsServerLock replyLock)    // IN: client has this lock
 {
-   int fileDesc, newLock;
-   HgfsServerLock actualLock;
-
-   ASSERT(lockData);
-   fileDesc = lockData->fileDesc;
-   LOG(4, ("%s: Acknowledging break on fd %d\n", __FUNCTION__, fileDesc));
-
    /*
     * The Linux server supports lock downgrading. We only downgrade to a shared
-    * lock if our previous call to fcntl() said we could, and if the client
-    * wants to downgrade to a shared lock. Otherwise, we break altogether.
+    * lock if the lease break allows it, and if the client wants to downgrade
+    * to a shared lock. Otherwise, or if the kernel refuses the downgrade, we
+    * break altogether.
     */
-   if (lockData->serverLock == HGFS_LOCK_SHARED &&
-       replyLock == HGFS_LOCK_SHARED) {
-      newLock = F_RDLCK;
-      actualLock = replyLock;
-   } else {
-      newLock = F_UNLCK;
-      actualLock = HGFS_LOCK_NONE;
+   if (offeredLock == HGFS_LOCK_SHARED &&
+       replyLock == HGFS_LOCK_SHARED &&
+       fcntl(fileDesc, F_SETLEASE, F_RDLCK) == 0) {
+      return HGFS_LOCK_SHARED;
    }
 
-   /* Downgrade or acknowledge the break altogether. */
-   if (fcntl(fileDesc, F_SETLEASE, newLock) == -1) {
+   if (fcntl(fileDesc, F_SETLEASE, F_UNLCK) == -1) {
       int error = errno;
       Log("%s: Could not break lease on fd %d: %s\n",
           __FUNCTION__, fileDesc, strerror(error));
    }
-
-   /* Cleanup. */
-   HgfsUpdateNodeServerLock(fileDesc, actualLock);
-   free(lockData);
+   return HGFS_LOCK_NONE;
 }
 #endif
 
@@ -26,6 +26,8 @@
 #include <string.h>
 
 #include "vmware.h"
+#include "vm_atomic.h"
+#include "vm_basic_asm.h"
 #include "hgfsServer.h"
 #include "hgfsServerInt.h"
 #include "util.h"
@@ -33,6 +35,176 @@
 #define LOGLEVEL_MODULE hgfs
 #include "loglevel_user.h"
 
+/* Buffer statistics of all transport sessions. */
+static Atomic_uint64 hspuPoolHits;
+static Atomic_uint64 hspuPoolMisses;
+static Atomic_uint64 hspuBounceBuffers;
+static Atomic_uint64 hspuMappedInPlace;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPUPoolClass --
+ *
+ *    Get the packet pool size class of a buffer.
+ *
+ * Results:
+ *    Index of the smallest class that holds bufSize bytes, or -1 if the
+ *    buffer is too large to be pooled.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HSPUPoolClass(size_t bufSize)  // IN: Size of buffer
+{
+   size_t pages = (bufSize - 1) >> HGFS_PACKET_POOL_MIN_SHIFT;
+
+   if (pages >= (1 << (HGFS_PACKET_POOL_CLASSES - 1))) {
+      return -1;
+   }
+   return mssb32_0((uint32)pages) + 1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPUAllocBuf --
+ *
+ *    Get a buffer from the session's packet pool, or allocate one if the
+ *    pool has none of the right size.
+ *
+ * Results:
+ *    Pointer to a buffer of at least bufSize bytes.
+ *
+ * Side effects:
+ *    Buffer may be allocated.
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HSPUAllocBuf(size_t bufSize,                              // IN: Size of buffer
+             HgfsTransportSessionInfo *transportSession)  // IN: Session Info
+{
+   int sizeClass = HSPUPoolClass(bufSize);
+   void *buf;
+   int i;
+
+   if (sizeClass < 0) {
+      Atomic_Inc64(&hspuPoolMisses);
+      return Util_SafeMalloc(bufSize);
+   }
+
+   for (i = 0; i < HGFS_PACKET_POOL_DEPTH; i++) {
+      buf = Atomic_ReadWritePtr(&transportSession->packetPool.bufs[sizeClass][i],
+                                NULL);
+      if (buf != NULL) {
+         Atomic_Inc64(&hspuPoolHits);
+         return buf;
+      }
+   }
+
+   Atomic_Inc64(&hspuPoolMisses);
+   return Util_SafeMalloc((size_t)1 << (HGFS_PACKET_POOL_MIN_SHIFT + sizeClass));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPUFreeBuf --
+ *
+ *    Return a buffer obtained from HSPUAllocBuf to the session's packet
+ *    pool, or free it if the pool is full or the session is gone.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Buffer may be freed.
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HSPUFreeBuf(void *buf,                                   // IN: Buffer
+            size_t bufSize,                              // IN: Size of buffer
+            HgfsTransportSessionInfo *transportSession)  // IN: Session Info
+{
+   int sizeClass = HSPUPoolClass(bufSize);
+   int i;
+
+   if (sizeClass >= 0 && Atomic_Read(&transportSession->refCount) > 0) {
+      for (i = 0; i < HGFS_PACKET_POOL_DEPTH; i++) {
+         if (Atomic_ReadIfEqualWritePtr(&transportSession->packetPool.bufs[sizeClass][i],
+                                        NULL, buf) == NULL) {
+            return;
+         }
+      }
+   }
+   free(buf);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_DestroyPacketPool --
+ *
+ *    Free the buffers held in the session's packet pool.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HSPU_DestroyPacketPool(HgfsTransportSessionInfo *transportSession)  // IN: Session Info
+{
+   int sizeClass;
+   int i;
+
+   for (sizeClass = 0; sizeClass < HGFS_PACKET_POOL_CLASSES; sizeClass++) {
+      for (i = 0; i < HGFS_PACKET_POOL_DEPTH; i++) {
+         free(Atomic_ReadWritePtr(&transportSession->packetPool.bufs[sizeClass][i],
+                                  NULL));
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_GetBufferStats --
+ *
+ *    Get the packet buffer statistics of all transport sessions.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_GetBufferStats(HgfsServerBufferStats *stats)  // OUT: Statistics
+{
+   ASSERT(stats);
+
+   stats->poolHits = Atomic_Read64(&hspuPoolHits);
+   stats->poolMisses = Atomic_Read64(&hspuPoolMisses);
+   stats->bounceBuffers = Atomic_Read64(&hspuBounceBuffers);
+   stats->mappedInPlace = Atomic_Read64(&hspuMappedInPlace);
+}
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -90,9 +262,10 @@ HSPU_GetReplyPacket(HgfsPacket *packet,        // IN/OUT: Hgfs Packet
    } else {
       /* For sockets channel we always need to allocate buffer */
       LOG(10, ("%s Allocating reply packet\n", __FUNCTION__));
-      packet->replyPacket = Util_SafeMalloc(*replyPacketSize);
+      packet->replyPacket = HSPUAllocBuf(*replyPacketSize, transportSession);
       packet->replyPacketIsAllocated = TRUE;
       packet->replyPacketSize = *replyPacketSize;
+      packet->replyPacketBufSize = *replyPacketSize;
    }
 
    *replyPacketSize = packet->replyPacketSize;
@@ -121,10 +294,12 @@ HSPU_PutReplyPacket(HgfsPacket *packet,        // IN/OUT: Hgfs Packet
 {
    if (packet->replyPacketIsAllocated) {
       LOG(10, ("%s Freeing reply packet", __FUNCTION__));
-      free(packet->replyPacket);
+      HSPUFreeBuf(packet->replyPacket, packet->replyPacketBufSize,
+                  transportSession);
       packet->replyPacketIsAllocated = FALSE;
       packet->replyPacket = NULL;
       packet->replyPacketSize = 0;
+      packet->replyPacketBufSize = 0;
    }
 }
 
@@ -299,8 +474,9 @@ HSPU_GetBuf(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
 
       /* Seems like more than one page was requested. */
       ASSERT_DEVEL(packet->iov[startIndex].len < bufSize);
-      *buf = Util_SafeMalloc(bufSize);
+      *buf = HSPUAllocBuf(bufSize, transportSession);
       *isAllocated = TRUE;
+      Atomic_Inc64(&hspuBounceBuffers);
 
       LOG(10, ("%s: Hgfs Allocating buffer \n", __FUNCTION__));
 
@@ -324,6 +500,7 @@ HSPU_GetBuf(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
    } else {
       /* We will continue to hold on to guest mappings */
       *buf = packet->iov[startIndex].va;
+      Atomic_Inc64(&hspuMappedInPlace);
       return *buf;
    }
 
@@ -457,7 +634,7 @@ HSPU_PutBuf(HgfsPacket *packet,        // IN/OUT: Hgfs Packet
          HSPU_CopyBufToIovec(packet, startIndex, *buf, *bufSize, transportSession);
       }
       LOG(10, ("%s: Hgfs Freeing buffer \n", __FUNCTION__));
-      free(*buf);
+      HSPUFreeBuf(*buf, *bufSize, transportSession);
       *isAllocated = FALSE;
    } else {
       for (iovCount = startIndex;
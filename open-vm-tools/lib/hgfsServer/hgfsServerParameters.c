@@ -122,6 +122,7 @@ static HgfsCapability hgfsDefaultCapabilityTable[] =
    {HGFS_OP_UNLOCK_BYTE_RANGE_V4,  HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_QUERY_EAS_V4,          HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_SET_EAS_V4,            HGFS_REQUEST_NOT_SUPPORTED},
+   {HGFS_OP_COMPOUND_V4,           HGFS_REQUEST_SUPPORTED},
 };
 
 /*
@@ -317,8 +318,9 @@ HgfsParseRequest(HgfsPacket *packet,         // IN: request packet
       localInput->op = request->op;
       localInput->payloadSize = packetSize;
       localInput->id = request->id;
-   } else if (request->op < HGFS_OP_CREATE_SESSION_V4) {
-      /* V3 header. */
+   } else if (request->op < HGFS_OP_CREATE_SESSION_V4 ||
+              request->op == HGFS_OP_COMPOUND_V4) {
+      /* V3 header. A compound of V3 requests may be sent with either header. */
       if (packetSize > sizeof *request) {
          localInput->payload = HGFS_REQ_GET_PAYLOAD_V3(request);
          localInput->payloadSize = packetSize -
@@ -5884,3 +5886,335 @@ HgfsPackChangeNotificationRequest(void *packet,                    // IN/OUT: Hg
 
    return result;
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackCompoundRequest --
+ *
+ *    Unpack hgfs compound request header and locate its sub-request entries.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackCompoundRequest(void const *packet,      // IN: HGFS packet
+                          size_t packetSize,       // IN: request packet size
+                          uint32 *count,           // OUT: number of entries
+                          uint32 *flags,           // OUT: compound flags
+                          size_t *maxReplySize,    // OUT: reply size limit or 0
+                          void const **entries,    // OUT: first entry
+                          size_t *entriesSize)     // OUT: size of all entries
+{
+   HgfsRequestCompoundV4 const *request = packet;
+
+   ASSERT(packet);
+
+   if (packetSize < sizeof *request) {
+      LOG(4, ("%s: HGFS packet too small\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   if (request->count > HGFS_COMPOUND_MAX_ENTRIES) {
+      LOG(4, ("%s: Too many sub-requests %u\n", __FUNCTION__, request->count));
+      return FALSE;
+   }
+
+   *count = request->count;
+   *flags = request->flags;
+   *maxReplySize = request->maxReplySize;
+   *entries = request + 1;
+   *entriesSize = packetSize - sizeof *request;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackCompoundEntry --
+ *
+ *    Unpack the compound sub-request entry at *offset and advance the
+ *    offset to the next entry.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE if the entry does not fit in the remaining packet.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackCompoundEntry(void const *entries,       // IN: compound entries
+                        size_t entriesSize,        // IN: size of all entries
+                        size_t *offset,            // IN/OUT: offset of the entry
+                        HgfsOp *op,                // OUT: sub-request opcode
+                        void const **payload,      // OUT: sub-request payload
+                        size_t *payloadSize)       // OUT: sub-request payload size
+{
+   HgfsCompoundEntryV4 const *entry;
+   size_t remaining;
+
+   ASSERT(*offset <= entriesSize);
+
+   remaining = entriesSize - *offset;
+   if (remaining < sizeof *entry) {
+      LOG(4, ("%s: HGFS packet too small\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   entry = (HgfsCompoundEntryV4 const *)((char const *)entries + *offset);
+   if (entry->size > remaining - sizeof *entry) {
+      LOG(4, ("%s: Sub-request is larger than the packet\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   *op = entry->op;
+   *payload = entry + 1;
+   *payloadSize = entry->size;
+   *offset += MIN(sizeof *entry + HGFS_COMPOUND_ALIGN(entry->size), remaining);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerLock2Oplock --
+ *
+ *    Convert a server lock into the oplock type used by V4 lock requests.
+ *
+ * Results:
+ *    The oplock type.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsOpportunisticLock
+HgfsServerLock2Oplock(HgfsServerLock serverLock)  // IN: server lock
+{
+   switch (serverLock) {
+   case HGFS_LOCK_SHARED:
+      return HGFS_OPLOCK_SHARED;
+   case HGFS_LOCK_EXCLUSIVE:
+      return HGFS_OPLOCK_EXCLUSIVE;
+   default:
+      return HGFS_OPLOCK_NONE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplock2ServerLock --
+ *
+ *    Convert an oplock type used by V4 lock requests into a server lock.
+ *
+ * Results:
+ *    The server lock.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsServerLock
+HgfsOplock2ServerLock(HgfsOpportunisticLock oplock)  // IN: oplock
+{
+   switch (oplock) {
+   case HGFS_OPLOCK_SHARED:
+      return HGFS_LOCK_SHARED;
+   case HGFS_OPLOCK_EXCLUSIVE:
+   case HGFS_OPLOCK_BATCH:
+      return HGFS_LOCK_EXCLUSIVE;
+   default:
+      return HGFS_LOCK_NONE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackOplockBreakRequest --
+ *
+ *    Pack the request the server sends to revoke or downgrade the oplock
+ *    a client holds on a file.
+ *
+ * Results:
+ *    TRUE if the request fits in the buffer, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackOplockBreakRequest(void *packet,               // IN/OUT: Hgfs Packet
+                           HgfsHandle handle,          // IN: file losing the lock
+                           HgfsServerLock serverLock,  // IN: lock left to the client
+                           HgfsSessionInfo *session,   // IN: session
+                           size_t *bufferSize)         // IN/OUT: packet size
+{
+   HgfsHeader *header = packet;
+   HgfsRequestOplockBreakV4 *request;
+
+   ASSERT(packet);
+   ASSERT(session);
+   ASSERT(bufferSize);
+
+   if (*bufferSize < sizeof *header + sizeof *request) {
+      return FALSE;
+   }
+
+   request = (HgfsRequestOplockBreakV4 *)(header + 1);
+   request->fid = handle;
+   request->serverLock = HgfsServerLock2Oplock(serverLock);
+   request->reserved = 0;
+
+   HgfsPackReplyHeaderV4(0, sizeof *request, HGFS_OP_OPLOCK_BREAK_V4,
+                         session->sessionId, 0, header);
+   *bufferSize = sizeof *header + sizeof *request;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackServerLockChangeRequest --
+ *
+ *    Unpack the request a client sends to change the oplock it holds on a
+ *    file, either on its own or to acknowledge an oplock break.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackServerLockChangeRequest(void const *packet,         // IN: HGFS packet
+                                  size_t packetSize,          // IN: request packet size
+                                  HgfsOp op,                  // IN: request type
+                                  HgfsHandle *file,           // OUT: file handle
+                                  HgfsServerLock *serverLock) // OUT: lock kept
+{
+   ASSERT(packet);
+   ASSERT(file);
+   ASSERT(serverLock);
+
+   switch (op) {
+   case HGFS_OP_SERVER_LOCK_CHANGE_V3: {
+      HgfsRequestServerLockChangeV2 const *requestV3 = packet;
+
+      if (packetSize < sizeof *requestV3) {
+         LOG(4, ("%s: Too small HGFS packet\n", __FUNCTION__));
+         return FALSE;
+      }
+      *file = requestV3->fid;
+      *serverLock = HgfsOplock2ServerLock(requestV3->serverLock);
+      break;
+   }
+   case HGFS_OP_SERVER_LOCK_CHANGE: {
+      HgfsRequestServerLockChange const *request = packet;
+
+      if (packetSize < sizeof *request) {
+         LOG(4, ("%s: Too small HGFS packet\n", __FUNCTION__));
+         return FALSE;
+      }
+      *file = request->file;
+      *serverLock = request->newServerLock;
+      break;
+   }
+   default:
+      NOT_REACHED();
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackServerLockChangeReply --
+ *
+ *    Pack the reply to a server lock change request.
+ *
+ * Results:
+ *    TRUE if successfully allocated reply request, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackServerLockChangeReply(HgfsPacket *packet,          // IN/OUT: Hgfs Packet
+                              char const *packetHeader,    // IN: packet header
+                              HgfsOp op,                   // IN: request type
+                              HgfsServerLock serverLock,   // IN: lock held
+                              size_t *payloadSize,         // OUT: size of packet
+                              HgfsSessionInfo *session)    // IN: Session info
+{
+   Bool result;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   *payloadSize = 0;
+
+   switch (op) {
+   case HGFS_OP_SERVER_LOCK_CHANGE_V3: {
+      HgfsReplyServerLockChangeV2 *reply;
+
+      result = HgfsAllocInitReply(packet, packetHeader, sizeof *reply,
+                                  (void **)&reply, session);
+      if (result) {
+         reply->serverLock = HgfsServerLock2Oplock(serverLock);
+         reply->reserved = 0;
+         *payloadSize = sizeof *reply;
+      }
+      break;
+   }
+   case HGFS_OP_SERVER_LOCK_CHANGE: {
+      HgfsReplyServerLockChange *reply;
+
+      result = HgfsAllocInitReply(packet, packetHeader, sizeof *reply,
+                                  (void **)&reply, session);
+      if (result) {
+         reply->serverLock = serverLock;
+         *payloadSize = sizeof *reply;
+      }
+      break;
+   }
+   default:
+      NOT_REACHED();
+      result = FALSE;
+   }
+
+   return result;
+}
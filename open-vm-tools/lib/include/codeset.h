@@ -380,6 +380,12 @@ int CodeSet_GetUtf8(const char *string,
                     const char *end,
                     uint32 *uchar);
 
+size_t CodeSet_AsciiPrefixLength(const char *bufIn,
+                                 size_t sizeIn);
+
+Bool CodeSet_IsValidUTF8(const char *bufIn,
+                         size_t sizeIn);
+
 
 /*
  *-----------------------------------------------------------------------------
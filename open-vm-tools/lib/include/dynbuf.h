@@ -30,12 +30,38 @@
 #include "vm_assert.h"
 
 
+struct iovec;
+
 typedef struct DynBuf {
    char *data;
    size_t size;
    size_t allocated;
+   unsigned int growth;   // Percentage growth past 256KB, 0 is linear
 } DynBuf;
 
+/*
+ * Growth policies for large buffers. Geometric growth keeps the cost of
+ * building a buffer linear in its final size; linear growth by 256KB steps
+ * wastes less memory but copies the buffer over and over.
+ */
+#define DYNBUF_GROWTH_LINEAR   0
+#define DYNBUF_GROWTH_DEFAULT  50
+#define DYNBUF_GROWTH_MAX      100
+
+/*
+ * A chunked dynamic buffer. Appending never moves data already in the
+ * buffer, and the content can be handed to writev() and friends as an iovec
+ * without being flattened.
+ */
+typedef struct DynRopeChunk DynRopeChunk;
+
+typedef struct DynRope {
+   DynRopeChunk *head;
+   DynRopeChunk *tail;
+   size_t size;
+   size_t numChunks;
+} DynRope;
+
 
 void
 DynBuf_Init(DynBuf *b); // IN
@@ -80,6 +106,34 @@ DynBuf_SafeInternalAppend(DynBuf *b,            // IN
 #define DynBuf_SafeAppend(_buf, _data, _size) \
    DynBuf_SafeInternalAppend(_buf, _data, _size, __FILE__, __LINE__)
 
+void
+DynBuf_SetGrowth(DynBuf *b,             // IN/OUT
+                 unsigned int growth);  // IN
+
+void
+DynRope_Init(DynRope *r); // OUT
+
+void
+DynRope_Destroy(DynRope *r); // IN/OUT
+
+Bool
+DynRope_Append(DynRope *r,       // IN/OUT
+               void const *data, // IN
+               size_t size);     // IN
+
+Bool
+DynRope_AppendDynBuf(DynRope *r,  // IN/OUT
+                     DynBuf *b);  // IN/OUT
+
+size_t
+DynRope_GetIOV(DynRope const *r,    // IN
+               struct iovec *iov,   // OUT
+               size_t maxEntries);  // IN
+
+Bool
+DynRope_Flatten(DynRope const *r,  // IN
+                DynBuf *b);        // IN/OUT
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -233,4 +287,63 @@ DynBuf_AppendString(DynBuf *buf,         // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRope_GetSize --
+ *
+ *      Returns the number of bytes stored in the chunked buffer.
+ *
+ * Results:
+ *      The size of the chunked buffer.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#if defined(SWIG)
+static size_t
+#else
+static INLINE size_t
+#endif
+DynRope_GetSize(DynRope const *r) // IN
+{
+   ASSERT(r);
+
+   return r->size;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRope_GetNumChunks --
+ *
+ *      Returns the number of chunks of the buffer, which is the number of
+ *      iovec entries DynRope_GetIOV needs.
+ *
+ * Results:
+ *      The number of chunks.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#if defined(SWIG)
+static size_t
+#else
+static INLINE size_t
+#endif
+DynRope_GetNumChunks(DynRope const *r) // IN
+{
+   ASSERT(r);
+
+   return r->numChunks;
+}
+
+
 #endif /* __DYNBUF_H__ */
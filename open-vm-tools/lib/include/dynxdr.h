@@ -40,6 +40,8 @@
 
 XDR *DynXdr_Create(XDR *in);
 Bool DynXdr_AppendRaw(XDR *xdrs, const void *buf, size_t len);
+Bool DynXdr_Reserve(XDR *xdrs, size_t len);
+void DynXdr_Reset(XDR *xdrs);
 void *DynXdr_AllocGet(XDR *xdrs);
 void *DynXdr_Get(XDR *xdrs);
 void DynXdr_Destroy(XDR *xdrs, Bool release);
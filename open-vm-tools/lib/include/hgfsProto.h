@@ -146,6 +146,7 @@ typedef enum {
    HGFS_OP_UNLOCK_BYTE_RANGE_V4,  /* Release byte range lock. */
    HGFS_OP_QUERY_EAS_V4,          /* Query extended attributes. */
    HGFS_OP_SET_EAS_V4,            /* Add or modify extended attributes. */
+   HGFS_OP_COMPOUND_V4,           /* Run a sequence of V3 requests in one packet. */
 
    HGFS_OP_MAX,                   /* Dummy op, must be last in enum */
 } HgfsOp;
@@ -2661,4 +2662,76 @@ struct HgfsReplyDeleteFileV4 {
 #include "vmware_pack_end.h"
 HgfsReplyDeleteFileV4;
 
+/*
+ * A compound request carries a sequence of V3 requests (open, read, write,
+ * close, getattr) which the server runs back to back, returning all the
+ * replies in one packet. Unlike other V4 operations it may also be sent
+ * with a V3 request header, in which case it runs in the default session.
+ *
+ * The request payload is an HgfsRequestCompoundV4 followed by count
+ * entries, each an HgfsCompoundEntryV4 followed by the sub-request payload
+ * (without its HgfsRequest header) padded to HGFS_COMPOUND_ALIGN. The
+ * reply payload has the same layout with HgfsReplyCompoundV4 and
+ * HgfsCompoundReplyEntryV4.
+ *
+ * A file handle of HGFS_COMPOUND_LAST_HANDLE in a read, write, close or
+ * getattr (with HGFS_FILE_NAME_USE_FILE_DESC) sub-request is replaced by
+ * the handle returned by the last successful open of the same compound.
+ *
+ * Once a sub-request fails the remaining ones are skipped, except for
+ * closes which always run so that a handle opened by the compound is not
+ * leaked. HGFS_COMPOUND_CONTINUE_ON_ERROR runs every sub-request instead,
+ * e.g. for a chain of getattrs. Skipped sub-requests have no reply entry.
+ */
+
+#define HGFS_COMPOUND_MAX_ENTRIES        16
+#define HGFS_COMPOUND_LAST_HANDLE        ((HgfsHandle)~((HgfsHandle)1))
+#define HGFS_COMPOUND_ALIGN(size)        (((size) + 7) & ~((size_t)7))
+
+/* HgfsRequestCompoundV4 flags. */
+#define HGFS_COMPOUND_CONTINUE_ON_ERROR  (1 << 0)
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsRequestCompoundV4 {
+   uint32 count;           /* Number of sub-requests which follow. */
+   uint32 flags;           /* Flags, see above. */
+   uint32 maxReplySize;    /* Largest reply payload the client accepts, or 0. */
+   uint32 reserved1;       /* Reserved for future use. */
+   uint64 reserved;        /* Reserved for future use. */
+}
+#include "vmware_pack_end.h"
+HgfsRequestCompoundV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsCompoundEntryV4 {
+   uint32 op;              /* HGFS_OP_XXX_V3 of the sub-request. */
+   uint32 size;            /* Size of the sub-request payload which follows. */
+   uint64 reserved;        /* Reserved for future use. */
+}
+#include "vmware_pack_end.h"
+HgfsCompoundEntryV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsReplyCompoundV4 {
+   uint32 count;           /* Number of reply entries which follow. */
+   uint32 reserved1;       /* Reserved for future use. */
+   uint64 reserved;        /* Reserved for future use. */
+}
+#include "vmware_pack_end.h"
+HgfsReplyCompoundV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsCompoundReplyEntryV4 {
+   uint32 index;           /* Index of the sub-request in the compound. */
+   uint32 op;              /* HGFS_OP_XXX_V3 of the sub-request. */
+   HgfsStatus status;      /* Status of the sub-request. */
+   uint32 size;            /* Size of the sub-reply payload which follows. */
+}
+#include "vmware_pack_end.h"
+HgfsCompoundReplyEntryV4;
+
 #endif /* _HGFS_PROTO_H_ */
@@ -83,6 +83,8 @@ struct HgfsPacket {
    void *replyPacket;
    size_t replyPacketSize;
    Bool replyPacketIsAllocated;
+   /* Size the reply buffer was allocated with, the reply may be shorter. */
+   size_t replyPacketBufSize;
 
    uint32 iovCount;
    HgfsVmxIov iov[1];
@@ -146,6 +148,52 @@ void HgfsServer_ExitState(void);
 uint32 HgfsServer_GetHandleCounter(void);
 void HgfsServer_SetHandleCounter(uint32 newHandleCounter);
 
+/*
+ * Per-op statistics, indexed by HgfsOp. Latencies are in nanoseconds and
+ * are bucketed by powers of two: bucket 0 counts the requests served in
+ * less than 1us, bucket i (i > 0) those served in [2^(9+i), 2^(10+i)) ns
+ * and the last bucket everything slower.
+ */
+
+#define HGFS_OP_STATS_BUCKETS  24
+
+typedef struct HgfsServerOpStats {
+   uint64 count;
+   uint64 errors;
+   uint64 bytesIn;       // request packet bytes
+   uint64 bytesOut;      // reply packet bytes
+   uint64 totalTime;
+   uint64 maxTime;
+   uint64 latency[HGFS_OP_STATS_BUCKETS];
+} HgfsServerOpStats;
+
+void HgfsServer_EnableOpStats(Bool enable);
+Bool HgfsServer_OpStatsEnabled(void);
+void HgfsServer_GetOpStats(HgfsServerOpStats *stats, uint32 numOps);
+
+/*
+ * Oplocks are off by default. A process that enables them has to call
+ * HgfsServer_ProcessOplockBreaks from its main loop whenever the host file
+ * system signals a lease break (SIGIO on Linux).
+ */
+
+void HgfsServer_EnableOplocks(Bool enable);
+void HgfsServer_ProcessOplockBreaks(void);
+
+/*
+ * Packet buffer statistics. Every pool hit is a malloc/free pair avoided,
+ * every in place mapping a copy through a bounce buffer avoided.
+ */
+
+typedef struct HgfsServerBufferStats {
+   uint64 poolHits;        // buffers reused from a session pool
+   uint64 poolMisses;      // buffers allocated
+   uint64 bounceBuffers;   // packets gathered from several iovs
+   uint64 mappedInPlace;   // packets used directly in guest memory
+} HgfsServerBufferStats;
+
+void HgfsServer_GetBufferStats(HgfsServerBufferStats *stats);
+
 /*
  * Function pointers used for getting names in HgfsServerGetDents
  *
@@ -63,11 +63,14 @@
  * hgfs locks
  */
 #define RANK_hgfsSessionArrayLock    (RANK_libLockBase + 0x4010)
+#define RANK_hgfsNotifyDispatchLock  (RANK_libLockBase + 0x4020)
 #define RANK_hgfsSharedFolders       (RANK_libLockBase + 0x4030)
 #define RANK_hgfsNotifyLock          (RANK_libLockBase + 0x4040)
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
 #define RANK_hgfsSearchArrayLock     (RANK_libLockBase + 0x4060)
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
+#define RANK_hgfsOpStatsLock         (RANK_libLockBase + 0x4080)
+#define RANK_hgfsOplockLock          (RANK_libLockBase + 0x4090)
 
 /*
  * SLPv2 global lock
@@ -229,6 +229,38 @@ Bool MXUser_IsCurThreadHoldingLocks(void);
 void MXUser_StatisticsControl(double contentionRatio,
                               uint64 minCount);
 
+/*
+ * Structured lock statistics, see MXUser_ForEachLockStats. Times are in
+ * nanoseconds; the percentiles stay zero until the lock has a histogram.
+ */
+
+typedef struct {
+   uint64  numSamples;
+   uint64  minTime;
+   uint64  maxTime;
+   uint64  meanTime;
+   uint64  p50Time;
+   uint64  p99Time;
+} MXUserTimeStats;
+
+typedef struct {
+   const char       *name;
+   uint32            serialNumber;
+   MX_Rank           rank;
+   uint64            numAttempts;
+   uint64            numSuccesses;
+   uint64            numSuccessesContended;
+   uint64            totalContentionTime;
+   double            contentionRatio;
+   MXUserTimeStats   acquire;      // time spent acquiring
+   MXUserTimeStats   held;         // time held
+} MXUserLockStats;
+
+Bool MXUser_EnableStats(Bool trackHeldTimes);
+void MXUser_ForEachLockStats(void (*func)(void *clientData,
+                                          const MXUserLockStats *stats),
+                             void *clientData);
+
 void MXUser_PerLockData(void);
 void MXUser_SetStatsFunc(void *context,
                          uint32 maxLineLength,
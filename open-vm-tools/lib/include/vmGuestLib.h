@@ -459,6 +459,71 @@ VMGuestLib_GetHostMemMappedMB(VMGuestLibHandle handle,  // IN
 VMGuestLibError
 VMGuestLib_GetHostMemUnmappedMB(VMGuestLibHandle handle,    // IN
                                 uint64 *hostMemUnmappedMB); // OUT
+
+
+/*
+ * Batch retrieval of the integral statistics.
+ *
+ * VMGuestLib_GetStats() fills 'stats', indexed by VMGuestLibStatId, with
+ * all the statistics from the last VMGuestLib_UpdateInfo() call in one
+ * pass, instead of one call per statistic. Entries for statistics the host
+ * did not provide, or past the end of the array, are left invalid. Only
+ * supported by hosts speaking the v3 protocol.
+ *
+ * The resource pool path is not an integral statistic; use
+ * VMGuestLib_GetResourcePoolPath() for it.
+ */
+
+typedef enum {
+   VMGUESTLIB_STAT_CPU_RESERVATION_MHZ     = 1,
+   VMGUESTLIB_STAT_CPU_LIMIT_MHZ           = 2,
+   VMGUESTLIB_STAT_CPU_SHARES              = 3,
+   VMGUESTLIB_STAT_CPU_USED_MS             = 4,
+   VMGUESTLIB_STAT_HOST_MHZ                = 5,
+   VMGUESTLIB_STAT_MEM_RESERVATION_MB      = 6,
+   VMGUESTLIB_STAT_MEM_LIMIT_MB            = 7,
+   VMGUESTLIB_STAT_MEM_SHARES              = 8,
+   VMGUESTLIB_STAT_MEM_MAPPED_MB           = 9,
+   VMGUESTLIB_STAT_MEM_ACTIVE_MB           = 10,
+   VMGUESTLIB_STAT_MEM_OVERHEAD_MB         = 11,
+   VMGUESTLIB_STAT_MEM_BALLOONED_MB        = 12,
+   VMGUESTLIB_STAT_MEM_SWAPPED_MB          = 13,
+   VMGUESTLIB_STAT_MEM_SHARED_MB           = 14,
+   VMGUESTLIB_STAT_MEM_SHARED_SAVED_MB     = 15,
+   VMGUESTLIB_STAT_MEM_USED_MB             = 16,
+   VMGUESTLIB_STAT_ELAPSED_MS              = 17,
+   /* 18 is the resource pool path. */
+   VMGUESTLIB_STAT_CPU_STOLEN_MS           = 19,
+   VMGUESTLIB_STAT_MEM_TARGET_SIZE_MB      = 20,
+   VMGUESTLIB_STAT_HOST_CPU_NUM_CORES      = 21,
+   VMGUESTLIB_STAT_HOST_CPU_USED_MS        = 22,
+   VMGUESTLIB_STAT_HOST_MEM_SWAPPED_MB     = 23,
+   VMGUESTLIB_STAT_HOST_MEM_SHARED_MB      = 24,
+   VMGUESTLIB_STAT_HOST_MEM_USED_MB        = 25,
+   VMGUESTLIB_STAT_HOST_MEM_PHYS_MB        = 26,
+   VMGUESTLIB_STAT_HOST_MEM_PHYS_FREE_MB   = 27,
+   VMGUESTLIB_STAT_HOST_MEM_KERN_OVHD_MB   = 28,
+   VMGUESTLIB_STAT_HOST_MEM_MAPPED_MB      = 29,
+   VMGUESTLIB_STAT_HOST_MEM_UNMAPPED_MB    = 30,
+   VMGUESTLIB_STAT_MEM_ZIPPED_MB           = 31,
+   VMGUESTLIB_STAT_MEM_ZIPSAVED_MB         = 32,
+   VMGUESTLIB_STAT_MEM_LLSWAPPED_MB        = 33,
+   VMGUESTLIB_STAT_MEM_SWAP_TARGET_MB      = 34,
+   VMGUESTLIB_STAT_MEM_BALLOON_TARGET_MB   = 35,
+   VMGUESTLIB_STAT_MEM_BALLOON_MAX_MB      = 36,
+   VMGUESTLIB_STAT_MAX                          // Size of a full stats array
+} VMGuestLibStatId;
+
+typedef struct {
+   Bool valid;
+   uint64 value;
+} VMGuestLibStat;
+
+VMGuestLibError
+VMGuestLib_GetStats(VMGuestLibHandle handle,   // IN
+                    VMGuestLibStat *stats,     // OUT
+                    uint32 numStats);          // IN
+
 #ifdef __cplusplus
 }
 #endif
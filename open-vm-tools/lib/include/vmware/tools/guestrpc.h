@@ -212,6 +212,11 @@ RpcChannel_BuildXdrCommand(const char *cmd,
                            char **result,
                            size_t *resultLen);
 
+gboolean
+RpcChannel_SetGuestInfo(RpcChannel *chan,
+                        const char *key,
+                        const char *value);
+
 RpcChannel *
 RpcChannel_Create(void);
 
@@ -0,0 +1,185 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _VMWARE_TOOLS_METRICS_H_
+#define _VMWARE_TOOLS_METRICS_H_
+
+/**
+ * @file metrics.h
+ *
+ * Public interface for vmtoolsd's metrics registry.
+ *
+ * @defgroup vmtools_metrics  Metrics
+ * @brief Counters, gauges and histograms exported by the service.
+ * @{
+ *
+ * vmtoolsd provides a registry of metrics that plugins can use to expose
+ * statistics about what they're doing. The registry is exported through a
+ * memory-mapped file (see metricsDefs.h), so external agents can read the
+ * metrics without talking to the service; "vmware-toolbox-cmd stat metrics"
+ * prints them.
+ *
+ * Plugins should look up their metrics once, usually when loading, and keep
+ * the returned pointers around; updating a metric is then just an atomic
+ * operation. Metric names should be prefixed with the plugin's name (e.g.,
+ * "timeSync.syncs"). Looking up a name that's already registered returns
+ * the existing metric, if the type matches.
+ *
+ * Lookups may fail (for example, if the registry is full), in which case
+ * NULL is returned. The update functions accept NULL metrics, so plugins
+ * don't need to check.
+ */
+
+#include <glib-object.h>
+#include "vmware/tools/plugin.h"
+#include "vmware/tools/metricsDefs.h"
+
+#define TOOLS_CORE_PROP_METRICS "tcs_prop_metrics"
+
+/**
+ * @brief Public interface of the metrics registry.
+ *
+ * This struct is published in the service's TOOLS_CORE_PROP_METRICS property.
+ * Applications should use the inline functions provided below instead of
+ * calling the function pointers directly.
+ */
+typedef struct ToolsCoreMetrics {
+   ToolsMetric *(*lookup)(ToolsAppCtx *ctx,
+                          const gchar *name,
+                          ToolsMetricType type);
+} ToolsCoreMetrics;
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMetrics_GetRegistry --                                        */ /**
+ *
+ * @brief Returns the metrics registry of the service.
+ *
+ * @param[in] ctx Application context.
+ *
+ * @return The metrics registry, or NULL if it's not available.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC ToolsCoreMetrics *
+ToolsCoreMetrics_GetRegistry(ToolsAppCtx *ctx)
+{
+   ToolsCoreMetrics *metrics = NULL;
+   g_object_get(ctx->serviceObj, TOOLS_CORE_PROP_METRICS, &metrics, NULL);
+   return metrics;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMetrics_Lookup --                                             */ /**
+ *
+ * @brief Looks up a metric, registering it if needed.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] name   Name of the metric.
+ * @param[in] type   Type of the metric.
+ *
+ * @return The metric, or NULL on error.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC ToolsMetric *
+ToolsCoreMetrics_Lookup(ToolsAppCtx *ctx,
+                        const gchar *name,
+                        ToolsMetricType type)
+{
+   ToolsCoreMetrics *metrics = ToolsCoreMetrics_GetRegistry(ctx);
+   if (metrics != NULL) {
+      return metrics->lookup(ctx, name, type);
+   }
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMetrics_GetCounter --                                         */ /**
+ *
+ * @brief Looks up a counter, registering it if needed.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] name   Name of the counter.
+ *
+ * @return The counter, or NULL on error.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC ToolsMetric *
+ToolsCoreMetrics_GetCounter(ToolsAppCtx *ctx,
+                            const gchar *name)
+{
+   return ToolsCoreMetrics_Lookup(ctx, name, TOOLS_METRIC_COUNTER);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMetrics_GetGauge --                                           */ /**
+ *
+ * @brief Looks up a gauge, registering it if needed.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] name   Name of the gauge.
+ *
+ * @return The gauge, or NULL on error.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC ToolsMetric *
+ToolsCoreMetrics_GetGauge(ToolsAppCtx *ctx,
+                          const gchar *name)
+{
+   return ToolsCoreMetrics_Lookup(ctx, name, TOOLS_METRIC_GAUGE);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMetrics_GetHistogram --                                       */ /**
+ *
+ * @brief Looks up a histogram, registering it if needed.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] name   Name of the histogram.
+ *
+ * @return The histogram, or NULL on error.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC ToolsMetric *
+ToolsCoreMetrics_GetHistogram(ToolsAppCtx *ctx,
+                              const gchar *name)
+{
+   return ToolsCoreMetrics_Lookup(ctx, name, TOOLS_METRIC_HISTOGRAM);
+}
+
+/** @} */
+
+#endif /* _VMWARE_TOOLS_METRICS_H_ */
@@ -0,0 +1,225 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _VMWARE_TOOLS_METRICSDEFS_H_
+#define _VMWARE_TOOLS_METRICSDEFS_H_
+
+/**
+ * @file metricsDefs.h
+ *
+ * Layout of vmtoolsd's metrics file, and functions to update metrics.
+ *
+ * @addtogroup vmtools_metrics
+ * @{
+ *
+ * The metrics registry is a file mapped into the service's memory, made of a
+ * header followed by an array of fixed-size metric slots. Slots are only ever
+ * appended: the service fills in a slot's name and type, and then bumps the
+ * count in the header, so readers only need to look at the first "count"
+ * slots to see fully registered metrics.
+ *
+ * Metric values are updated with atomic operations directly on the mapped
+ * file, so updates never block. Readers may see a histogram's sample count,
+ * sum and buckets at slightly different points in time.
+ *
+ * This header doesn't depend on glib, so that it can be used by readers of
+ * the metrics file that are not part of vmtoolsd.
+ */
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "vm_basic_asm.h"
+#include "vm_atomic.h"
+
+/** Magic number identifying a metrics file ("VMTM"). */
+#define TOOLS_METRICS_MAGIC         0x4d544d56
+
+/** Current version of the metrics file layout. */
+#define TOOLS_METRICS_VERSION       1
+
+/** Maximum length of a metric name, including the terminating NUL. */
+#define TOOLS_METRICS_NAME_LEN      48
+
+/** Number of buckets in histograms. */
+#define TOOLS_METRICS_HIST_BUCKETS  32
+
+/** Directory where vmtoolsd exports its metrics files. */
+#define TOOLS_METRICS_DIR           "/run/vmware-tools"
+
+/** Suffix of metrics files; the file is named after the service. */
+#define TOOLS_METRICS_SUFFIX        ".metrics"
+
+/** Types of metrics. */
+typedef enum ToolsMetricType {
+   TOOLS_METRIC_NONE       = 0,
+   /** Monotonically increasing count. */
+   TOOLS_METRIC_COUNTER    = 1,
+   /** Signed value that can go up and down. */
+   TOOLS_METRIC_GAUGE      = 2,
+   /** Distribution of values, in power-of-two buckets. */
+   TOOLS_METRIC_HISTOGRAM  = 3,
+} ToolsMetricType;
+
+
+/**
+ * A metric slot in the metrics file.
+ *
+ * For counters and gauges, @a value holds the current value; gauges are to
+ * be read as signed. For histograms, @a value holds the number of samples,
+ * @a sum their sum, and bucket @a i the number of samples in the range
+ * [2^(i-1), 2^i). Bucket 0 counts zero samples, and the last bucket also
+ * counts all samples larger than its range.
+ */
+typedef struct ToolsMetric {
+   char           name[TOOLS_METRICS_NAME_LEN];
+   uint32         type;
+   uint32         reserved;
+   Atomic_uint64  value;
+   Atomic_uint64  sum;
+   Atomic_uint64  buckets[TOOLS_METRICS_HIST_BUCKETS];
+} ToolsMetric;
+
+
+/** Header of the metrics file. */
+typedef struct ToolsMetricsHeader {
+   uint32         magic;
+   uint32         version;
+   uint32         metricSize;
+   uint32         capacity;
+   Atomic_uint32  count;
+   uint32         pid;
+   uint64         startTime;
+} ToolsMetricsHeader;
+
+
+/*
+ *******************************************************************************
+ * ToolsMetric_Add --                                                     */ /**
+ *
+ * @brief Adds a value to a counter or gauge.
+ *
+ * Negative deltas can be used with gauges. Does nothing if @a metric is NULL,
+ * so callers don't need to check whether the metric could be registered.
+ *
+ * @param[in] metric The metric.
+ * @param[in] delta  Value to add.
+ *
+ *******************************************************************************
+ */
+
+static INLINE void
+ToolsMetric_Add(ToolsMetric *metric,
+                int64 delta)
+{
+   if (metric != NULL) {
+      Atomic_Add64(&metric->value, (uint64) delta);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsMetric_Inc --                                                     */ /**
+ *
+ * @brief Increments a counter or gauge.
+ *
+ * @param[in] metric The metric.
+ *
+ *******************************************************************************
+ */
+
+static INLINE void
+ToolsMetric_Inc(ToolsMetric *metric)
+{
+   if (metric != NULL) {
+      Atomic_Inc64(&metric->value);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsMetric_Set --                                                     */ /**
+ *
+ * @brief Sets the value of a gauge.
+ *
+ * @param[in] metric The metric.
+ * @param[in] value  New value.
+ *
+ *******************************************************************************
+ */
+
+static INLINE void
+ToolsMetric_Set(ToolsMetric *metric,
+                int64 value)
+{
+   if (metric != NULL) {
+      Atomic_Write64(&metric->value, (uint64) value);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsMetric_Bucket --                                                  */ /**
+ *
+ * @brief Returns the histogram bucket for a sample.
+ *
+ * @param[in] value  The sample.
+ *
+ * @return Index of the bucket counting the sample.
+ *
+ *******************************************************************************
+ */
+
+static INLINE uint32
+ToolsMetric_Bucket(uint64 value)
+{
+   if (value == 0) {
+      return 0;
+   }
+   return MIN((uint32) mssb64_0(value) + 1, TOOLS_METRICS_HIST_BUCKETS - 1);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsMetric_Observe --                                                 */ /**
+ *
+ * @brief Adds a sample to a histogram.
+ *
+ * @param[in] metric The metric.
+ * @param[in] value  The sample.
+ *
+ *******************************************************************************
+ */
+
+static INLINE void
+ToolsMetric_Observe(ToolsMetric *metric,
+                    uint64 value)
+{
+   if (metric != NULL) {
+      Atomic_Inc64(&metric->buckets[ToolsMetric_Bucket(value)]);
+      Atomic_Add64(&metric->sum, value);
+      Atomic_Inc64(&metric->value);
+   }
+}
+
+/** @} */
+
+#endif /* _VMWARE_TOOLS_METRICSDEFS_H_ */
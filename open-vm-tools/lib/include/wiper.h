@@ -48,6 +48,13 @@ typedef enum {
    PARTITION_ZFS,
 } WiperPartition_Type;
 
+/* Ways to reclaim the free space of a partition, from slowest to fastest */
+typedef enum {
+   WIPER_BACKEND_ZERO_FILL = 0,  /* Fill free space with zeroed files */
+   WIPER_BACKEND_PUNCH_HOLE,     /* Allocate free space and punch holes in it */
+   WIPER_BACKEND_TRIM,           /* Ask the filesystem to discard free space */
+} WiperBackend;
+
 /* Max size of a path */
 #define NATIVE_MAX_PATH 256
 #define MAX_WIPER_FILE_SIZE (2 << 30)   /* The maximum wiper file size in bytes */
@@ -73,6 +80,9 @@ typedef struct WiperPartition {
 #if defined(_WIN32)
    /* Private flags used by the Win32 implementation */
    DWORD flags;
+#else
+   /* Private flags used by the POSIX implementation */
+   uint32 flags;
 #endif
 
    DblLnkLst_Links link;
@@ -107,6 +117,12 @@ typedef struct Wiper_State Wiper_State;
 
 Wiper_State *Wiper_Start(const WiperPartition *p, unsigned int maxWiperFileSize);
 
+#if !defined(_WIN32)
+WiperBackend Wiper_GetBestBackend(const WiperPartition *p);
+Wiper_State *Wiper_StartWithBackend(const WiperPartition *p,
+                                    WiperBackend backend);
+#endif
+
 unsigned char *Wiper_Next(Wiper_State **s, unsigned int *progress);
 unsigned char *Wiper_Cancel(Wiper_State **s);
 
@@ -149,7 +149,7 @@ MXUser_ControlExclLock(MXUserExclLock *lock,  // IN/OUT:
 
    switch (command) {
    case MXUSER_CONTROL_ACQUISITION_HISTO: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserAcquireStats *acquireStats;
 
          acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
@@ -180,7 +180,7 @@ MXUser_ControlExclLock(MXUserExclLock *lock,  // IN/OUT:
    }
 
    case MXUSER_CONTROL_HELD_HISTO: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
          if (heldStats == NULL) {
@@ -208,7 +208,7 @@ MXUser_ControlExclLock(MXUserExclLock *lock,  // IN/OUT:
    }
 
    case MXUSER_CONTROL_ENABLE_STATS: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          va_list a;
          Bool trackHeldTimes;
          MXUserHeldStats *heldStats;
@@ -410,7 +410,7 @@ MXUser_DestroyExclLock(MXUserExclLock *lock)  // IN:
 
       MXUserRemoveFromList(&lock->header);
 
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserHeldStats *heldStats;
          MXUserAcquireStats *acquireStats;
 
@@ -464,7 +464,7 @@ MXUser_AcquireExclLock(MXUserExclLock *lock)  // IN/OUT:
 
    MXUserAcquisitionTracking(&lock->header, TRUE);
 
-   if (vmx86_stats) {
+   if (MXUSER_STATS) {
       VmTimeType value = 0;
       MXUserHeldStats *heldStats;
       MXUserAcquireStats *acquireStats;
@@ -527,7 +527,7 @@ MXUser_ReleaseExclLock(MXUserExclLock *lock)  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_EXCL);
 
-   if (vmx86_stats) {
+   if (MXUSER_STATS) {
       MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
       if (UNLIKELY(heldStats != NULL)) {
@@ -607,7 +607,7 @@ MXUser_TryAcquireExclLock(MXUserExclLock *lock)  // IN/OUT:
       }
    }
 
-   if (vmx86_stats) {
+   if (MXUSER_STATS) {
       MXUserAcquireStats *acquireStats;
 
       acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
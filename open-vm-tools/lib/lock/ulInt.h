@@ -38,6 +38,7 @@ typedef pthread_t MXUserThreadID;
 #endif
 
 #include "vm_basic_types.h"
+#include "vm_basic_defs.h"
 #include "vthreadBase.h"
 #include "hostinfo.h"
 
@@ -46,6 +47,18 @@ typedef pthread_t MXUserThreadID;
 #define MXUSER_STAT_CLASS_ACQUISITION "a"
 #define MXUSER_STAT_CLASS_HELD        "h"
 
+/*
+ * Statistics support is compiled into stats builds, and into Tools where
+ * it is turned on at runtime (see MXUser_EnableStats). Until then it costs
+ * a pointer read per acquisition and release.
+ */
+
+#if vmx86_stats || defined(VMX86_TOOLS)
+#define MXUSER_STATS 1
+#else
+#define MXUSER_STATS 0
+#endif
+
 /*
  * A portable recursive lock.
  */
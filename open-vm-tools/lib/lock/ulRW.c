@@ -376,7 +376,7 @@ MXUser_ControlRWLock(MXUserRWLock *lock,  // IN/OUT:
 
    switch (command) {
    case MXUSER_CONTROL_ACQUISITION_HISTO: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserAcquireStats *acquireStats;
 
          acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
@@ -406,7 +406,7 @@ MXUser_ControlRWLock(MXUserRWLock *lock,  // IN/OUT:
    }
 
    case MXUSER_CONTROL_HELD_HISTO: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
          if (heldStats == NULL) {
@@ -434,7 +434,7 @@ MXUser_ControlRWLock(MXUserRWLock *lock,  // IN/OUT:
    }
 
    case MXUSER_CONTROL_ENABLE_STATS: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          va_list a;
          Bool trackHeldTimes;
          MXUserHeldStats *heldStats;
@@ -676,7 +676,7 @@ MXUser_DestroyRWLock(MXUserRWLock *lock)  // IN:
 
       MXUserRemoveFromList(&lock->header);
 
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserHeldStats *heldStats;
          MXUserAcquireStats *acquireStats;
 
@@ -788,7 +788,7 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
                                                                    "Write");
    }
 
-   if (vmx86_stats) {
+   if (MXUSER_STATS) {
       VmTimeType value;
       MXUserAcquireStats *acquireStats;
 
@@ -990,7 +990,7 @@ MXUser_ReleaseRWLock(MXUserRWLock *lock)  // IN/OUT:
 
    myContext = MXUserGetHolderContext(lock);
 
-   if (vmx86_stats) {
+   if (MXUSER_STATS) {
       MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
       if (UNLIKELY(heldStats != NULL)) {
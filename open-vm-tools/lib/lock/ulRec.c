@@ -165,7 +165,7 @@ MXUser_ControlRecLock(MXUserRecLock *lock,  // IN/OUT:
 
    switch (command) {
    case MXUSER_CONTROL_ACQUISITION_HISTO: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserAcquireStats *acquireStats;
 
          acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
@@ -195,7 +195,7 @@ MXUser_ControlRecLock(MXUserRecLock *lock,  // IN/OUT:
    }
 
    case MXUSER_CONTROL_HELD_HISTO: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
          if ((heldStats != NULL) && (lock->vmmLock == NULL)) {
@@ -223,7 +223,7 @@ MXUser_ControlRecLock(MXUserRecLock *lock,  // IN/OUT:
    }
 
    case MXUSER_CONTROL_ENABLE_STATS: {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          va_list a;
          Bool trackHeldTimes;
          MXUserHeldStats *heldStats;
@@ -501,7 +501,7 @@ MXUserCondDestroyRecLock(MXUserRecLock *lock)  // IN:
 
          MXUserRemoveFromList(&lock->header);
 
-         if (vmx86_stats) {
+         if (MXUSER_STATS) {
             MXUserHeldStats *heldStats;
             MXUserAcquireStats *acquireStats;
 
@@ -574,7 +574,7 @@ MXUser_AcquireRecLock(MXUserRecLock *lock)  // IN/OUT:
       /* Rank checking is only done on the first acquisition */
       MXUserAcquisitionTracking(&lock->header, TRUE);
 
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          VmTimeType value = 0;
          MXUserAcquireStats *acquireStats;
 
@@ -644,7 +644,7 @@ MXUser_ReleaseRecLock(MXUserRecLock *lock)  // IN/OUT:
       ASSERT(MXUserMX_UnlockRec);
       (*MXUserMX_UnlockRec)(lock->vmmLock);
    } else {
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
          if (LIKELY(heldStats != NULL)) {
@@ -746,7 +746,7 @@ MXUser_TryAcquireRecLock(MXUserRecLock *lock)  // IN/OUT:
          MXUserAcquisitionTracking(&lock->header, FALSE);
       }
 
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserAcquireStats *acquireStats;
 
          acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
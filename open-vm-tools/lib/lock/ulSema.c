@@ -582,7 +582,7 @@ MXUser_DestroySemaphore(MXUserSemaphore *sema)  // IN:
 
       MXUserRemoveFromList(&sema->header);
 
-      if (vmx86_stats) {
+      if (MXUSER_STATS) {
          MXUserAcquireStats *acquireStats;
 
          acquireStats = Atomic_ReadPtr(&sema->acquireStatsMem);
@@ -632,7 +632,7 @@ MXUser_DownSemaphore(MXUserSemaphore *sema)  // IN/OUT:
 
    MXUserAcquisitionTracking(&sema->header, TRUE);  // rank checking
 
-   if (vmx86_stats) {
+   if (MXUSER_STATS) {
       VmTimeType start = 0;
       Bool tryDownSuccess = FALSE;
       MXUserAcquireStats *acquireStats;
@@ -712,7 +712,7 @@ MXUser_TimedDownSemaphore(MXUserSemaphore *sema,  // IN/OUT:
 
    MXUserAcquisitionTracking(&sema->header, TRUE);  // rank checking
 
-   if (vmx86_stats) {
+   if (MXUSER_STATS) {
       VmTimeType start = 0;
       Bool tryDownSuccess = FALSE;
       MXUserAcquireStats *acquireStats;
@@ -805,7 +805,7 @@ MXUser_TryDownSemaphore(MXUserSemaphore *sema)  // IN/OUT:
                          __FUNCTION__, err);
    }
 
-   if (vmx86_stats) {
+   if (MXUSER_STATS) {
       MXUserAcquireStats *acquireStats;
 
       acquireStats = Atomic_ReadPtr(&sema->acquireStatsMem);
@@ -57,6 +57,7 @@ struct MXUserHisto {
 };
 
 static Bool    mxUserTrackHeldTimes = FALSE;
+static Bool    mxUserStatsEnabled = FALSE;
 static char   *mxUserHistoLine = NULL;
 static uint32  mxUserMaxLineLength = 0;
 static void   *mxUserStatsContext = NULL;
@@ -64,6 +65,14 @@ static void  (*mxUserStatsFunc)(void *context,
                                const char *fmt,
                                va_list ap) = NULL;
 
+/*
+ * While MXUser_ForEachLockStats runs the statistics actions of a lock, the
+ * dump routines fill this record instead of logging. Protected by the lock
+ * list lock.
+ */
+
+static MXUserLockStats *mxUserExportStats = NULL;
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -338,6 +347,99 @@ MXUserStatsLog(const char *fmt,  // IN:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserExportTimeStats --
+ *
+ *      Return the time statistics of the record being exported that match
+ *      the specified statistics class.
+ *
+ * Results:
+ *      As above
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static MXUserTimeStats *
+MXUserExportTimeStats(const char *typeName)  // IN:
+{
+   ASSERT(mxUserExportStats);
+
+   if (strcmp(typeName, MXUSER_STAT_CLASS_HELD) == 0) {
+      return &mxUserExportStats->held;
+   } else {
+      return &mxUserExportStats->acquire;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserHistoPercentile --
+ *
+ *      Return the value below which the specified percentage of the samples
+ *      of a histogram fall. The histogram may be updated concurrently, so
+ *      the result is approximate.
+ *
+ * Results:
+ *      The lower bound of the matching bin (samples below the histogram
+ *      minimum count in its first bin), or zero if there are no samples.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+MXUserHistoPercentile(MXUserHisto *histo,  // IN:
+                      uint32 percent)      // IN:
+{
+   uint32 i;
+   uint64 count = 0;
+   uint64 totalSamples = histo->totalSamples;
+   uint64 rank = (totalSamples * percent + 99) / 100;
+
+   if (totalSamples == 0) {
+      return 0;
+   }
+
+   for (i = 0; i < histo->numBins; i++) {
+      count += histo->binData[i];
+
+      if (count >= rank) {
+         double value = (double) histo->minValue;
+         uint32 j;
+
+         /*
+          * Bin i starts at minValue * 10^(i / BINS_PER_DECADE). Step
+          * through the decades, then through the bins of the last one
+          * (1.0232929922807541 is 10^(1/100)).
+          */
+
+         ASSERT_ON_COMPILE(BINS_PER_DECADE == 100);
+
+         for (j = 0; j < i / BINS_PER_DECADE; j++) {
+            value *= 10.0;
+         }
+
+         for (j = 0; j < i % BINS_PER_DECADE; j++) {
+            value *= 1.0232929922807541;
+         }
+
+         return (uint64) value;
+      }
+   }
+
+   return histo->maxValue;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -361,6 +463,15 @@ MXUserHistoDump(MXUserHisto *histo,    // IN:
    ASSERT(header);
    ASSERT(histo);
 
+   if (mxUserExportStats != NULL) {
+      MXUserTimeStats *timeStats = MXUserExportTimeStats(histo->typeName);
+
+      timeStats->p50Time = MXUserHistoPercentile(histo, 50);
+      timeStats->p99Time = MXUserHistoPercentile(histo, 99);
+
+      return;
+   }
+
    if (histo->totalSamples) {
       char *p;
       uint32 i;
@@ -559,6 +670,19 @@ MXUserDumpBasicStats(MXUserBasicStats *stats,  // IN:
 {
    uint64 stdDev;
 
+   if (mxUserExportStats != NULL) {
+      MXUserTimeStats *timeStats = MXUserExportTimeStats(stats->typeName);
+
+      if (stats->numSamples != 0) {
+         timeStats->numSamples = stats->numSamples;
+         timeStats->minTime = stats->minTime;
+         timeStats->maxTime = stats->maxTime;
+         timeStats->meanTime = stats->timeSum / stats->numSamples;
+      }
+
+      return;
+   }
+
    if (stats->numSamples < 2) {
       /*
        * It's possible to get a request to dump statistics when there
@@ -689,6 +813,48 @@ MXUserAcquisitionSample(MXUserAcquisitionStats *stats,  // IN/OUT:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserContentionRatio --
+ *
+ *      Contention shows up in two ways - failed attempts to acquire and
+ *      detected contention while acquiring. Return the largest of the two
+ *      as the contention ratio of the specified statistics.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+MXUserContentionRatio(MXUserAcquisitionStats *stats)  // IN:
+{
+   double basic;
+   double acquisition;
+
+   if (stats->numAttempts == 0) {
+      return 0.0;
+   }
+
+   basic = ((double) stats->numAttempts - stats->numSuccesses) /
+            ((double) stats->numAttempts);
+
+   if (stats->numSuccesses == 0) {
+      acquisition = 0.0;
+   } else {
+      acquisition = ((double) stats->numSuccessesContended) /
+                     ((double) stats->numSuccesses);
+   }
+
+   return (basic < acquisition) ? acquisition : basic;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -714,6 +880,17 @@ MXUserDumpAcquisitionStats(MXUserAcquisitionStats *stats,  // IN:
          MXUserDumpBasicStats(&stats->basicStats, header);
       }
 
+      if (mxUserExportStats != NULL) {
+         mxUserExportStats->numAttempts = stats->numAttempts;
+         mxUserExportStats->numSuccesses = stats->numSuccesses;
+         mxUserExportStats->numSuccessesContended =
+                                                  stats->numSuccessesContended;
+         mxUserExportStats->totalContentionTime = stats->totalContentionTime;
+         mxUserExportStats->contentionRatio = MXUserContentionRatio(stats);
+
+         return;
+      }
+
       MXUserStatsLog("MXUser: ce l=%u a=%"FMT64"u s=%"FMT64"u sc=%"FMT64"u "
                      "sct=%"FMT64"u t=%"FMT64"u\n",
                      header->serialNumber,
@@ -776,27 +953,7 @@ MXUserKitchen(MXUserAcquisitionStats *stats,  // IN:
     * How much "heat" is this lock generating?
     */
 
-   if (stats->numAttempts == 0) {
-      *contentionRatio = 0.0;
-   } else {
-      double basic;
-      double acquisition;
-
-      /*
-       * Contention shows up in two ways - failed attempts to acquire
-       * and detected contention while acquiring. Determine which is
-       * the largest and use that as the contention ratio for the
-       * specified statistics.
-       */
-
-      basic = ((double) stats->numAttempts - stats->numSuccesses) /
-               ((double) stats->numAttempts);
-
-      acquisition = ((double) stats->numSuccessesContended) /
-                     ((double) stats->numSuccesses);
-
-      *contentionRatio = (basic < acquisition) ? acquisition : basic;
-   }
+   *contentionRatio = MXUserContentionRatio(stats);
 
    /*
     * Handle the explicit control cases.
@@ -912,6 +1069,9 @@ MXUserForceHisto(Atomic_Ptr *histoPtr,  // IN/OUT:
  *
  *      What's to be done with statistics?
  *
+ *      Statistics are collected once a statistics function has been
+ *      registered or MXUser_EnableStats has been called.
+ *
  * Results:
  *      0  Statstics are disabled
  *      1  Collect statistics without tracking held times
@@ -926,7 +1086,9 @@ MXUserForceHisto(Atomic_Ptr *histoPtr,  // IN/OUT:
 uint32
 MXUserStatsMode(void)
 {
-   if (vmx86_stats && (mxUserStatsFunc != NULL) && (mxUserMaxLineLength > 0)) {
+   if (MXUSER_STATS &&
+       (mxUserStatsEnabled ||
+        ((mxUserStatsFunc != NULL) && (mxUserMaxLineLength > 0)))) {
       return mxUserTrackHeldTimes ? 2 : 1;
    } else {
       return 0;
@@ -1043,6 +1205,171 @@ MXUser_PerLockData(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserEnableLockStats --
+ *
+ *      Turn statistics and histograms on for the specified lock, if its type
+ *      supports them.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      Memory is allocated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#define MXUSER_ENABLE_LOCK_STATS(controlFunc, lock, trackHeldTimes)          \
+   do {                                                                     \
+      controlFunc((lock), MXUSER_CONTROL_ENABLE_STATS, (trackHeldTimes));   \
+      controlFunc((lock), MXUSER_CONTROL_ACQUISITION_HISTO,                 \
+                  (uint64) MXUSER_DEFAULT_HISTO_MIN_VALUE_NS,               \
+                  (uint32) MXUSER_DEFAULT_HISTO_DECADES);                   \
+      if (trackHeldTimes) {                                                 \
+         controlFunc((lock), MXUSER_CONTROL_HELD_HISTO,                     \
+                     (uint64) MXUSER_DEFAULT_HISTO_MIN_VALUE_NS,            \
+                     (uint32) MXUSER_DEFAULT_HISTO_DECADES);                \
+      }                                                                     \
+   } while (0)
+
+static void
+MXUserEnableLockStats(MXUserHeader *header,  // IN/OUT:
+                      Bool trackHeldTimes)   // IN:
+{
+   if (header->signature == MXUserGetSignature(MXUSER_TYPE_EXCL)) {
+      MXUSER_ENABLE_LOCK_STATS(MXUser_ControlExclLock,
+                               (MXUserExclLock *) header, trackHeldTimes);
+   } else if (header->signature == MXUserGetSignature(MXUSER_TYPE_REC)) {
+      MXUSER_ENABLE_LOCK_STATS(MXUser_ControlRecLock,
+                               (MXUserRecLock *) header, trackHeldTimes);
+   } else if (header->signature == MXUserGetSignature(MXUSER_TYPE_RW)) {
+      MXUSER_ENABLE_LOCK_STATS(MXUser_ControlRWLock,
+                               (MXUserRWLock *) header, trackHeldTimes);
+   }
+}
+
+#undef MXUSER_ENABLE_LOCK_STATS
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_EnableStats --
+ *
+ *      Turn statistics on, at runtime, for all the existing locks that
+ *      support them and for all the locks created from now on. Every lock
+ *      is considered "hot" from then on, so that all of them get acquisition
+ *      and held time histograms.
+ *
+ *      Statistics cannot be turned off again.
+ *
+ * Results:
+ *      TRUE    Statistics are on
+ *      FALSE   Statistics are not supported by this build
+ *
+ * Side effects:
+ *      Memory is allocated for every lock. Locking gets slower.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+MXUser_EnableStats(Bool trackHeldTimes)  // IN:
+{
+   MXRecLock *listLock;
+   ListItem *entry;
+
+   if (!MXUSER_STATS) {
+      return FALSE;
+   }
+
+   listLock = MXUserInternalSingleton(&mxLockMemPtr);
+
+   if (listLock == NULL) {
+      return FALSE;
+   }
+
+   MXRecLockAcquire(listLock,
+                    NULL);  // non-stats
+
+   mxUserTrackHeldTimes = trackHeldTimes;
+   mxUserStatsEnabled = TRUE;
+   mxUserContentionCount = ~((uint64) 0);  // always "hot"; no logging
+
+   LIST_SCAN(entry, mxUserLockList) {
+      MXUserEnableLockStats(LIST_CONTAINER(entry, MXUserHeader, item),
+                            trackHeldTimes);
+   }
+
+   MXRecLockRelease(listLock);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_ForEachLockStats --
+ *
+ *      Call the specified function with a snapshot of the statistics of
+ *      every lock that has statistics.
+ *
+ *      Like MXUser_PerLockData, this works on active locks so the data is
+ *      approximate. The function is called with the lock list locked; it
+ *      must not create or destroy locks.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      Locks that are "hot" get histograms.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_ForEachLockStats(void (*func)(void *clientData,                // IN:
+                                     const MXUserLockStats *stats),
+                        void *clientData)                             // IN:
+{
+   MXRecLock *listLock = MXUserInternalSingleton(&mxLockMemPtr);
+   ListItem *entry;
+
+   if (listLock == NULL) {
+      return;
+   }
+
+   MXRecLockAcquire(listLock,
+                    NULL);  // non-stats
+
+   LIST_SCAN(entry, mxUserLockList) {
+      MXUserHeader *header = LIST_CONTAINER(entry, MXUserHeader, item);
+      MXUserLockStats lockStats;
+
+      if (header->statsFunc == NULL) {
+         continue;
+      }
+
+      memset(&lockStats, 0, sizeof lockStats);
+      lockStats.name = header->name;
+      lockStats.serialNumber = header->serialNumber;
+      lockStats.rank = header->rank;
+
+      mxUserExportStats = &lockStats;
+      (*header->statsFunc)(header);
+      mxUserExportStats = NULL;
+
+      (*func)(clientData, &lockStats);
+   }
+
+   MXRecLockRelease(listLock);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
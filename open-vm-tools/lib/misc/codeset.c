@@ -1675,12 +1675,23 @@ CodeSet_Validate(const char *buf,   // IN: the string
                  size_t size,	    // IN: length of string
                  const char *code)  // IN: encoding
 {
-#if defined(NO_ICU)
-   return CodeSetOld_Validate(buf, size, code);
-#else
+#if !defined(NO_ICU)
    UConverter *cv;
    UErrorCode uerr;
+#endif
 
+   /*
+    * UTF-8 is what nearly every caller asks about, and it can be checked
+    * in place without setting up a converter.
+    */
+
+   if (Str_Strcasecmp(code, "UTF-8") == 0) {
+      return CodeSet_IsValidUTF8(buf, size);
+   }
+
+#if defined(NO_ICU)
+   return CodeSetOld_Validate(buf, size, code);
+#else
    // ucnv_toUChars takes 32-bit int size
    ASSERT_NOT_IMPLEMENTED(size <= (size_t) MAX_INT32);
 
@@ -23,11 +23,17 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "vmware.h"
 #include "codeset.h"
 #include "codesetOld.h"
 #include "util.h"
 
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__SSE2__)
+#include <emmintrin.h>
+#define CODESET_USE_SSE2
+#endif
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -148,6 +154,136 @@ out:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSet_AsciiPrefixLength --
+ *
+ *      Count the leading bytes of a buffer that are 7-bit ASCII. The
+ *      buffer is examined 16 bytes at a time with SSE2 where available,
+ *      otherwise a machine word at a time.
+ *
+ * Results:
+ *      Number of leading bytes below 0x80 (sizeIn if all of them are).
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+size_t
+CodeSet_AsciiPrefixLength(const char *bufIn,  // IN:
+                          size_t sizeIn)      // IN:
+{
+   size_t i = 0;
+
+#if defined(CODESET_USE_SSE2)
+   for (; sizeIn - i >= sizeof(__m128i); i += sizeof(__m128i)) {
+      __m128i chunk = _mm_loadu_si128((const __m128i *) (bufIn + i));
+
+      if (_mm_movemask_epi8(chunk) != 0) {
+         break;
+      }
+   }
+#else
+   for (; sizeIn - i >= sizeof(uintptr_t); i += sizeof(uintptr_t)) {
+      uintptr_t word;
+
+      memcpy(&word, bufIn + i, sizeof word);
+      if ((word & ((uintptr_t) ~0 / 0xff * 0x80)) != 0) {
+         break;
+      }
+   }
+#endif
+
+   while (i < sizeIn && (uint8) bufIn[i] < 0x80) {
+      i++;
+   }
+
+   return i;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSet_IsValidUTF8 --
+ *
+ *      Validate a UTF-8 buffer without converting it.
+ *
+ *      A sequence is accepted if it is well formed, uses the shortest
+ *      encoding, is not a surrogate (U+D800 - U+DFFF) and does not exceed
+ *      U+10FFFF. These are the rules iconv and CodeSetOld_Utf8ToUtf16le
+ *      enforce, so the result matches a full conversion. Runs of ASCII,
+ *      which is most of what we see in practice, are skipped in bulk.
+ *
+ * Results:
+ *      TRUE if the buffer is valid UTF-8, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+CodeSet_IsValidUTF8(const char *bufIn,  // IN:
+                    size_t sizeIn)      // IN:
+{
+   const uint8 *p = (const uint8 *) bufIn;
+   const uint8 *end = p + sizeIn;
+
+   while (p < end) {
+      uint8 lower = 0x80;
+      uint8 upper = 0xbf;
+      size_t len;
+      size_t i;
+
+      if (*p < 0x80) {
+         p += CodeSet_AsciiPrefixLength((const char *) p, end - p);
+         continue;
+      }
+
+      if (*p < 0xc2 || *p > 0xf4) {
+         return FALSE;
+      }
+
+      if (*p < 0xe0) {
+         len = 2;
+      } else if (*p < 0xf0) {
+         len = 3;
+         if (*p == 0xe0) {
+            lower = 0xa0;  // Overlong
+         } else if (*p == 0xed) {
+            upper = 0x9f;  // Surrogates
+         }
+      } else {
+         len = 4;
+         if (*p == 0xf0) {
+            lower = 0x90;  // Overlong
+         } else if (*p == 0xf4) {
+            upper = 0x8f;  // Above U+10FFFF
+         }
+      }
+
+      if ((size_t) (end - p) < len || p[1] < lower || p[1] > upper) {
+         return FALSE;
+      }
+
+      for (i = 2; i < len; i++) {
+         if ((p[i] & 0xc0) != 0x80) {
+            return FALSE;
+         }
+      }
+
+      p += len;
+   }
+
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -227,8 +227,32 @@ CodeSetOldUtf8ToUtf16leDb(const char *bufIn,   // IN:
    while (bufIn < bufEnd) {
       size_t neededSize;
       uint32 uniChar;
-      int n = CodeSet_GetUtf8(bufIn, bufEnd, &uniChar);
+      int n;
+
+      /* Widen a whole run of ASCII at once. */
+      if ((uint8) *bufIn < 0x80) {
+         size_t numAscii = CodeSet_AsciiPrefixLength(bufIn, bufEnd - bufIn);
+         size_t i;
+
+         neededSize = currentSize + numAscii * sizeof *buf;
+         if (allocatedSize < neededSize) {
+            if (DynBuf_Enlarge(db, neededSize) == FALSE) {
+               return FALSE;
+            }
+            allocatedSize = DynBuf_GetAllocatedSize(db);
+            ASSERT(neededSize <= allocatedSize);
+            buf = (uint16 *)((char *)DynBuf_Get(db) + currentSize);
+         }
+         for (i = 0; i < numAscii; i++) {
+            buf[i] = (uint8) bufIn[i];
+         }
+         buf += numAscii;
+         bufIn += numAscii;
+         currentSize = neededSize;
+         continue;
+      }
 
+      n = CodeSet_GetUtf8(bufIn, bufEnd, &uniChar);
       if (n <= 0) {
          return FALSE;
       }
@@ -1390,6 +1414,33 @@ CodeSetOld_Utf16leToUtf8Db(char const *bufIn,  // IN
       size_t size;
       size_t newSize;
 
+      /* Narrow a whole run of ASCII at once. */
+      if (utf16In[codeUnitIndex] < 0x80) {
+         size_t numAscii = 1;
+         size_t i;
+
+         while (codeUnitIndex + numAscii < numCodeUnits &&
+                utf16In[codeUnitIndex + numAscii] < 0x80) {
+            numAscii++;
+         }
+
+         size = DynBuf_GetSize(db);
+         newSize = size + numAscii;
+         if ((newSize < size) ||  // Prevent integer overflow
+             (DynBuf_GetAllocatedSize(db) < newSize &&
+              DynBuf_Enlarge(db, newSize) == FALSE)) {
+            return FALSE;
+         }
+
+         dbBytes = (uint8 *)DynBuf_Get(db) + size;
+         for (i = 0; i < numAscii; i++) {
+            dbBytes[i] = (uint8) utf16In[codeUnitIndex + i];
+         }
+         DynBuf_SetSize(db, newSize);
+         codeUnitIndex += numAscii - 1;
+         continue;
+      }
+
       if (utf16In[codeUnitIndex] < 0xD800 ||
           utf16In[codeUnitIndex] > 0xDFFF) {
          // Non-surrogate UTF-16 code units directly represent a code point.
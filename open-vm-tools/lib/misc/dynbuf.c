@@ -29,6 +29,21 @@
 
 #include "vmware.h"
 #include "dynbuf.h"
+#include "iovector.h"
+
+/*
+ * Chunk sizes of a DynRope: chunks start small and double up to the cap, so
+ * that both small and huge ropes use few chunks without wasting memory.
+ */
+#define DYNROPE_MIN_CHUNK (1 << 10)
+#define DYNROPE_MAX_CHUNK (1 << 20)
+
+struct DynRopeChunk {
+   DynRopeChunk *next;
+   char *data;
+   size_t size;
+   size_t allocated;
+};
 
 
 /*
@@ -55,6 +70,7 @@ DynBuf_Init(DynBuf *b)  // OUT:
    b->data = NULL;
    b->size = 0;
    b->allocated = 0;
+   b->growth = DYNBUF_GROWTH_DEFAULT;
 }
 
 
@@ -63,7 +79,8 @@ DynBuf_Init(DynBuf *b)  // OUT:
  *
  * DynBuf_Destroy --
  *
- *      Dynamic buffer destructor --hpreg
+ *      Dynamic buffer destructor. The growth policy is kept, in case the
+ *      buffer is used again --hpreg
  *
  * Results:
  *      None
@@ -80,7 +97,38 @@ DynBuf_Destroy(DynBuf *b)  // IN/OUT:
    ASSERT(b);
 
    free(b->data);
-   DynBuf_Init(b);
+   b->data = NULL;
+   b->size = 0;
+   b->allocated = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBuf_SetGrowth --
+ *
+ *      Set how a dynamic buffer grows once it is larger than 256KB: by
+ *      'growth' percent of its allocated size, or linearly by 256KB steps for
+ *      DYNBUF_GROWTH_LINEAR. Smaller buffers always double.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynBuf_SetGrowth(DynBuf *b,            // IN/OUT:
+                 unsigned int growth)  // IN:
+{
+   ASSERT(b);
+   ASSERT(growth <= DYNBUF_GROWTH_MAX);
+
+   b->growth = MIN(growth, DYNBUF_GROWTH_MAX);
 }
 
 
@@ -251,10 +299,13 @@ DynBuf_Enlarge(DynBuf *b,       // IN:
 #else
                         /*
                          * Double the previously allocated size if it is less
-                         * than 256KB; otherwise grow it linearly by 256KB
+                         * than 256KB; otherwise grow it by the buffer's
+                         * growth percentage, and at least by 256KB
                          */
-                        (b->allocated < 256 * 1024 ? b->allocated * 2
-                                                   : b->allocated + 256 * 1024)
+                        (b->allocated < 256 * 1024 ?
+                            b->allocated * 2 :
+                            b->allocated +
+                               MAX(b->allocated / 100 * b->growth, 256 * 1024))
 #endif
                       :
 #if defined(DYNBUF_DEBUG)
@@ -274,8 +325,8 @@ DynBuf_Enlarge(DynBuf *b,       // IN:
 
    /*
     * Prevent integer overflow. We can use this form of checking specifically
-    * because a multiple by 2 is used (in the worst case). This type of
-    * checking does not work in the general case.
+    * because the buffer at most doubles. This type of checking does not work
+    * in the general case.
     */
 
    if (newAllocated < b->allocated) {
@@ -432,8 +483,334 @@ DynBuf_Copy(DynBuf *src,   // IN
 
    dest->size = src->size;
    dest->allocated = src->allocated;
+   dest->growth = src->growth;
 
    memcpy(dest->data, src->data, src->size);
 
    return TRUE;
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRope_Init --
+ *
+ *      Chunked dynamic buffer constructor.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynRope_Init(DynRope *r)  // OUT:
+{
+   ASSERT(r);
+
+   r->head = NULL;
+   r->tail = NULL;
+   r->size = 0;
+   r->numChunks = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRope_Destroy --
+ *
+ *      Chunked dynamic buffer destructor.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynRope_Destroy(DynRope *r)  // IN/OUT:
+{
+   DynRopeChunk *chunk;
+
+   ASSERT(r);
+
+   chunk = r->head;
+   while (chunk != NULL) {
+      DynRopeChunk *next = chunk->next;
+
+      free(chunk->data);
+      free(chunk);
+      chunk = next;
+   }
+
+   DynRope_Init(r);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRopeAddChunk --
+ *
+ *      Link a chunk holding 'data' at the end of a chunked buffer. The chunk
+ *      takes ownership of 'data'.
+ *
+ * Results:
+ *      TRUE on success
+ *      FALSE on failure (not enough memory)
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+DynRopeAddChunk(DynRope *r,        // IN/OUT:
+                char *data,        // IN:
+                size_t size,       // IN:
+                size_t allocated)  // IN:
+{
+   DynRopeChunk *chunk;
+
+   chunk = malloc(sizeof *chunk);
+   if (chunk == NULL) {
+      return FALSE;
+   }
+
+   chunk->next = NULL;
+   chunk->data = data;
+   chunk->size = size;
+   chunk->allocated = allocated;
+
+   if (r->tail != NULL) {
+      r->tail->next = chunk;
+   } else {
+      r->head = chunk;
+   }
+   r->tail = chunk;
+   r->size += size;
+   r->numChunks++;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRope_Append --
+ *
+ *      Append data at the end of a chunked buffer. The data fills the room
+ *      left in the last chunk, and the rest goes to a new chunk. Data
+ *      already in the buffer is never moved.
+ *
+ * Results:
+ *      TRUE on success
+ *      FALSE on failure (not enough memory)
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+DynRope_Append(DynRope *r,        // IN/OUT:
+               void const *data,  // IN:
+               size_t size)       // IN:
+{
+   DynRopeChunk *tail;
+   char const *src = data;
+   size_t allocated;
+   char *chunkData;
+
+   ASSERT(r);
+
+   if (size == 0) {
+      return TRUE;
+   }
+
+   ASSERT(data);
+
+   if (r->size + size < r->size) {  // Prevent integer overflow
+      return FALSE;
+   }
+
+   tail = r->tail;
+   if (tail != NULL && tail->allocated > tail->size) {
+      size_t room = MIN(tail->allocated - tail->size, size);
+
+      memcpy(tail->data + tail->size, src, room);
+      tail->size += room;
+      r->size += room;
+      src += room;
+      size -= room;
+
+      if (size == 0) {
+         return TRUE;
+      }
+   }
+
+   allocated = tail != NULL ? MIN(tail->allocated * 2, DYNROPE_MAX_CHUNK)
+                            : DYNROPE_MIN_CHUNK;
+   allocated = MAX(allocated, MAX(size, DYNROPE_MIN_CHUNK));
+
+   chunkData = malloc(allocated);
+   if (chunkData == NULL) {
+      return FALSE;
+   }
+   memcpy(chunkData, src, size);
+
+   if (!DynRopeAddChunk(r, chunkData, size, allocated)) {
+      free(chunkData);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRope_AppendDynBuf --
+ *
+ *      Move the content of a dynamic buffer at the end of a chunked buffer
+ *      without copying it. The dynamic buffer is left empty.
+ *
+ * Results:
+ *      TRUE on success
+ *      FALSE on failure (not enough memory), 'b' is left untouched.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+DynRope_AppendDynBuf(DynRope *r,  // IN/OUT:
+                     DynBuf *b)   // IN/OUT:
+{
+   size_t size;
+   size_t allocated;
+
+   ASSERT(r);
+   ASSERT(b);
+
+   size = DynBuf_GetSize(b);
+   if (size == 0) {
+      return TRUE;
+   }
+
+   if (r->size + size < r->size) {  // Prevent integer overflow
+      return FALSE;
+   }
+
+   allocated = DynBuf_GetAllocatedSize(b);
+   if (!DynRopeAddChunk(r, DynBuf_Get(b), size, allocated)) {
+      return FALSE;
+   }
+
+   DynBuf_Detach(b);
+   DynBuf_SetSize(b, 0);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRope_GetIOV --
+ *
+ *      Describe the content of a chunked buffer as an I/O vector. At most
+ *      'maxEntries' entries are filled; DynRope_GetNumChunks tells how many
+ *      are needed for the whole buffer. The entries point into the buffer
+ *      and remain valid until it is destroyed.
+ *
+ * Results:
+ *      The number of entries filled.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+size_t
+DynRope_GetIOV(DynRope const *r,    // IN:
+               struct iovec *iov,   // OUT:
+               size_t maxEntries)   // IN:
+{
+   DynRopeChunk *chunk;
+   size_t i = 0;
+
+   ASSERT(r);
+   ASSERT(iov || maxEntries == 0);
+
+   for (chunk = r->head; chunk != NULL && i < maxEntries;
+        chunk = chunk->next) {
+      iov[i].iov_base = chunk->data;
+      iov[i].iov_len = chunk->size;
+      i++;
+   }
+
+   return i;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynRope_Flatten --
+ *
+ *      Append the content of a chunked buffer at the end of a dynamic buffer,
+ *      for consumers that need contiguous data. The dynamic buffer is
+ *      enlarged only once.
+ *
+ * Results:
+ *      TRUE on success
+ *      FALSE on failure (not enough memory)
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+DynRope_Flatten(DynRope const *r,  // IN:
+                DynBuf *b)         // IN/OUT:
+{
+   DynRopeChunk *chunk;
+   size_t newSize;
+
+   ASSERT(r);
+   ASSERT(b);
+
+   newSize = b->size + r->size;
+   if (newSize < b->size) {  // Prevent integer overflow
+      return FALSE;
+   }
+
+   if (newSize > b->allocated && !DynBuf_Enlarge(b, newSize)) {
+      return FALSE;
+   }
+
+   for (chunk = r->head; chunk != NULL; chunk = chunk->next) {
+      memcpy(b->data + b->size, chunk->data, chunk->size);
+      b->size += chunk->size;
+   }
+
+   return TRUE;
+}
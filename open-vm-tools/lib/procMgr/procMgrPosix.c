@@ -249,41 +249,541 @@ done:
 }
 
 
+/*
+ * The strings of the ProcMgrProcInfo entries listed on Linux are carved out
+ * of large blocks owned by the list instead of being malloc'ed one by one,
+ * which matters on guests with thousands of processes.  The list handed out
+ * to callers is the first member of a ProcMgrProcList, so that
+ * ProcMgr_FreeProcList can find the blocks again.
+ */
+
+#define PROCMGR_STRING_BLOCK_SIZE (64 * 1024)
+
+typedef struct ProcMgrStringBlock {
+   struct ProcMgrStringBlock *next;
+   size_t used;
+   size_t size;
+   char data[1];
+} ProcMgrStringBlock;
+
+typedef struct ProcMgrProcList {
+   ProcMgrProcInfoArray procs;    // Must be first.
+   ProcMgrStringBlock *strings;
+} ProcMgrProcList;
+
+/*
+ * Owners are looked up once per uid and per listing rather than once per
+ * process: getpwuid() may go all the way to a remote NSS service.
+ */
+typedef struct ProcMgrOwner {
+   uid_t uid;
+   char *name;
+} ProcMgrOwner;
+
+DEFINE_DYNARRAY_TYPE(ProcMgrOwner);
+
+
 /*
  *----------------------------------------------------------------------
  *
- * ProcMgr_ListProcesses --
+ * ProcMgrProcListStrndup --
  *
- *      List all the processes that the calling client has privilege to
- *      enumerate. The strings in the returned structure should be all
- *      UTF-8 encoded, although we do not enforce it right now.
+ *    Copy 'len' bytes of 'str' to the string blocks of 'list' and NUL
+ *    terminate the copy.
  *
  * Results:
- *      
- *      A ProcMgrProcInfoArray.
+ *    The copy, valid until the list is freed.
  *
  * Side effects:
+ *    May allocate a new string block.
  *
  *----------------------------------------------------------------------
  */
 
-ProcMgrProcInfoArray *
-ProcMgr_ListProcesses(void)
+static char *
+ProcMgrProcListStrndup(ProcMgrProcList *list,  // IN/OUT
+                       const char *str,        // IN
+                       size_t len)             // IN
 {
-   ProcMgrProcInfoArray *procList = NULL;
+   ProcMgrStringBlock *block = list->strings;
+   char *copy;
+
+   if (NULL == block || block->size - block->used < len + 1) {
+      size_t size = MAX(len + 1, PROCMGR_STRING_BLOCK_SIZE);
+
+      block = Util_SafeMalloc(sizeof *block + size);
+      block->used = 0;
+      block->size = size;
+      block->next = list->strings;
+      list->strings = block;
+   }
+
+   copy = block->data + block->used;
+   memcpy(copy, str, len);
+   copy[len] = '\0';
+   block->used += len + 1;
+
+   return copy;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrProcListAllocString --
+ *
+ *    Convert a NUL terminated string in the default encoding to UTF-8
+ *    and store it in the string blocks of 'list'.  When the default
+ *    encoding is UTF-8, which is the common case, the string is only
+ *    validated.
+ *
+ * Results:
+ *    The UTF-8 string, or NULL if 'str' can't be converted.
+ *
+ * Side effects:
+ *    May allocate a new string block.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+ProcMgrProcListAllocString(ProcMgrProcList *list,  // IN/OUT
+                           const char *str)        // IN
+{
+   static int defaultIsUtf8 = -1;
+   size_t len = strlen(str);
+   char *utf8;
+   char *copy;
+
+   if (defaultIsUtf8 == -1) {
+      defaultIsUtf8 = Unicode_ResolveEncoding(STRING_ENCODING_DEFAULT) ==
+                      STRING_ENCODING_UTF8;
+   }
+
+   if (defaultIsUtf8 &&
+       Unicode_IsBufferValid(str, len, STRING_ENCODING_UTF8)) {
+      return ProcMgrProcListStrndup(list, str, len);
+   }
+
+   utf8 = Unicode_Alloc(str, STRING_ENCODING_DEFAULT);
+   if (NULL == utf8) {
+      return NULL;
+   }
+   copy = ProcMgrProcListStrndup(list, utf8, strlen(utf8));
+   free(utf8);
+
+   return copy;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrProcListGetOwner --
+ *
+ *    Get the name of the user 'uid', falling back to the numeric uid if
+ *    the user is unknown.
+ *
+ * Results:
+ *    The owner name, stored in the string blocks of 'list'.
+ *
+ * Side effects:
+ *    Looks up and caches 'uid' in 'owners' the first time it is seen.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+ProcMgrProcListGetOwner(ProcMgrProcList *list,     // IN/OUT
+                        ProcMgrOwnerArray *owners, // IN/OUT
+                        uid_t uid)                 // IN
+{
+   size_t count = ProcMgrOwnerArray_Count(owners);
+   ProcMgrOwner owner;
+   struct passwd *pwd;
+   size_t i;
+
+   for (i = 0; i < count; i++) {
+      ProcMgrOwner *cached = ProcMgrOwnerArray_AddressOf(owners, i);
+
+      if (cached->uid == uid) {
+         return cached->name;
+      }
+   }
+
+   owner.uid = uid;
+   pwd = getpwuid(uid);
+   if (NULL != pwd) {
+      owner.name = ProcMgrProcListAllocString(list, pwd->pw_name);
+   } else {
+      owner.name = NULL;
+   }
+   if (NULL == owner.name) {
+      char uidStr[32];
+
+      Str_Sprintf(uidStr, sizeof uidStr, "%d", (int) uid);
+      owner.name = ProcMgrProcListStrndup(list, uidStr, strlen(uidStr));
+   }
+
+   /* A failure to cache is harmless. */
+   ProcMgrOwnerArray_Push(owners, owner);
+
+   return owner.name;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadProcFileAt --
+ *
+ *    Read the whole contents of the file 'name' in the /proc/<pid>
+ *    directory 'pidFd' into 'buf', which is reused from one call to the
+ *    next.  See ProcMgr_ReadProcFile.
+ *
+ * Results:
+ *    The length of the file, the contents being NUL terminated in 'buf'.
+ *    -1 on error.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ProcMgrReadProcFileAt(int pidFd,          // IN
+                      const char *name,   // IN
+                      DynBuf *buf)        // IN/OUT
+{
+   int fd;
+   int size = 0;
+
+   fd = openat(pidFd, name, O_RDONLY);
+   if (-1 == fd) {
+      return -1;
+   }
+
+   for (;;) {
+      ssize_t numRead;
+
+      if (DynBuf_GetAllocatedSize(buf) < size + 512 &&
+          !DynBuf_Enlarge(buf, size + 512)) {
+         size = -1;
+         break;
+      }
+
+      numRead = read(fd, (char *) DynBuf_Get(buf) + size,
+                     DynBuf_GetAllocatedSize(buf) - size - 1);
+      if (numRead < 0) {
+         if (EINTR == errno) {
+            continue;
+         }
+         size = -1;
+         break;
+      }
+      if (0 == numRead) {
+         break;
+      }
+      size += numRead;
+   }
+   close(fd);
+
+   if (size >= 0) {
+      ((char *) DynBuf_Get(buf))[size] = '\0';
+   }
+
+   return size;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrGetProcInfo --
+ *
+ *    Gather the information of the process 'pid', whose /proc directory
+ *    is open as 'pidFd'.
+ *
+ * Results:
+ *    TRUE and 'procInfo' filled in if the process could be inspected.
+ *
+ * Side effects:
+ *    Strings are allocated in the string blocks of 'list'.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrGetProcInfo(ProcMgrProcList *list,      // IN/OUT
+                   ProcMgrOwnerArray *owners,  // IN/OUT
+                   pid_t pid,                  // IN
+                   int pidFd,                  // IN
+                   DynBuf *buf,                // IN/OUT: scratch buffer
+                   time_t hostStartTime,       // IN
+                   unsigned long long hertz,   // IN
+                   ProcMgrProcInfo *procInfo)  // OUT
+{
+   struct stat fileStat;
+   int numRead;
+   int replaceLoop;
+   char *contents;
+   char *cmdName = NULL;
+   char *stringBegin;
+   unsigned long long dummy;
+   unsigned long long relativeStartTime;
+   int numberFound;
+
+   procInfo->procId = pid;
+   procInfo->procCmdName = NULL;
+   procInfo->procCmdLine = NULL;
+   procInfo->procOwner = NULL;
+
+   /*
+    * Read in the command and its arguments.  Arguments are separated
+    * by \0, which we convert to ' '.  Then we add a NULL terminator
+    * at the end.  Example: "perl -cw try.pl" is read in as
+    * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
+    * It would have been nice to preserve the NUL character so it is easy
+    * to determine what the command line arguments are without
+    * using a quote and space parsing heuristic.  But we do this
+    * to have parity with how Windows reports the command line.
+    * In the future, we could keep the NUL version around and pass it
+    * back to the client for easier parsing when retrieving individual
+    * command line parameters is needed.
+    */
+   numRead = ProcMgrReadProcFileAt(pidFd, "cmdline", buf);
+   if (numRead < 0) {
+      /*
+       * We may not be able to open the file due to the security reason.
+       * In that case, just ignore the process.
+       */
+      return FALSE;
+   }
+   contents = DynBuf_Get(buf);
+
+   if (numRead > 0) {
+      /*
+       * Stop before we hit the final '\0'; want to leave it alone.
+       */
+      for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
+         if ('\0' == contents[replaceLoop]) {
+            if (NULL == cmdName) {
+               /*
+                * Store the command name.
+                * Find the last path separator, to get the cmd name.
+                * If no separator is found, then use the whole name.
+                */
+               cmdName = strrchr(contents, '/');
+               if (NULL == cmdName) {
+                  cmdName = contents;
+               } else {
+                  /*
+                   * Skip over the last separator.
+                   */
+                  cmdName++;
+               }
+               procInfo->procCmdName = ProcMgrProcListAllocString(list,
+                                                                  cmdName);
+            }
+            contents[replaceLoop] = ' ';
+         }
+      }
+      procInfo->procCmdLine = ProcMgrProcListAllocString(list, contents);
+   } else {
+      /*
+       * Some procs don't have a command line text, so read a name from
+       * the 'status' file (should be the first line). If unable to get a
+       * name, the process is still real, so it should be included in the
+       * list, just without a name.
+       */
+      if (ProcMgrReadProcFileAt(pidFd, "status", buf) > 0) {
+         /*
+          * Extract the part with just the name, by reading until the first
+          * space, then reading the next non-space word after that, and
+          * ignoring everything else. The format looks like this:
+          *     "^Name:[ \t]*(.*)$"
+          * for example:
+          *     "Name:    nfsd"
+          */
+         const char *nameStart;
+         char *copyItr;
+
+         contents = DynBuf_Get(buf);
+
+         /* Skip non-whitespace. */
+         for (nameStart = contents; *nameStart &&
+                                    *nameStart != ' ' &&
+                                    *nameStart != '\t' &&
+                                    *nameStart != '\n'; ++nameStart);
+         /* Skip whitespace. */
+         for (;*nameStart &&
+               (*nameStart == ' ' ||
+                *nameStart == '\t' ||
+                *nameStart == '\n'); ++nameStart);
+         /* Copy the name to the start of the string and null term it. */
+         for (copyItr = contents; *nameStart && *nameStart != '\n';) {
+            *(copyItr++) = *(nameStart++);
+         }
+         *copyItr = '\0';
+         /*
+          * Store the command name.
+          */
+         procInfo->procCmdName = ProcMgrProcListAllocString(list, contents);
+      }
+   }
+
+   if (NULL == procInfo->procCmdLine) {
+      procInfo->procCmdLine = ProcMgrProcListStrndup(list, "", 0);
+   }
+
+   /*
+    * The owner of /proc/<pid> is the owner of the process.  If we can't
+    * stat() it, ignore the process.  Maybe we don't have enough
+    * permission.
+    */
+   if (0 != fstat(pidFd, &fileStat)) {
+      return FALSE;
+   }
+
+   /*
+    * Figure out the process start time.  Read /proc/<pid>/stat and
+    * compute the start time in absolute time.
+    */
+   if (0 >= ProcMgrReadProcFileAt(pidFd, "stat", buf)) {
+      return FALSE;
+   }
+
+   /*
+    * Skip over initial process id and process name.  "123 (bash) [...]".
+    * The process name may itself contain ')', so look for the last one.
+    */
+   stringBegin = strrchr(DynBuf_Get(buf), ')');
+   if (NULL == stringBegin) {
+      return FALSE;
+   }
+   stringBegin += 2;
+
+   numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
+                        "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
+                        "%d %ld %Lu",
+                        (char *) &dummy, (int *) &dummy, (int *) &dummy,
+                        (int *) &dummy, (int *) &dummy,  (int *) &dummy,
+                        (unsigned long *) &dummy, (unsigned long *) &dummy,
+                        (unsigned long *) &dummy, (unsigned long *) &dummy,
+                        (unsigned long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (long *) &dummy, (long *) &dummy,
+                        (int *) &dummy, (long *) &dummy,
+                        &relativeStartTime);
+   if (20 != numberFound) {
+      return FALSE;
+   }
+
+   procInfo->procOwner = ProcMgrProcListGetOwner(list, owners,
+                                                 fileStat.st_uid);
+   procInfo->procStartTime = hostStartTime + (relativeStartTime / hertz);
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrAddProcess --
+ *
+ *    Add the process 'pid' to 'list', if it exists and can be inspected.
+ *
+ * Results:
+ *    FALSE if the list could not be expanded, TRUE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrAddProcess(ProcMgrProcList *list,      // IN/OUT
+                  ProcMgrOwnerArray *owners,  // IN/OUT
+                  int procFd,                 // IN: /proc
+                  pid_t pid,                  // IN
+                  DynBuf *buf,                // IN/OUT: scratch buffer
+                  time_t hostStartTime,       // IN
+                  unsigned long long hertz)   // IN
+{
+   char pidStr[16];
    ProcMgrProcInfo procInfo;
+   Bool found;
+   int pidFd;
+
+   Str_Sprintf(pidStr, sizeof pidStr, "%d", (int) pid);
+   pidFd = openat(procFd, pidStr, O_RDONLY | O_DIRECTORY);
+   if (-1 == pidFd) {
+      return TRUE;
+   }
+
+   found = ProcMgrGetProcInfo(list, owners, pid, pidFd, buf, hostStartTime,
+                              hertz, &procInfo);
+   close(pidFd);
+
+   if (found && !ProcMgrProcInfoArray_Push(&list->procs, procInfo)) {
+      Warning("%s: failed to expand DynArray - out of memory\n",
+              __FUNCTION__);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesFiltered --
+ *
+ *      List the processes whose ids are in 'pids' that the calling client
+ *      has privilege to enumerate, or all of them if 'numPids' is 0.  A
+ *      process is listed once even if its id appears several times in
+ *      'pids'.  The strings in the returned structure should be all UTF-8
+ *      encoded, although we do not enforce it right now.
+ *
+ *      Each process directory is opened once and its files are read
+ *      relative to it; when 'pids' is given, /proc isn't even scanned.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, NULL on failure or if no process at all
+ *      could be listed when 'numPids' is 0.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesFiltered(const ProcMgr_Pid *pids,  // IN/OPT
+                              size_t numPids)           // IN
+{
+   ProcMgrProcList *list;
+   ProcMgrOwnerArray owners;
+   DynBuf buf;
    Bool failed = TRUE;
    DIR *dir;
    struct dirent *ent;
+   int procFd;
    static time_t hostStartTime = 0;
    static unsigned long long hertz = 100;
    int numberFound;
 
-   procList = Util_SafeCalloc(1, sizeof *procList);
-   ProcMgrProcInfoArray_Init(procList, 0);
-   procInfo.procCmdName = NULL;
-   procInfo.procCmdLine = NULL;
-   procInfo.procOwner = NULL;
+   list = Util_SafeCalloc(1, sizeof *list);
+   ProcMgrProcInfoArray_Init(&list->procs, 0);
+   ProcMgrOwnerArray_Init(&owners, 0);
+   DynBuf_Init(&buf);
 
    /*
     * Figure out when the system started.  We need this number to
@@ -332,285 +832,102 @@ ProcMgr_ListProcesses(void)
 #endif
    } // if (0 == hostStartTime)
 
-   /*
-    * Scan /proc for any directory that is all numbers.
-    * That represents a process id.
-    */
    dir = opendir("/proc");
    if (NULL == dir) {
-      Warning("ProcMgr_ListProcesses unable to open /proc\n");
+      Warning("%s unable to open /proc\n", __FUNCTION__);
       goto abort;
    }
+   procFd = dirfd(dir);
 
-   while ((ent = readdir(dir))) {
-      struct stat fileStat;
-      char cmdFilePath[1024];
-      int statResult;
-      int numRead = 0;   /* number of bytes that read() actually read */
-      int cmdFd;
-      int replaceLoop;
-      struct passwd *pwd;
-      char *cmdLineTemp = NULL;
-      char *cmdStatTemp = NULL;
-      size_t strLen = 0;
-      unsigned long long dummy;
-      unsigned long long relativeStartTime;
-      char *stringBegin;
-      char *cmdNameBegin;
-      Bool cmdNameLookup = TRUE;
+   if (numPids > 0) {
+      size_t i;
 
-      /*
-       * We only care about dirs that look like processes.
-       */
-      if (strspn(ent->d_name, "0123456789") != strlen(ent->d_name)) {
-         continue;
-      }
+      for (i = 0; i < numPids; i++) {
+         size_t j;
 
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/cmdline",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         continue;
-      }
-      
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
          /*
-          * We may not be able to open the file due to the security reason.
-          * In that case, just ignore and continue.
+          * Report each process once, like the full listing does, even if
+          * the caller asked for it several times.  Filters are short, so
+          * a linear search is fine.
           */
-         continue;
-      }
-
-      /*
-       * Read in the command and its arguments.  Arguments are separated
-       * by \0, which we convert to ' '.  Then we add a NULL terminator
-       * at the end.  Example: "perl -cw try.pl" is read in as
-       * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
-       * It would have been nice to preserve the NUL character so it is easy
-       * to determine what the command line arguments are without
-       * using a quote and space parsing heuristic.  But we do this
-       * to have parity with how Windows reports the command line.
-       * In the future, we could keep the NUL version around and pass it
-       * back to the client for easier parsing when retrieving individual
-       * command line parameters is needed.
-       */
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-      close(cmdFd);
-
-      if (numRead < 0) {
-         continue;
-      }
-
-      if (numRead > 0) {
-         /*
-          * Stop before we hit the final '\0'; want to leave it alone.
-          */
-         for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
-            if ('\0' == cmdLineTemp[replaceLoop]) {
-               if (cmdNameLookup) {
-                  /*
-                   * Store the command name.
-                   * Find the last path separator, to get the cmd name.
-                   * If no separator is found, then use the whole name.
-                   */
-                  cmdNameBegin = strrchr(cmdLineTemp, '/');
-                  if (NULL == cmdNameBegin) {
-                     cmdNameBegin = cmdLineTemp;
-                  } else {
-                     /*
-                      * Skip over the last separator.
-                      */
-                     cmdNameBegin++;
-                  }
-                  procInfo.procCmdName = Unicode_Alloc(cmdNameBegin, STRING_ENCODING_DEFAULT);
-                  cmdNameLookup = FALSE;
-               }
-               cmdLineTemp[replaceLoop] = ' ';
+         for (j = 0; j < i; j++) {
+            if (pids[j] == pids[i]) {
+               break;
             }
          }
-      } else {
-         /*
-          * Some procs don't have a command line text, so read a name from
-          * the 'status' file (should be the first line). If unable to get a name,
-          * the process is still real, so it should be included in the list, just 
-          * without a name.
-          */
-         cmdFd = -1;
-         numRead = 0;
-
-         if (snprintf(cmdFilePath,
-                      sizeof cmdFilePath,
-                      "/proc/%s/status",
-                      ent->d_name) != -1) {
-            cmdFd = open(cmdFilePath, O_RDONLY);
-         }
-         if (cmdFd != -1) {
-            numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-            close(cmdFd);
-         }
-         if (numRead > 0) {
-            /*
-             * Extract the part with just the name, by reading until the first
-             * space, then reading the next non-space word after that, and
-             * ignoring everything else. The format looks like this:
-             *     "^Name:[ \t]*(.*)$"
-             * for example:
-             *     "Name:    nfsd"
-             */
-            const char *nameStart;
-            char *copyItr;
-
-            /* Skip non-whitespace. */
-            for (nameStart = cmdLineTemp; *nameStart && 
-                                          *nameStart != ' ' &&
-                                          *nameStart != '\t' &&
-                                          *nameStart != '\n'; ++nameStart);
-            /* Skip whitespace. */
-            for (;*nameStart && 
-                  (*nameStart == ' ' ||
-                   *nameStart == '\t' ||
-                   *nameStart == '\n'); ++nameStart);
-            /* Copy the name to the start of the string and null term it. */
-            for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
-               *(copyItr++) = *(nameStart++);
-            }
-            *copyItr = '\0';
-            /*
-             * Store the command name.
-             */
-            procInfo.procCmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+         if (j < i) {
+            continue;
          }
-      }
 
-      /*
-       * Get the inode information for this process.  This gives us
-       * the process owner.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-
-      /*
-       * stat() /proc/<pid> to get the owner.  We use fileStat.st_uid
-       * later in this code.  If we can't stat(), ignore and continue.
-       * Maybe we don't have enough permission.
-       */
-      statResult = stat(cmdFilePath, &fileStat);
-      if (0 != statResult) {
-         goto next_entry;
+         if (!ProcMgrAddProcess(list, &owners, procFd, pids[i], &buf,
+                                hostStartTime, hertz)) {
+            goto abort;
+         }
       }
 
-      /*
-       * Figure out the process start time.  Open /proc/<pid>/stat
-       * and read the start time and compute it in absolute time.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/stat",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         goto next_entry;
-      }
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
-      close(cmdFd);
-      if (0 >= numRead) {
-         goto next_entry;
-      }
-      /*
-       * Skip over initial process id and process name.  "123 (bash) [...]".
-       */
-      stringBegin = strchr(cmdStatTemp, ')') + 2;
-
-      numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
-                           "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
-                           "%d %ld %Lu",
-                           (char *) &dummy, (int *) &dummy, (int *) &dummy,
-                           (int *) &dummy, (int *) &dummy,  (int *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (long *) &dummy, (long *) &dummy,
-                           (int *) &dummy, (long *) &dummy,
-                           &relativeStartTime);
-      if (20 != numberFound) {
-         goto next_entry;
-      }
+      failed = FALSE;
+      goto abort;
+   }
 
-      /*
-       * Store the command line string pointer in dynbuf.
-       */
-      if (cmdLineTemp) {
-         procInfo.procCmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-      } else {
-         procInfo.procCmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
+   /*
+    * Scan /proc for any directory that is all numbers.
+    * That represents a process id.
+    */
+   while ((ent = readdir(dir))) {
+      if (ent->d_name[strspn(ent->d_name, "0123456789")] != '\0') {
+         continue;
       }
 
-      /*
-       * Store the pid in dynbuf.
-       */
-      procInfo.procId = (pid_t) atoi(ent->d_name);
-
-      /*
-       * Store the owner of the process.
-       */
-      pwd = getpwuid(fileStat.st_uid);
-      procInfo.procOwner = (NULL == pwd)
-                           ? Str_SafeAsprintf(&strLen, "%d", (int) fileStat.st_uid)
-                           : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
-
-      /*
-       * Store the time that the process started.
-       */
-      procInfo.procStartTime = hostStartTime + (relativeStartTime / hertz);
-
-      /*
-       * Store the process info pointer into a list buffer.
-       */
-      if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
-         Warning("%s: failed to expand DynArray - out of memory\n",
-                 __FUNCTION__);
+      if (!ProcMgrAddProcess(list, &owners, procFd,
+                             (pid_t) atoi(ent->d_name), &buf,
+                             hostStartTime, hertz)) {
          goto abort;
       }
-      procInfo.procCmdName = NULL;
-      procInfo.procCmdLine = NULL;
-      procInfo.procOwner = NULL;
-
-next_entry:
-      free(cmdLineTemp);
-      free(cmdStatTemp);
    } // while readdir
 
-   if (0 < ProcMgrProcInfoArray_Count(procList)) {
+   if (0 < ProcMgrProcInfoArray_Count(&list->procs)) {
       failed = FALSE;
    }
 
 abort:
-   closedir(dir);
+   if (NULL != dir) {
+      closedir(dir);
+   }
 
-   free(procInfo.procCmdName);
-   free(procInfo.procCmdLine);
-   free(procInfo.procOwner);
+   DynBuf_Destroy(&buf);
+   ProcMgrOwnerArray_Destroy(&owners);
 
    if (failed) {
-      ProcMgr_FreeProcList(procList);
-      procList = NULL;
+      ProcMgr_FreeProcList(&list->procs);
+      list = NULL;
    }
 
-   return procList;
+   return NULL == list ? NULL : &list->procs;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcesses --
+ *
+ *      List all the processes that the calling client has privilege to
+ *      enumerate. The strings in the returned structure should be all
+ *      UTF-8 encoded, although we do not enforce it right now.
+ *
+ * Results:
+ *      
+ *      A ProcMgrProcInfoArray.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcesses(void)
+{
+   return ProcMgr_ListProcessesFiltered(NULL, 0);
 }
 #endif // defined(linux)
 
@@ -1176,6 +1493,66 @@ abort:
 }
 #endif // defined(__APPLE__)
 
+#if !defined(linux)
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesFiltered --
+ *
+ *      List the processes whose ids are in 'pids' that the calling client
+ *      has privilege to enumerate, or all of them if 'numPids' is 0.
+ *
+ *      There is no cheaper way than listing everything on these platforms,
+ *      so the full list is filtered.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, NULL on failure.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesFiltered(const ProcMgr_Pid *pids,  // IN/OPT
+                              size_t numPids)           // IN
+{
+   ProcMgrProcInfoArray *procList = ProcMgr_ListProcesses();
+   size_t procCount;
+   size_t kept = 0;
+   size_t i;
+
+   if (NULL == procList || 0 == numPids) {
+      return procList;
+   }
+
+   procCount = ProcMgrProcInfoArray_Count(procList);
+   for (i = 0; i < procCount; i++) {
+      ProcMgrProcInfo *procInfo = ProcMgrProcInfoArray_AddressOf(procList, i);
+      size_t j;
+
+      for (j = 0; j < numPids; j++) {
+         if (pids[j] == procInfo->procId) {
+            break;
+         }
+      }
+
+      if (j < numPids) {
+         *ProcMgrProcInfoArray_AddressOf(procList, kept++) = *procInfo;
+      } else {
+         free(procInfo->procCmdName);
+         free(procInfo->procCmdLine);
+         free(procInfo->procOwner);
+      }
+   }
+   ProcMgrProcInfoArray_SetCount(procList, kept);
+
+   return procList;
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1195,6 +1572,20 @@ abort:
 void
 ProcMgr_FreeProcList(ProcMgrProcInfoArray *procList)
 {
+#if defined(linux)
+   ProcMgrProcList *list = (ProcMgrProcList *) procList;
+
+   if (NULL == procList) {
+      return;
+   }
+
+   while (NULL != list->strings) {
+      ProcMgrStringBlock *block = list->strings;
+
+      list->strings = block->next;
+      free(block);
+   }
+#else
    int i;
    size_t procCount;
 
@@ -1209,6 +1600,7 @@ ProcMgr_FreeProcList(ProcMgrProcInfoArray *procList)
       free(procInfo->procCmdLine);
       free(procInfo->procOwner);
    }
+#endif
 
    ProcMgrProcInfoArray_Destroy(procList);
    free(procList);
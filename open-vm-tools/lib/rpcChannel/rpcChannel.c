@@ -238,25 +238,41 @@ RpcChannelXdrWrapper(RpcInData *data,
    if (rpc->xdrOut != NULL && copy.result != NULL) {
       XDR xdrs;
       xdrproc_t xdrProc = rpc->xdrOut;
+      u_int xdrSize;
+      char *buf;
+
+      /*
+       * Size the reply first, so it can be serialized straight into a buffer
+       * of the right size. xdr_sizeof() returns 0 on failure.
+       */
+      xdrSize = xdr_sizeof(xdrProc, copy.result);
+      if (xdrSize == 0) {
+         ret = RPCIN_SETRETVALS(data, "XDR serialization failed.", FALSE);
+         goto exit;
+      }
 
-      if (DynXdr_Create(&xdrs) == NULL) {
+      buf = malloc(MAX(xdrSize, 1));
+      if (buf == NULL) {
          ret = RPCIN_SETRETVALS(data, "Out of memory.", FALSE);
          goto exit;
       }
 
+      xdrmem_create(&xdrs, buf, xdrSize, XDR_ENCODE);
       if (!xdrProc(&xdrs, copy.result)) {
          ret = RPCIN_SETRETVALS(data, "XDR serialization failed.", FALSE);
-         DynXdr_Destroy(&xdrs, TRUE);
+         xdr_destroy(&xdrs);
+         free(buf);
          goto exit;
       }
+      ASSERT(xdr_getpos(&xdrs) == xdrSize);
+      xdr_destroy(&xdrs);
 
       if (copy.freeResult) {
          VMX_XDR_FREE(rpc->xdrOut, copy.result);
       }
-      data->result = DynXdr_Get(&xdrs);
-      data->resultLen = XDR_GETPOS(&xdrs);
+      data->result = buf;
+      data->resultLen = xdrSize;
       data->freeResult = TRUE;
-      DynXdr_Destroy(&xdrs, FALSE);
    }
 
 exit:
@@ -268,7 +284,9 @@ exit:
 
 
 /**
- * Builds an "rpcout" command to send a XDR struct.
+ * Builds an "rpcout" command to send a XDR struct. The size of the serialized
+ * struct is computed first, so that the command is built with a single
+ * allocation.
  *
  * @param[in]  cmd         The command name.
  * @param[in]  xdrProc     Function to use for serializing the XDR struct.
@@ -286,33 +304,71 @@ RpcChannel_BuildXdrCommand(const char *cmd,
                            char **result,
                            size_t *resultLen)
 {
-   Bool ret = FALSE;
+   Bool ret;
    xdrproc_t proc = xdrProc;
+   size_t cmdLen = strlen(cmd);
+   u_int xdrSize;
+   char *buf;
    XDR xdrs;
 
-   if (DynXdr_Create(&xdrs) == NULL) {
+   xdrSize = xdr_sizeof(proc, xdrData);
+   if (xdrSize == 0) {
       return FALSE;
    }
 
-   if (!DynXdr_AppendRaw(&xdrs, cmd, strlen(cmd))) {
-      goto exit;
+   buf = malloc(cmdLen + 1 + xdrSize);
+   if (buf == NULL) {
+      return FALSE;
    }
 
-   if (!DynXdr_AppendRaw(&xdrs, " ", 1)) {
-      goto exit;
-   }
+   memcpy(buf, cmd, cmdLen);
+   buf[cmdLen] = ' ';
 
-   if (!proc(&xdrs, xdrData)) {
-      goto exit;
+   xdrmem_create(&xdrs, buf + cmdLen + 1, xdrSize, XDR_ENCODE);
+   ret = proc(&xdrs, xdrData);
+   ASSERT(!ret || xdr_getpos(&xdrs) == xdrSize);
+   xdr_destroy(&xdrs);
+
+   if (!ret) {
+      free(buf);
+      return FALSE;
    }
 
-   *result = DynXdr_Get(&xdrs);
-   *resultLen = xdr_getpos(&xdrs);
+   *result = buf;
+   *resultLen = cmdLen + 1 + xdrSize;
+   return TRUE;
+}
+
 
-   ret = TRUE;
+/**
+ * Sets a guestinfo variable on the host through the channel. Failures are
+ * logged but otherwise ignored, since callers use this for periodically
+ * published data that will be refreshed on the next attempt.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  key         The guestinfo key to set.
+ * @param[in]  value       The value to store under the key.
+ *
+ * @return Whether the host accepted the value.
+ */
+
+gboolean
+RpcChannel_SetGuestInfo(RpcChannel *chan,
+                        const char *key,
+                        const char *value)
+{
+   gboolean ret;
+   gchar *msg;
+
+   g_return_val_if_fail(chan != NULL, FALSE);
+
+   msg = g_strdup_printf("info-set %s %s", key, value);
+   ret = RpcChannel_Send(chan, msg, strlen(msg) + 1, NULL, NULL);
+   if (!ret) {
+      g_debug("Failed to set guestinfo %s.\n", key);
+   }
+   g_free(msg);
 
-exit:
-   DynXdr_Destroy(&xdrs, !ret);
    return ret;
 }
 
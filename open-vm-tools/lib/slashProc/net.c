@@ -50,21 +50,22 @@
 
 
 /**
- * @brief Evaluate an expression with a regular expression match.
- *
- * Convenience wrapper to fetch a regular expression match result, evaluate
- * it as an argument in some expression, and then free it.
+ * Initial size of the buffer a @c /proc/net node is read into.  The buffer
+ * is doubled until the whole node fits.
+ */
+#define SLASHPROC_READ_SIZE 16384
+
+
+/**
+ * @brief Cursor over the lines and tokens of a @c /proc/net node.
  *
- * @param[in] matchInfo  GMatchInfo RE context.
- * @param[in] matchIndex Match index.
- * @param[in] expr       Expression to evaluate.  Must contain @c MATCH as
- *                       placeholder where matched value will be inserted.
+ * The parsers below tokenize the node in place, without copying lines or
+ * tokens, and only allocate what they return to the caller.
  */
-#define MATCHEXPR(matchInfo, matchIndex, expr) do {                     \
-   gchar *MATCH = g_match_info_fetch(matchInfo, matchIndex);            \
-   expr;                                                                \
-   g_free(MATCH);                                                       \
-} while(0)
+typedef struct SlashProcNetCursor {
+   const char *pos;     ///< Current position.
+   const char *end;     ///< End of the current line or of the buffer.
+} SlashProcNetCursor;
 
 
 /**
@@ -95,11 +96,17 @@ static const char *pathToNetRoute6 = PROC_NET_ROUTE6;
  * Private function prototypes.
  */
 
-static void Ip6StringToIn6Addr(const char *ip6String,
-                               struct in6_addr *in6_addr);
-static guint64 MatchToGuint64(const GMatchInfo *matchInfo,
-                              const gint matchIndex,
-                              gint base);
+static gchar *ReadNode(const char *path, gsize *length);
+static Bool NextLine(SlashProcNetCursor *buffer, SlashProcNetCursor *line);
+static Bool SkipSpaces(SlashProcNetCursor *line);
+static Bool IsAtEnd(SlashProcNetCursor *line);
+static Bool ParseWord(SlashProcNetCursor *line, const char **word,
+                      gsize *wordLen);
+static Bool ParseHex(SlashProcNetCursor *line, unsigned int digits,
+                     guint64 *value);
+static Bool ParseDec(SlashProcNetCursor *line, Bool allowNegative,
+                     guint64 *value);
+static Bool ParseIn6Addr(SlashProcNetCursor *line, struct in6_addr *in6_addr);
 
 
 /*
@@ -203,11 +210,9 @@ SlashProcNetSetPathRoute6(const char *newPathToNetRoute6)
  *
  * @note        Caller should free the returned @c GHashTable with
  *              @c g_hash_table_destroy.
- * @note        This routine creates persistent GLib GRegexs.
  *
  * @return      On failure, NULL.  On success, a valid @c GHashTable.
  * @todo        Provide a case-insensitive key comparison function.
- * @todo        Consider init/cleanup routines to not "leak" GRegexs.
  *
  ******************************************************************************
  */
@@ -216,31 +221,19 @@ GHashTable *
 SlashProcNet_GetSnmp(void)
 {
    GHashTable *myHashTable = NULL;
-   GIOChannel *myChannel = NULL;
-   GIOStatus keyIoStatus;
-   GIOStatus valIoStatus;
-   gchar *myKeyLine = NULL;
-   gchar *myValLine = NULL;
+   SlashProcNetCursor buffer;
+   SlashProcNetCursor keyLine;
+   SlashProcNetCursor valLine;
+   gchar *contents;
+   gsize length;
    Bool parseError = FALSE;
-   int fd = -1;
-
-   static GRegex *myKeyRegex = NULL;
-   static GRegex *myValRegex = NULL;
-
-   if (myKeyRegex == NULL) {
-      myKeyRegex = g_regex_new("^(\\w+): (\\w+ )*(\\w+)$", G_REGEX_OPTIMIZE,
-                               0, NULL);
-      myValRegex = g_regex_new("^(\\w+): (-?\\d+ )*(-?\\d+)$", G_REGEX_OPTIMIZE,
-                               0, NULL);
-      ASSERT(myKeyRegex);
-      ASSERT(myValRegex);
-   }
 
-   if ((fd = g_open(pathToNetSnmp, O_RDONLY)) == -1) {
+   if ((contents = ReadNode(pathToNetSnmp, &length)) == NULL) {
       return NULL;
    }
 
-   myChannel = g_io_channel_unix_new(fd);
+   buffer.pos = contents;
+   buffer.end = contents + length;
 
    myHashTable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
@@ -251,69 +244,56 @@ SlashProcNet_GetSnmp(void)
     * pfx0: val0 val1 val2 ... valN
     * ...
     * pfxN: ...
+    *
+    * A trailing key line without a value line is ignored.
     */
 
-   while ((keyIoStatus = g_io_channel_read_line(myChannel, &myKeyLine, NULL, NULL,
-                                                NULL)) == G_IO_STATUS_NORMAL &&
-          (valIoStatus = g_io_channel_read_line(myChannel, &myValLine, NULL, NULL,
-                                                NULL)) == G_IO_STATUS_NORMAL) {
-
-      GMatchInfo *keyMatchInfo = NULL;
-      GMatchInfo *valMatchInfo = NULL;
-
-      gchar **myKeys = NULL;
-      gchar **myVals = NULL;
-
-      gchar **myKey = NULL;
-      gchar **myVal = NULL;
-
-      gchar *keyPrefix = NULL;
-      gchar *valPrefix = NULL;
+   while (!parseError &&
+          NextLine(&buffer, &keyLine) &&
+          NextLine(&buffer, &valLine)) {
+      const char *keyPrefix;
+      const char *valPrefix;
+      gsize keyPrefixLen;
+      gsize valPrefixLen;
 
       /*
-       * Per format above, we expect a pair of lines with a matching prefix.
+       * Per format above, we expect a pair of lines with a matching prefix,
+       * followed by ": " and single space separated columns.
        */
-      {
-         if (!g_regex_match(myKeyRegex, myKeyLine, 0, &keyMatchInfo) ||
-             !g_regex_match(myValRegex, myValLine, 0, &valMatchInfo)) {
-            parseError = TRUE;
-            goto badIteration;
-         }
-
-         keyPrefix = g_match_info_fetch(keyMatchInfo, 1);
-         valPrefix = g_match_info_fetch(valMatchInfo, 1);
-
-         ASSERT(keyPrefix);
-         ASSERT(valPrefix);
-
-         if (strcmp(keyPrefix, valPrefix)) {
-            parseError = TRUE;
-            goto badIteration;
-         }
+      if (!ParseWord(&keyLine, &keyPrefix, &keyPrefixLen) ||
+          !ParseWord(&valLine, &valPrefix, &valPrefixLen) ||
+          keyPrefixLen != valPrefixLen ||
+          memcmp(keyPrefix, valPrefix, keyPrefixLen) != 0 ||
+          *keyLine.pos++ != ':' || *valLine.pos++ != ':') {
+         parseError = TRUE;
+         break;
       }
 
-      myKeys = g_strsplit(myKeyLine, " ", 0);
-      myVals = g_strsplit(myValLine, " ", 0);
-
       /*
        * Iterate over the columns, combining the column keys with the prefix
        * to form the new key name.  (I.e., "Ip: InDiscards" => "IpInDiscards".)
        */
-      for (myKey = &myKeys[1], myVal = &myVals[1];
-           *myKey && *myVal;
-           myKey++, myVal++) {
+      while (!IsAtEnd(&keyLine) && !IsAtEnd(&valLine)) {
+         const char *key;
+         gsize keyLen;
          gchar *hashKey;
-         guint64 *myIntVal = NULL;
+         guint64 *myIntVal;
+         guint64 val;
 
-         hashKey = g_strjoin(NULL, keyPrefix, *myKey, NULL);
-         g_strstrip(hashKey);
+         if (*keyLine.pos++ != ' ' || *valLine.pos++ != ' ' ||
+             !ParseWord(&keyLine, &key, &keyLen) ||
+             !ParseDec(&valLine, TRUE, &val)) {
+            parseError = TRUE;
+            break;
+         }
+
+         hashKey = g_malloc(keyPrefixLen + keyLen + 1);
+         memcpy(hashKey, keyPrefix, keyPrefixLen);
+         memcpy(hashKey + keyPrefixLen, key, keyLen);
+         hashKey[keyPrefixLen + keyLen] = '\0';
 
-         /*
-          * By virtue of having matched the above regex, this conversion
-          * must hold.
-          */
          myIntVal = g_new(guint64, 1);
-         *myIntVal = g_ascii_strtoull(*myVal, NULL, 10);
+         *myIntVal = val;
 
          /*
           * If our input contains duplicate keys, which I really don't see
@@ -325,55 +305,26 @@ SlashProcNet_GetSnmp(void)
       }
 
       /*
-       * Make sure the column counts matched.  If we succeeded, both pointers
-       * should now be NULL.
+       * Make sure the column counts matched and that there was at least one
+       * column.  If we succeeded, both lines should now be consumed.
        */
-      if (*myKey || *myVal) {
+      if (!IsAtEnd(&keyLine) || !IsAtEnd(&valLine) ||
+          keyLine.pos == keyPrefix + keyPrefixLen + 1) {
          parseError = TRUE;
       }
-
-badIteration:
-      g_match_info_free(keyMatchInfo);
-      g_match_info_free(valMatchInfo);
-
-      g_free(keyPrefix);
-      g_free(valPrefix);
-
-      g_strfreev(myKeys);
-      g_strfreev(myVals);
-
-      g_free(myKeyLine);
-      g_free(myValLine);
-      myKeyLine = NULL;
-      myValLine = NULL;
-
-      if (parseError) {
-         break;
-      }
    }
 
    /*
     * Error conditions:
     *    Hash table empty:      Unable to parse any input.
-    *    myKeyLine != NULL:     Failed to read "key" and "value" lines during
-    *                           same loop iteration.
     *    parseError == TRUE:    See loop body above.
     */
-   if (keyIoStatus == G_IO_STATUS_ERROR ||
-       valIoStatus == G_IO_STATUS_ERROR ||
-       g_hash_table_size(myHashTable) == 0 ||
-       parseError) {
+   if (g_hash_table_size(myHashTable) == 0 || parseError) {
       g_hash_table_destroy(myHashTable);
       myHashTable = NULL;
    }
 
-   g_free(myKeyLine);
-   g_free(myValLine);
-   myKeyLine = NULL;
-   myValLine = NULL;
-
-   close(fd);
-   g_io_channel_unref(myChannel);
+   g_free(contents);
 
    return myHashTable;
 }
@@ -394,11 +345,9 @@ badIteration:
  *
  * @note        Caller should free the returned @c GHashTable with
  *              @c g_hash_table_destroy.
- * @note        This routine creates persistent GLib GRegexs.
  *
  * @return      On failure, NULL.  On success, a valid @c GHashTable.
  * @todo        Provide a case-insensitive key comparison function.
- * @todo        Consider init/cleanup routines to not "leak" GRegexs.
  *
  ******************************************************************************
  */
@@ -407,25 +356,18 @@ GHashTable *
 SlashProcNet_GetSnmp6(void)
 {
    GHashTable *myHashTable = NULL;
-   GIOChannel *myChannel = NULL;
-   GIOStatus ioStatus;
-   gchar *myInputLine = NULL;
+   SlashProcNetCursor buffer;
+   SlashProcNetCursor line;
+   gchar *contents;
+   gsize length;
    Bool parseError = FALSE;
-   int fd = -1;
-
-   static GRegex *myRegex = NULL;
-
-   if (myRegex == NULL) {
-      myRegex = g_regex_new("^(\\w+)\\s+(-?\\d+)\\s*$", G_REGEX_OPTIMIZE,
-                            0, NULL);
-      ASSERT(myRegex);
-   }
 
-   if ((fd = g_open(pathToNetSnmp6, O_RDONLY)) == -1) {
+   if ((contents = ReadNode(pathToNetSnmp6, &length)) == NULL) {
       return NULL;
    }
 
-   myChannel = g_io_channel_unix_new(fd);
+   buffer.pos = contents;
+   buffer.end = contents + length;
 
    myHashTable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
@@ -438,53 +380,40 @@ SlashProcNet_GetSnmp6(void)
     * keyN                              valueN
     */
 
-   while ((ioStatus = g_io_channel_read_line(myChannel, &myInputLine, NULL,
-                                             NULL, NULL)) == G_IO_STATUS_NORMAL) {
-      GMatchInfo *matchInfo = NULL;
+   while (NextLine(&buffer, &line)) {
+      const char *key;
+      gsize keyLen;
+      guint64 val;
+      guint64 *myIntVal;
 
-      if (g_regex_match(myRegex, myInputLine, 0, &matchInfo)) {
-         gchar *myKey = NULL;
-         gchar *myVal = NULL;
-         guint64 *myIntVal = NULL;
-
-         myKey = g_match_info_fetch(matchInfo, 1);
-         myVal = g_match_info_fetch(matchInfo, 2);
-
-         /*
-          * By virtue of having matched the above regex, this conversion
-          * must hold.
-          */
-         myIntVal = g_new(guint64, 1);
-         *myIntVal = g_ascii_strtoull(myVal, NULL, 10);
-
-         /*
-          * The hash table will take ownership of myKey and myIntVal.  We're
-          * still responsible for myVal.
-          */
-         g_hash_table_insert(myHashTable, myKey, myIntVal);
-         g_free(myVal);
-      } else {
+      if (!ParseWord(&line, &key, &keyLen) ||
+          !SkipSpaces(&line) ||
+          !ParseDec(&line, TRUE, &val)) {
          parseError = TRUE;
+         break;
       }
 
-      g_match_info_free(matchInfo);
-      g_free(myInputLine);
-      myInputLine = NULL;
-
-      if (parseError) {
+      SkipSpaces(&line);
+      if (!IsAtEnd(&line)) {
+         parseError = TRUE;
          break;
       }
+
+      myIntVal = g_new(guint64, 1);
+      *myIntVal = val;
+
+      /*
+       * The hash table will take ownership of the key and myIntVal.
+       */
+      g_hash_table_insert(myHashTable, g_strndup(key, keyLen), myIntVal);
    }
 
-   if (ioStatus == G_IO_STATUS_ERROR ||
-       g_hash_table_size(myHashTable) == 0 ||
-       parseError) {
+   if (g_hash_table_size(myHashTable) == 0 || parseError) {
       g_hash_table_destroy(myHashTable);
       myHashTable = NULL;
    }
 
-   close(fd);
-   g_io_channel_unref(myChannel);
+   g_free(contents);
 
    return myHashTable;
 }
@@ -511,10 +440,8 @@ SlashProcNet_GetSnmp6(void)
  *
  * @note        Caller is responsible for freeing the @c GPtrArray with
  *              SlashProcNet_FreeRoute.
- * @note        This routine creates persistent GLib GRegexs.
  *
  * @return      On failure, NULL.  On success, a valid @c GPtrArray.
- * @todo        Consider init/cleanup routines to not "leak" GRegexs.
  * @todo        Consider rewriting, integrating with libdnet.
  *
  ******************************************************************************
@@ -523,39 +450,29 @@ SlashProcNet_GetSnmp6(void)
 GPtrArray *
 SlashProcNet_GetRoute(void)
 {
-   GIOChannel *myChannel = NULL;
-   GIOStatus myIoStatus;
+   static const char *fields[] = {
+      "Iface", "Destination", "Gateway", "Flags", "RefCnt", "Use", "Metric",
+      "Mask", "MTU", "Window", "IRTT"
+   };
    GPtrArray *myArray = NULL;
-   gchar *myLine = NULL;
-   int fd = -1;
-
-   static GRegex *myFieldsRE = NULL;
-   static GRegex *myValuesRE = NULL;
-
-   if (myFieldsRE == NULL) {
-      myFieldsRE = g_regex_new("^Iface\\s+Destination\\s+Gateway\\s+Flags\\s+"
-                               "RefCnt\\s+Use\\s+Metric\\s+Mask\\s+MTU\\s+"
-                               "Window\\s+IRTT\\s*$", 0, 0, NULL);
-      myValuesRE = g_regex_new("^(\\w+)\\s+([[:xdigit:]]{8})\\s+"
-                               "([[:xdigit:]]{8})\\s+([[:xdigit:]]{4})\\s+"
-                               "\\d+\\s+\\d+\\s+(\\d+)\\s+"
-                               "([[:xdigit:]]{8})\\s+(\\d+)\\s+\\d+\\s+(\\d+)\\s*$",
-                               0, 0, NULL);
-      ASSERT(myFieldsRE);
-      ASSERT(myValuesRE);
-   }
+   SlashProcNetCursor buffer;
+   SlashProcNetCursor line;
+   gchar *contents;
+   gsize length;
+   unsigned int i;
 
    /*
-    * 1.  Open pathToNetRoute, associate it with a GIOChannel.
+    * 1.  Read pathToNetRoute.
     */
 
-   if ((fd = g_open(pathToNetRoute, O_RDONLY)) == -1) {
+   if ((contents = ReadNode(pathToNetRoute, &length)) == NULL) {
       Warning("%s: open(%s): %s\n", __func__, pathToNetRoute,
               g_strerror(errno));
       return NULL;
    }
 
-   myChannel = g_io_channel_unix_new(fd);
+   buffer.pos = contents;
+   buffer.end = contents + length;
 
    /*
     * 2.  Sanity check the header, making sure it matches what we expect.
@@ -563,14 +480,26 @@ SlashProcNet_GetRoute(void)
     *     anyway.)
     */
 
-   myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL, NULL);
-   if (myIoStatus != G_IO_STATUS_NORMAL ||
-       g_regex_match(myFieldsRE, myLine, 0, NULL) == FALSE) {
+   if (!NextLine(&buffer, &line)) {
       goto out;
    }
 
-   g_free(myLine);
-   myLine = NULL;
+   for (i = 0; i < ARRAYSIZE(fields); i++) {
+      const char *field;
+      gsize fieldLen;
+
+      if ((i > 0 && !SkipSpaces(&line)) ||
+          !ParseWord(&line, &field, &fieldLen) ||
+          fieldLen != strlen(fields[i]) ||
+          memcmp(field, fields[i], fieldLen) != 0) {
+         goto out;
+      }
+   }
+
+   SkipSpaces(&line);
+   if (!IsAtEnd(&line)) {
+      goto out;
+   }
 
    myArray = g_ptr_array_new();
 
@@ -578,24 +507,46 @@ SlashProcNet_GetRoute(void)
     * 3.  For each line...
     */
 
-   while ((myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL,
-                                               NULL)) == G_IO_STATUS_NORMAL) {
-      GMatchInfo *myMatchInfo = NULL;
+   while (NextLine(&buffer, &line)) {
       struct rtentry *myEntry = NULL;
       struct sockaddr_in *sin = NULL;
-      Bool parseError = FALSE;
+      const char *iface;
+      gsize ifaceLen;
+      guint64 dst;
+      guint64 gateway;
+      guint64 flags;
+      guint64 metric;
+      guint64 mask;
+      guint64 mtu;
+      guint64 irtt;
+      guint64 unused;
 
       /*
-       * 3a. Validate with regex.
+       * 3a. Validate and tokenize.
+       *
+       * Iface Destination Gateway Flags RefCnt Use Metric Mask MTU Window IRTT
        */
-      if (!g_regex_match(myValuesRE, myLine, 0, &myMatchInfo)) {
-         parseError = TRUE;
-         goto badIteration;
+      if (!ParseWord(&line, &iface, &ifaceLen) || !SkipSpaces(&line) ||
+          !ParseHex(&line, 8, &dst) || !SkipSpaces(&line) ||
+          !ParseHex(&line, 8, &gateway) || !SkipSpaces(&line) ||
+          !ParseHex(&line, 4, &flags) || !SkipSpaces(&line) ||
+          !ParseDec(&line, FALSE, &unused) || !SkipSpaces(&line) ||
+          !ParseDec(&line, FALSE, &unused) || !SkipSpaces(&line) ||
+          !ParseDec(&line, FALSE, &metric) || !SkipSpaces(&line) ||
+          !ParseHex(&line, 8, &mask) || !SkipSpaces(&line) ||
+          !ParseDec(&line, FALSE, &mtu) || !SkipSpaces(&line) ||
+          !ParseDec(&line, FALSE, &unused) || !SkipSpaces(&line) ||
+          !ParseDec(&line, FALSE, &irtt)) {
+         goto badLine;
+      }
+
+      SkipSpaces(&line);
+      if (!IsAtEnd(&line)) {
+         goto badLine;
       }
 
       /*
-       * 3b. Allocate new rtentry, add to array.  This simplifies the cleanup
-       *     code path.
+       * 3b. Allocate new rtentry, add to array.
        */
       myEntry = g_new0(struct rtentry, 1);
       g_ptr_array_add(myArray, myEntry);
@@ -603,46 +554,34 @@ SlashProcNet_GetRoute(void)
       /*
        * 3c. Copy contents to new struct rtentry.
        */
-      myEntry->rt_dev = g_match_info_fetch(myMatchInfo, 1);
+      myEntry->rt_dev = g_strndup(iface, ifaceLen);
 
       sin = (struct sockaddr_in *)&myEntry->rt_dst;
       sin->sin_family = AF_INET;
-      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 2, 16);
+      sin->sin_addr.s_addr = dst;
 
       sin = (struct sockaddr_in *)&myEntry->rt_gateway;
       sin->sin_family = AF_INET;
-      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 3, 16);
+      sin->sin_addr.s_addr = gateway;
 
       sin = (struct sockaddr_in *)&myEntry->rt_genmask;
       sin->sin_family = AF_INET;
-      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 6, 16);
-
-      myEntry->rt_flags = MatchToGuint64(myMatchInfo, 4, 16);
-      myEntry->rt_metric = MatchToGuint64(myMatchInfo, 5, 10);
-      myEntry->rt_mtu = MatchToGuint64(myMatchInfo, 7, 10);
-      myEntry->rt_irtt = MatchToGuint64(myMatchInfo, 8, 10);
+      sin->sin_addr.s_addr = mask;
 
-badIteration:
-      g_free(myLine);
-      myLine = NULL;
-
-      g_match_info_free(myMatchInfo);
-      myMatchInfo = NULL;
-
-      if (parseError) {
-         break;
-      }
+      myEntry->rt_flags = flags;
+      myEntry->rt_metric = metric;
+      myEntry->rt_mtu = mtu;
+      myEntry->rt_irtt = irtt;
    }
 
-   if (myArray && myIoStatus != G_IO_STATUS_EOF) {
-      SlashProcNet_FreeRoute(myArray);
-      myArray = NULL;
-   }
+   goto out;
+
+badLine:
+   SlashProcNet_FreeRoute(myArray);
+   myArray = NULL;
 
 out:
-   g_free(myLine);
-   close(fd);
-   g_io_channel_unref(myChannel);
+   g_free(contents);
 
    return myArray;
 }
@@ -701,10 +640,8 @@ SlashProcNet_FreeRoute(GPtrArray *routeArray)
  *
  * @note        Caller is responsible for freeing the @c GPtrArray with
  *              SlashProcNet_FreeRoute6.
- * @note        This routine creates persistent GLib GRegexs.
  *
  * @return      On failure, NULL.  On success, a valid @c GPtrArray.
- * @todo        Consider init/cleanup routines to not "leak" GRegexs.
  * @todo        Consider rewriting, integrating with libdnet.
  *
  ******************************************************************************
@@ -713,85 +650,99 @@ SlashProcNet_FreeRoute(GPtrArray *routeArray)
 GPtrArray *
 SlashProcNet_GetRoute6(void)
 {
-   GIOChannel *myChannel = NULL;
-   GIOStatus myIoStatus;
    GPtrArray *myArray = NULL;
-   gchar *myLine = NULL;
-   Bool parseError = FALSE;
-   int fd = -1;
-
-   static GRegex *myValuesRE = NULL;
-
-   if (myValuesRE == NULL) {
-      myValuesRE = g_regex_new("^([[:xdigit:]]{32}) ([[:xdigit:]]{2}) "
-                                "([[:xdigit:]]{32}) ([[:xdigit:]]{2}) "
-                                "([[:xdigit:]]{32}) ([[:xdigit:]]{8}) "
-                                "[[:xdigit:]]{8} [[:xdigit:]]{8} "
-                                "([[:xdigit:]]{8})\\s+(\\w+)\\s*$", 0, 0,
-                                NULL);
-      ASSERT(myValuesRE);
-   }
+   SlashProcNetCursor buffer;
+   SlashProcNetCursor line;
+   gchar *contents;
+   gsize length;
 
    /*
-    * 1.  Open pathToNetRoute6, associate it with a GIOChannel.
+    * 1.  Read pathToNetRoute6.
     */
 
-   if ((fd = g_open(pathToNetRoute6, O_RDONLY)) == -1) {
+   if ((contents = ReadNode(pathToNetRoute6, &length)) == NULL) {
       Warning("%s: open(%s): %s\n", __func__, pathToNetRoute,
               g_strerror(errno));
       return NULL;
    }
 
-   myChannel = g_io_channel_unix_new(fd);
+   buffer.pos = contents;
+   buffer.end = contents + length;
 
    myArray = g_ptr_array_new();
 
-   while ((myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL,
-                                               NULL)) == G_IO_STATUS_NORMAL) {
-      struct in6_rtmsg *myEntry = NULL;
-      GMatchInfo *myMatchInfo = NULL;
+   /*
+    * 2.  For each line...
+    *
+    * dst dst_len src src_len gateway metric refcnt use flags iface
+    */
 
-      if (!g_regex_match(myValuesRE, myLine, 0, &myMatchInfo)) {
-         parseError = TRUE;
-         goto badIteration;
+   while (NextLine(&buffer, &line)) {
+      struct in6_rtmsg entry;
+      struct in6_rtmsg *myEntry;
+      const char *iface;
+      gsize ifaceLen;
+      guint64 dstLen;
+      guint64 srcLen;
+      guint64 metric;
+      guint64 flags;
+      guint64 unused;
+      char ifName[64];
+
+      memset(&entry, 0, sizeof entry);
+
+      if (!ParseIn6Addr(&line, &entry.rtmsg_dst) || *line.pos++ != ' ' ||
+          !ParseHex(&line, 2, &dstLen) || *line.pos++ != ' ' ||
+          !ParseIn6Addr(&line, &entry.rtmsg_src) || *line.pos++ != ' ' ||
+          !ParseHex(&line, 2, &srcLen) || *line.pos++ != ' ' ||
+          !ParseIn6Addr(&line, &entry.rtmsg_gateway) || *line.pos++ != ' ' ||
+          !ParseHex(&line, 8, &metric) || *line.pos++ != ' ' ||
+          !ParseHex(&line, 8, &unused) || *line.pos++ != ' ' ||
+          !ParseHex(&line, 8, &unused) || *line.pos++ != ' ' ||
+          !ParseHex(&line, 8, &flags) || !SkipSpaces(&line) ||
+          !ParseWord(&line, &iface, &ifaceLen)) {
+         goto badLine;
       }
 
-      myEntry = g_new0(struct in6_rtmsg, 1);
-      g_ptr_array_add(myArray, myEntry);
-
-      MATCHEXPR(myMatchInfo, 1, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_dst));
-      MATCHEXPR(myMatchInfo, 3, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_src));
-      MATCHEXPR(myMatchInfo, 5, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_gateway));
-
-      myEntry->rtmsg_dst_len = MatchToGuint64(myMatchInfo, 2, 16);
-      myEntry->rtmsg_src_len = MatchToGuint64(myMatchInfo, 4, 16);
-      myEntry->rtmsg_metric = MatchToGuint64(myMatchInfo, 6, 16);
-      myEntry->rtmsg_flags = MatchToGuint64(myMatchInfo, 7, 16);
+      SkipSpaces(&line);
+      if (!IsAtEnd(&line)) {
+         goto badLine;
+      }
 
-      MATCHEXPR(myMatchInfo, 8, myEntry->rtmsg_ifindex = NetUtil_GetIfIndex(MATCH));
+      myEntry = g_new(struct in6_rtmsg, 1);
+      g_ptr_array_add(myArray, myEntry);
 
-badIteration:
-      g_free(myLine);
-      myLine = NULL;
+      entry.rtmsg_dst_len = dstLen;
+      entry.rtmsg_src_len = srcLen;
+      entry.rtmsg_metric = metric;
+      entry.rtmsg_flags = flags;
 
-      g_match_info_free(myMatchInfo);
-      myMatchInfo = NULL;
+      /*
+       * Interface names fit in IFNAMSIZ; anything longer can't be a real
+       * interface, but is still looked up for consistency.
+       */
+      if (ifaceLen < sizeof ifName) {
+         memcpy(ifName, iface, ifaceLen);
+         ifName[ifaceLen] = '\0';
+         entry.rtmsg_ifindex = NetUtil_GetIfIndex(ifName);
+      } else {
+         gchar *longName = g_strndup(iface, ifaceLen);
 
-      if (parseError) {
-         break;
+         entry.rtmsg_ifindex = NetUtil_GetIfIndex(longName);
+         g_free(longName);
       }
-   }
 
-   if (myArray && myIoStatus != G_IO_STATUS_EOF) {
-      SlashProcNet_FreeRoute6(myArray);
-      myArray = NULL;
+      *myEntry = entry;
    }
 
-   g_free(myLine);
-   myLine = NULL;
+   goto out;
 
-   close(fd);
-   g_io_channel_unref(myChannel);
+badLine:
+   SlashProcNet_FreeRoute6(myArray);
+   myArray = NULL;
+
+out:
+   g_free(contents);
 
    return myArray;
 }
@@ -834,53 +785,323 @@ SlashProcNet_FreeRoute6(GPtrArray *routeArray)
 
 /*
  ******************************************************************************
- * Ip6StringToIn6Addr --                                                */ /**
+ * ReadNode --                                                          */ /**
  *
- * @brief Parses a @c /proc/net/ipv6_route hexadecimal IPv6 address and
- *        records it in a <tt>struct in6_addr</tt>.
+ * @brief Reads a whole @c /proc node into a NUL-terminated buffer.
+ *
+ * @c /proc nodes report a size of 0, so the buffer is grown until a read
+ * comes back short.  Reads are done with @c pread, a single call being
+ * enough for all but the largest routing tables.
+ *
+ * @param[in]   path            Path of the node.
+ * @param[out]  length          Length of the contents, excluding the NUL.
+ *
+ * @return      The contents, to be freed with @c g_free, or NULL on failure
+ *              with @c errno set.
+ *
+ ******************************************************************************
+ */
+
+static gchar *
+ReadNode(const char *path,
+         gsize *length)
+{
+   gchar *contents;
+   gsize size = SLASHPROC_READ_SIZE;
+   gsize used = 0;
+   int fd;
+
+   if ((fd = g_open(path, O_RDONLY)) == -1) {
+      return NULL;
+   }
+
+   contents = g_malloc(size);
+
+   for (;;) {
+      ssize_t nread = pread(fd, contents + used, size - used - 1, used);
+
+      if (nread < 0) {
+         int error = errno;
+
+         if (error == EINTR) {
+            continue;
+         }
+         g_free(contents);
+         close(fd);
+         errno = error;
+         return NULL;
+      }
+
+      if (nread == 0) {
+         break;
+      }
+
+      used += nread;
+      if (size - used - 1 == 0) {
+         size *= 2;
+         contents = g_realloc(contents, size);
+      }
+   }
+
+   close(fd);
+
+   contents[used] = '\0';
+   *length = used;
+
+   return contents;
+}
+
+
+/*
+ ******************************************************************************
+ * NextLine --                                                          */ /**
+ *
+ * @brief Extracts the next line from a buffer.
+ *
+ * @param[in,out] buffer        Cursor over the whole buffer, moved past the
+ *                              line and its terminator.
+ * @param[out]    line          Cursor over the line, excluding the
+ *                              terminator.
  *
- * @param[in]   ip6String       Source string.
- * @param[out]  in6_addr        Output struct.
+ * @return      FALSE if the buffer is exhausted.
  *
  ******************************************************************************
  */
 
-static void
-Ip6StringToIn6Addr(const char *ip6String,
-                   struct in6_addr *in6_addr)
+static Bool
+NextLine(SlashProcNetCursor *buffer,
+         SlashProcNetCursor *line)
 {
+   const char *eol;
+
+   if (buffer->pos >= buffer->end) {
+      return FALSE;
+   }
+
+   eol = memchr(buffer->pos, '\n', buffer->end - buffer->pos);
+   if (eol == NULL) {
+      eol = buffer->end;
+   }
+
+   line->pos = buffer->pos;
+   line->end = eol;
+   buffer->pos = eol < buffer->end ? eol + 1 : eol;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * SkipSpaces --                                                        */ /**
+ *
+ * @brief Skips white space in a line.
+ *
+ * @param[in,out] line          Line cursor.
+ *
+ * @return      TRUE if at least one white space character was skipped.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+SkipSpaces(SlashProcNetCursor *line)
+{
+   const char *start = line->pos;
+
+   while (line->pos < line->end && g_ascii_isspace(*line->pos)) {
+      line->pos++;
+   }
+
+   return line->pos != start;
+}
+
+
+/*
+ ******************************************************************************
+ * IsAtEnd --                                                           */ /**
+ *
+ * @brief Checks whether a line has been entirely consumed.
+ *
+ * @param[in]   line            Line cursor.
+ *
+ * @return      TRUE if there is nothing left in the line.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+IsAtEnd(SlashProcNetCursor *line)
+{
+   return line->pos >= line->end;
+}
+
+
+/*
+ ******************************************************************************
+ * ParseWord --                                                         */ /**
+ *
+ * @brief Parses a non-empty run of word characters (@c [A-Za-z0-9_]).
+ *
+ * @param[in,out] line          Line cursor.
+ * @param[out]    word          Start of the word, not NUL-terminated.
+ * @param[out]    wordLen       Length of the word.
+ *
+ * @return      FALSE if there is no word at the cursor.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+ParseWord(SlashProcNetCursor *line,
+          const char **word,
+          gsize *wordLen)
+{
+   const char *start = line->pos;
+
+   while (line->pos < line->end &&
+          (g_ascii_isalnum(*line->pos) || *line->pos == '_')) {
+      line->pos++;
+   }
+
+   *word = start;
+   *wordLen = line->pos - start;
+
+   return *wordLen > 0;
+}
+
+
+/*
+ ******************************************************************************
+ * ParseHex --                                                          */ /**
+ *
+ * @brief Parses a hexadecimal number of exactly @a digits digits.
+ *
+ * @param[in,out] line          Line cursor.
+ * @param[in]     digits        Number of digits, at most 16.
+ * @param[out]    value         Parsed value.
+ *
+ * @return      FALSE if the cursor isn't at @a digits hexadecimal digits.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+ParseHex(SlashProcNetCursor *line,
+         unsigned int digits,
+         guint64 *value)
+{
+   guint64 result = 0;
    unsigned int i;
 
-   ASSERT(strlen(ip6String) == 32);
+   ASSERT(digits <= 16);
 
-   for (i = 0; i < 16; i++) {
-      int nmatched;
-      nmatched = sscanf(&ip6String[2 * i], "%2hhx", &in6_addr->s6_addr[i]);
-      ASSERT(nmatched == 1);
+   if ((gsize) (line->end - line->pos) < digits) {
+      return FALSE;
+   }
+
+   for (i = 0; i < digits; i++) {
+      int digit = g_ascii_xdigit_value(line->pos[i]);
+
+      if (digit < 0) {
+         return FALSE;
+      }
+      result = (result << 4) | digit;
+   }
+
+   line->pos += digits;
+   *value = result;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ParseDec --                                                          */ /**
+ *
+ * @brief Parses a decimal number, with the semantics of
+ *        @c g_ascii_strtoull: out of range values saturate, and negative
+ *        values are negated in 64 bits.
+ *
+ * @param[in,out] line          Line cursor.
+ * @param[in]     allowNegative Whether a leading '-' is accepted.
+ * @param[out]    value         Parsed value.
+ *
+ * @return      FALSE if the cursor isn't at a number.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+ParseDec(SlashProcNetCursor *line,
+         Bool allowNegative,
+         guint64 *value)
+{
+   guint64 result = 0;
+   Bool negative = FALSE;
+   Bool overflow = FALSE;
+   const char *start;
+
+   if (allowNegative && line->pos < line->end && *line->pos == '-') {
+      negative = TRUE;
+      line->pos++;
    }
+
+   start = line->pos;
+   while (line->pos < line->end && g_ascii_isdigit(*line->pos)) {
+      unsigned int digit = *line->pos - '0';
+
+      if (result > (G_MAXUINT64 - digit) / 10) {
+         overflow = TRUE;
+      }
+      result = result * 10 + digit;
+      line->pos++;
+   }
+
+   if (line->pos == start) {
+      return FALSE;
+   }
+
+   if (overflow) {
+      *value = G_MAXUINT64;
+   } else {
+      *value = negative ? -result : result;
+   }
+
+   return TRUE;
 }
 
 
 /*
  ******************************************************************************
- * MatchToGuint64 --                                                    */ /**
+ * ParseIn6Addr --                                                      */ /**
+ *
+ * @brief Parses a @c /proc/net/ipv6_route hexadecimal IPv6 address and
+ *        records it in a <tt>struct in6_addr</tt>.
  *
- * @brief Wrapper around @c g_ascii_strtoull and @c g_match_info_fetch.
+ * @param[in,out] line          Line cursor.
+ * @param[out]    in6_addr      Output struct.
  *
- * @param[in]   matchInfo       Source regular expression match context.
- * @param[in]   matchIndex      Match number to fetch.
- * @param[in]   base            Base represented by matched string.
- *                              (See @c g_ascii_strtoull docs.)
+ * @return      FALSE if the cursor isn't at 32 hexadecimal digits.
  *
  ******************************************************************************
  */
 
-static guint64
-MatchToGuint64(const GMatchInfo *matchInfo,
-               const gint matchIndex,
-               gint base)
+static Bool
+ParseIn6Addr(SlashProcNetCursor *line,
+             struct in6_addr *in6_addr)
 {
-   guint64 retval;
-   MATCHEXPR(matchInfo, matchIndex, retval = g_ascii_strtoull(MATCH, NULL, base));
-   return retval;
+   unsigned int i;
+
+   for (i = 0; i < 16; i++) {
+      guint64 byte;
+
+      if (!ParseHex(line, 2, &byte)) {
+         return FALSE;
+      }
+      in6_addr->s6_addr[i] = byte;
+   }
+
+   return TRUE;
 }
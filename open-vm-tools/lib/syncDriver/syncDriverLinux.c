@@ -25,14 +25,18 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <linux/fs.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include "debug.h"
 #include "dynbuf.h"
+#include "hostinfo.h"
 #include "strutil.h"
+#include "vm_atomic.h"
 #include "syncDriverInt.h"
 
 /* Out toolchain headers are somewhat outdated and don't define these. */
@@ -41,6 +45,38 @@
 #  define FITHAW          _IOWR('X', 120, int)    /* Thaw */
 #endif
 
+#if !defined(SYS_syncfs)
+#  if defined(__x86_64__)
+#     define SYS_syncfs   306
+#  elif defined(__i386__)
+#     define SYS_syncfs   344
+#  elif defined(__aarch64__)
+#     define SYS_syncfs   267
+#  elif defined(__arm__)
+#     define SYS_syncfs   (__NR_SYSCALL_BASE + 373)
+#  endif
+#endif
+
+/* Max. number of threads used to open and flush the mounts before freezing. */
+#define LINUX_FREEZE_MAX_THREADS   8
+
+
+/*
+ * A mount point to be frozen. The fd is opened, and the file system flushed,
+ * by the worker threads before any freezing starts.
+ */
+typedef struct LinuxFreezeMount {
+   char          *path;
+   int            fd;
+   int            openErr;    // errno from open(), 0 on success
+} LinuxFreezeMount;
+
+typedef struct LinuxFreezeQueue {
+   LinuxFreezeMount *mounts;
+   uint32            count;
+   Atomic_uint32     next;
+} LinuxFreezeQueue;
+
 
 typedef struct LinuxDriver {
    SyncHandle  driver;
@@ -106,6 +142,91 @@ LinuxFiClose(SyncDriverHandle handle)
 }
 
 
+/*
+ *******************************************************************************
+ * LinuxFreezePrepareWorker --                                            */ /**
+ *
+ * Thread body: opens the mount points in the queue and flushes their file
+ * systems with syncfs(). FIFREEZE syncs the file system itself, but with
+ * the dirty data already written out that sync is short, and so is the time
+ * the earlier mounts spend frozen while later ones are being processed.
+ *
+ * @param[in] data   The LinuxFreezeQueue.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static void *
+LinuxFreezePrepareWorker(void *data)
+{
+   LinuxFreezeQueue *queue = data;
+
+   for (;;) {
+      uint32 i = Atomic_FetchAndInc(&queue->next);
+      LinuxFreezeMount *mount;
+
+      if (i >= queue->count) {
+         break;
+      }
+
+      mount = &queue->mounts[i];
+      mount->fd = open(mount->path, O_RDONLY);
+      if (mount->fd == -1) {
+         mount->openErr = errno;
+         continue;
+      }
+
+#if defined(SYS_syncfs)
+      if (syscall(SYS_syncfs, mount->fd) == -1) {
+         Debug(LGPFX "syncfs of '%s' failed: %d (%s)\n",
+               mount->path, errno, strerror(errno));
+      }
+#endif
+   }
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFreezePrepare --                                                  */ /**
+ *
+ * Opens and flushes all the mount points in the queue, in parallel, using up
+ * to LINUX_FREEZE_MAX_THREADS threads (including the caller's).
+ *
+ * @param[in] queue   Mount points to prepare.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxFreezePrepare(LinuxFreezeQueue *queue)
+{
+   pthread_t threads[LINUX_FREEZE_MAX_THREADS - 1];
+   uint32 numThreads = 0;
+   uint32 i;
+
+   Atomic_Write(&queue->next, 0);
+
+   while (numThreads < ARRAYSIZE(threads) && numThreads + 1 < queue->count) {
+      if (pthread_create(&threads[numThreads], NULL, LinuxFreezePrepareWorker,
+                         queue) != 0) {
+         break;
+      }
+      numThreads++;
+   }
+
+   LinuxFreezePrepareWorker(queue);
+
+   for (i = 0; i < numThreads; i++) {
+      pthread_join(threads[i], NULL);
+   }
+}
+
+
 /*
  *******************************************************************************
  * LinuxDriver_Freeze --                                                  */ /**
@@ -128,15 +249,19 @@ LinuxDriver_Freeze(const char *paths,
                    SyncDriverHandle *handle)
 {
    char *path;
-   int fd;
    size_t count = 0;
    unsigned int index = 0;
+   uint32 i;
    Bool first = TRUE;
    DynBuf fds;
+   DynBuf mounts;
+   LinuxFreezeQueue queue;
    LinuxDriver *sync = NULL;
    SyncDriverErr err = SD_SUCCESS;
+   VmTimeType freezeStart;
 
    DynBuf_Init(&fds);
+   DynBuf_Init(&mounts);
 
    Debug(LGPFX "Freezing using Linux ioctls...\n");
 
@@ -148,22 +273,47 @@ LinuxDriver_Freeze(const char *paths,
    sync->driver.thaw = LinuxFiThaw;
    sync->driver.close = LinuxFiClose;
 
+   while ((path = StrUtil_GetNextToken(&index, paths, ":")) != NULL) {
+      LinuxFreezeMount mount;
+
+      mount.path = path;
+      mount.fd = -1;
+      mount.openErr = 0;
+      if (!DynBuf_Append(&mounts, &mount, sizeof mount)) {
+         free(path);
+         err = SD_ERROR;
+         goto exit;
+      }
+   }
+
    /*
-    * Iterate through the requested paths. If we get an error for the first
-    * path, and it's not EPERM, assume that the ioctls are not available in
-    * the current kernel.
+    * Open and flush everything up front, so that the window between the
+    * first and the last freeze only covers the freezes themselves.
     */
-   while ((path = StrUtil_GetNextToken(&index, paths, ":")) != NULL) {
-      fd = open(path, O_RDONLY);
-      if (fd == -1) {
-         switch (errno) {
+   queue.mounts = DynBuf_Get(&mounts);
+   queue.count = DynBuf_GetSize(&mounts) / sizeof *queue.mounts;
+   LinuxFreezePrepare(&queue);
+
+   /*
+    * Freeze the requested paths in the order given, which for the mount list
+    * is the order the file systems were mounted in. If we get an error for
+    * the first path, and it's not EPERM, assume that the ioctls are not
+    * available in the current kernel.
+    */
+   freezeStart = Hostinfo_SystemTimerUS();
+   for (i = 0; i < queue.count; i++) {
+      LinuxFreezeMount *mount = &queue.mounts[i];
+      VmTimeType start;
+
+      if (mount->fd == -1) {
+         switch (mount->openErr) {
          case EACCES:
             /*
              * We sometimes get access errors to virtual filesystems mounted
              * as users with permission 700, so just ignore these.
              */
-            Debug(LGPFX "cannot access mounted directory '%s'.\n", path);
-            free(path);
+            Debug(LGPFX "cannot access mounted directory '%s'.\n",
+                  mount->path);
             continue;
 
          case EIO:
@@ -172,20 +322,19 @@ LinuxDriver_Freeze(const char *paths,
              * us these; probably could use a better way to detect HFGS, but
              * this should be enough. Just skip.
              */
-            Debug(LGPFX "I/O error reading directory '%s'.\n", path);
-            free(path);
+            Debug(LGPFX "I/O error reading directory '%s'.\n", mount->path);
             continue;
 
          default:
             Debug(LGPFX "failed to open '%s': %d (%s)\n",
-                  path, errno, strerror(errno));
+                  mount->path, mount->openErr, strerror(mount->openErr));
             err = SD_ERROR;
-            free(path);
             goto exit;
          }
       }
 
-      if (ioctl(fd, FIFREEZE) == -1) {
+      start = Hostinfo_SystemTimerUS();
+      if (ioctl(mount->fd, FIFREEZE) == -1) {
          int ioctlerr = errno;
          /*
           * If the ioctl does not exist, Linux will return ENOTTY. If it's not
@@ -197,37 +346,49 @@ LinuxDriver_Freeze(const char *paths,
           * more than once depending on the OS configuration (e.g., usage of
           * bind mounts).
           */
-         close(fd);
          if (ioctlerr != EBUSY && ioctlerr != EOPNOTSUPP) {
             Debug(LGPFX "failed to freeze '%s': %d (%s)\n",
-                  path, ioctlerr, strerror(ioctlerr));
+                  mount->path, ioctlerr, strerror(ioctlerr));
             err = first && ioctlerr == ENOTTY ? SD_UNAVAILABLE : SD_ERROR;
-            free(path);
             break;
          }
       } else {
-         Debug(LGPFX "successfully froze '%s'.\n", path);
-         if (!DynBuf_Append(&fds, &fd, sizeof fd)) {
-            if (ioctl(fd, FITHAW) == -1) {
+         Debug(LGPFX "successfully froze '%s' in %"FMT64"d us.\n",
+               mount->path, Hostinfo_SystemTimerUS() - start);
+         if (!DynBuf_Append(&fds, &mount->fd, sizeof mount->fd)) {
+            if (ioctl(mount->fd, FITHAW) == -1) {
                Warning(LGPFX "failed to thaw '%s': %d (%s)\n",
-                       path, errno, strerror(errno));
+                       mount->path, errno, strerror(errno));
             }
-            free(path);
-            close(fd);
             err = SD_ERROR;
             break;
          }
+         mount->fd = -1;
          count++;
       }
 
-      free(path);
       first = FALSE;
    }
 
+   if (err == SD_SUCCESS) {
+      Debug(LGPFX "froze %"FMTSZ"u file systems in %"FMT64"d us.\n",
+            count, Hostinfo_SystemTimerUS() - freezeStart);
+   }
+
 exit:
    sync->fds = DynBuf_Detach(&fds);
    sync->fdCnt = count;
 
+   queue.mounts = DynBuf_Get(&mounts);
+   queue.count = DynBuf_GetSize(&mounts) / sizeof *queue.mounts;
+   for (i = 0; i < queue.count; i++) {
+      if (queue.mounts[i].fd != -1) {
+         close(queue.mounts[i].fd);
+      }
+      free(queue.mounts[i].path);
+   }
+   DynBuf_Destroy(&mounts);
+
    if (err != SD_SUCCESS) {
       LinuxFiThaw(&sync->driver);
       LinuxFiClose(&sync->driver);
@@ -236,4 +397,3 @@ exit:
    }
    return err;
 }
-
@@ -27,6 +27,10 @@
 #error This file should not be compiled on this platform.
 #endif
 
+#if defined(__linux__)
+#define _GNU_SOURCE // Needed to get fallocate()
+#endif
+
 #include <stdio.h>
 #include <sys/stat.h>
 #if defined(__linux__) || defined(sun)
@@ -41,6 +45,12 @@
 # endif /* __FreeBSD_version >= 500000 */
 #endif
 #include <unistd.h>
+#if defined(__linux__)
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
 
 #include "vmware.h"
 #include "wiper.h"
@@ -70,6 +80,30 @@
 /* Number of device numbers to store for device-mapper */
 #define WIPER_MAX_DM_NUMBERS 8
 
+/* Free space to leave on the partition when filling it */
+#define WIPER_RESERVED_SPACE (((uint64)5) << 20) /* 5 MB */
+
+/*
+ * Number of bytes to allocate or punch per call to Wiper_Next() with the
+ * punch-hole backend. Neither operation touches the data, so this can be
+ * much larger than what the zero-fill backend writes.
+ */
+#define WIPER_PUNCH_STEP (((uint64)64) << 20) /* 64 MB */
+
+/* Number of bytes of the filesystem to trim per call to Wiper_Next() */
+#define WIPER_TRIM_STEP (((uint64)1) << 30) /* 1 GB */
+
+/* Private WiperPartition flags */
+#define WIPER_FLAG_DISCARD_MOUNT 0x1   /* Mounted with online discard */
+
+#if defined(__linux__) && defined(FITRIM)
+# define WIPER_HAVE_TRIM
+#endif
+
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+# define WIPER_HAVE_PUNCH_HOLE
+#endif
+
 #if defined(sun) || defined(__linux__)
 # define PROCFS "proc"
 #elif defined(__FreeBSD__) || defined(__APPLE__)
@@ -81,6 +115,8 @@
 typedef enum {
    WIPER_PHASE_CREATE,
    WIPER_PHASE_FILL,
+   WIPER_PHASE_PUNCH,
+   WIPER_PHASE_TRIM,
 } WiperPhase;
 
 typedef struct File {
@@ -104,6 +140,17 @@ typedef struct WiperState {
    unsigned char buf[WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE];
    /* Effective user id */
    uid_t euid;
+   /* How free space is reclaimed */
+   WiperBackend backend;
+   /* Punch-hole backend: bytes allocated, and bytes punched so far */
+   uint64 allocated;
+   uint64 punched;
+   /* Punch-hole backend: offset of the next hole in the current file */
+   uint64 punchOffset;
+   /* Trim backend: descriptor of the mount point */
+   int trimFd;
+   /* Trim backend: offset of the next range to trim */
+   uint64 trimOffset;
 } WiperState;
 
 #ifdef sun
@@ -426,6 +473,7 @@ WiperPartitionFilter(WiperPartition *item,         // IN/OUT
    size_t i;
 
    item->type = PARTITION_UNSUPPORTED;
+   item->flags = 0;
 
    for (i = 0; i < ARRAYSIZE(gKnownPartitions); i++) {
       info = &gKnownPartitions[i];
@@ -465,6 +513,12 @@ WiperPartitionFilter(WiperPartition *item,         // IN/OUT
       }
    }
 
+#if defined(__linux__)
+   if (hasmntopt(mnt, "discard") != NULL) {
+      item->flags |= WIPER_FLAG_DISCARD_MOUNT;
+   }
+#endif
+
    if (item->type == PARTITION_UNSUPPORTED) {
       ASSERT(comment);
       item->comment = Util_SafeStrdup(comment);
@@ -691,12 +745,106 @@ Wiper_IsWipeSupported(const WiperPartition *part)
 }
 
 
+#if defined(WIPER_HAVE_TRIM)
 /*
  *-----------------------------------------------------------------------------
  *
- * Wiper_Start --
+ * WiperCanTrim --
+ *
+ *      Check whether the filesystem mounted on a partition supports FITRIM
+ *      and sits on a device that accepts discards.
  *
- *      Allocate and initialize the wiper state
+ *      The probe asks for an empty range: filesystems that can trim reject
+ *      it with EINVAL without discarding anything, while the others fail
+ *      with ENOTTY (no FITRIM support), EOPNOTSUPP (device can't discard)
+ *      or EPERM (not privileged).
+ *
+ * Results:
+ *      TRUE if the partition can be trimmed.
+ *
+ * Side Effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+WiperCanTrim(const WiperPartition *p)     // IN
+{
+   struct fstrim_range range;
+   Bool ret;
+   int fd;
+
+   fd = Posix_Open(p->mountPoint, O_RDONLY);
+   if (fd < 0) {
+      return FALSE;
+   }
+
+   range.start = 0;
+   range.len = 0;
+   range.minlen = 0;
+   ret = ioctl(fd, FITRIM, &range) == 0 || errno == EINVAL;
+
+   close(fd);
+   return ret;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Wiper_GetBestBackend --
+ *
+ *      Find the fastest way of reclaiming the free space of a partition.
+ *
+ *      Trimming asks the filesystem to discard its free blocks directly,
+ *      without writing anything. Filesystems mounted with online discard
+ *      pass discards down whenever blocks are freed, so allocating all the
+ *      free space and punching holes in it achieves the same thing without
+ *      writing data. Otherwise, free space has to be filled with zeroes.
+ *
+ * Results:
+ *      The backend to pass to Wiper_StartWithBackend().
+ *
+ * Side Effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+WiperBackend
+Wiper_GetBestBackend(const WiperPartition *p)     // IN
+{
+   ASSERT(p);
+
+   if (p->type == PARTITION_UNSUPPORTED || !p->attemptUnmaps) {
+      return WIPER_BACKEND_ZERO_FILL;
+   }
+
+#if defined(WIPER_HAVE_TRIM)
+   if (WiperCanTrim(p)) {
+      return WIPER_BACKEND_TRIM;
+   }
+#endif
+
+#if defined(WIPER_HAVE_PUNCH_HOLE)
+   if ((p->flags & WIPER_FLAG_DISCARD_MOUNT) != 0) {
+      return WIPER_BACKEND_PUNCH_HOLE;
+   }
+#endif
+
+   return WIPER_BACKEND_ZERO_FILL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Wiper_StartWithBackend --
+ *
+ *      Allocate and initialize the wiper state for the given backend. If the
+ *      backend can't be used, falls back to filling free space with zeroes.
  *
  * Results:
  *      A Wiper_State on success
@@ -709,8 +857,8 @@ Wiper_IsWipeSupported(const WiperPartition *part)
  */
 
 Wiper_State *
-Wiper_Start(const WiperPartition *p,             // IN
-            unsigned int maxWiperFileSize)       // IN : unused
+Wiper_StartWithBackend(const WiperPartition *p,     // IN
+                       WiperBackend backend)        // IN
 {
    WiperState *state;
 
@@ -726,11 +874,67 @@ Wiper_Start(const WiperPartition *p,             // IN
    state->nr = 0;
    memset(state->buf, 0, WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE);
    state->euid = geteuid();
+   state->backend = WIPER_BACKEND_ZERO_FILL;
+   state->allocated = 0;
+   state->punched = 0;
+   state->punchOffset = 0;
+   state->trimFd = -1;
+   state->trimOffset = 0;
+
+   switch (backend) {
+#if defined(WIPER_HAVE_TRIM)
+   case WIPER_BACKEND_TRIM:
+      state->trimFd = Posix_Open(p->mountPoint, O_RDONLY);
+      if (state->trimFd < 0) {
+         Log("Unable to open %s for trimming, using zero fill.\n",
+             p->mountPoint);
+         break;
+      }
+      state->backend = WIPER_BACKEND_TRIM;
+      state->phase = WIPER_PHASE_TRIM;
+      break;
+#endif
+
+#if defined(WIPER_HAVE_PUNCH_HOLE)
+   case WIPER_BACKEND_PUNCH_HOLE:
+      state->backend = WIPER_BACKEND_PUNCH_HOLE;
+      break;
+#endif
+
+   default:
+      break;
+   }
 
    return (void *)state;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Wiper_Start --
+ *
+ *      Allocate and initialize the wiper state, filling free space with
+ *      zeroes.
+ *
+ * Results:
+ *      A Wiper_State on success
+ *      NULL on failure
+ *
+ * Side Effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Wiper_State *
+Wiper_Start(const WiperPartition *p,             // IN
+            unsigned int maxWiperFileSize)       // IN : unused
+{
+   return Wiper_StartWithBackend(p, WIPER_BACKEND_ZERO_FILL);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -788,10 +992,205 @@ WiperClean(WiperState *state)      // IN/OUT
       state->f = next;
    }
 
+   if (state->trimFd >= 0) {
+      close(state->trimFd);
+   }
+
    free(state);
 }
 
 
+#if defined(WIPER_HAVE_TRIM)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperNextTrim --
+ *
+ *      Trim the next WIPER_TRIM_STEP bytes of the filesystem. The last
+ *      range is left open-ended so that the whole filesystem is covered
+ *      even if statfs() doesn't count all of its blocks.
+ *
+ * Results:
+ *      Same as Wiper_Next().
+ *
+ * Side Effects:
+ *      The filesystem discards the free blocks in the range.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned char *
+WiperNextTrim(WiperState **state,         // IN/OUT
+              unsigned int *progress)     // OUT
+{
+   struct fstrim_range range;
+   uint64 free;
+   uint64 total;
+   unsigned char *error;
+   Bool last;
+
+   error = WiperGetSpace(*state, &free, &total);
+   if (*error != '\0') {
+      WiperClean(*state);
+      *state = NULL;
+      return error;
+   }
+
+   range.start = (*state)->trimOffset;
+   range.len = WIPER_TRIM_STEP;
+   range.minlen = 0;
+
+   last = range.start + range.len >= total;
+   if (last) {
+      range.len = MAX_UINT64 - range.start;
+   }
+
+   if (ioctl((*state)->trimFd, FITRIM, &range) < 0) {
+      Log("FITRIM failed on %s: %d\n", (*state)->p->mountPoint, errno);
+      WiperClean(*state);
+      *state = NULL;
+      return "Unable to trim the partition";
+   }
+
+   if (last) {
+      WiperClean(*state);
+      *state = NULL;
+      *progress = 100;
+      return "";
+   }
+
+   (*state)->trimOffset += WIPER_TRIM_STEP;
+   *progress = 99 * (*state)->trimOffset / total;
+   return "";
+}
+#endif
+
+
+#if defined(WIPER_HAVE_PUNCH_HOLE)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperAllocate --
+ *
+ *      Allocate (without writing) the next piece of free space into the
+ *      current wiper file.
+ *
+ * Results:
+ *      "" on success; the phase moves to WIPER_PHASE_PUNCH once the
+ *      partition is full, or the backend falls back to zero fill if the
+ *      filesystem can't allocate space this way.
+ *      The description of the error on failure.
+ *
+ * Side Effects:
+ *      Uses up free space on the partition.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned char *
+WiperAllocate(WiperState *state,     // IN/OUT
+              uint64 free)           // IN
+{
+   File *f = state->f;
+   uint64 len = MIN(WIPER_PUNCH_STEP, free - WIPER_RESERVED_SPACE);
+
+   if (f->size + len >= (((uint64)2) << 30) /* 2 GB */) {
+      state->phase = WIPER_PHASE_CREATE;
+      return "";
+   }
+
+   if (fallocate(f->fd.posix, 0, f->size, len) != 0) {
+      switch (errno) {
+      case ENOSPC:
+         state->phase = WIPER_PHASE_PUNCH;
+         return "";
+
+      case EOPNOTSUPP:
+         Log("Unable to allocate space on %s, using zero fill.\n",
+             state->p->mountPoint);
+         state->backend = WIPER_BACKEND_ZERO_FILL;
+         return "";
+
+      case EDQUOT:
+         return "User's disk quota exceeded";
+
+      default:
+         return "Unable to allocate space for a wiper file";
+      }
+   }
+
+   f->size += len;
+   state->allocated += len;
+   return "";
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperNextPunch --
+ *
+ *      Punch the next hole in the wiper files, giving the space back to the
+ *      filesystem (which discards it). Files are deleted once fully punched.
+ *
+ * Results:
+ *      Same as Wiper_Next().
+ *
+ * Side Effects:
+ *      Frees space on the partition.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned char *
+WiperNextPunch(WiperState **state,         // IN/OUT
+               unsigned int *progress)     // OUT
+{
+   File *f = (*state)->f;
+   uint64 len;
+
+   if (f == NULL) {
+      /* We are done */
+      WiperClean(*state);
+      *state = NULL;
+      *progress = 100;
+      return "";
+   }
+
+   len = MIN(WIPER_PUNCH_STEP, f->size - (*state)->punchOffset);
+   if (len > 0 &&
+       fallocate(f->fd.posix, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                 (*state)->punchOffset, len) != 0) {
+      if (errno != EOPNOTSUPP) {
+         WiperClean(*state);
+         *state = NULL;
+         return "Unable to punch holes in a wiper file";
+      }
+
+      /* Deleting the file gives back the rest of its space. */
+      len = f->size - (*state)->punchOffset;
+   }
+
+   (*state)->punchOffset += len;
+   (*state)->punched += len;
+
+   if ((*state)->punchOffset >= f->size) {
+      FileIO_Close(&f->fd);
+      (*state)->f = f->next;
+      (*state)->punchOffset = 0;
+      free(f);
+   }
+
+   if ((*state)->allocated == 0) {
+      *progress = 99;
+   } else {
+      *progress = 50 + 49 * (*state)->punched / (*state)->allocated;
+   }
+   return "";
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -828,6 +1227,18 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
    ASSERT(*s);
    state = (WiperState **)s;
 
+#if defined(WIPER_HAVE_TRIM)
+   if ((*state)->phase == WIPER_PHASE_TRIM) {
+      return WiperNextTrim(state, progress);
+   }
+#endif
+
+#if defined(WIPER_HAVE_PUNCH_HOLE)
+   if ((*state)->phase == WIPER_PHASE_PUNCH) {
+      return WiperNextPunch(state, progress);
+   }
+#endif
+
    error = WiperGetSpace(*state, &free, &total);
    if (*error != '\0') {
       WiperClean(*state);
@@ -837,7 +1248,14 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
 
    /* Disk space is an important system resource. Don't fill the partition
       completely */
-   if (free <= (((uint64)5) << 20) /* 5 MB */) {
+   if (free <= WIPER_RESERVED_SPACE) {
+      if ((*state)->backend == WIPER_BACKEND_PUNCH_HOLE) {
+         /* Now give the space back */
+         (*state)->phase = WIPER_PHASE_PUNCH;
+         *progress = 50;
+         return "";
+      }
+
       /* We are done */
       WiperClean(*state);
       *state = NULL;
@@ -898,6 +1316,17 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
       break;
 
    case WIPER_PHASE_FILL:
+#if defined(WIPER_HAVE_PUNCH_HOLE)
+      if ((*state)->backend == WIPER_BACKEND_PUNCH_HOLE) {
+         error = WiperAllocate(*state, free);
+         if (*error != '\0') {
+            WiperClean(*state);
+            *state = NULL;
+            return error;
+         }
+         break;
+      }
+#endif
       {
          unsigned int i;
 
@@ -959,6 +1388,10 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
    }
 
    *progress = 99 - 99 * free / total;
+   if ((*state)->backend == WIPER_BACKEND_PUNCH_HOLE) {
+      /* Filling is only the first half of the job */
+      *progress /= 2;
+   }
    return "";
 }
 
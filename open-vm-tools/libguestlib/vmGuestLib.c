@@ -23,6 +23,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#if !defined(_WIN32)
+#   include <unistd.h>
+#endif
 #include "vmware.h"
 #include "vmGuestLib.h"
 #include "vmGuestLibInt.h"
@@ -37,9 +40,28 @@
 #include "dynxdr.h"
 #include "xdrutil.h"
 #include "ctype.h"
+#include "vm_atomic.h"
+#include "userlock.h"
 
 #define GUESTLIB_NAME "VMware Guest API"
 
+/*
+ * Prefix of the error replies generated locally by RpcOut (as opposed to
+ * the ones sent by the host); those indicate a broken channel.
+ */
+#define GUESTLIB_RPCOUT_ERROR_PREFIX "RpcOut: "
+
+/*
+ * Channel shared by all the handles of this process, so that an update does
+ * not have to open and close a backdoor channel every time. Protected by the
+ * lock stored in gChannelLockStorage.
+ */
+static Atomic_Ptr gChannelLockStorage;
+static RpcOut *gChannel;
+#if !defined(_WIN32)
+static pid_t gChannelPid;
+#endif
+
 /* 
  * These are client side data structures, separate from the wire data formats
  * (VMGuestLibDataV[23]).
@@ -327,6 +349,109 @@ VMGuestLib_CloseHandle(VMGuestLibHandle handle) // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLibSendRequest --
+ *
+ *      Send a request over the channel shared by all the handles, opening
+ *      it if needed.
+ *
+ *      The host closes channels that have been idle for a while, so if the
+ *      request fails because of the channel itself, reopen it and retry
+ *      once.
+ *
+ * Results:
+ *      TRUE on success. '*reply' contains an allocated result of the rpc.
+ *      FALSE on error. '*reply' contains an allocated description of the
+ *      error or NULL.
+ *
+ * Side effects:
+ *      The shared channel may be (re)opened.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VMGuestLibSendRequest(const char *request,  // IN
+                      char **reply,         // OUT
+                      size_t *replyLen)     // OUT
+{
+   MXUserExclLock *lck;
+   const char *myReply = NULL;
+   size_t myReplyLen = 0;
+   Bool status = FALSE;
+   int attempt;
+
+   lck = MXUser_CreateSingletonExclLock(&gChannelLockStorage,
+                                        "guestLibChannelLock", RANK_LEAF);
+   ASSERT_NOT_IMPLEMENTED(lck != NULL);
+
+   MXUser_AcquireExclLock(lck);
+
+#if !defined(_WIN32)
+   /*
+    * A forked child must not share the channel with its parent. Just forget
+    * about the inherited one: closing it would close it for the parent too.
+    */
+   if (gChannel != NULL && gChannelPid != getpid()) {
+      gChannel = NULL;
+   }
+#endif
+
+   for (attempt = 0; attempt < 2; attempt++) {
+      if (gChannel == NULL) {
+         gChannel = RpcOut_Construct();
+         if (gChannel == NULL) {
+            myReply = "RpcOut: Unable to create the RpcOut object";
+            myReplyLen = strlen(myReply);
+            break;
+         }
+         if (!RpcOut_start(gChannel)) {
+            RpcOut_Destruct(gChannel);
+            gChannel = NULL;
+            myReply = "RpcOut: Unable to open the communication channel";
+            myReplyLen = strlen(myReply);
+            break;
+         }
+#if !defined(_WIN32)
+         gChannelPid = getpid();
+#endif
+      }
+
+      status = RpcOut_send(gChannel, request, strlen(request),
+                           &myReply, &myReplyLen);
+      if (status ||
+          strncmp(myReply, GUESTLIB_RPCOUT_ERROR_PREFIX,
+                  sizeof GUESTLIB_RPCOUT_ERROR_PREFIX - 1) != 0) {
+         break;
+      }
+
+      Debug("Channel error, reopening: %s\n", myReply);
+      RpcOut_stop(gChannel);
+      RpcOut_Destruct(gChannel);
+      gChannel = NULL;
+   }
+
+   /*
+    * The reply lives in the channel buffer, so copy it before somebody else
+    * gets a chance to use the channel.
+    */
+   if (myReply != NULL) {
+      *reply = Util_SafeMalloc(myReplyLen + 1);
+      memcpy(*reply, myReply, myReplyLen);
+      (*reply)[myReplyLen] = '\0';
+      *replyLen = myReplyLen;
+   } else {
+      *reply = NULL;
+   }
+
+   MXUser_ReleaseExclLock(lck);
+
+   return status;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -379,7 +504,7 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
                   hostVersion);
 
       /* Send the request. */
-      if (RpcOut_sendOne(&reply, &replyLen, commandBuf)) {
+      if (VMGuestLibSendRequest(commandBuf, &reply, &replyLen)) {
          VMGuestLibDataV2 *v2reply = (VMGuestLibDataV2 *)reply;
          VMSessionId sessionId = HANDLE_SESSIONID(handle);
 
@@ -495,6 +620,22 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
          goto done;
       }
 
+      /*
+       * Deep-free the statistics from the previous update: the decoder
+       * would otherwise write the new strings into the old buffers.
+       */
+      if (HANDLE_DATA(handle) != NULL &&
+          HANDLE_SESSIONID(handle) != 0 &&
+          HANDLE_VERSION(handle) == 3) {
+         GuestLibV3StatCount c;
+
+         v3stats = HANDLE_DATA(handle);
+         for (c = 0; c < v3stats->numStats; c++) {
+            VMX_XDR_FREE(xdr_GuestLibV3Stat, &v3stats->stats[c]);
+         }
+         v3stats->numStats = 0;
+      }
+
       /* 0. Copy the reply version and sessionId to the handle. */
       HANDLE_VERSION(handle) = v3reply->hdr.version;
       HANDLE_SESSIONID(handle) = v3reply->hdr.sessionId;
@@ -553,6 +694,7 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
          for (c = 0; c < count; c++) {
             VMX_XDR_FREE(xdr_GuestLibV3Stat, &v3stats->stats[c]);
          }
+         v3stats->numStats = 0;
          HANDLE_SESSIONID(handle) = 0;
       }
 
@@ -1761,6 +1903,106 @@ VMGuestLib_GetMemBalloonMaxMB(VMGuestLibHandle handle,    // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLib_GetStats --
+ *
+ *      Retrieve all the integral statistics from the last update at once.
+ *      'stats' is indexed by VMGuestLibStatId; entries for statistics that
+ *      are not available are marked invalid.
+ *
+ * Results:
+ *      VMGuestLibError
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VMGuestLibError
+VMGuestLib_GetStats(VMGuestLibHandle handle,   // IN
+                    VMGuestLibStat *stats,     // OUT
+                    uint32 numStats)           // IN
+{
+   VMGuestLibStatisticsV3 *v3stats;
+   VMGuestLibError error;
+   GuestLibV3StatCount count;
+   void *data;
+
+   error = VMGuestLibCheckArgs(handle, stats, &data);
+   if (VMGUESTLIB_ERROR_SUCCESS != error) {
+      return error;
+   }
+   if (HANDLE_VERSION(handle) != 3) {
+      return VMGUESTLIB_ERROR_UNSUPPORTED_VERSION;
+   }
+   v3stats = data;
+
+   memset(stats, 0, numStats * sizeof *stats);
+
+   for (count = 0; count < v3stats->numStats; count++) {
+      const GuestLibV3Stat *stat = &v3stats->stats[count];
+
+      if (stat->d >= numStats) {
+         continue;
+      }
+
+#define VMGUESTLIB_STAT_CASE(STATID, FIELDNAME)                         \
+      case STATID:                                                      \
+         stats[stat->d].valid = stat->GuestLibV3Stat_u.FIELDNAME.valid; \
+         stats[stat->d].value = stat->GuestLibV3Stat_u.FIELDNAME.value; \
+         break
+
+      switch (stat->d) {
+      VMGUESTLIB_STAT_CASE(GUESTLIB_CPU_RESERVATION_MHZ, cpuReservationMHz);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_CPU_LIMIT_MHZ, cpuLimitMHz);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_CPU_SHARES, cpuShares);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_CPU_USED_MS, cpuUsedMs);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MHZ, hostMHz);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_RESERVATION_MB, memReservationMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_LIMIT_MB, memLimitMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_SHARES, memShares);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_MAPPED_MB, memMappedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_ACTIVE_MB, memActiveMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_OVERHEAD_MB, memOverheadMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_BALLOONED_MB, memBalloonedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_SWAPPED_MB, memSwappedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_SHARED_MB, memSharedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_SHARED_SAVED_MB, memSharedSavedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_USED_MB, memUsedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_ELAPSED_MS, elapsedMs);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_CPU_STOLEN_MS, cpuStolenMs);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_TARGET_SIZE_MB, memTargetSizeMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_CPU_NUM_CORES, hostCpuNumCores);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_CPU_USED_MS, hostCpuUsedMs);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MEM_SWAPPED_MB, hostMemSwappedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MEM_SHARED_MB, hostMemSharedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MEM_USED_MB, hostMemUsedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MEM_PHYS_MB, hostMemPhysMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MEM_PHYS_FREE_MB, hostMemPhysFreeMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MEM_KERN_OVHD_MB, hostMemKernOvhdMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MEM_MAPPED_MB, hostMemMappedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_HOST_MEM_UNMAPPED_MB, hostMemUnmappedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_ZIPPED_MB, memZippedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_ZIPSAVED_MB, memZipSavedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_LLSWAPPED_MB, memLLSwappedMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_SWAP_TARGET_MB, memSwapTargetMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_BALLOON_TARGET_MB, memBalloonTargetMB);
+      VMGUESTLIB_STAT_CASE(GUESTLIB_MEM_BALLOON_MAX_MB, memBalloonMaxMB);
+      default:
+         /* Not an integral statistic. */
+         break;
+      }
+
+#undef VMGUESTLIB_STAT_CASE
+   }
+
+   return VMGUESTLIB_ERROR_SUCCESS;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
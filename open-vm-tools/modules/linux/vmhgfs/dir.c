@@ -802,7 +802,7 @@ HgfsDirOpen(struct inode *inode,  // IN: Inode of the dir to open
 
    result = HgfsPrivateDirOpen(file, &handle);
    if (!result) {
-      result = HgfsCreateFileInfo(file, handle);
+      result = HgfsCreateFileInfo(file, handle, HGFS_LOCK_NONE);
    }
 
    return result;
@@ -28,9 +28,11 @@
 #include <linux/errno.h>
 #include <linux/module.h>
 #include <linux/signal.h>
+#include <linux/pagemap.h>
 #include "compat_cred.h"
 #include "compat_fs.h"
 #include "compat_kernel.h"
+#include "compat_mm.h"
 #include "compat_slab.h"
 
 /* Must be after compat_fs.h */
@@ -70,6 +72,17 @@ static int HgfsUnpackOpenReply(HgfsReq *req,
                                HgfsOp opUsed,
                                HgfsHandle *file,
                                HgfsServerLock *lock);
+static Bool HgfsOpenWantsPrefetch(struct inode *inode,
+                                  struct file *file);
+static Bool HgfsPackOpenPrefetchRequest(HgfsReq *req);
+static int HgfsUnpackOpenPrefetchReply(HgfsReq *req,
+                                       HgfsHandle *file,
+                                       HgfsServerLock *lock,
+                                       char const **data,
+                                       uint32 *dataSize);
+static void HgfsPrimeFirstPage(struct inode *inode,
+                               char const *data,
+                               uint32 dataSize);
 static int HgfsGetOpenFlags(uint32 flags);
 
 /* HGFS file operations for files. */
@@ -268,8 +281,17 @@ HgfsPackOpenRequest(struct inode *inode, // IN: Inode of the file to open
       requestV3->groupPerms = (inode->i_mode & S_IRWXG) >> 3;
       requestV3->otherPerms = (inode->i_mode & S_IRWXO);
 
-      /* XXX: Request no lock for now. */
-      requestV3->desiredLock = HGFS_LOCK_NONE;
+      /*
+       * Ask for an oplock so that the file can be cached until the server
+       * breaks it, provided the server said it would send the break.
+       */
+      if (hgfsServerLocksSupported) {
+         requestV3->desiredLock =
+            requestV3->mode == HGFS_OPEN_MODE_READ_ONLY ? HGFS_LOCK_SHARED :
+                                                          HGFS_LOCK_OPPORTUNISTIC;
+      } else {
+         requestV3->desiredLock = HGFS_LOCK_NONE;
+      }
 
       requestV3->reserved1 = 0;
       requestV3->reserved2 = 0;
@@ -461,6 +483,251 @@ HgfsUnpackOpenReply(HgfsReq *req,          // IN: Packet with reply inside
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsOpenWantsPrefetch --
+ *
+ *    Decide whether the open should also fetch the file's contents. We
+ *    only do so for read only opens of files that fit in a single page
+ *    which isn't cached yet, since such files are usually read in full
+ *    right after being opened.
+ *
+ * Results:
+ *    TRUE if the open should be sent as a compound open and read.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsOpenWantsPrefetch(struct inode *inode, // IN: Inode of the file to open
+                      struct file *file)   // IN: File pointer for this open
+{
+   struct page *page;
+   loff_t size;
+   Bool cached = FALSE;
+
+   if (!hgfsCompoundSupported ||
+       (file->f_flags & O_ACCMODE) != O_RDONLY ||
+       (file->f_flags & (O_CREAT | O_TRUNC)) != 0) {
+      return FALSE;
+   }
+
+   size = compat_i_size_read(inode);
+   if (size <= 0 || size > PAGE_CACHE_SIZE) {
+      return FALSE;
+   }
+
+   page = find_get_page(inode->i_mapping, 0);
+   if (page) {
+      cached = PageUptodate(page);
+      page_cache_release(page);
+   }
+   return !cached;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPackOpenPrefetchRequest --
+ *
+ *    Turn a packed HGFS_OP_OPEN_V3 request into a compound request that
+ *    opens the file and reads its first page using the handle returned
+ *    by the open, saving a round trip to the server.
+ *
+ * Results:
+ *    TRUE if the request was converted, FALSE if it doesn't fit in the
+ *    packet, in which case the open request is left untouched.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsPackOpenPrefetchRequest(HgfsReq *req) // IN/OUT: Packed open request
+{
+   HgfsRequest *header = (HgfsRequest *)HGFS_REQ_PAYLOAD(req);
+   HgfsRequestCompoundV4 *compound;
+   HgfsCompoundEntryV4 *entry;
+   HgfsRequestReadV3 *read;
+   size_t openSize = req->payloadSize - sizeof *header;
+   size_t requestSize = sizeof *header + sizeof *compound +
+                        sizeof *entry + HGFS_COMPOUND_ALIGN(openSize) +
+                        sizeof *entry + sizeof *read;
+
+   ASSERT(header->op == HGFS_OP_OPEN_V3);
+
+   if (requestSize > req->bufferSize) {
+      return FALSE;
+   }
+
+   compound = (HgfsRequestCompoundV4 *)HGFS_REQ_PAYLOAD_V3(req);
+   entry = (HgfsCompoundEntryV4 *)(compound + 1);
+
+   /* Slide the open request down to make room for the compound headers. */
+   memmove(entry + 1, compound, openSize);
+   memset((char *)(entry + 1) + openSize, 0,
+          HGFS_COMPOUND_ALIGN(openSize) - openSize);
+
+   memset(compound, 0, sizeof *compound);
+   compound->count = 2;
+   compound->maxReplySize = req->bufferSize - sizeof (HgfsReply);
+
+   memset(entry, 0, sizeof *entry);
+   entry->op = HGFS_OP_OPEN_V3;
+   entry->size = openSize;
+
+   entry = (HgfsCompoundEntryV4 *)((char *)(entry + 1) +
+                                   HGFS_COMPOUND_ALIGN(openSize));
+   memset(entry, 0, sizeof *entry + sizeof *read);
+   entry->op = HGFS_OP_READ_V3;
+   entry->size = sizeof *read;
+
+   read = (HgfsRequestReadV3 *)(entry + 1);
+   read->file = HGFS_COMPOUND_LAST_HANDLE;
+   read->offset = 0;
+   read->requiredSize = MIN(PAGE_CACHE_SIZE, HGFS_IO_MAX);
+
+   header->op = HGFS_OP_COMPOUND_V4;
+   req->payloadSize = requestSize;
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsUnpackOpenPrefetchReply --
+ *
+ *    Get the open results and the prefetched data out of the reply to a
+ *    request packed by HgfsPackOpenPrefetchRequest. A failed read isn't
+ *    an error: the data is simply fetched again by readpage.
+ *
+ * Results:
+ *    Returns zero on success, or negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsUnpackOpenPrefetchReply(HgfsReq *req,         // IN: Packet with reply
+                            HgfsHandle *file,     // OUT: Handle in reply
+                            HgfsServerLock *lock, // OUT: The server lock
+                            char const **data,    // OUT: Data or NULL
+                            uint32 *dataSize)     // OUT: Size of the data
+{
+   HgfsReplyCompoundV4 *reply = (HgfsReplyCompoundV4 *)HGFS_REP_PAYLOAD_V3(req);
+   char *end = (char *)HGFS_REQ_PAYLOAD(req) + req->payloadSize;
+   HgfsCompoundReplyEntryV4 *entry = (HgfsCompoundReplyEntryV4 *)(reply + 1);
+   HgfsReplyOpenV3 *openReply;
+   HgfsReplyReadV3 *readReply;
+   int result;
+
+   *data = NULL;
+   *dataSize = 0;
+
+   if ((char *)(entry + 1) > end || reply->count == 0 ||
+       entry->op != HGFS_OP_OPEN_V3) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsUnpackOpenPrefetchReply: "
+              "malformed reply\n"));
+      return -EPROTO;
+   }
+
+   result = HgfsStatusConvertToLinux(entry->status);
+   if (result != 0) {
+      return result;
+   }
+
+   openReply = (HgfsReplyOpenV3 *)(entry + 1);
+   if (entry->size != sizeof *openReply || (char *)(openReply + 1) > end) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsUnpackOpenPrefetchReply: wrong "
+              "open reply size\n"));
+      return -EPROTO;
+   }
+   *file = openReply->file;
+   *lock = openReply->acquiredLock;
+
+   if (reply->count < 2) {
+      return 0;
+   }
+   entry = (HgfsCompoundReplyEntryV4 *)((char *)openReply +
+                                        HGFS_COMPOUND_ALIGN(entry->size));
+   if ((char *)(entry + 1) > end || entry->op != HGFS_OP_READ_V3 ||
+       entry->status != HGFS_STATUS_SUCCESS) {
+      return 0;
+   }
+
+   readReply = (HgfsReplyReadV3 *)(entry + 1);
+   if (entry->size < offsetof(HgfsReplyReadV3, payload) ||
+       (char *)(entry + 1) + entry->size > end ||
+       readReply->actualSize >
+          entry->size - offsetof(HgfsReplyReadV3, payload) ||
+       readReply->actualSize > PAGE_CACHE_SIZE) {
+      return 0;
+   }
+   *data = readReply->payload;
+   *dataSize = readReply->actualSize;
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPrimeFirstPage --
+ *
+ *    Populate the first page of the file's page cache with the data
+ *    prefetched by the open, so the following read is served locally.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The first page of the mapping may be added and marked up to date.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsPrimeFirstPage(struct inode *inode, // IN: Inode of the opened file
+                   char const *data,    // IN: Data of the first page
+                   uint32 dataSize)     // IN: Size of the data
+{
+   struct page *page;
+   char *buffer;
+
+   ASSERT(dataSize <= PAGE_CACHE_SIZE);
+
+   page = grab_cache_page(inode->i_mapping, 0);
+   if (!page) {
+      return;
+   }
+
+   /* Someone may have read the page while we were waiting for the reply. */
+   if (!PageUptodate(page)) {
+      buffer = kmap(page);
+      memcpy(buffer, data, dataSize);
+      memset(buffer + dataSize, 0, PAGE_CACHE_SIZE - dataSize);
+      kunmap(page);
+      flush_dcache_page(page);
+      SetPageUptodate(page);
+      LOG(6, (KERN_DEBUG "VMware hgfs: HgfsPrimeFirstPage: cached %u "
+              "bytes\n", dataSize));
+   }
+   compat_unlock_page(page);
+   page_cache_release(page);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -584,6 +851,9 @@ HgfsOpen(struct inode *inode,  // IN: Inode of the file to open
    HgfsHandle replyFile;
    HgfsServerLock replyLock;
    HgfsInodeInfo *iinfo;
+   Bool prefetch;
+   char const *data;
+   uint32 dataSize = 0;
    int result = 0;
 
    ASSERT(inode);
@@ -615,6 +885,11 @@ HgfsOpen(struct inode *inode,  // IN: Inode of the file to open
       goto out;
    }
 
+   /* Small files are read along with the open when the server allows it. */
+   prefetch = opUsed == HGFS_OP_OPEN_V3 &&
+              HgfsOpenWantsPrefetch(inode, file) &&
+              HgfsPackOpenPrefetchRequest(req);
+
    /* Send the request and process the reply. */
    result = HgfsSendRequest(req);
    if (result == 0) {
@@ -622,6 +897,14 @@ HgfsOpen(struct inode *inode,  // IN: Inode of the file to open
       replyStatus = HgfsReplyStatus(req);
       result = HgfsStatusConvertToLinux(replyStatus);
 
+      /* Retry without prefetching the data. Set globally. */
+      if (prefetch && (result == -EPROTO || result == -EOPNOTSUPP)) {
+         LOG(4, (KERN_DEBUG "VMware hgfs: HgfsOpen: Compound requests "
+                 "not supported. Falling back to plain open.\n"));
+         hgfsCompoundSupported = FALSE;
+         goto retry;
+      }
+
       switch (result) {
       case 0:
          iinfo->createdAndUnopened = FALSE;
@@ -632,17 +915,34 @@ HgfsOpen(struct inode *inode,  // IN: Inode of the file to open
           * the server.
           */
          iinfo->hostFileId = 0;
-         result = HgfsUnpackOpenReply(req, opUsed, &replyFile, &replyLock);
+         data = NULL;
+         if (prefetch) {
+            result = HgfsUnpackOpenPrefetchReply(req, &replyFile, &replyLock,
+                                                 &data, &dataSize);
+            if (result == -EPROTO) {
+               /* A server that mangles compound replies can't be trusted. */
+               LOG(4, (KERN_DEBUG "VMware hgfs: HgfsOpen: Malformed compound "
+                       "reply. Falling back to plain open.\n"));
+               hgfsCompoundSupported = FALSE;
+               goto retry;
+            }
+         } else {
+            result = HgfsUnpackOpenReply(req, opUsed, &replyFile, &replyLock);
+         }
          if (result != 0) {
             break;
          }
-         result = HgfsCreateFileInfo(file, replyFile);
+         result = HgfsCreateFileInfo(file, replyFile, replyLock);
          if (result != 0) {
             break;
          }
          LOG(6, (KERN_DEBUG "VMware hgfs: HgfsOpen: set handle to %u\n",
                  replyFile));
 
+         if (data != NULL) {
+            HgfsPrimeFirstPage(inode, data, dataSize);
+         }
+
          /*
           * HgfsCreate faked all of the inode's attributes, so by the time
           * we're done in HgfsOpen, we need to make sure that the attributes
@@ -78,6 +78,8 @@ HgfsOp hgfsVersionDeleteDir;
 HgfsOp hgfsVersionRename;
 HgfsOp hgfsVersionQueryVolumeInfo;
 HgfsOp hgfsVersionCreateSymlink;
+Bool hgfsCompoundSupported;
+Bool hgfsServerLocksSupported;
 
 /* Private functions. */
 static inline unsigned long HgfsComputeBlockBits(unsigned long blockSize);
@@ -413,6 +415,9 @@ HgfsReadSuper(struct super_block *sb, // OUT: Superblock object
    sb->s_blocksize_bits = HgfsComputeBlockBits(HGFS_BLOCKSIZE);
    sb->s_blocksize = 1 << sb->s_blocksize_bits;
 
+   /* Find out whether files may be cached under server oplocks. */
+   HgfsNegotiateServerLocks();
+
    /*
     * Create the root dentry and its corresponding inode.
     */
@@ -559,6 +564,8 @@ HgfsResetOps(void)
    hgfsVersionRename          = HGFS_OP_RENAME_V3;
    hgfsVersionQueryVolumeInfo = HGFS_OP_QUERY_VOLUME_INFO_V3;
    hgfsVersionCreateSymlink   = HGFS_OP_CREATE_SYMLINK_V3;
+   hgfsCompoundSupported      = TRUE;
+   hgfsServerLocksSupported   = FALSE;
 
    if (USE_VMCI) {
       hgfsVersionRead = HGFS_OP_READ_FAST_V4;
@@ -653,6 +660,9 @@ HgfsCleanupFileSystem(void)
       success = FALSE;
    }
 
+   /* Acknowledge oplock breaks still queued while the transport is up. */
+   HgfsFlushOplockBreaks();
+
    /* Transport cleanup. */
    HgfsTransportExit();
 
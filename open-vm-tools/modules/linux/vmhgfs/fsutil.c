@@ -36,6 +36,7 @@
 #include "compat_sched.h"
 #include "compat_slab.h"
 #include "compat_spinlock.h"
+#include "compat_workqueue.h"
 
 #include "vm_assert.h"
 #include "cpName.h"
@@ -47,6 +48,8 @@
 #include "hgfsProto.h"
 #include "vm_basic_types.h"
 
+extern int USE_VMCI;
+
 static void HgfsSetFileType(struct inode *inode,
                             HgfsAttrInfo const *attr);
 static int HgfsUnpackGetattrReply(HgfsReq *req,
@@ -60,6 +63,35 @@ static int HgfsPackGetattrRequest(HgfsReq *req,
 static int HgfsBuildRootPath(char *buffer,
                              size_t bufferLen,
                              HgfsSuperInfo *si);
+static struct inode *HgfsBreakServerLock(HgfsHandle handle,
+                                         HgfsServerLock serverLock);
+static void HgfsSendServerLockChange(HgfsHandle handle,
+                                     HgfsServerLock serverLock);
+static void HgfsOplockBreakWork(compat_work_arg data);
+static void HgfsPackHeaderV4(HgfsReq *req,
+                             HgfsOp op,
+                             uint64 sessionId,
+                             size_t requestSize);
+static void HgfsDestroyServerSession(uint64 sessionId);
+
+/* Deferred handling of an oplock break received from the server. */
+typedef struct HgfsOplockBreakData {
+   compat_work work;
+   HgfsHandle handle;
+   HgfsServerLock serverLock;
+} HgfsOplockBreakData;
+
+/* Open files holding a server oplock. Protected by hgfsBigLock. */
+static LIST_HEAD(hgfsLeasedFiles);
+
+/*
+ * Handles whose oplock was broken before the open reply was processed, so
+ * the oplock granted in that reply must not be trusted. Protected by
+ * hgfsBigLock.
+ */
+#define HGFS_REVOKED_HANDLES_MAX 8
+static HgfsHandle hgfsRevokedHandles[HGFS_REVOKED_HANDLES_MAX];
+static unsigned int hgfsRevokedHandlesNext;
 
 /*
  * Private function implementations.
@@ -1915,7 +1947,9 @@ HgfsGetOpenMode(uint32 flags) // IN: Open flags
  *    Create the HGFS-specific file information struct and store a pointer to
  *    it in the VFS file pointer. Also, link the file information struct in the
  *    inode's file list, so that we may find it when all we have is an inode
- *    (such as in writepage()).
+ *    (such as in writepage()). Files opened with a server oplock are also
+ *    linked in the list of leased files, so that a break from the server can
+ *    find them by handle.
  *
  * Results:
  *    Zero if success, non-zero if error.
@@ -1927,8 +1961,9 @@ HgfsGetOpenMode(uint32 flags) // IN: Open flags
  */
 
 int
-HgfsCreateFileInfo(struct file *file,  // IN: File pointer to attach to
-                   HgfsHandle handle)  // IN: Handle returned from server
+HgfsCreateFileInfo(struct file *file,           // IN: File pointer to attach to
+                   HgfsHandle handle,           // IN: Handle returned from server
+                   HgfsServerLock serverLock)   // IN: Oplock granted by server
 {
    HgfsFileInfo *fileInfo;
    HgfsInodeInfo *inodeInfo;
@@ -1968,6 +2003,10 @@ HgfsCreateFileInfo(struct file *file,  // IN: File pointer to attach to
    fileInfo->isStale = TRUE;
    fileInfo->direntPos = 0;
 
+   fileInfo->serverLock = serverLock;
+   fileInfo->inode = file->f_dentry->d_inode;
+   INIT_LIST_HEAD(&fileInfo->leaseList);
+
    /*
     * I don't think we need any VFS locks since we're only touching the HGFS
     * specific state. But we should still acquire our own lock.
@@ -1976,6 +2015,20 @@ HgfsCreateFileInfo(struct file *file,  // IN: File pointer to attach to
     */
    spin_lock(&hgfsBigLock);
    list_add_tail(&fileInfo->list, &inodeInfo->files);
+   if (serverLock != HGFS_LOCK_NONE) {
+      unsigned int i;
+
+      for (i = 0; i < HGFS_REVOKED_HANDLES_MAX; i++) {
+         if (hgfsRevokedHandles[i] == handle) {
+            hgfsRevokedHandles[i] = HGFS_INVALID_HANDLE;
+            fileInfo->serverLock = HGFS_LOCK_NONE;
+            break;
+         }
+      }
+      if (fileInfo->serverLock != HGFS_LOCK_NONE) {
+         list_add_tail(&fileInfo->leaseList, &hgfsLeasedFiles);
+      }
+   }
    spin_unlock(&hgfsBigLock);
 
    return 0;
@@ -2010,6 +2063,7 @@ HgfsReleaseFileInfo(struct file *file) // IN: File pointer to detach from
 
    spin_lock(&hgfsBigLock);
    list_del_init(&fileInfo->list);
+   list_del_init(&fileInfo->leaseList);
    spin_unlock(&hgfsBigLock);
 
    kfree(fileInfo);
@@ -2017,6 +2071,489 @@ HgfsReleaseFileInfo(struct file *file) // IN: File pointer to detach from
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsInodeHasServerLock --
+ *
+ *    Check whether any open file of the inode still holds a server oplock,
+ *    in which case the server will tell us before the file changes and the
+ *    cached attributes and pages can be trusted.
+ *
+ * Results:
+ *    TRUE if an oplock is held, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsInodeHasServerLock(struct inode *inode) // IN: Inode to check
+{
+   HgfsInodeInfo *inodeInfo;
+   struct list_head *cur;
+   Bool locked = FALSE;
+
+   ASSERT(inode);
+
+   inodeInfo = INODE_GET_II_P(inode);
+
+   spin_lock(&hgfsBigLock);
+   list_for_each(cur, &inodeInfo->files) {
+      HgfsFileInfo *finfo = list_entry(cur, HgfsFileInfo, list);
+
+      if (finfo->serverLock != HGFS_LOCK_NONE) {
+         locked = TRUE;
+         break;
+      }
+   }
+   spin_unlock(&hgfsBigLock);
+
+   return locked;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBreakServerLock --
+ *
+ *    Record that the server downgraded or revoked the oplock held on a
+ *    handle. A file that no longer holds any oplock is removed from the list
+ *    of leased files. An unknown handle is remembered in case the break
+ *    overtook the reply to the open that created it.
+ *
+ * Results:
+ *    The inode of the file with a reference held, which the caller must
+ *    release with iput(), or NULL if no open file uses the handle.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static struct inode *
+HgfsBreakServerLock(HgfsHandle handle,          // IN: Handle of the open file
+                    HgfsServerLock serverLock)  // IN: New oplock
+{
+   struct list_head *cur;
+   struct inode *inode = NULL;
+
+   spin_lock(&hgfsBigLock);
+   list_for_each(cur, &hgfsLeasedFiles) {
+      HgfsFileInfo *finfo = list_entry(cur, HgfsFileInfo, leaseList);
+
+      if (finfo->handle == handle) {
+         finfo->serverLock = serverLock;
+         if (serverLock == HGFS_LOCK_NONE) {
+            list_del_init(&finfo->leaseList);
+         }
+         inode = igrab(finfo->inode);
+         break;
+      }
+   }
+   if (cur == &hgfsLeasedFiles) {
+      /* The open reply may not have been processed yet. */
+      hgfsRevokedHandles[hgfsRevokedHandlesNext] = handle;
+      hgfsRevokedHandlesNext = (hgfsRevokedHandlesNext + 1) %
+                               HGFS_REVOKED_HANDLES_MAX;
+   }
+   spin_unlock(&hgfsBigLock);
+
+   return inode;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSendServerLockChange --
+ *
+ *    Acknowledge an oplock break by telling the server which oplock the
+ *    client now holds on the handle.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSendServerLockChange(HgfsHandle handle,          // IN: Handle of the file
+                         HgfsServerLock serverLock)  // IN: Oplock now held
+{
+   HgfsReq *req;
+   HgfsRequest *header;
+   HgfsRequestServerLockChangeV2 *request;
+   int result;
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsSendServerLockChange: out of "
+              "memory while getting new request\n"));
+      return;
+   }
+
+   header = (HgfsRequest *)(HGFS_REQ_PAYLOAD(req));
+   header->id = req->id;
+   header->op = HGFS_OP_SERVER_LOCK_CHANGE_V3;
+
+   request = (HgfsRequestServerLockChangeV2 *)(HGFS_REQ_PAYLOAD_V3(req));
+   request->fid = handle;
+   switch (serverLock) {
+   case HGFS_LOCK_SHARED:
+      request->serverLock = HGFS_OPLOCK_SHARED;
+      break;
+   case HGFS_LOCK_EXCLUSIVE:
+      request->serverLock = HGFS_OPLOCK_EXCLUSIVE;
+      break;
+   default:
+      request->serverLock = HGFS_OPLOCK_NONE;
+      break;
+   }
+   request->reserved = 0;
+   req->payloadSize = HGFS_REQ_PAYLOAD_SIZE_V3(request);
+
+   result = HgfsSendRequest(req);
+   if (result == 0) {
+      result = HgfsStatusConvertToLinux(HgfsReplyStatus(req));
+   }
+   if (result != 0) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsSendServerLockChange: handle %u "
+              "failed: %d\n", handle, result));
+   }
+
+   HgfsFreeRequest(req);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockBreakWork --
+ *
+ *    Process an oplock break in process context. Dirty pages of the file are
+ *    written back, and cached pages are dropped if the oplock was revoked,
+ *    before the break is acknowledged so that the server releases the file
+ *    to the conflicting opener only once the host sees our data.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Frees the work item.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockBreakWork(compat_work_arg data)  // IN: Work item
+{
+   HgfsOplockBreakData *breakData;
+   struct inode *inode;
+
+   breakData = COMPAT_WORK_GET_DATA(data, HgfsOplockBreakData, work);
+
+   inode = HgfsBreakServerLock(breakData->handle, breakData->serverLock);
+   if (inode) {
+      compat_filemap_write_and_wait(inode->i_mapping);
+      if (breakData->serverLock == HGFS_LOCK_NONE) {
+         compat_invalidate_remote_inode(inode);
+      }
+   }
+
+   /*
+    * Always acknowledge, even for a handle we no longer know about, so the
+    * server does not wait for the lease break timeout.
+    */
+   HgfsSendServerLockChange(breakData->handle, breakData->serverLock);
+
+   if (inode) {
+      iput(inode);
+   }
+   kfree(breakData);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockBreak --
+ *
+ *    Handle an oplock break sent by the server. Called from the transport in
+ *    atomic context, so the work is deferred to a work queue.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsOplockBreak(HgfsHandle handle,                 // IN: Handle of the file
+                HgfsOpportunisticLock serverLock)  // IN: Oplock now allowed
+{
+   HgfsOplockBreakData *breakData;
+
+   breakData = kmalloc(sizeof *breakData, GFP_ATOMIC);
+   if (!breakData) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsOplockBreak: out of memory for "
+              "handle %u\n", handle));
+      return;
+   }
+
+   breakData->handle = handle;
+   switch (serverLock) {
+   case HGFS_OPLOCK_SHARED:
+      breakData->serverLock = HGFS_LOCK_SHARED;
+      break;
+   case HGFS_OPLOCK_EXCLUSIVE:
+   case HGFS_OPLOCK_BATCH:
+      breakData->serverLock = HGFS_LOCK_EXCLUSIVE;
+      break;
+   default:
+      breakData->serverLock = HGFS_LOCK_NONE;
+      break;
+   }
+
+   COMPAT_INIT_WORK(&breakData->work, HgfsOplockBreakWork, breakData);
+   compat_schedule_work(&breakData->work);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFlushOplockBreaks --
+ *
+ *    Wait for pending oplock break work to complete. Called when the module
+ *    is unloaded, before the transport is closed.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsFlushOplockBreaks(void)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2, 5, 41)
+   flush_scheduled_tasks();
+#else
+   flush_scheduled_work();
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackHeaderV4 --
+ *
+ *    Fill in the version 4 header of a request whose payload follows it.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsPackHeaderV4(HgfsReq *req,         // IN/OUT: Request to send
+                 HgfsOp op,            // IN: Operation
+                 uint64 sessionId,     // IN: Session of the request
+                 size_t requestSize)   // IN: Size of the payload
+{
+   HgfsHeader *header = (HgfsHeader *)(HGFS_REQ_PAYLOAD(req));
+
+   memset(header, 0, sizeof *header);
+   header->version = 1;
+   header->dummy = HGFS_V4_LEGACY_OPCODE;
+   header->packetSize = sizeof *header + requestSize;
+   header->headerSize = sizeof *header;
+   header->requestId = req->id;
+   header->op = op;
+   header->sessionId = sessionId;
+   req->payloadSize = header->packetSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDestroyServerSession --
+ *
+ *    Destroy a session created by HgfsNegotiateServerLocks. Requests
+ *    without a version 4 header keep using the default session of the
+ *    transport.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsDestroyServerSession(uint64 sessionId)  // IN: Session to destroy
+{
+   HgfsReq *req;
+   HgfsRequestDestroySessionV4 *request;
+   int result;
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsDestroyServerSession: out of "
+              "memory while getting new request\n"));
+      return;
+   }
+
+   request = (HgfsRequestDestroySessionV4 *)(HGFS_REQ_PAYLOAD(req) +
+                                             sizeof (HgfsHeader));
+   request->reserved = 0;
+   HgfsPackHeaderV4(req, HGFS_OP_DESTROY_SESSION_V4, sessionId,
+                    sizeof *request);
+
+   result = HgfsSendRequest(req);
+   if (result != 0) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsDestroyServerSession: failed: "
+              "%d\n", result));
+   }
+
+   HgfsFreeRequest(req);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNegotiateServerLocks --
+ *
+ *    Ask the server for its capabilities and record whether it grants
+ *    oplocks and breaks them with HGFS_OP_OPLOCK_BREAK_V4. Only then may
+ *    the client ask for oplocks and trust cached data past the TTL. Breaks
+ *    are only delivered over VMCI, so the other transports don't ask.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Sets hgfsServerLocksSupported.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNegotiateServerLocks(void)
+{
+   HgfsReq *req;
+   HgfsHeader *header;
+   HgfsRequestCreateSessionV4 *request;
+   HgfsReplyCreateSessionV4 *reply;
+   size_t replySize;
+   Bool lockChange = FALSE;
+   Bool oplockBreak = FALSE;
+   uint32 i;
+   int result;
+
+   hgfsServerLocksSupported = FALSE;
+   if (!USE_VMCI) {
+      return;
+   }
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsNegotiateServerLocks: out of "
+              "memory while getting new request\n"));
+      return;
+   }
+
+   request = (HgfsRequestCreateSessionV4 *)(HGFS_REQ_PAYLOAD(req) +
+                                            sizeof (HgfsHeader));
+   request->numCapabilities = 0;
+   request->maxPacketSize = HGFS_PACKET_MAX;
+   request->reserved = 0;
+   HgfsPackHeaderV4(req, HGFS_OP_CREATE_SESSION_V4, HGFS_INVALID_SESSION_ID,
+                    offsetof(HgfsRequestCreateSessionV4, capabilities));
+
+   result = HgfsSendRequest(req);
+   if (result != 0) {
+      goto out;
+   }
+
+   header = (HgfsHeader *)(HGFS_REQ_PAYLOAD(req));
+   if (req->payloadSize < sizeof *header ||
+       header->headerSize < sizeof *header ||
+       header->headerSize > req->payloadSize) {
+      result = -EPROTO;
+      goto out;
+   }
+   result = HgfsStatusConvertToLinux(header->status);
+   if (result != 0) {
+      goto out;
+   }
+
+   reply = (HgfsReplyCreateSessionV4 *)(HGFS_REQ_PAYLOAD(req) +
+                                        header->headerSize);
+   replySize = req->payloadSize - header->headerSize;
+   if (replySize < offsetof(HgfsReplyCreateSessionV4, capabilities) ||
+       reply->numCapabilities > (replySize -
+                                 offsetof(HgfsReplyCreateSessionV4,
+                                          capabilities)) /
+                                sizeof reply->capabilities[0]) {
+      result = -EPROTO;
+      goto out;
+   }
+
+   for (i = 0; i < reply->numCapabilities; i++) {
+      Bool supported = (reply->capabilities[i].flags &
+                        HGFS_REQUEST_SUPPORTED) != 0;
+
+      switch (reply->capabilities[i].op) {
+      case HGFS_OP_SERVER_LOCK_CHANGE_V3:
+         lockChange = supported;
+         break;
+      case HGFS_OP_OPLOCK_BREAK_V4:
+         oplockBreak = supported;
+         break;
+      default:
+         break;
+      }
+   }
+   hgfsServerLocksSupported = lockChange && oplockBreak;
+
+   /* The session was only needed for its capabilities. */
+   HgfsDestroyServerSession(reply->sessionId);
+
+out:
+   if (result != 0) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: HgfsNegotiateServerLocks: failed: "
+              "%d\n", result));
+   }
+   LOG(6, (KERN_DEBUG "VMware hgfs: HgfsNegotiateServerLocks: oplocks %s\n",
+           hgfsServerLocksSupported ? "supported" : "not supported"));
+   HgfsFreeRequest(req);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -86,8 +86,14 @@ void HgfsDentryAgeReset(struct dentry *dentry);
 void HgfsDentryAgeForce(struct dentry *dentry);
 int HgfsGetOpenMode(uint32 flags);
 int HgfsCreateFileInfo(struct file *file,
-                       HgfsHandle handle);
+                       HgfsHandle handle,
+                       HgfsServerLock serverLock);
 void HgfsReleaseFileInfo(struct file *file);
+Bool HgfsInodeHasServerLock(struct inode *inode);
+void HgfsOplockBreak(HgfsHandle handle,
+                     HgfsOpportunisticLock serverLock);
+void HgfsFlushOplockBreaks(void);
+void HgfsNegotiateServerLocks(void);
 int HgfsGetHandle(struct inode *inode,
                   HgfsOpenMode mode,
                   HgfsHandle *handle);
@@ -2206,7 +2206,15 @@ HgfsRevalidate(struct dentry *dentry)  // IN: Dentry to revalidate
    age = jiffies - dentry->d_time;
    iinfo = INODE_GET_II_P(dentry->d_inode);
 
-   if (age > si->ttl || iinfo->hostFileId == 0) {
+   /*
+    * While an open file holds a server oplock, the server breaks it before
+    * anybody else changes the file, so the cached attributes stay valid
+    * past the TTL. That only holds if the server negotiated the breaks.
+    */
+   if ((age > si->ttl &&
+        !(hgfsServerLocksSupported &&
+          HgfsInodeHasServerLock(dentry->d_inode))) ||
+       iinfo->hostFileId == 0) {
       HgfsAttrInfo attr;
       LOG(6, (KERN_DEBUG "VMware hgfs: HgfsRevalidate: dentry is too old, "
               "getting new attributes\n"));
@@ -187,6 +187,15 @@ typedef struct HgfsFileInfo {
    /* Directory read position for tracking. */
    loff_t direntPos;
 
+   /* Oplock granted by the server on this handle. */
+   HgfsServerLock serverLock;
+
+   /* Links to place this object on the list of oplocked files. */
+   struct list_head leaseList;
+
+   /* Inode of the open file, flushed when the server breaks the oplock. */
+   struct inode *inode;
+
 } HgfsFileInfo;
 
 
@@ -229,4 +238,13 @@ extern HgfsOp hgfsVersionRename;
 extern HgfsOp hgfsVersionQueryVolumeInfo;
 extern HgfsOp hgfsVersionCreateSymlink;
 
+/* Whether the server takes compound requests; cleared on the first refusal. */
+extern Bool hgfsCompoundSupported;
+
+/*
+ * Whether the server grants oplocks and breaks them, as negotiated at mount
+ * time with HgfsNegotiateServerLocks.
+ */
+extern Bool hgfsServerLocksSupported;
+
 #endif // _HGFS_DRIVER_MODULE_H_
@@ -166,6 +166,8 @@ HgfsTransportSetupNewChannel(void)
    }
 
    USE_VMCI = 0;
+   /* Oplock breaks can't reach us on the other channels. */
+   hgfsServerLocksSupported = FALSE;
 
    newChannel = HgfsGetVSocketChannel();
    if (newChannel != NULL) {
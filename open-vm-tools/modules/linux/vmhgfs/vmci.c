@@ -34,6 +34,7 @@
 #include "hgfsProto.h"
 #include "hgfsTransport.h"
 #include "module.h"
+#include "fsutil.h"
 #include "request.h"
 #include "transport.h"
 #include "vm_assert.h"
@@ -85,8 +86,8 @@ HgfsShmemPages gHgfsShmemPages;
  *
  * HgfsRequestAsyncDispatch --
  *
- *   XXX Main dispatcher function. Currently just a stub. Needs to run
- *   in atomic context.
+ *   Main dispatcher function for requests sent by the server. Needs to run
+ *   in atomic context, so anything that can block is deferred.
  *
  * Results:
  *    None
@@ -102,16 +103,33 @@ HgfsRequestAsyncDispatch(char *payload, // IN: request header
                          uint32 size)   // IN: size of payload
 {
    HgfsRequest *reqHeader = (HgfsRequest *)payload;
+   HgfsOp op = reqHeader->op;
 
    LOG(4, (KERN_WARNING "Size in Dispatch %u\n", size));
 
-   switch (reqHeader->op) {
+   /* Version 4 packets carry the real opcode in the HgfsHeader. */
+   if (op == HGFS_V4_LEGACY_OPCODE && size >= sizeof (HgfsHeader)) {
+      op = ((HgfsHeader *)payload)->op;
+   }
+
+   switch (op) {
    case HGFS_OP_NOTIFY_V4: {
       LOG(4, (KERN_WARNING "Calling HGFS_OP_NOTIFY_V4 dispatch function\n"));
       break;
    }
+   case HGFS_OP_OPLOCK_BREAK_V4: {
+      HgfsRequestOplockBreakV4 *request;
+
+      if (size < sizeof (HgfsHeader) + sizeof *request) {
+         LOG(4, (KERN_WARNING "%s: Truncated oplock break\n", __func__));
+         break;
+      }
+      request = (HgfsRequestOplockBreakV4 *)(payload + sizeof (HgfsHeader));
+      HgfsOplockBreak(request->fid, request->serverLock);
+      break;
+   }
    default:
-      LOG(4, (KERN_WARNING "%s: Unknown opcode = %d", __func__, reqHeader->op));
+      LOG(4, (KERN_WARNING "%s: Unknown opcode = %d", __func__, op));
    }
 }
 
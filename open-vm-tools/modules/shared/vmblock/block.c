@@ -78,21 +78,116 @@
 #include "block.h"
 #include "dbllnklst.h"
 
+/*
+ * Blocks are hashed by filename, so lookups from the file system operations
+ * only have to look at a handful of entries even when thousands of files are
+ * blocked (e.g., during a large DnD operation). They are also hashed by
+ * blocker, so that all the blocks of a blocker can be found without walking
+ * the whole table when it goes away.
+ *
+ * Both bucket counts must be powers of two.
+ */
+#define BLOCK_HASH_BUCKETS    1024
+#define BLOCKER_HASH_BUCKETS  32
+
 typedef struct BlockInfo {
-   DblLnkLst_Links links;
+   DblLnkLst_Links links;          // Filename hash bucket
+   DblLnkLst_Links blockerLinks;   // Blocker hash bucket
    os_atomic_t refcount;
    os_blocker_id_t blocker;
    os_completion_t completion;
+   unsigned int hash;
    char filename[OS_PATH_MAX];
 } BlockInfo;
 
 
-/* XXX: Is it worth turning this into a hash table? */
-static DblLnkLst_Links blockedFiles;
+static DblLnkLst_Links blockedFiles[BLOCK_HASH_BUCKETS];
+static DblLnkLst_Links blockers[BLOCKER_HASH_BUCKETS];
 static os_rwlock_t blockedFilesLock;
 static os_kmem_cache_t *blockInfoCache;
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockHashFilename --
+ *
+ *    Hashes a filename (32-bit FNV-1a).
+ *
+ * Results:
+ *    The hash value.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BlockHashFilename(const char *filename)  // IN
+{
+   const unsigned char *p = (const unsigned char *)filename;
+   unsigned int hash = 2166136261U;
+
+   while (*p != '\0') {
+      hash ^= *p++;
+      hash *= 16777619U;
+   }
+
+   return hash;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockFileBucket --
+ *
+ *    Returns the filename hash bucket for the given hash value.
+ *
+ * Results:
+ *    The bucket's list head.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static DblLnkLst_Links *
+BlockFileBucket(unsigned int hash)  // IN
+{
+   return &blockedFiles[hash & (BLOCK_HASH_BUCKETS - 1)];
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockBlockerBucket --
+ *
+ *    Returns the blocker hash bucket for the given blocker. Blocker IDs are
+ *    pointers, so the low bits (which are the same for all of them because
+ *    of alignment) are dropped.
+ *
+ * Results:
+ *    The bucket's list head.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static DblLnkLst_Links *
+BlockBlockerBucket(const os_blocker_id_t blocker)  // IN
+{
+   unsigned long id = (unsigned long)blocker >> 4;
+
+   return &blockers[(id ^ (id >> 8)) & (BLOCKER_HASH_BUCKETS - 1)];
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -112,6 +207,8 @@ static os_kmem_cache_t *blockInfoCache;
 int
 BlockInit(void)
 {
+   unsigned int i;
+
    ASSERT(!blockInfoCache);
 
    blockInfoCache = os_kmem_cache_create("blockInfoCache",
@@ -122,7 +219,12 @@ BlockInit(void)
       return OS_ENOMEM;
    }
 
-   DblLnkLst_Init(&blockedFiles);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_Init(&blockedFiles[i]);
+   }
+   for (i = 0; i < BLOCKER_HASH_BUCKETS; i++) {
+      DblLnkLst_Init(&blockers[i]);
+   }
    os_rwlock_init(&blockedFilesLock);
 
    return 0;
@@ -148,8 +250,15 @@ BlockInit(void)
 void
 BlockCleanup(void)
 {
+   unsigned int i;
+
    ASSERT(blockInfoCache);
-   ASSERT(!DblLnkLst_IsLinked(&blockedFiles));
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      ASSERT(!DblLnkLst_IsLinked(&blockedFiles[i]));
+   }
+   for (i = 0; i < BLOCKER_HASH_BUCKETS; i++) {
+      ASSERT(!DblLnkLst_IsLinked(&blockers[i]));
+   }
 
    os_rwlock_destroy(&blockedFilesLock);
    os_kmem_cache_destroy(blockInfoCache);
@@ -175,6 +284,7 @@ BlockCleanup(void)
 static BlockInfo *
 AllocBlock(os_kmem_cache_t *cache,        // IN: cache to allocate from
            const char *filename,          // IN: filname of block
+           unsigned int hash,             // IN: hash of filename
            const os_blocker_id_t blocker) // IN: blocker id
 {
    BlockInfo *block;
@@ -194,9 +304,11 @@ AllocBlock(os_kmem_cache_t *cache,        // IN: cache to allocate from
    }
 
    DblLnkLst_Init(&block->links);
+   DblLnkLst_Init(&block->blockerLinks);
    os_atomic_set(&block->refcount, 1);
    os_completion_init(&block->completion);
    block->blocker = blocker;
+   block->hash = hash;
 
    return block;
 }
@@ -268,7 +380,9 @@ BlockGrabReference(BlockInfo *block)
  *
  * BlockDropReference --
  *
- *    Increments reference count in the provided block structure.
+ *    Decrements reference count in the provided block structure. Callers
+ *    use this to release a block returned by BlockLookup() that they are
+ *    not going to wait on.
  *
  * Results:
  *    None.
@@ -280,7 +394,7 @@ BlockGrabReference(BlockInfo *block)
  *----------------------------------------------------------------------------
  */
 
-static void
+void
 BlockDropReference(BlockInfo *block)
 {
    if (os_atomic_dec_and_test(&block->refcount)) {
@@ -297,6 +411,7 @@ BlockDropReference(BlockInfo *block)
  *
  *    Searches for a block on the provided filename by the provided blocker.
  *    If blocker is NULL, it is ignored and any matching filename is returned.
+ *    hash must be the result of BlockHashFilename(filename).
  *
  *    Note that this assumes the proper locking has been done on the data
  *    structure holding the blocked files.
@@ -312,8 +427,10 @@ BlockDropReference(BlockInfo *block)
 
 static BlockInfo *
 GetBlock(const char *filename,          // IN: file to find block for
+         unsigned int hash,             // IN: hash of filename
          const os_blocker_id_t blocker) // IN: blocker associated with this block
 {
+   struct DblLnkLst_Links *bucket = BlockFileBucket(hash);
    struct DblLnkLst_Links *curr;
 
    /*
@@ -328,9 +445,10 @@ GetBlock(const char *filename,          // IN: file to find block for
    ASSERT(os_rwlock_held(&blockedFilesLock));
 #endif
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
+   DblLnkLst_ForEach(curr, bucket) {
       BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if ((blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
+      if (currBlock->hash == hash &&
+          (blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
           strcmp(currBlock->filename, filename) == 0) {
          return currBlock;
       }
@@ -345,7 +463,7 @@ GetBlock(const char *filename,          // IN: file to find block for
  *
  * BlockDoRemoveBlock --
  *
- *    Removes given block from the block list and notifies waiters that block
+ *    Removes given block from the block table and notifies waiters that block
  *    is gone.
  *
  * Results:
@@ -363,6 +481,7 @@ BlockDoRemoveBlock(BlockInfo *block)
    ASSERT(block);
 
    DblLnkLst_Unlink1(&block->links);
+   DblLnkLst_Unlink1(&block->blockerLinks);
 
    /* Wake up waiters, if any */
    LOG(4, "Completing block on [%s] (%d waiters)\n",
@@ -403,25 +522,29 @@ BlockAddFileBlock(const char *filename,           // IN: name of file to block
                   const os_blocker_id_t blocker)  // IN: blocker adding the block
 {
    BlockInfo *block;
+   unsigned int hash;
    int retval;
 
    ASSERT(filename);
 
+   hash = BlockHashFilename(filename);
+
    os_write_lock(&blockedFilesLock);
 
-   if (GetBlock(filename, OS_UNKNOWN_BLOCKER)) {
+   if (GetBlock(filename, hash, OS_UNKNOWN_BLOCKER)) {
       retval = OS_EEXIST;
       goto out;
    }
 
-   block = AllocBlock(blockInfoCache, filename, blocker);
+   block = AllocBlock(blockInfoCache, filename, hash, blocker);
    if (!block) {
       Warning("BlockAddFileBlock: out of memory\n");
       retval = OS_ENOMEM;
       goto out;
    }
 
-   DblLnkLst_LinkLast(&blockedFiles, &block->links);
+   DblLnkLst_LinkLast(BlockFileBucket(hash), &block->links);
+   DblLnkLst_LinkLast(BlockBlockerBucket(blocker), &block->blockerLinks);
    LOG(4, "added block for [%s]\n", filename);
    retval = 0;
 
@@ -454,13 +577,16 @@ BlockRemoveFileBlock(const char *filename,          // IN: block to remove
                      const os_blocker_id_t blocker) // IN: blocker removing this block
 {
    BlockInfo *block;
+   unsigned int hash;
    int retval;
 
    ASSERT(filename);
 
+   hash = BlockHashFilename(filename);
+
    os_write_lock(&blockedFilesLock);
 
-   block = GetBlock(filename, blocker);
+   block = GetBlock(filename, hash, blocker);
    if (!block) {
       retval = OS_ENOENT;
       goto out;
@@ -497,20 +623,38 @@ BlockRemoveAllBlocks(const os_blocker_id_t blocker)  // IN: blocker to remove bl
    struct DblLnkLst_Links *curr;
    struct DblLnkLst_Links *tmp;
    unsigned int removed = 0;
+   unsigned int i;
 
    os_write_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
+   /*
+    * A specific blocker's blocks all live in the same bucket of the blocker
+    * index; removing everything means walking all of them.
+    */
+   for (i = 0; i < BLOCKER_HASH_BUCKETS; i++) {
+      struct DblLnkLst_Links *bucket = &blockers[i];
+
+      if (blocker != OS_UNKNOWN_BLOCKER) {
+         bucket = BlockBlockerBucket(blocker);
+      }
+
+      DblLnkLst_ForEachSafe(curr, tmp, bucket) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo,
+                                                    blockerLinks);
+         if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
 
-         BlockDoRemoveBlock(currBlock);
+            BlockDoRemoveBlock(currBlock);
 
-         /*
-          * We count only entries removed from the -list-, regardless of whether
-          * or not other waiters exist.
-          */
-         ++removed;
+            /*
+             * We count only entries removed from the -table-, regardless of
+             * whether or not other waiters exist.
+             */
+            ++removed;
+         }
+      }
+
+      if (blocker != OS_UNKNOWN_BLOCKER) {
+         break;
       }
    }
 
@@ -555,8 +699,10 @@ BlockWaitOnFile(const char *filename,   // IN: file to block on
     * blocking here.)
     */
    if (cookie == NULL) {
+      unsigned int hash = BlockHashFilename(filename);
+
       os_read_lock(&blockedFilesLock);
-      block = GetBlock(filename, OS_UNKNOWN_BLOCKER);
+      block = GetBlock(filename, hash, OS_UNKNOWN_BLOCKER);
       if (block) {
          BlockGrabReference(block);
       }
@@ -596,7 +742,8 @@ BlockWaitOnFile(const char *filename,   // IN: file to block on
  *      Opaque pointer to a blockInfo if a block is found, NULL otherwise.
  *
  * Side effects:
- *      Located blockInfo, if any, has an incremented reference count.
+ *      Located blockInfo, if any, has an incremented reference count, which
+ *      is released by BlockWaitOnFile() or BlockDropReference().
  *
  *-----------------------------------------------------------------------------
  */
@@ -608,10 +755,11 @@ BlockLookup(const char *filename,               // IN: pathname to test for
                                                 //     search for
 {
    BlockInfo *block;
+   unsigned int hash = BlockHashFilename(filename);
 
    os_read_lock(&blockedFilesLock);
 
-   block = GetBlock(filename, blocker);
+   block = GetBlock(filename, hash, blocker);
    if (block) {
       BlockGrabReference(block);
    }
@@ -644,13 +792,16 @@ BlockListFileBlocks(void)
 {
    DblLnkLst_Links *curr;
    int count = 0;
+   unsigned int i;
 
    os_read_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
-          count++, currBlock->filename, currBlock->blocker);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_ForEach(curr, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
+             count++, currBlock->filename, currBlock->blocker);
+      }
    }
 
    os_read_unlock(&blockedFilesLock);
@@ -82,6 +82,7 @@ int BlockRemoveFileBlock(const char *filename, const os_blocker_id_t blocker);
 unsigned int BlockRemoveAllBlocks(const os_blocker_id_t blocker);
 int BlockWaitOnFile(const char *filename, BlockHandle cookie);
 BlockHandle BlockLookup(const char *filename, const os_blocker_id_t blocker);
+void BlockDropReference(BlockHandle cookie);
 #ifdef VMX86_DEVEL
 void BlockListFileBlocks(void);
 #endif
@@ -110,6 +110,14 @@ static GuestInfoCache gInfoCache;
 
 static Bool vmResumed;
 
+/*
+ * XDR stream used to serialize NIC info updates. It's kept around between
+ * updates so that its buffer is reused, since the NIC info can be large and
+ * is sent on every gather that finds a change.
+ */
+
+static XDR *gNicInfoXdr = NULL;
+
 
 /*
  * Local functions
@@ -499,11 +507,15 @@ nicinfo_fsm:
                GuestNicProto message = {0};
                GuestNicList *nicList = NULL;
                NicInfoVersion fallbackVersion;
-               XDR xdrs;
+               u_int xdrSize;
 
-               if (DynXdr_Create(&xdrs) == NULL) {
-                  return FALSE;
+               if (gNicInfoXdr == NULL) {
+                  gNicInfoXdr = DynXdr_Create(NULL);
+                  if (gNicInfoXdr == NULL) {
+                     return FALSE;
+                  }
                }
+               DynXdr_Reset(gNicInfoXdr);
 
                /* Add the RPC preamble: message name, and type. */
                Str_Sprintf(request, sizeof request, "%s  %d ",
@@ -527,20 +539,25 @@ nicinfo_fsm:
                   fallbackVersion = NIC_INFO_V1;
                }
 
-               /* Write preamble and serialized nic info to XDR stream. */
-               if (!DynXdr_AppendRaw(&xdrs, request, strlen(request)) ||
-                   !xdr_GuestNicProto(&xdrs, &message)) {
+               /*
+                * Write preamble and serialized nic info to XDR stream. The
+                * nic info is sized first, so the stream's buffer is grown at
+                * most once.
+                */
+               xdrSize = xdr_sizeof((xdrproc_t) xdr_GuestNicProto, &message);
+               if (xdrSize == 0 ||
+                   !DynXdr_Reserve(gNicInfoXdr, strlen(request) + xdrSize) ||
+                   !DynXdr_AppendRaw(gNicInfoXdr, request, strlen(request)) ||
+                   !xdr_GuestNicProto(gNicInfoXdr, &message)) {
                   g_warning("Error serializing nic info v%d data.", message.ver);
-                  DynXdr_Destroy(&xdrs, TRUE);
                   return FALSE;
                }
 
                status = RpcChannel_Send(ctx->rpc,
-                                        DynXdr_Get(&xdrs),
-                                        xdr_getpos(&xdrs),
+                                        DynXdr_Get(gNicInfoXdr),
+                                        xdr_getpos(gNicInfoXdr),
                                         &reply,
                                         &replyLen);
-               DynXdr_Destroy(&xdrs, TRUE);
 
                /*
                 * Do not free/destroy contents of `message`.  The v3 nicInfo
@@ -1148,6 +1165,11 @@ GuestInfoServerShutdown(gpointer src,
 {
    GuestInfoClearCache();
 
+   if (gNicInfoXdr != NULL) {
+      DynXdr_Destroy(gNicInfoXdr, TRUE);
+      gNicInfoXdr = NULL;
+   }
+
    if (gatherTimeoutSource != NULL) {
       g_source_destroy(gatherTimeoutSource);
       gatherTimeoutSource = NULL;
@@ -23,10 +23,15 @@
  */
 
 #include <string.h>
+#if !defined(_WIN32)
+#  include <signal.h>
+#endif
 
 #define G_LOG_DOMAIN "hgfsd"
 
 #include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
 #include "hgfsServerManager.h"
 #include "vm_assert.h"
 #include "vmware/guestrpc/tclodefs.h"
@@ -41,6 +46,216 @@
 VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 #endif
 
+#define HGFS_CONFGROUPNAME          "hgfsServer"
+#define HGFS_CONFNAME_OPSTATS       "op-stats"
+#define HGFS_CONFNAME_OPLOCKS       "oplocks"
+#define HGFS_STATS_GUESTINFO_KEY    "guestinfo.vmtools.hgfsStats"
+#define HGFS_STATS_PUBLISH_PERIOD   (60 * 1000)    /* ms */
+
+/* Timer publishing the op statistics, when they're enabled. */
+static GSource *gStatsSource = NULL;
+
+#if !defined(_WIN32)
+/* Watches SIGIO, which the host raises to break the leases behind oplocks. */
+static GSource *gOplockSource = NULL;
+#endif
+
+
+/**
+ * Builds the JSON representation of the HGFS server per-op statistics,
+ * followed by the packet buffer statistics. Only ops that have been seen
+ * are listed; times are in nanoseconds.
+ *
+ * @return The JSON document, to be freed with g_free().
+ */
+
+static gchar *
+HgfsServerStatsToJSON(void)
+{
+   HgfsServerOpStats *stats = g_new(HgfsServerOpStats, HGFS_OP_MAX);
+   HgfsServerBufferStats bufferStats;
+   GString *json = g_string_new("{\"ops\":[");
+   gboolean first = TRUE;
+   guint op;
+
+   HgfsServer_GetOpStats(stats, HGFS_OP_MAX);
+
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      guint i;
+
+      if (stats[op].count == 0) {
+         continue;
+      }
+
+      g_string_append_printf(json,
+                             "%s{\"op\":%u"
+                             ",\"count\":%"FMT64"u"
+                             ",\"errors\":%"FMT64"u"
+                             ",\"bytesIn\":%"FMT64"u"
+                             ",\"bytesOut\":%"FMT64"u"
+                             ",\"totalTime\":%"FMT64"u"
+                             ",\"maxTime\":%"FMT64"u"
+                             ",\"latency\":[",
+                             first ? "" : ",",
+                             op,
+                             stats[op].count,
+                             stats[op].errors,
+                             stats[op].bytesIn,
+                             stats[op].bytesOut,
+                             stats[op].totalTime,
+                             stats[op].maxTime);
+      for (i = 0; i < HGFS_OP_STATS_BUCKETS; i++) {
+         g_string_append_printf(json, "%s%"FMT64"u", i == 0 ? "" : ",",
+                                stats[op].latency[i]);
+      }
+      g_string_append(json, "]}");
+      first = FALSE;
+   }
+   HgfsServer_GetBufferStats(&bufferStats);
+   g_string_append_printf(json,
+                          "],\"buffers\":{\"poolHits\":%"FMT64"u"
+                          ",\"poolMisses\":%"FMT64"u"
+                          ",\"bounceBuffers\":%"FMT64"u"
+                          ",\"mappedInPlace\":%"FMT64"u}}",
+                          bufferStats.poolHits,
+                          bufferStats.poolMisses,
+                          bufferStats.bounceBuffers,
+                          bufferStats.mappedInPlace);
+   g_free(stats);
+
+   return g_string_free(json, FALSE);
+}
+
+
+/**
+ * Timer callback that publishes the op statistics to the host through
+ * guestinfo, where "vmware-toolbox-cmd stat hgfs" can read them.
+ *
+ * @param[in]  _ctx     The application context.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+HgfsServerStatsPublish(gpointer _ctx)
+{
+   ToolsAppCtx *ctx = _ctx;
+   gchar *json = HgfsServerStatsToJSON();
+
+   RpcChannel_SetGuestInfo(ctx->rpc, HGFS_STATS_GUESTINFO_KEY, json);
+   g_free(json);
+
+   return TRUE;
+}
+
+
+/**
+ * Turns the op statistics on or off when the config file sets them; without
+ * the key the server keeps whatever the "hgfs.opStats.enable" Config value
+ * chose. The guest service also publishes them periodically while they're on.
+ *
+ * @param[in]  ctx      The application context.
+ */
+
+static void
+HgfsServerStatsConfigure(ToolsAppCtx *ctx)
+{
+   gboolean enable;
+
+   if (g_key_file_has_key(ctx->config, HGFS_CONFGROUPNAME,
+                          HGFS_CONFNAME_OPSTATS, NULL)) {
+      HgfsServer_EnableOpStats(g_key_file_get_boolean(ctx->config,
+                                                      HGFS_CONFGROUPNAME,
+                                                      HGFS_CONFNAME_OPSTATS,
+                                                      NULL));
+   }
+   enable = HgfsServer_OpStatsEnabled();
+
+   if (enable && gStatsSource == NULL && ctx->rpc != NULL &&
+       strcmp(ctx->name, VMTOOLS_GUEST_SERVICE) == 0) {
+      gStatsSource = g_timeout_source_new(HGFS_STATS_PUBLISH_PERIOD);
+      VMTOOLSAPP_ATTACH_SOURCE(ctx, gStatsSource, HgfsServerStatsPublish,
+                               ctx, NULL);
+   } else if (!enable && gStatsSource != NULL) {
+      g_source_destroy(gStatsSource);
+      g_source_unref(gStatsSource);
+      gStatsSource = NULL;
+   }
+}
+
+
+#if !defined(_WIN32)
+/**
+ * Hands pending lease breaks to the HGFS server, which sends the oplock
+ * breaks to the clients holding them.
+ *
+ * @param[in]  info     Unused.
+ * @param[in]  data     Unused.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+HgfsServerOplockSignal(const siginfo_t *info,
+                       gpointer data)
+{
+   HgfsServer_ProcessOplockBreaks();
+   return TRUE;
+}
+#endif
+
+
+/**
+ * Turns oplocks on or off as the config file says; they're off by default.
+ * Lease breaks are caught with the application's SIGIO source, so that the
+ * server doesn't install a signal handler of its own. Once created, the
+ * source stays until shutdown: locks granted while oplocks were on still
+ * have to be broken.
+ *
+ * @param[in]  ctx      The application context.
+ */
+
+static void
+HgfsServerOplocksConfigure(ToolsAppCtx *ctx)
+{
+   gboolean enable = g_key_file_get_boolean(ctx->config, HGFS_CONFGROUPNAME,
+                                            HGFS_CONFNAME_OPLOCKS, NULL);
+
+#if defined(_WIN32)
+   enable = FALSE;
+#else
+   if (enable && gOplockSource == NULL) {
+      gOplockSource = VMTools_NewSignalSource(SIGIO);
+      if (gOplockSource == NULL) {
+         g_warning("Cannot watch SIGIO, HGFS oplocks stay disabled.\n");
+         enable = FALSE;
+      } else {
+         VMTOOLSAPP_ATTACH_SOURCE(ctx, gOplockSource, HgfsServerOplockSignal,
+                                  NULL, NULL);
+      }
+   }
+#endif
+   HgfsServer_EnableOplocks(enable);
+}
+
+
+/**
+ * Reconfigures the op statistics and oplocks upon config file reload.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The application context.
+ * @param[in]  data     Unused.
+ */
+
+static void
+HgfsServerConfReload(gpointer src,
+                     ToolsAppCtx *ctx,
+                     gpointer data)
+{
+   HgfsServerStatsConfigure(ctx);
+   HgfsServerOplocksConfigure(ctx);
+}
+
 
 /**
  * Clean up internal state on shutdown.
@@ -56,7 +271,21 @@ HgfsServerShutdown(gpointer src,
                    ToolsPluginData *plugin)
 {
    HgfsServerMgrData *mgrData = plugin->_private;
+
+   if (gStatsSource != NULL) {
+      g_source_destroy(gStatsSource);
+      g_source_unref(gStatsSource);
+      gStatsSource = NULL;
+   }
+   HgfsServer_EnableOplocks(FALSE);
    HgfsServerManager_Unregister(mgrData);
+#if !defined(_WIN32)
+   if (gOplockSource != NULL) {
+      g_source_destroy(gOplockSource);
+      g_source_unref(gOplockSource);
+      gOplockSource = NULL;
+   }
+#endif
    g_free(mgrData);
 }
 
@@ -93,6 +322,21 @@ HgfsServerRpcDispatch(RpcInData *data)
 }
 
 
+/**
+ * Handles a "Hgfs_Stats" RPC, replying with the op statistics as JSON.
+ *
+ * @param[in]  data  RPC request data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+HgfsServerRpcStats(RpcInData *data)
+{
+   return RPCIN_SETRETVALSF(data, HgfsServerStatsToJSON(), TRUE);
+}
+
+
 /**
  * Sends the HGFS capability to the VMX.
  *
@@ -180,10 +424,12 @@ ToolsOnLoad(ToolsAppCtx *ctx)
 
    {
       RpcChannelCallback rpcs[] = {
-         { HGFS_SYNC_REQREP_CMD, HgfsServerRpcDispatch, mgrData, NULL, NULL, 0 }
+         { HGFS_SYNC_REQREP_CMD, HgfsServerRpcDispatch, mgrData, NULL, NULL, 0 },
+         { "Hgfs_Stats", HgfsServerRpcStats, NULL, NULL, NULL, 0 }
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, HgfsServerCapReg, &regData },
+         { TOOLS_CORE_SIG_CONF_RELOAD, HgfsServerConfReload, NULL },
          { TOOLS_CORE_SIG_SHUTDOWN, HgfsServerShutdown, &regData }
       };
       ToolsAppReg regs[] = {
@@ -195,5 +441,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
    }
    regData._private = mgrData;
 
+   HgfsServerStatsConfigure(ctx);
+   HgfsServerOplocksConfigure(ctx);
+
    return &regData;
 }
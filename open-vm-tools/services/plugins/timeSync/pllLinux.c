@@ -34,6 +34,12 @@
 #include <sys/timex.h>
 #include "vm_assert.h"
 
+/*
+ * Poll exponent the kernel discipline should use, as reported back by
+ * adjtimex. See TimeSync_PLLUpdate.
+ */
+static long pllTimeConstant = 4;
+
 
 static void
 TimeSyncLogPLLState(const char *prefix, struct timex *tx)
@@ -99,6 +105,48 @@ TimeSync_PLLSetFrequency(int64 ppmCorrection)
 }
 
 
+/*
+ ******************************************************************************
+ * TimeSync_PLLSetUpdateInterval --                                     */ /**
+ *
+ * Set the expected interval between PLL updates.  The time constant of the
+ * kernel discipline is derived from it the next time the PLL is updated.
+ *
+ * The kernel corrects the frequency by offset * interval / 2 ^ (2 * (2 +
+ * constant)) on each update.  Keeping 2 ^ (2 + constant) at or just above
+ * the interval keeps that gain at or below 1, which is what makes the
+ * loop stable: doubling the interval must bump the constant by one.
+ *
+ * @param[in] interval       Interval between updates, in microseconds.
+ *
+ * @return TRUE on success.
+ *
+ ******************************************************************************
+ */
+
+Bool
+TimeSync_PLLSetUpdateInterval(int64 interval)
+{
+   int64 secs = interval / US_PER_SEC;
+   long constant = 0;
+
+   while (constant < 16 && (1LL << constant) < secs) {
+      constant++;
+   }
+
+   /*
+    * The kernel clamps the time constant to MAXTC (10), so asking for more
+    * would only make TimeSync_PLLUpdate set it again on every update. We
+    * never want to go below the 16s we use by default.
+    */
+   pllTimeConstant = MAX(4, MIN(constant - 2, 10));
+   g_debug("%s: interval %"FMT64"ds, time constant %ld\n", __FUNCTION__,
+           secs, pllTimeConstant);
+
+   return TRUE;
+}
+
+
 /*
  ******************************************************************************
  * TimeSync_PLLUpdate --                                                */ /**
@@ -158,11 +206,13 @@ TimeSync_PLLUpdate(int64 offset)
     * Since TimeSyncReadHostAndGuest retries if the error is large, we
     * don't need to implement the clock filter.  Hence we want a time
     * constant of 60/8 = 7, but settle for the lowest available: 16.  This
-    * allows us to react to changes relatively fast.
+    * allows us to react to changes relatively fast.  When the sync period
+    * is stretched the time constant follows it (see
+    * TimeSync_PLLSetUpdateInterval).
     */
-   if (tx.constant != 4) {
+   if (tx.constant != pllTimeConstant) {
       tx.modes = ADJ_TIMECONST;
-      tx.constant = 0;
+      tx.constant = pllTimeConstant - 4;
       error = adjtimex(&tx);
       if (error == -1) {
          g_debug("%s: adjtimex set time constant failed: %d %s\n", __FUNCTION__,
@@ -88,3 +88,24 @@ TimeSync_PLLUpdate(int64 offset)
    NOT_IMPLEMENTED();
    return FALSE;
 }
+
+
+/*
+ ******************************************************************************
+ * TimeSync_PLLSetUpdateInterval --                                     */ /**
+ *
+ * Set the expected interval between PLL updates.
+ *
+ * @param[in] interval       Interval between updates, in microseconds.
+ *
+ * @return FALSE
+ *
+ ******************************************************************************
+ */
+
+Bool
+TimeSync_PLLSetUpdateInterval(int64 interval)
+{
+   NOT_IMPLEMENTED();
+   return FALSE;
+}
@@ -83,16 +83,28 @@
  *
  * 5. Avoid changing the slew in any other circumstance.  This allows a
  *    another agent to slew the time when we are not actively slewing.
+ *
+ * Adapting the sync period:
+ *
+ * Once the PLL is locked the kernel discipline keeps the clock on track
+ * between samples, so reading the host time every period is mostly
+ * wasted backdoor calls.  While the measured error stays below
+ * TIMESYNC_PLL_STABLE the period is doubled, up to TIMESYNC_MAX_PERIOD,
+ * and the PLL time constant follows it.  Any larger error halves it
+ * again, and leaving the PLL state goes straight back to the configured
+ * period.
  */
 
 #include "timeSync.h"
 #include "backdoor.h"
 #include "backdoor_def.h"
 #include "conf.h"
+#include "hostinfo.h"
 #include "msg.h"
 #include "strutil.h"
 #include "system.h"
 #include "vmware/guestrpc/timesync.h"
+#include "vmware/tools/metrics.h"
 #include "vmware/tools/plugin.h"
 #include "vmware/tools/utils.h"
 
@@ -123,6 +135,12 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 #define TIMESYNC_PLL_UNSYNC (2 * TIMESYNC_PLL_ACTIVATE)
 /* Period during which the frequency error of guest time is measured. */
 #define TIMESYNC_CALIBRATION_DURATION (15 * 60 * US_PER_SEC) /* 15min. */
+/* While the PLL is locked and the error stays below TIMESYNC_PLL_STABLE,
+ * the sync period grows up to 16 times the configured one, but no more
+ * than TIMESYNC_MAX_PERIOD (NTP's maximum poll interval). */
+#define TIMESYNC_PLL_STABLE 1000 /* 1ms. */
+#define TIMESYNC_MAX_PERIOD_SHIFT 4
+#define TIMESYNC_MAX_PERIOD 1024 /* In seconds. */
 
 typedef enum TimeSyncState {
    TIMESYNC_INITIALIZING,
@@ -136,13 +154,36 @@ typedef enum TimeSyncSlewState {
    TimeSyncPLL,
 } TimeSyncSlewState;
 
+/* Backdoor call used to read the host time, see TimeSyncReadHost. */
+typedef enum TimeSyncBackdoorCmd {
+   TIMESYNC_BDOOR_UNKNOWN,
+   TIMESYNC_BDOOR_GETTIMEFULL_WITH_LAG,
+   TIMESYNC_BDOOR_GETTIMEFULL,
+   TIMESYNC_BDOOR_GETTIME,
+} TimeSyncBackdoorCmd;
+
+typedef struct TimeSyncStats {
+   uint64             syncs;
+   uint64             backdoorCalls;
+   uint64             backdoorTime;           /* In microseconds. */
+   uint64             totalCorrection;        /* Absolute, in microseconds. */
+   uint64             maxCorrection;          /* Absolute, in microseconds. */
+} TimeSyncStats;
+
 typedef struct TimeSyncData {
    gboolean           slewActive;
    gboolean           slewCorrection;
    uint32             slewPercentCorrection;
    uint32             timeSyncPeriod;         /* In seconds. */
+   uint32             currentPeriod;          /* In seconds. */
    TimeSyncState      state;
    TimeSyncSlewState  slewState;
+   TimeSyncBackdoorCmd backdoorCmd;
+   TimeSyncStats      stats;
+   ToolsMetric       *syncsMetric;
+   ToolsMetric       *backdoorMetric;        /* In microseconds. */
+   ToolsMetric       *correctionMetric;      /* In microseconds. */
+   ToolsAppCtx       *ctx;
    GSource           *timer;
 } TimeSyncData;
 
@@ -150,9 +191,40 @@ typedef struct TimeSyncData {
 static void TimeSyncSetSlewState(TimeSyncData *data, gboolean active);
 static void TimeSyncResetSlew(TimeSyncData *data);
 
+
+/**
+ * Issue a backdoor call, accounting for the number of calls made and the
+ * time spent in them.
+ *
+ * @param[in]     data        Structure tracking time sync state.
+ * @param[in,out] bp          Backdoor call arguments.
+ */
+
+static void
+TimeSyncBackdoor(TimeSyncData *data, Backdoor_proto *bp)
+{
+   VmTimeType start = Hostinfo_SystemTimerUS();
+   VmTimeType elapsed;
+
+   Backdoor(bp);
+
+   elapsed = Hostinfo_SystemTimerUS() - start;
+   data->stats.backdoorCalls++;
+   data->stats.backdoorTime += elapsed;
+   ToolsMetric_Observe(data->backdoorMetric, elapsed);
+}
+
+
 /**
  * Read the time reported by the Host OS.
  *
+ * The first read probes for the newest backdoor call supported by the
+ * host, and the result is remembered for the following reads.  If the
+ * remembered call fails (e.g. after migrating to an older host), fall
+ * back to the older ones.  The probe is redone when the loop starts and
+ * when the host explicitly asks for a sync (e.g. after a resume).
+ *
+ * @param[in]   data                Structure tracking time sync state.
  * @param[out]  host                Time on the Host.
  * @param[out]  apparentError       Apparent time error = apparent - real.
  * @param[out]  apparentErrorValid  Did the platform inform us of apparentError.
@@ -163,8 +235,8 @@ static void TimeSyncResetSlew(TimeSyncData *data);
  */
 
 static gboolean
-TimeSyncReadHost(int64 *host, int64 *apparentError, Bool *apparentErrorValid,
-                 int64 *maxTimeError)
+TimeSyncReadHost(TimeSyncData *data, int64 *host, int64 *apparentError,
+                 Bool *apparentErrorValid, int64 *maxTimeError)
 {
    Backdoor_proto bp;
    int64 maxTimeLag;
@@ -208,29 +280,56 @@ TimeSyncReadHost(int64 *host, int64 *apparentError, Bool *apparentErrorValid,
     * BDOOR_MAGIC, which was set by the call to Backdoor() prior to touching the
     * backdoor port.
     */
-   bp.in.cx.halfs.low = BDOOR_CMD_GETTIMEFULL_WITH_LAG;
-   Backdoor(&bp);
-   if (bp.out.ax.word == BDOOR_MAGIC) {
-      hostSecs = ((uint64)bp.out.si.word << 32) | bp.out.dx.word;
-      interruptLag = bp.out.di.word;
-      timeLagCall = TRUE;
-      g_debug("Using BDOOR_CMD_GETTIMEFULL_WITH_LAG\n");
-   } else {
+   interruptLag = 0;
+   timeLagCall = FALSE;
+
+   switch (data->backdoorCmd) {
+   case TIMESYNC_BDOOR_UNKNOWN:
+   case TIMESYNC_BDOOR_GETTIMEFULL_WITH_LAG:
+      bp.in.cx.halfs.low = BDOOR_CMD_GETTIMEFULL_WITH_LAG;
+      TimeSyncBackdoor(data, &bp);
+      if (bp.out.ax.word == BDOOR_MAGIC) {
+         hostSecs = ((uint64)bp.out.si.word << 32) | bp.out.dx.word;
+         interruptLag = bp.out.di.word;
+         timeLagCall = TRUE;
+         if (data->backdoorCmd != TIMESYNC_BDOOR_GETTIMEFULL_WITH_LAG) {
+            g_debug("Using BDOOR_CMD_GETTIMEFULL_WITH_LAG\n");
+            data->backdoorCmd = TIMESYNC_BDOOR_GETTIMEFULL_WITH_LAG;
+         }
+         break;
+      }
       g_debug("BDOOR_CMD_GETTIMEFULL_WITH_LAG not supported by current host, "
               "attempting BDOOR_CMD_GETTIMEFULL\n");
-      interruptLag = 0;
-      timeLagCall = FALSE;
+      /* Fall through. */
+
+   case TIMESYNC_BDOOR_GETTIMEFULL:
       bp.in.cx.halfs.low = BDOOR_CMD_GETTIMEFULL;
-      Backdoor(&bp);
+      TimeSyncBackdoor(data, &bp);
       if (bp.out.ax.word == BDOOR_MAGIC) {
          hostSecs = ((uint64)bp.out.si.word << 32) | bp.out.dx.word;
-      } else {
-         g_debug("BDOOR_CMD_GETTIMEFULL not supported by current host, "
-                 "attempting BDOOR_CMD_GETTIME\n");
-         bp.in.cx.halfs.low = BDOOR_CMD_GETTIME;
-         Backdoor(&bp);
-         hostSecs = bp.out.ax.word;
+         if (data->backdoorCmd != TIMESYNC_BDOOR_GETTIMEFULL) {
+            g_debug("Using BDOOR_CMD_GETTIMEFULL\n");
+            data->backdoorCmd = TIMESYNC_BDOOR_GETTIMEFULL;
+         }
+         break;
       }
+      g_debug("BDOOR_CMD_GETTIMEFULL not supported by current host, "
+              "attempting BDOOR_CMD_GETTIME\n");
+      /* Fall through. */
+
+   case TIMESYNC_BDOOR_GETTIME:
+      /* BDOOR_CMD_GETTIME cannot report a failure. */
+      bp.in.cx.halfs.low = BDOOR_CMD_GETTIME;
+      TimeSyncBackdoor(data, &bp);
+      hostSecs = bp.out.ax.word;
+      if (data->backdoorCmd != TIMESYNC_BDOOR_GETTIME) {
+         g_debug("Using BDOOR_CMD_GETTIME\n");
+         data->backdoorCmd = TIMESYNC_BDOOR_GETTIME;
+      }
+      break;
+
+   default:
+      NOT_REACHED();
    }
    hostUsecs = bp.out.bx.word;
    maxTimeLag = bp.out.cx.word;
@@ -262,6 +361,7 @@ TimeSyncReadHost(int64 *host, int64 *apparentError, Bool *apparentErrorValid,
  * between apparent time and host time (apparentError).  The host and
  * guest time may be sampled multiple times to ensure an accurate reading.
  *
+ * @param[in]   data                Structure tracking time sync state.
  * @param[out]  host                Time on the Host.
  * @param[out]  guest               Time in the Guest.
  * @param[out]  apparentError       Apparent time error = apparent - real.
@@ -273,7 +373,7 @@ TimeSyncReadHost(int64 *host, int64 *apparentError, Bool *apparentErrorValid,
  */
 
 static gboolean
-TimeSyncReadHostAndGuest(int64 *host, int64 *guest, 
+TimeSyncReadHostAndGuest(TimeSyncData *data, int64 *host, int64 *guest,
                          int64 *apparentError, Bool *apparentErrorValid,
                          int64 *maxTimeError)
 {
@@ -287,7 +387,7 @@ TimeSyncReadHostAndGuest(int64 *host, int64 *guest,
    *apparentErrorValid = FALSE;
    *host = *guest = *apparentError = *maxTimeError = 0;
 
-   if (!TimeSyncReadHost(&host2, &tmpApparentError, 
+   if (!TimeSyncReadHost(data, &host2, &tmpApparentError,
                          &tmpApparentErrorValid, &tmpMaxTimeError)) {
       return FALSE;
    }
@@ -302,7 +402,7 @@ TimeSyncReadHostAndGuest(int64 *host, int64 *guest,
          return FALSE;
       }
       
-      if (!TimeSyncReadHost(&host2, &tmpApparentError, 
+      if (!TimeSyncReadHost(data, &host2, &tmpApparentError,
                             &tmpApparentErrorValid, &tmpMaxTimeError)) {
          return FALSE;
       }
@@ -413,7 +513,7 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
 
    int64 now;
    int64 remaining = 0;
-   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
+   int64 timeSyncPeriodUS = data->currentPeriod * US_PER_SEC;
    int64 slewDiff = (adjustment * data->slewPercentCorrection) / 100;
    
    if (!TimeSync_GetCurrentTime(&now)) {
@@ -425,6 +525,10 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
       g_debug("Adjustment too large (%"FMT64"d), resetting PLL state.\n", 
               adjustment);
       data->slewState = TimeSyncUncalibrated;
+      if (TimeSync_PLLSupported()) {
+         /* Don't carry a stretched time constant over to the next lock. */
+         TimeSync_PLLSetUpdateInterval((int64)data->timeSyncPeriod * US_PER_SEC);
+      }
    }
 
    if (data->slewState == TimeSyncUncalibrated) {
@@ -493,14 +597,53 @@ TimeSyncResetSlew(TimeSyncData *data)
    int64 remaining;
    int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
    data->slewState = TimeSyncUncalibrated;
+   data->currentPeriod = data->timeSyncPeriod;
    TimeSync_Slew(0, timeSyncPeriodUS, &remaining);
    if (TimeSync_PLLSupported()) {
+      TimeSync_PLLSetUpdateInterval(timeSyncPeriodUS);
       TimeSync_PLLUpdate(0);
       TimeSync_PLLSetFrequency(0);
    }
 }
 
 
+/**
+ * Adapt the sync period to the error measured while the PLL is locked.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  adjustment        Error measured by the last sync.
+ */
+
+static void
+TimeSyncAdaptPeriod(TimeSyncData *data, int64 adjustment)
+{
+   uint32 period = data->currentPeriod;
+   uint32 maxPeriod;
+   int64 absAdjustment = adjustment < 0 ? -adjustment : adjustment;
+
+   if (data->slewState != TimeSyncPLL) {
+      period = data->timeSyncPeriod;
+   } else if (absAdjustment < TIMESYNC_PLL_STABLE / 2) {
+      maxPeriod = MIN(data->timeSyncPeriod << TIMESYNC_MAX_PERIOD_SHIFT,
+                      TIMESYNC_MAX_PERIOD);
+      if (period * 2 <= maxPeriod) {
+         period *= 2;
+      }
+   } else if (absAdjustment > TIMESYNC_PLL_STABLE) {
+      period = MAX(period / 2, data->timeSyncPeriod);
+   }
+
+   if (period != data->currentPeriod) {
+      g_debug("Adapting sync period: %u -> %u sec (adjustment %"FMT64"d).\n",
+              data->currentPeriod, period, adjustment);
+      data->currentPeriod = period;
+      if (data->slewState == TimeSyncPLL) {
+         TimeSync_PLLSetUpdateInterval((int64)period * US_PER_SEC);
+      }
+   }
+}
+
+
 /**
  * Update whether slewing is used for time correction.
  *
@@ -521,6 +664,43 @@ TimeSyncSetSlewState(TimeSyncData *data, gboolean active)
 }
 
 
+/**
+ * Account for a correction applied to the guest time.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  adjustment        Amount the guest time was corrected by.
+ */
+
+static void
+TimeSyncAccountCorrection(TimeSyncData *data, int64 adjustment)
+{
+   uint64 absAdjustment = adjustment < 0 ? -adjustment : adjustment;
+
+   data->stats.totalCorrection += absAdjustment;
+   data->stats.maxCorrection = MAX(data->stats.maxCorrection, absAdjustment);
+   ToolsMetric_Observe(data->correctionMetric, absAdjustment);
+}
+
+
+/**
+ * Log the time sync statistics.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ */
+
+static void
+TimeSyncLogStats(TimeSyncData *data)
+{
+   TimeSyncStats *stats = &data->stats;
+
+   g_debug("Time sync statistics: %"FMT64"u syncs, %"FMT64"u backdoor calls "
+           "(%"FMT64"uus total), corrections %"FMT64"uus total, "
+           "%"FMT64"uus max, current period %u sec.\n",
+           stats->syncs, stats->backdoorCalls, stats->backdoorTime,
+           stats->totalCorrection, stats->maxCorrection, data->currentPeriod);
+}
+
+
 /**
  * Set the guest OS time to the host OS time.
  *
@@ -547,13 +727,16 @@ TimeSyncDoSync(Bool slewCorrection,
            "syncOnce %d, slewCorrection %d, allowBackwardSync %d.\n",
            syncOnce, slewCorrection, allowBackwardSync);
 
-   if (!TimeSyncReadHostAndGuest(&host, &guest, &apparentError, 
+   if (!TimeSyncReadHostAndGuest(data, &host, &guest, &apparentError,
                                  &apparentErrorValid, &maxTimeError)) {
       return FALSE;
    }
 
    gosError = guest - host - apparentError;
 
+   data->stats.syncs++;
+   ToolsMetric_Inc(data->syncsMetric);
+
    if (syncOnce) {
 
       /*
@@ -570,6 +753,7 @@ TimeSyncDoSync(Bool slewCorrection,
          if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
             return FALSE;
          }
+         TimeSyncAccountCorrection(data, -gosError + -apparentError);
       } else {
          g_debug("One time synchronization: correction not needed.\n");
       }
@@ -590,12 +774,15 @@ TimeSyncDoSync(Bool slewCorrection,
          if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
             return FALSE;
          }
+         TimeSyncAccountCorrection(data, -gosError + -apparentError);
       } else if (slewCorrection && apparentErrorValid) {
          g_debug("Periodic synchronization: slewing time.\n");
          if (!TimeSyncSlewTime(data, -gosError)) {
             return FALSE;
          }
+         TimeSyncAccountCorrection(data, -gosError);
       }
+      TimeSyncAdaptPeriod(data, -gosError);
    }
 
    return TRUE;
@@ -607,20 +794,33 @@ TimeSyncDoSync(Bool slewCorrection,
  *
  * @param[in]  _data    Time sync data.
  *
- * @return always TRUE.
+ * @return FALSE if the loop was rescheduled with a new period, TRUE otherwise.
  */
 
 static gboolean
 ToolsDaemonTimeSyncLoop(gpointer _data)
 {
    TimeSyncData *data = _data;
+   uint32 period;
 
    ASSERT(data != NULL);
 
+   period = data->currentPeriod;
    if (!TimeSyncDoSync(data->slewCorrection, FALSE, FALSE, data)) {
       g_warning("Unable to synchronize time.\n");
    }
 
+   if (data->currentPeriod != period) {
+      /* Reschedule with the adapted period; this source is done. */
+      TimeSyncLogStats(data);
+      g_source_destroy(data->timer);
+      g_source_unref(data->timer);
+      data->timer = g_timeout_source_new(data->currentPeriod * 1000);
+      VMTOOLSAPP_ATTACH_SOURCE(data->ctx, data->timer,
+                               ToolsDaemonTimeSyncLoop, data, NULL);
+      return FALSE;
+   }
+
    return TRUE;
 }
 
@@ -648,6 +848,7 @@ TimeSyncStartLoop(ToolsAppCtx *ctx,
     * Turn slew on and set it to nominal.  
     */
    TimeSyncResetSlew(data);
+   data->backdoorCmd = TIMESYNC_BDOOR_UNKNOWN;
 
    g_debug("New sync period is %d sec.\n", data->timeSyncPeriod);
 
@@ -655,7 +856,7 @@ TimeSyncStartLoop(ToolsAppCtx *ctx,
       g_warning("Unable to synchronize time when starting time loop.\n");
    }
 
-   data->timer = g_timeout_source_new(data->timeSyncPeriod * 1000);
+   data->timer = g_timeout_source_new(data->currentPeriod * 1000);
    VMTOOLSAPP_ATTACH_SOURCE(ctx, data->timer, ToolsDaemonTimeSyncLoop, data, NULL);
 
    data->state = TIMESYNC_RUNNING;
@@ -679,6 +880,7 @@ TimeSyncStopLoop(ToolsAppCtx *ctx,
    ASSERT(data->timer != NULL);
 
    g_debug("Stopping time sync loop.\n");
+   TimeSyncLogStats(data);
 
    TimeSyncSetSlewState(data, FALSE);
    TimeSync_DisableTimeSlew();
@@ -705,6 +907,8 @@ TimeSyncTcloHandler(RpcInData *data)
    Bool backwardSync = !strcmp(data->args, "1");
    TimeSyncData *syncData = data->clientData;
 
+   /* The host may have changed (e.g. resume on another host), probe again. */
+   syncData->backdoorCmd = TIMESYNC_BDOOR_UNKNOWN;
    if (!TimeSyncDoSync(syncData->slewCorrection, TRUE, backwardSync, syncData)) {
       return RPCIN_SETRETVALS(data, "Unable to sync time", FALSE);
    } else {
@@ -905,7 +1109,7 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       NULL
    };
 
-   TimeSyncData *data = g_malloc(sizeof (TimeSyncData));
+   TimeSyncData *data = g_malloc0(sizeof (TimeSyncData));
    RpcChannelCallback rpcs[] = {
       { TIMESYNC_SYNCHRONIZE, TimeSyncTcloHandler, data, NULL, NULL, 0 }
    };
@@ -924,7 +1128,15 @@ ToolsOnLoad(ToolsAppCtx *ctx)
    data->state = TIMESYNC_INITIALIZING;
    data->slewState = TimeSyncUncalibrated;
    data->timeSyncPeriod = TIMESYNC_TIME;
+   data->currentPeriod = TIMESYNC_TIME;
+   data->backdoorCmd = TIMESYNC_BDOOR_UNKNOWN;
+   data->ctx = ctx;
    data->timer = NULL;
+   data->syncsMetric = ToolsCoreMetrics_GetCounter(ctx, "timeSync.syncs");
+   data->backdoorMetric = ToolsCoreMetrics_GetHistogram(ctx,
+                                                        "timeSync.backdoorUs");
+   data->correctionMetric = ToolsCoreMetrics_GetHistogram(ctx,
+                                                          "timeSync.correctionUs");
 
    regData.regs = VMTools_WrapArray(regs, sizeof *regs, ARRAYSIZE(regs));
    regData._private = data;
@@ -50,6 +50,9 @@ TimeSync_PLLUpdate(int64 offset);
 Bool
 TimeSync_PLLSetFrequency(int64 ppmCorrection);
 
+Bool
+TimeSync_PLLSetUpdateInterval(int64 interval);
+
 Bool
 TimeSync_PLLSupported(void);
 
@@ -177,8 +177,6 @@ static VGAuthUserHandle *currentUserHandle = NULL;
 #endif
 
 
-#define SECONDS_BETWEEN_POLL_TEST_FINISHED     1
-
 /*
  * This is used by the PRODUCT_VERSION_STRING macro.
  */
@@ -268,10 +266,10 @@ typedef struct VixToolsStartProgramState {
  * Tracks processes started via StartProgram, so their exit information can
  * be returned with ListProcessesEx()
  *
- * We need live and dead because the exit status is fetched by from
- * a timer loop, and StartProgram of a very short lived program
+ * We need live and dead because the exit status is fetched from
+ * the main loop, and StartProgram of a very short lived program
  * followed immediately by a ListProcesses could miss the program
- * if we don't save it off for before the timer fires.
+ * if we don't save it off for before the exit callback runs.
  *
  * Note that we save off the procState so that we keep an open
  * handle to the process, to prevent its PID from being recycled.
@@ -370,6 +368,10 @@ static VixError VixToolsGetFileInfo(VixCommandRequestHeader *requestMsg,
 
 static VixError VixToolsSetFileAttributes(VixCommandRequestHeader *requestMsg);
 
+static void VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,
+                                   void *eventQueue,
+                                   GSourceFunc callback,
+                                   void *clientData);
 static gboolean VixToolsMonitorAsyncProc(void *clientData);
 static gboolean VixToolsMonitorStartProgram(void *clientData);
 static void VixToolsRegisterHgfsSessionInvalidator(void *clientData);
@@ -1319,7 +1321,6 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    STARTUPINFO si;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
 
    if (NULL != pid) {
       *pid = (int64) -1;
@@ -1452,13 +1453,11 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    }
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Get called back when the app exits.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -1525,7 +1524,6 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
    wchar_t *envBlock = NULL;
    Bool envBlockFromMalloc = TRUE;
 #endif
-   GSource *timer;
 
    /*
     * Initialize this here so we can call free on its member variables in abort
@@ -1707,13 +1705,11 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
    Debug("%s started '%s', pid %"FMT64"d\n", __FUNCTION__, fullCommandLine, *pid);
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Get called back when the app exits.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorStartProgram, asyncState);
 
    /*
     * VixToolsMonitorStartProgram will clean asyncState up when the program
@@ -1741,18 +1737,112 @@ abort:
 } // VixToolsStartProgramImpl
 
 
+/*
+ * Main loop source that dispatches once a program started with
+ * ProcMgr_ExecAsync() has exited. It polls the selectable ProcMgr hands
+ * out for the process (the pipe the waiter writes the exit status to on
+ * POSIX, the process handle on Windows), so there is no periodic wakeup
+ * while the program runs and no delay once it is done.
+ */
+
+typedef struct VixToolsAsyncProcSource {
+   GSource     src;
+   GPollFD     pollFd;
+} VixToolsAsyncProcSource;
+
+
+static gboolean
+VixToolsAsyncProcSourcePrepare(GSource *src,   // IN
+                               gint *timeout)  // OUT
+{
+   *timeout = -1;
+   return FALSE;
+}
+
+
+static gboolean
+VixToolsAsyncProcSourceCheck(GSource *src)   // IN
+{
+   VixToolsAsyncProcSource *procSrc = (VixToolsAsyncProcSource *) src;
+
+   return procSrc->pollFd.revents != 0;
+}
+
+
+static gboolean
+VixToolsAsyncProcSourceDispatch(GSource *src,          // IN
+                                GSourceFunc callback,  // IN
+                                gpointer data)         // IN
+{
+   ASSERT(callback != NULL);
+   return callback(data);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsWatchAsyncProc --
+ *
+ *    Arranges for callback to be called from eventQueue once the async
+ *    process exits. The watch stays attached for as long as the callback
+ *    returns TRUE.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    Attaches a source to the context of eventQueue.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,  // IN
+                       void *eventQueue,              // IN
+                       GSourceFunc callback,          // IN
+                       void *clientData)              // IN
+{
+   static GSourceFuncs srcFuncs = {
+      VixToolsAsyncProcSourcePrepare,
+      VixToolsAsyncProcSourceCheck,
+      VixToolsAsyncProcSourceDispatch,
+      NULL,
+      NULL,
+      NULL
+   };
+   VixToolsAsyncProcSource *procSrc;
+
+   procSrc = (VixToolsAsyncProcSource *) g_source_new(&srcFuncs,
+                                                      sizeof *procSrc);
+#if defined(_WIN32)
+   procSrc->pollFd.fd = (gintptr) ProcMgr_GetAsyncProcSelectable(procState);
+   procSrc->pollFd.events = G_IO_IN;
+#else
+   procSrc->pollFd.fd = ProcMgr_GetAsyncProcSelectable(procState);
+   procSrc->pollFd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+#endif
+   g_source_add_poll(&procSrc->src, &procSrc->pollFd);
+
+   g_source_set_callback(&procSrc->src, callback, clientData, NULL);
+   g_source_attach(&procSrc->src,
+                   g_main_loop_get_context((GMainLoop *) eventQueue));
+   g_source_unref(&procSrc->src);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * VixToolsMonitorAsyncProc --
  *
- *    This polls a program running in the guest to see if it has completed.
- *    It is used by the test/dev code to detect when a test application
- *    completes.
+ *    Called when a program running in the guest has completed. Collects
+ *    its exit code and reports it. It is used by the test/dev code to
+ *    detect when a test application completes.
  *
  * Return value:
- *    TRUE on non-glib implementation.
- *    FALSE on glib implementation.
+ *    TRUE if the program is in fact still running.
+ *    FALSE once the program has been cleaned up.
  *
  * Side effects:
  *    None
@@ -1769,7 +1859,6 @@ VixToolsMonitorAsyncProc(void *clientData) // IN
    int exitCode = 0;
    ProcMgr_Pid pid = -1;
    int result = -1;
-   GSource *timer;
    char *requestName = NULL;
    VixRunProgramOptions runProgramOptions;
 
@@ -1780,17 +1869,11 @@ VixToolsMonitorAsyncProc(void *clientData) // IN
     * Check if the program has completed.
     */
    procIsRunning = ProcMgr_IsAsyncProcRunning(asyncState->procState);
-   if (!procIsRunning) {
-      goto done;
+   if (procIsRunning) {
+      /* Spurious wakeup; keep watching. */
+      return TRUE;
    }
 
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
-   g_source_unref(timer);
-   return FALSE;
-
-done:
 
    /*
     * We need to always check the exit code, even if there is no need to
@@ -1918,13 +2001,13 @@ VixToolsRegisterHgfsSessionInvalidator(void *clientData)    // IN:
  *
  * VixToolsMonitorStartProgram --
  *
- *    This polls a program started by StartProgram to see if it has completed.
- *    If it has, saves off its exitCode and endTime so they can be queried
- *    via ListProcessesEx.
+ *    Called when a program started by StartProgram has completed. Saves
+ *    off its exitCode and endTime so they can be queried via
+ *    ListProcessesEx.
  *
  * Return value:
- *    TRUE on non-glib implementation.
- *    FALSE on glib implementation.
+ *    TRUE if the program is in fact still running.
+ *    FALSE once the exit state has been recorded.
  *
  * Side effects:
  *    None
@@ -1941,7 +2024,6 @@ VixToolsMonitorStartProgram(void *clientData) // IN
    ProcMgr_Pid pid = -1;
    int result = -1;
    VixToolsExitedProgramState *exitState;
-   GSource *timer;
 
    asyncState = (VixToolsStartProgramState *) clientData;
    ASSERT(asyncState);
@@ -1950,17 +2032,11 @@ VixToolsMonitorStartProgram(void *clientData) // IN
     * Check if the program has completed.
     */
    procIsRunning = ProcMgr_IsAsyncProcRunning(asyncState->procState);
-   if (!procIsRunning) {
-      goto done;
+   if (procIsRunning) {
+      /* Spurious wakeup; keep watching. */
+      return TRUE;
    }
 
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
-   g_source_unref(timer);
-   return FALSE;
-
-done:
 
    result = ProcMgr_GetExitCode(asyncState->procState, &exitCode);
    pid = ProcMgr_GetPid(asyncState->procState);
@@ -5010,7 +5086,25 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
     * a common case, when a client is watching for a single pid
     * from StartProgram to exit.
     */
+#if defined(_WIN32)
    procList = ProcMgr_ListProcesses();
+#else
+   if (numPids > 0) {
+      /*
+       * Only look up the requested processes, rather than listing
+       * everything and filtering below.
+       */
+      ProcMgr_Pid *procIds = Util_SafeCalloc(numPids, sizeof *procIds);
+
+      for (i = 0; i < numPids; i++) {
+         procIds[i] = (ProcMgr_Pid) pids[i];
+      }
+      procList = ProcMgr_ListProcessesFiltered(procIds, numPids);
+      free(procIds);
+   } else {
+      procList = ProcMgr_ListProcesses();
+   }
+#endif
    if (NULL == procList) {
       err = FoundryToolsDaemon_TranslateSystemErr();
       goto abort;
@@ -6911,7 +7005,6 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    Bool forcedRoot = FALSE;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
    VMAutomationRequestParser parser;
 
    err = VMAutomationRequestParserInit(&parser,
@@ -7170,10 +7263,8 @@ if (0 == *interpreterName) {
    pid = (int64) ProcMgr_GetPid(asyncState->procState);
 
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -68,6 +68,20 @@ typedef struct VmBackupScriptOp {
 } VmBackupScriptOp;
 
 
+#if defined(_WIN32)
+/*
+ * Event source that becomes ready when the event handle of the script being
+ * monitored is signaled. GIOChannel can't watch arbitrary handles, so this
+ * polls the handle directly and dispatches to a GIOFunc like an I/O watch.
+ */
+
+typedef struct VmBackupScriptSource {
+   GSource src;
+   GPollFD pollFd;
+} VmBackupScriptSource;
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -404,6 +418,105 @@ VmBackupScriptOpCancel(VmBackupOp *_op)   // IN
 }
 
 
+#if defined(_WIN32)
+static gboolean
+VmBackupScriptSourcePrepare(GSource *src,   // IN
+                            gint *timeout)  // OUT
+{
+   *timeout = -1;
+   return FALSE;
+}
+
+
+static gboolean
+VmBackupScriptSourceCheck(GSource *src)   // IN
+{
+   VmBackupScriptSource *scriptSrc = (VmBackupScriptSource *) src;
+
+   return scriptSrc->pollFd.revents != 0;
+}
+
+
+static gboolean
+VmBackupScriptSourceDispatch(GSource *src,          // IN
+                             GSourceFunc callback,  // IN
+                             gpointer data)         // IN
+{
+   VmBackupScriptSource *scriptSrc = (VmBackupScriptSource *) src;
+
+   ASSERT(callback != NULL);
+   return ((GIOFunc) callback)(NULL, scriptSrc->pollFd.revents, data);
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptOpWatch --
+ *
+ *    Creates an I/O watch that fires when the currently running script
+ *    exits, so the state machine can query the operation right away instead
+ *    of polling it. On Windows the script's selectable is an event handle,
+ *    which is polled by a custom source with the same callback signature.
+ *
+ * Result
+ *    A new source, or NULL if no script is running.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static GSource *
+VmBackupScriptOpWatch(VmBackupOp *_op)   // IN
+{
+#if defined(_WIN32)
+   static GSourceFuncs srcFuncs = {
+      VmBackupScriptSourcePrepare,
+      VmBackupScriptSourceCheck,
+      VmBackupScriptSourceDispatch,
+      NULL,
+      NULL,
+      NULL
+   };
+   VmBackupScriptSource *scriptSrc;
+#else
+   GIOChannel *chan;
+#endif
+   VmBackupScriptOp *op = (VmBackupScriptOp *) _op;
+   VmBackupScript *scripts = op->state->scripts;
+   VmBackupScript *currScript;
+   GSource *src;
+
+   if (op->canceled || scripts == NULL || op->state->currentScript < 0) {
+      return NULL;
+   }
+
+   currScript = &scripts[op->state->currentScript];
+   if (currScript->proc == NULL) {
+      return NULL;
+   }
+
+#if defined(_WIN32)
+   scriptSrc = (VmBackupScriptSource *) g_source_new(&srcFuncs,
+                                                     sizeof *scriptSrc);
+   scriptSrc->pollFd.fd = (gintptr) ProcMgr_GetAsyncProcSelectable(currScript->proc);
+   scriptSrc->pollFd.events = G_IO_IN;
+   g_source_add_poll(&scriptSrc->src, &scriptSrc->pollFd);
+   src = &scriptSrc->src;
+#else
+   /* The descriptor belongs to the ProcMgr handle, so don't close it. */
+   chan = g_io_channel_unix_new(ProcMgr_GetAsyncProcSelectable(currScript->proc));
+   src = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+   g_io_channel_unref(chan);   // Ownership transferred to src.
+#endif
+
+   return src;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -453,6 +566,7 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
    op->callbacks.queryFn = VmBackupScriptOpQuery;
    op->callbacks.cancelFn = VmBackupScriptOpCancel;
    op->callbacks.releaseFn = VmBackupScriptOpRelease;
+   op->callbacks.watchFn = VmBackupScriptOpWatch;
 
    g_debug("Trying to run scripts from %s\n", scriptDir);
 
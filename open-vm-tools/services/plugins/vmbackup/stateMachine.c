@@ -39,6 +39,7 @@
 #include <glib-object.h>
 #include <gmodule.h>
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "str.h"
 #include "strutil.h"
 #include "util.h"
@@ -63,20 +64,19 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 #include "ioplGet.h"
 #endif
 
-#define VMBACKUP_ENQUEUE_EVENT() do {                                         \
-   gBackupState->timerEvent = g_timeout_source_new(gBackupState->pollPeriod); \
-   VMTOOLSAPP_ATTACH_SOURCE(gBackupState->ctx,                                \
-                            gBackupState->timerEvent,                         \
-                            VmBackupAsyncCallback,                            \
-                            NULL,                                             \
-                            NULL);                                            \
-} while (0)
-
 static VmBackupState *gBackupState = NULL;
 
 static Bool
 VmBackupEnableSync(void);
 
+static gboolean
+VmBackupAsyncCallback(void *clientData);
+
+static gboolean
+VmBackupWatchCallback(GIOChannel *chan,
+                      GIOCondition cond,
+                      gpointer clientData);
+
 
 /**
  * Returns a string representation of the given state machine state.
@@ -117,6 +117,98 @@ VmBackupGetStateName(VmBackupMState state)
 }
 
 
+/**
+ * Moves the state machine to the given state. The time spent in the state
+ * being left is reported to the VMX in a keep-alive event, so that the
+ * latency of each phase of the quiesce operation can be tracked.
+ *
+ * @param[in]  nextState   The new state.
+ */
+
+static void
+VmBackupSetState(VmBackupMState nextState)
+{
+   VmTimeType now = Hostinfo_SystemTimerUS();
+
+   if (gBackupState->machineState != VMBACKUP_MSTATE_IDLE) {
+      gchar *desc;
+
+      desc = g_strdup_printf("%s %"FMT64"dus",
+                             VmBackupGetStateName(gBackupState->machineState),
+                             now - gBackupState->phaseStart);
+      g_debug("Leaving state %s\n", desc);
+      VmBackup_SendEvent(VMBACKUP_EVENT_KEEP_ALIVE, 0, desc);
+      g_free(desc);
+   }
+
+   gBackupState->machineState = nextState;
+   gBackupState->phaseStart = now;
+}
+
+
+/**
+ * Schedules the next run of the state machine.
+ *
+ * If the current operation is still pending and knows how to signal its
+ * own completion, the state machine waits on the operation's event source;
+ * otherwise, it falls back to polling the operation every pollPeriod.
+ * When nothing is pending, the next step runs as soon as the main loop is
+ * idle, except while the sync provider is waiting for the "snapshot done"
+ * message (see VmBackupSnapshotDone), in which case nothing is scheduled.
+ *
+ * @param[in]  pending     Whether the current operation is still pending.
+ */
+
+static void
+VmBackupEnqueueEvent(gboolean pending)
+{
+   GSource *src;
+   GSourceFunc cb = VmBackupAsyncCallback;
+
+   ASSERT(gBackupState->timerEvent == NULL);
+
+   if (pending) {
+      ASSERT(gBackupState->currentOp != NULL);
+      src = VmBackup_Watch(gBackupState->currentOp);
+      if (src != NULL) {
+         cb = (GSourceFunc) VmBackupWatchCallback;
+      } else {
+         src = g_timeout_source_new(gBackupState->pollPeriod);
+      }
+   } else if (gBackupState->machineState == VMBACKUP_MSTATE_SYNC_FREEZE &&
+              gBackupState->currentOp == NULL &&
+              gBackupState->callback == NULL) {
+      return;
+   } else {
+      src = g_idle_source_new();
+   }
+
+   gBackupState->timerEvent = src;
+   VMTOOLSAPP_ATTACH_SOURCE(gBackupState->ctx,
+                            gBackupState->timerEvent,
+                            cb,
+                            NULL,
+                            NULL);
+}
+
+
+/**
+ * Cancels any scheduled run of the state machine and schedules a new one.
+ * Used when something outside of the state machine changes its state.
+ */
+
+static void
+VmBackupRestartEvent(void)
+{
+   if (gBackupState->timerEvent != NULL) {
+      g_source_destroy(gBackupState->timerEvent);
+      g_source_unref(gBackupState->timerEvent);
+      gBackupState->timerEvent = NULL;
+   }
+   VmBackupEnqueueEvent(FALSE);
+}
+
+
 /**
  * Sends a keep alive backup event to the VMX.
  *
@@ -293,7 +385,7 @@ VmBackupStartScripts(VmBackupScriptType type)
       return FALSE;
    }
 
-   gBackupState->machineState = nextState;
+   VmBackupSetState(nextState);
    return TRUE;
 }
 
@@ -314,7 +406,7 @@ VmBackupOnError(void)
    case VMBACKUP_MSTATE_SYNC_ERROR:
       /* Next state is "script error". */
       if (!VmBackupStartScripts(VMBACKUP_SCRIPT_FREEZE_FAIL)) {
-         gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+         VmBackupSetState(VMBACKUP_MSTATE_IDLE);
       }
       break;
 
@@ -322,7 +414,7 @@ VmBackupOnError(void)
    case VMBACKUP_MSTATE_SYNC_THAW:
       /* Next state is "sync error". */
       gBackupState->pollPeriod = 1000;
-      gBackupState->machineState = VMBACKUP_MSTATE_SYNC_ERROR;
+      VmBackupSetState(VMBACKUP_MSTATE_SYNC_ERROR);
       g_signal_emit_by_name(gBackupState->ctx->serviceObj,
                             TOOLS_CORE_SIG_IO_FREEZE,
                             gBackupState->ctx,
@@ -331,7 +423,7 @@ VmBackupOnError(void)
 
    case VMBACKUP_MSTATE_SCRIPT_THAW:
       /* Next state is "idle". */
-      gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+      VmBackupSetState(VMBACKUP_MSTATE_IDLE);
       break;
 
    default:
@@ -368,6 +460,8 @@ VmBackupDoAbort(void)
       /* Transition to the error state. */
       if (VmBackupOnError()) {
          VmBackupFinalize();
+      } else {
+         VmBackupRestartEvent();
       }
    }
 }
@@ -406,6 +500,7 @@ static gboolean
 VmBackupAsyncCallback(void *clientData)
 {
    VmBackupOpStatus status = VMBACKUP_STATUS_FINISHED;
+   gboolean pending = FALSE;
 
    g_debug("*** %s\n", __FUNCTION__);
    ASSERT(gBackupState != NULL);
@@ -420,6 +515,7 @@ VmBackupAsyncCallback(void *clientData)
 
    switch (status) {
    case VMBACKUP_STATUS_PENDING:
+      pending = TRUE;
       goto exit;
 
    case VMBACKUP_STATUS_FINISHED:
@@ -505,7 +601,7 @@ VmBackupAsyncCallback(void *clientData)
    case VMBACKUP_MSTATE_SCRIPT_ERROR:
    case VMBACKUP_MSTATE_SCRIPT_THAW:
       /* Next state is "idle". */
-      gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+      VmBackupSetState(VMBACKUP_MSTATE_IDLE);
       break;
 
    case VMBACKUP_MSTATE_SYNC_ERROR:
@@ -525,13 +621,33 @@ exit:
    if (gBackupState->machineState == VMBACKUP_MSTATE_IDLE) {
       VmBackupFinalize();
    } else {
+      VmBackupEnqueueEvent(pending);
       gBackupState->forceRequeue = FALSE;
-      VMBACKUP_ENQUEUE_EVENT();
    }
    return FALSE;
 }
 
 
+/**
+ * I/O watch callback for operations that can signal their own progress;
+ * see VmBackup_Watch().
+ *
+ * @param[in]  chan           Unused.
+ * @param[in]  cond           Unused.
+ * @param[in]  clientData     Unused.
+ *
+ * @return FALSE
+ */
+
+static gboolean
+VmBackupWatchCallback(GIOChannel *chan,
+                      GIOCondition cond,
+                      gpointer clientData)
+{
+   return VmBackupAsyncCallback(clientData);
+}
+
+
 /**
  * Calls the sync provider's start function.
  *
@@ -560,7 +676,7 @@ VmBackupEnableSync(void)
       return FALSE;
    }
 
-   gBackupState->machineState = VMBACKUP_MSTATE_SYNC_FREEZE;
+   VmBackupSetState(VMBACKUP_MSTATE_SYNC_FREEZE);
    return TRUE;
 }
 
@@ -663,6 +779,7 @@ VmBackupStartCommon(RpcInData *data,
    gBackupState->ctx = data->appCtx;
    gBackupState->pollPeriod = 1000;
    gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+   gBackupState->phaseStart = Hostinfo_SystemTimerUS();
    gBackupState->provider = provider;
    g_debug("Using quiesceApps = %d, quiesceFS = %d, allowHWProvider = %d,"
            "execScripts = %d, scriptArg = %s, timeout = %u\n",
@@ -721,7 +838,7 @@ VmBackupStartCommon(RpcInData *data,
                                NULL);
    }
 
-   VMBACKUP_ENQUEUE_EVENT();
+   VmBackupEnqueueEvent(FALSE);
    return RPCIN_SETRETVALS(data, "", TRUE);
 
 error:
@@ -914,7 +1031,12 @@ VmBackupSnapshotDone(RpcInData *data)
             VmBackupFinalize();
          }
       } else {
-         gBackupState->machineState = VMBACKUP_MSTATE_SYNC_THAW;
+         VmBackupSetState(VMBACKUP_MSTATE_SYNC_THAW);
+      }
+
+      /* Let the state machine pick up the new state right away. */
+      if (gBackupState != NULL) {
+         VmBackupRestartEvent();
       }
       return RPCIN_SETRETVALS(data, "", TRUE);
    }
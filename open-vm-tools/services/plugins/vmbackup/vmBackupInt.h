@@ -57,15 +57,22 @@ typedef enum {
 
 /**
  * This is a "base struct" for asynchronous operations monitored by the
- * state machine. Each implementation should provide these three functions
+ * state machine. Each implementation should provide these functions
  * at the start of the struct so that the state machine can properly
  * interact with it.
+ *
+ * watchFn is optional: if provided, it should return a new source that
+ * fires when the operation may have changed state, so that the state machine
+ * doesn't need to poll it. The source must dispatch to a GIOFunc, like an
+ * I/O watch (see g_io_create_watch()). It may return NULL if there's nothing
+ * to wait on at the moment.
  */
 
 typedef struct VmBackupOp {
    VmBackupOpStatus (*queryFn)(struct VmBackupOp *);
    void (*releaseFn)(struct VmBackupOp *);
    void (*cancelFn)(struct VmBackupOp *);
+   GSource *(*watchFn)(struct VmBackupOp *);
 } VmBackupOp;
 
 
@@ -102,6 +109,7 @@ typedef struct VmBackupState {
    ssize_t        currentScript;
    gchar         *errorMsg;
    VmBackupMState machineState;
+   VmTimeType     phaseStart;
    struct VmBackupSyncProvider *provider;
 } VmBackupState;
 
@@ -126,7 +134,8 @@ typedef struct VmBackupSyncProvider {
 /**
  * Sets the current asynchronous operation being monitored, and an
  * optional callback for after it's done executing. If the operation
- * is NULL, the callback is set to execute later (currently, later = 200ms).
+ * is NULL, the callback is set to execute on the next run of the state
+ * machine.
  *
  * @param[in]  state          The backup state.
  * @param[in]  op             The current op to set.
@@ -169,6 +178,22 @@ VmBackup_QueryStatus(VmBackupOp *op)
 }
 
 
+/**
+ * Convenience function to call the operation-specific watch function.
+ *
+ * @param[in]  op    The backup op.
+ *
+ * @return A source to wait on, or NULL if the operation needs to be polled.
+ */
+
+static INLINE GSource *
+VmBackup_Watch(VmBackupOp *op)
+{
+   ASSERT(op != NULL);
+   return (op->watchFn != NULL) ? op->watchFn(op) : NULL;
+}
+
+
 /**
  * Convenience function to call the operation-specific cancel function.
  * Code calling this function should still call VmBackup_QueryStatus()
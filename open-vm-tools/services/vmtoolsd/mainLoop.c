@@ -42,6 +42,45 @@
 #include "vmware/tools/utils.h"
 #include "vmware/tools/vmbackup.h"
 
+#if defined(__linux__)
+#  include <errno.h>
+#  include <string.h>
+#  include <unistd.h>
+#  include <sys/inotify.h>
+#endif
+
+/**
+ * Maximum number of config file polls between two attempts to watch the
+ * file again. The interval doubles after each failed attempt, so that a
+ * missing directory or an exhausted inotify limit isn't retried on every
+ * poll.
+ */
+#define CONF_WATCH_RETRY_MAX  64
+
+#if defined(__linux__)
+/**
+ * Delay, in milliseconds, between the last change to the config file and its
+ * reload. Editors and config management tools touch the file several times
+ * in a row when saving it.
+ */
+#define CONF_RELOAD_DELAY  250
+
+/** Data for the inotify watch on the config file's directory. */
+typedef struct ToolsCoreConfWatch {
+   gchar               *fileName;
+   ToolsServiceState   *state;
+} ToolsCoreConfWatch;
+#endif
+
+static gboolean
+ToolsCoreStartConfWatch(ToolsServiceState *state);
+
+static void
+ToolsCoreStartConfCheck(ToolsServiceState *state);
+
+static void
+ToolsCoreStopConfCheck(ToolsServiceState *state);
+
 /*
  ******************************************************************************
  * ToolsCoreCleanup --                                                  */ /**
@@ -57,8 +96,14 @@
 static void
 ToolsCoreCleanup(ToolsServiceState *state)
 {
+   ToolsCoreStopConfCheck(state);
+   if (state->lockStatsTask != 0) {
+      g_source_remove(state->lockStatsTask);
+      state->lockStatsTask = 0;
+   }
    ToolsCorePool_Shutdown(&state->ctx);
    ToolsCore_UnloadPlugins(state);
+   ToolsCoreMetrics_Shutdown(&state->ctx);
    if (state->ctx.rpc != NULL) {
       RpcChannel_Destroy(state->ctx.rpc);
       state->ctx.rpc = NULL;
@@ -124,24 +169,295 @@ ToolsCoreInitializeDebug(ToolsServiceState *state)
 
 
 /**
- * Timer callback that just calls ToolsCore_ReloadConfig().
+ * Timer callback for polling the config file. Calls ToolsCore_ReloadConfig(),
+ * and stops polling once the file can be watched again (e.g., after its
+ * directory has been recreated). Setting up the watch is retried with an
+ * exponential backoff.
  *
  * @param[in]  clientData  Service state.
  *
- * @return TRUE.
+ * @return Whether to keep polling.
  */
 
 static gboolean
 ToolsCoreConfFileCb(gpointer clientData)
 {
-   ToolsCore_ReloadConfig(clientData, FALSE);
+   ToolsServiceState *state = clientData;
+
+   ToolsCore_ReloadConfig(state, FALSE);
+
+   if (state->configWatchRetry > 0) {
+      state->configWatchRetry--;
+      return TRUE;
+   }
+   if (ToolsCoreStartConfWatch(state)) {
+      g_debug("Watching the config file again, stopped polling it.\n");
+      state->configCheckTask = 0;
+      return FALSE;
+   }
+
+   state->configWatchBackoff = MIN(state->configWatchBackoff * 2,
+                                   CONF_WATCH_RETRY_MAX);
+   state->configWatchRetry = state->configWatchBackoff - 1;
+   return TRUE;
+}
+
+
+#if defined(__linux__)
+/**
+ * Timer callback for a config file change reported by the file watch. The
+ * file is re-read even if its mtime looks unchanged, since the mtime only has
+ * a one second resolution.
+ *
+ * @param[in]  clientData  Service state.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+ToolsCoreConfReloadCb(gpointer clientData)
+{
+   ToolsServiceState *state = clientData;
+
+   state->configReloadTask = 0;
+   state->configMtime = 0;
+   ToolsCore_ReloadConfig(state, FALSE);
+   return FALSE;
+}
+#endif
+
+
+/**
+ * Schedules a reload of the config file, pushing back a reload that is
+ * already pending so that a burst of changes causes a single reload.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreScheduleConfReload(ToolsServiceState *state)
+{
+#if defined(__linux__)
+   if (state->configReloadTask != 0) {
+      g_source_remove(state->configReloadTask);
+   }
+   state->configReloadTask = g_timeout_add(CONF_RELOAD_DELAY,
+                                           ToolsCoreConfReloadCb,
+                                           state);
+#endif
+}
+
+
+#if defined(__linux__)
+/**
+ * Callback for the config file watch. Drains the inotify queue and schedules
+ * a reload if the config file was written, created, replaced by a rename or
+ * removed. If the directory itself goes away, the watch is dropped and the
+ * service falls back to polling the file until it can be watched again.
+ *
+ * @param[in]  chan     The inotify channel.
+ * @param[in]  cond     Unused.
+ * @param[in]  data     The watch data.
+ *
+ * @return Whether to keep the watch.
+ */
+
+static gboolean
+ToolsCoreConfWatchCb(GIOChannel *chan,
+                     GIOCondition cond,
+                     gpointer data)
+{
+   ToolsCoreConfWatch *watch = data;
+   ToolsServiceState *state = watch->state;
+   int fd = g_io_channel_unix_get_fd(chan);
+   gboolean changed = FALSE;
+   gboolean lost = FALSE;
+   union {
+      struct inotify_event ev;
+      char buf[4096];
+   } events;
+
+   for (;;) {
+      ssize_t len = read(fd, &events, sizeof events);
+      char *p;
+
+      if (len < 0 && errno == EINTR) {
+         continue;
+      }
+      if (len <= 0) {
+         break;
+      }
+
+      for (p = events.buf; p < events.buf + len; ) {
+         struct inotify_event *ev = (struct inotify_event *) p;
+
+         if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF |
+                         IN_UNMOUNT)) {
+            lost = TRUE;
+         } else if ((ev->mask & IN_Q_OVERFLOW) ||
+                    (ev->len > 0 && strcmp(ev->name, watch->fileName) == 0)) {
+            changed = TRUE;
+         }
+         p += sizeof *ev + ev->len;
+      }
+   }
+
+   if (changed || lost) {
+      ToolsCoreScheduleConfReload(state);
+   }
+
+   if (lost) {
+      g_debug("Config directory went away, polling the config file.\n");
+      state->configWatchTask = 0;
+      ToolsCoreStartConfCheck(state);
+      return FALSE;
+   }
+
    return TRUE;
 }
 
 
 /**
- * IO freeze signal handler. Disables the conf file check task if I/O is
- * frozen, re-enable it otherwise. See bug 529653.
+ * Frees the config file watch data once its source is destroyed.
+ *
+ * @param[in]  data     The watch data.
+ */
+
+static void
+ToolsCoreConfWatchFree(gpointer data)
+{
+   ToolsCoreConfWatch *watch = data;
+
+   g_free(watch->fileName);
+   g_free(watch);
+}
+#endif
+
+
+/**
+ * Starts watching the config file's directory for changes to the file.
+ *
+ * @param[in]  state    Service state.
+ *
+ * @return Whether the watch could be set up.
+ */
+
+static gboolean
+ToolsCoreStartConfWatch(ToolsServiceState *state)
+{
+#if defined(__linux__)
+   ToolsCoreConfWatch *watch;
+   GIOChannel *chan;
+   GSource *src;
+   gchar *path;
+   gchar *dirName;
+   int fd;
+   int wd;
+
+   if (state->configFile != NULL) {
+      path = g_strdup(state->configFile);
+   } else {
+      char *confPath = GuestApp_GetConfPath();
+
+      if (confPath == NULL) {
+         return FALSE;
+      }
+      path = g_build_filename(confPath, CONF_FILE, NULL);
+      free(confPath);
+   }
+
+   fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd < 0) {
+      g_debug("Cannot watch the config file: %s\n", strerror(errno));
+      g_free(path);
+      return FALSE;
+   }
+
+   dirName = g_path_get_dirname(path);
+   wd = inotify_add_watch(fd, dirName,
+                          IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                          IN_MOVED_FROM | IN_MOVED_TO |
+                          IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+   if (wd < 0) {
+      g_debug("Cannot watch %s: %s\n", dirName, strerror(errno));
+      close(fd);
+      g_free(dirName);
+      g_free(path);
+      return FALSE;
+   }
+   g_free(dirName);
+
+   watch = g_new(ToolsCoreConfWatch, 1);
+   watch->fileName = g_path_get_basename(path);
+   watch->state = state;
+
+   chan = g_io_channel_unix_new(fd);
+   g_io_channel_set_close_on_unref(chan, TRUE);
+   src = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+   g_io_channel_unref(chan);   // Ownership transferred to src.
+
+   g_source_set_callback(src, (GSourceFunc) ToolsCoreConfWatchCb, watch,
+                         ToolsCoreConfWatchFree);
+   state->configWatchTask =
+      g_source_attach(src, g_main_loop_get_context(state->ctx.mainLoop));
+   g_source_unref(src);
+   g_free(path);
+
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+
+/**
+ * Starts checking the config file for changes: with a watch on its
+ * directory if the platform supports it, or by polling its mtime.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreStartConfCheck(ToolsServiceState *state)
+{
+   if (state->configWatchTask == 0 && !ToolsCoreStartConfWatch(state)) {
+      state->configWatchBackoff = 1;
+      state->configWatchRetry = 0;
+      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 10,
+                                             ToolsCoreConfFileCb,
+                                             state);
+   }
+}
+
+
+/**
+ * Stops checking the config file for changes, and drops any pending reload.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreStopConfCheck(ToolsServiceState *state)
+{
+   if (state->configCheckTask != 0) {
+      g_source_remove(state->configCheckTask);
+      state->configCheckTask = 0;
+   }
+   if (state->configWatchTask != 0) {
+      g_source_remove(state->configWatchTask);
+      state->configWatchTask = 0;
+   }
+   if (state->configReloadTask != 0) {
+      g_source_remove(state->configReloadTask);
+      state->configReloadTask = 0;
+   }
+}
+
+
+/**
+ * IO freeze signal handler. Disables the conf file check if I/O is frozen,
+ * re-enable it otherwise. See bug 529653. Changes made while frozen are not
+ * reported by the file watch, so the file is checked again on thaw.
  *
  * @param[in]  src      The source object.
  * @param[in]  ctx      Unused.
@@ -155,13 +471,14 @@ ToolsCoreIOFreezeCb(gpointer src,
                     gboolean freeze,
                     ToolsServiceState *state)
 {
-   if (state->configCheckTask > 0 && freeze) {
-      g_source_remove(state->configCheckTask);
-      state->configCheckTask = 0;
-   } else if (state->configCheckTask == 0 && !freeze) {
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 10,
-                                             ToolsCoreConfFileCb,
-                                             state);
+   gboolean running = state->configCheckTask != 0 ||
+                      state->configWatchTask != 0;
+
+   if (running && freeze) {
+      ToolsCoreStopConfCheck(state);
+   } else if (!running && !freeze) {
+      ToolsCoreStartConfCheck(state);
+      ToolsCore_ReloadConfig(state, FALSE);
    }
 }
 
@@ -227,9 +544,7 @@ ToolsCoreRunLoop(ToolsServiceState *state)
                           state);
       }
 
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 10,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      ToolsCoreStartConfCheck(state);
 
 #if defined(__APPLE__)
       ToolsCore_CFRunLoop(state);
@@ -362,6 +677,13 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
                             TRUE,
                             reset);
    }
+
+   /* Lock statistics can be turned on, but not off, while running. */
+   if (loaded &&
+       g_key_file_get_boolean(state->ctx.config, state->name,
+                              CONFNAME_LOCKSTATS, NULL)) {
+      ToolsCore_EnableLockStats(state);
+   }
 }
 
 
@@ -416,6 +738,7 @@ ToolsCore_Setup(ToolsServiceState *state)
    ToolsCoreService_RegisterProperty(state->ctx.serviceObj,
                                      &ctxProp);
    g_object_set(state->ctx.serviceObj, TOOLS_CORE_PROP_CTX, &state->ctx, NULL);
+   ToolsCoreMetrics_Init(&state->ctx);
    ToolsCorePool_Init(&state->ctx);
 
    /* Initializes the debug library if needed. */
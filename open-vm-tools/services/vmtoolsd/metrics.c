@@ -0,0 +1,339 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file metrics.c
+ *
+ * Implementation of the metrics registry defined in metrics.h.
+ */
+
+#include <string.h>
+#include <time.h>
+#if !defined(_WIN32)
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#endif
+#include "vmware.h"
+#include "toolsCoreInt.h"
+#include "serviceObj.h"
+#include "vmware/tools/metrics.h"
+
+#define DEFAULT_MAX_METRICS   256
+
+typedef struct MetricsState {
+   ToolsCoreMetrics     funcs;
+   ToolsMetricsHeader  *hdr;
+   ToolsMetric         *metrics;
+   size_t               size;
+   gchar               *path;
+#if GLIB_CHECK_VERSION(2,32,0)
+   GMutex               lock;
+#else
+   GMutex              *lock;
+#endif
+} MetricsState;
+
+
+static MetricsState gState;
+
+static inline void
+MetricsStateLock(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+   g_mutex_lock(&gState.lock);
+#else
+   g_mutex_lock(gState.lock);
+#endif
+}
+
+static inline void
+MetricsStateUnlock(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+   g_mutex_unlock(&gState.lock);
+#else
+   g_mutex_unlock(gState.lock);
+#endif
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMetricsLookup --                                              */ /**
+ *
+ * Looks up a metric by name, registering a new one if it doesn't exist yet.
+ * New metrics are published to readers by bumping the count in the header
+ * after the slot has been filled in.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] name   Name of the metric.
+ * @param[in] type   Type of the metric.
+ *
+ * @return The metric, or NULL if the registry is full, the name is invalid,
+ *         or a metric with the same name but a different type exists.
+ *
+ *******************************************************************************
+ */
+
+static ToolsMetric *
+ToolsCoreMetricsLookup(ToolsAppCtx *ctx,
+                       const gchar *name,
+                       ToolsMetricType type)
+{
+   guint i;
+   guint count;
+   ToolsMetric *metric = NULL;
+
+   g_return_val_if_fail(name != NULL && *name != '\0', NULL);
+   g_return_val_if_fail(type == TOOLS_METRIC_COUNTER ||
+                        type == TOOLS_METRIC_GAUGE ||
+                        type == TOOLS_METRIC_HISTOGRAM, NULL);
+
+   if (strlen(name) >= TOOLS_METRICS_NAME_LEN) {
+      g_warning("Metric name too long: %s\n", name);
+      return NULL;
+   }
+
+   MetricsStateLock();
+
+   count = Atomic_Read32(&gState.hdr->count);
+   for (i = 0; i < count; i++) {
+      if (strcmp(gState.metrics[i].name, name) == 0) {
+         if (gState.metrics[i].type == type) {
+            metric = &gState.metrics[i];
+         } else {
+            g_warning("Metric %s already registered with type %u.\n",
+                      name, gState.metrics[i].type);
+         }
+         goto exit;
+      }
+   }
+
+   if (count == gState.hdr->capacity) {
+      g_warning("Metrics registry is full, cannot register %s.\n", name);
+      goto exit;
+   }
+
+   metric = &gState.metrics[count];
+   memset(metric, 0, sizeof *metric);
+   g_strlcpy(metric->name, name, sizeof metric->name);
+   metric->type = type;
+
+   /*
+    * Publish the slot. The locked increment is a full barrier, so readers in
+    * other processes that see the new count also see the initialized slot.
+    */
+   Atomic_Inc32(&gState.hdr->count);
+
+exit:
+   MetricsStateUnlock();
+   return metric;
+}
+
+
+#if !defined(_WIN32)
+/*
+ *******************************************************************************
+ * ToolsCoreMetricsMapFile --                                             */ /**
+ *
+ * Creates the metrics file and maps it into memory. The file is created under
+ * a temporary name and renamed once the header is written, so readers never
+ * see a partially initialized file.
+ *
+ * @param[in] path   Path of the metrics file.
+ * @param[in] size   Size of the file.
+ *
+ * @return Pointer to the mapped file, or NULL on error.
+ *
+ *******************************************************************************
+ */
+
+static void *
+ToolsCoreMetricsMapFile(const gchar *path,
+                        size_t size)
+{
+   int fd;
+   void *mem = NULL;
+   gchar *dir = g_path_get_dirname(path);
+   gchar *tmpPath = g_strdup_printf("%s.tmp", path);
+
+   if (g_mkdir_with_parents(dir, 0755) != 0) {
+      g_debug("Cannot create metrics directory %s: %s\n", dir, strerror(errno));
+      goto exit;
+   }
+
+   fd = open(tmpPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      g_debug("Cannot create metrics file %s: %s\n", tmpPath, strerror(errno));
+      goto exit;
+   }
+
+   if (ftruncate(fd, size) == 0) {
+      mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (mem == MAP_FAILED) {
+         g_warning("Cannot map metrics file: %s\n", strerror(errno));
+         mem = NULL;
+      }
+   } else {
+      g_warning("Cannot resize metrics file: %s\n", strerror(errno));
+   }
+   close(fd);
+
+   if (mem != NULL) {
+      ToolsMetricsHeader *hdr = mem;
+
+      hdr->magic = TOOLS_METRICS_MAGIC;
+      hdr->version = TOOLS_METRICS_VERSION;
+      hdr->metricSize = sizeof (ToolsMetric);
+      hdr->capacity = (size - sizeof *hdr) / sizeof (ToolsMetric);
+      hdr->pid = (uint32) getpid();
+      hdr->startTime = (uint64) time(NULL);
+
+      if (rename(tmpPath, path) != 0) {
+         g_warning("Cannot rename metrics file: %s\n", strerror(errno));
+         munmap(mem, size);
+         mem = NULL;
+      }
+   }
+
+   if (mem == NULL) {
+      unlink(tmpPath);
+   }
+
+exit:
+   g_free(tmpPath);
+   g_free(dir);
+   return mem;
+}
+#endif
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMetrics_Init --                                               */ /**
+ *
+ * Initializes the metrics registry and exports it through the service's
+ * object. The registry is backed by a file named after the service in
+ * TOOLS_METRICS_DIR, unless the "metrics.path" option in the service's
+ * section of the config file says otherwise. If the file can't be created
+ * (e.g., when running as an unprivileged user), the registry is kept in
+ * memory only, so plugins can still update their metrics.
+ *
+ * @param[in] ctx Application context.
+ *
+ *******************************************************************************
+ */
+
+void
+ToolsCoreMetrics_Init(ToolsAppCtx *ctx)
+{
+   gint maxMetrics;
+   GError *err = NULL;
+   ToolsServiceProperty prop = { TOOLS_CORE_PROP_METRICS };
+
+   maxMetrics = g_key_file_get_integer(ctx->config, ctx->name,
+                                       "metrics.maxMetrics", &err);
+   if (err != NULL || maxMetrics <= 0) {
+      maxMetrics = DEFAULT_MAX_METRICS;
+      g_clear_error(&err);
+   }
+
+   gState.size = sizeof *gState.hdr + maxMetrics * sizeof (ToolsMetric);
+   gState.funcs.lookup = ToolsCoreMetricsLookup;
+
+#if !defined(_WIN32)
+   gState.path = g_key_file_get_string(ctx->config, ctx->name,
+                                       "metrics.path", NULL);
+   if (gState.path == NULL) {
+      gState.path = g_strdup_printf("%s%c%s%s", TOOLS_METRICS_DIR, DIRSEPC,
+                                    ctx->name, TOOLS_METRICS_SUFFIX);
+   }
+
+   gState.hdr = ToolsCoreMetricsMapFile(gState.path, gState.size);
+   if (gState.hdr == NULL) {
+      g_free(gState.path);
+      gState.path = NULL;
+   }
+#endif
+
+   if (gState.hdr == NULL) {
+      gState.hdr = g_malloc0(gState.size);
+      gState.hdr->magic = TOOLS_METRICS_MAGIC;
+      gState.hdr->version = TOOLS_METRICS_VERSION;
+      gState.hdr->metricSize = sizeof (ToolsMetric);
+      gState.hdr->capacity = maxMetrics;
+   }
+
+   gState.metrics = (ToolsMetric *) (gState.hdr + 1);
+   g_debug("Metrics registry: %s, %u slots.\n",
+           gState.path != NULL ? gState.path : "in memory",
+           gState.hdr->capacity);
+
+#if GLIB_CHECK_VERSION(2,32,0)
+   g_mutex_init(&gState.lock);
+#else
+   gState.lock = g_mutex_new();
+#endif
+
+   ToolsCoreService_RegisterProperty(ctx->serviceObj, &prop);
+   g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_METRICS, &gState.funcs, NULL);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMetrics_Shutdown --                                           */ /**
+ *
+ * Tears down the metrics registry, removing the metrics file. Must be called
+ * after all plugins have been unloaded, since they may hold pointers into the
+ * registry.
+ *
+ * @param[in] ctx Application context.
+ *
+ *******************************************************************************
+ */
+
+void
+ToolsCoreMetrics_Shutdown(ToolsAppCtx *ctx)
+{
+   if (gState.hdr == NULL) {
+      return;
+   }
+
+   g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_METRICS, NULL, NULL);
+
+#if !defined(_WIN32)
+   if (gState.path != NULL) {
+      unlink(gState.path);
+      munmap(gState.hdr, gState.size);
+      g_free(gState.path);
+   } else
+#endif
+   {
+      g_free(gState.hdr);
+   }
+
+#if GLIB_CHECK_VERSION(2,32,0)
+   g_mutex_clear(&gState.lock);
+#else
+   g_mutex_free(gState.lock);
+#endif
+   memset(&gState, 0, sizeof gState);
+}
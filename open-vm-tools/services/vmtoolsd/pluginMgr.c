@@ -31,18 +31,54 @@
 #include "util.h"
 #include "vmware/tools/i18n.h"
 #include "vmware/tools/log.h"
+#include "vmware/tools/metrics.h"
 #include "vmware/tools/utils.h"
 
 
+/** Suffix of the optional manifest describing a plugin's entry points. */
+#define PLUGIN_MANIFEST_SUFFIX   ".manifest"
+
+/** Group in the plugin manifest listing the plugin's entry points. */
+#define PLUGIN_MANIFEST_GROUP    "plugin"
+
+/** Group in the plugin manifest listing the plugin's static capabilities. */
+#define PLUGIN_MANIFEST_CAPS     "capabilities"
+
+/** Config key that can be used to disable deferred plugin loading. */
+#define CONFNAME_LAZYLOAD        "plugins.lazyLoad"
+
 /** Defines the internal data about a plugin. */
 typedef struct ToolsPlugin {
    gchar               *fileName;
    GModule             *module;
    ToolsPluginOnLoad    onload;
    ToolsPluginData     *data;
+   gdouble              openTime;
 } ToolsPlugin;
 
 
+/**
+ * Defines a plugin whose loading has been deferred. The plugin's manifest
+ * lists the RPCs and signals it handles; stubs are registered for those, and
+ * the first one to fire loads the plugin and hands the event over to it.
+ * Capabilities listed in the manifest are advertised by a stub without
+ * loading the plugin.
+ */
+typedef struct ToolsLazyPlugin {
+   gchar               *fileName;
+   gchar               *path;
+   gchar              **rpcs;
+   gchar              **signals;
+   gchar              **capNames;
+   GArray              *caps;
+   RpcChannelCallback  *rpcStubs;
+   gulong              *sigStubs;
+   gulong               capsStub;
+   ToolsServiceState   *state;
+   gboolean             loaded;
+} ToolsLazyPlugin;
+
+
 #ifdef USE_APPLOADER
 static Bool (*LoadDependencies)(char *libName, Bool useShipped);
 #endif
@@ -303,6 +339,73 @@ ToolsCoreRegisterProvider(ToolsServiceState *state,
 }
 
 
+/**
+ * Iterates through a plugin's app registration data, calling the given
+ * callback for each piece of data.
+ *
+ * @param[in]  state       Service state.
+ * @param[in]  plugin      The plugin.
+ * @param[in]  appRegCb    Callback called for each application registration.
+ */
+
+static void
+ToolsCoreForEachApp(ToolsServiceState *state,
+                    ToolsPlugin *plugin,
+                    PluginAppRegCallback appRegCb)
+{
+   GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
+   guint j;
+
+   if (regs == NULL) {
+      return;
+   }
+
+   for (j = 0; j < regs->len; j++) {
+      guint k;
+      guint pregIdx;
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
+      ToolsAppProviderReg *preg = NULL;
+
+      /* Find the provider for the desired reg type. */
+      for (k = 0; k < state->providers->len; k++) {
+         ToolsAppProviderReg *tmp = &g_array_index(state->providers,
+                                                   ToolsAppProviderReg,
+                                                   k);
+         if (tmp->prov->regType == reg->type) {
+            preg = tmp;
+            pregIdx = k;
+            break;
+         }
+      }
+
+      if (preg == NULL) {
+         g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
+                   reg->type, plugin->data->name);
+         if (plugin->data->errorCb != NULL &&
+             !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
+            break;
+         }
+         continue;
+      }
+
+      for (k = 0; k < reg->data->len; k++) {
+         gpointer appdata = &reg->data->data[preg->prov->regSize * k];
+         if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
+            /* Break out of the outer loop. */
+            j = regs->len;
+            break;
+         }
+
+         /*
+          * The registration callback may have modified the provider array,
+          * so we need to re-read the provider pointer.
+          */
+         preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
+      }
+   }
+}
+
+
 /**
  * Iterates through the list of plugins, and through each plugin's app
  * registration data, calling the appropriate callback for each piece
@@ -326,59 +429,13 @@ ToolsCoreForEachPlugin(ToolsServiceState *state,
 
    for (i = 0; i < state->plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
-      GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
-      guint j;
 
       if (pluginCb != NULL) {
          pluginCb(state, plugin->data);
       }
 
-      if (regs == NULL || appRegCb == NULL) {
-         continue;
-      }
-
-      for (j = 0; j < regs->len; j++) {
-         guint k;
-         guint pregIdx;
-         ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
-         ToolsAppProviderReg *preg = NULL;
-
-         /* Find the provider for the desired reg type. */
-         for (k = 0; k < state->providers->len; k++) {
-            ToolsAppProviderReg *tmp = &g_array_index(state->providers,
-                                                      ToolsAppProviderReg,
-                                                      k);
-            if (tmp->prov->regType == reg->type) {
-               preg = tmp;
-               pregIdx = k;
-               break;
-            }
-         }
-
-         if (preg == NULL) {
-            g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
-                      reg->type, plugin->data->name);
-            if (plugin->data->errorCb != NULL &&
-                !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
-               break;
-            }
-            continue;
-         }
-
-         for (k = 0; k < reg->data->len; k++) {
-            gpointer appdata = &reg->data->data[preg->prov->regSize * k];
-            if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
-               /* Break out of the outer loop. */
-               j = regs->len;
-               break;
-            }
-
-            /*
-             * The registration callback may have modified the provider array,
-             * so we need to re-read the provider pointer.
-             */
-            preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
-         }
+      if (appRegCb != NULL) {
+         ToolsCoreForEachApp(state, plugin, appRegCb);
       }
    }
 }
@@ -488,18 +545,615 @@ ToolsCoreStrPtrCompare(gconstpointer _str1,
 }
 
 
+/**
+ * Opens the shared object of a plugin and looks up its entry point.
+ *
+ * @param[in]  entry    File name of the plugin.
+ * @param[in]  path     Full path to the plugin.
+ *
+ * @return A new ToolsPlugin instance, or NULL on failure.
+ */
+
+static ToolsPlugin *
+ToolsCoreOpenPlugin(const gchar *entry,
+                    const gchar *path)
+{
+   GModule *module = NULL;
+   GTimer *timer;
+   ToolsPlugin *plugin = NULL;
+   ToolsPluginOnLoad onload;
+
+   timer = g_timer_new();
+
+#ifdef USE_APPLOADER
+   /* Trying loading the plugins with system libraries */
+   if (!LoadDependencies((char *) path, FALSE)) {
+      g_warning("Loading of library dependencies for %s failed.\n", entry);
+      goto exit;
+   }
+#endif
+
+   module = g_module_open(path, G_MODULE_BIND_LOCAL);
+#ifdef USE_APPLOADER
+   if (module == NULL) {
+      /* Falling back to the shipped libraries */
+      if (!LoadDependencies((char *) path, TRUE)) {
+         g_warning("Loading of shipped library dependencies for %s failed.\n",
+                  entry);
+         goto exit;
+      }
+      module = g_module_open(path, G_MODULE_BIND_LOCAL);
+   }
+#endif
+   if (module == NULL) {
+      g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
+      goto exit;
+   }
+
+   if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) &onload)) {
+      g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
+      if (!g_module_close(module)) {
+         g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
+      }
+      goto exit;
+   }
+
+   plugin = g_malloc(sizeof *plugin);
+   plugin->fileName = g_strdup(entry);
+   plugin->data = NULL;
+   plugin->module = module;
+   plugin->onload = onload;
+   plugin->openTime = g_timer_elapsed(timer, NULL);
+
+exit:
+   g_timer_destroy(timer);
+   return plugin;
+}
+
+
+/**
+ * Calls a plugin's entry point and, if the plugin wants to be loaded, adds it
+ * to the list of active plugins. The plugin is freed otherwise.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin to initialize.
+ *
+ * @return Whether the plugin was added to the list of active plugins.
+ */
+
+static gboolean
+ToolsCoreInitPlugin(ToolsServiceState *state,
+                    ToolsPlugin *plugin)
+{
+   GTimer *timer;
+   gdouble initTime;
+
+   timer = g_timer_new();
+   plugin->data = plugin->onload(&state->ctx);
+   initTime = g_timer_elapsed(timer, NULL);
+   g_timer_destroy(timer);
+
+   if (plugin->data == NULL) {
+      g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
+             plugin->fileName);
+      ToolsCoreFreePlugin(plugin);
+      return FALSE;
+   } else if (state->ctx.errorCode != 0) {
+      /* The plugin has requested the container to quit. */
+      ToolsCoreFreePlugin(plugin);
+      return FALSE;
+   }
+
+   ASSERT(plugin->data->name != NULL);
+   g_module_make_resident(plugin->module);
+   g_ptr_array_add(state->plugins, plugin);
+   VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
+   g_debug("Plugin '%s' initialized (open: %.1f ms, init: %.1f ms).\n",
+           plugin->data->name,
+           plugin->openTime * 1000.0,
+           initTime * 1000.0);
+   ToolsMetric_Observe(ToolsCoreMetrics_GetHistogram(&state->ctx,
+                                                     "vmtoolsd.pluginLoadUs"),
+                       (uint64) ((plugin->openTime + initTime) * 1000000.0));
+   ToolsMetric_Inc(ToolsCoreMetrics_GetCounter(&state->ctx,
+                                               "vmtoolsd.pluginsLoaded"));
+   return TRUE;
+}
+
+
+/**
+ * Looks for a plugin's handler for the given signal. Only the first handler
+ * is returned; plugins don't connect more than once to the same signal.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin.
+ * @param[in]  sigId    ID of the signal.
+ *
+ * @return The handler registration, or NULL if not found.
+ */
+
+static ToolsPluginSignalCb *
+ToolsCoreFindSignalCb(ToolsServiceState *state,
+                      ToolsPlugin *plugin,
+                      guint sigId)
+{
+   guint i;
+   GArray *regs = plugin->data->regs;
+
+   for (i = 0; regs != NULL && i < regs->len; i++) {
+      guint j;
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, i);
+
+      if (reg->type != TOOLS_APP_SIGNALS || reg->data == NULL) {
+         continue;
+      }
+
+      for (j = 0; j < reg->data->len; j++) {
+         guint id;
+         GQuark detail;
+         ToolsPluginSignalCb *sig = &g_array_index(reg->data,
+                                                   ToolsPluginSignalCb,
+                                                   j);
+
+         if (g_signal_parse_name(sig->signame,
+                                 G_OBJECT_TYPE(state->ctx.serviceObj),
+                                 &id,
+                                 &detail,
+                                 FALSE) &&
+             id == sigId) {
+            return sig;
+         }
+      }
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Removes the stub RPC handlers and signal connections of a deferred plugin.
+ *
+ * @param[in]  lazy     The deferred plugin.
+ */
+
+static void
+ToolsCoreUnregisterLazyPlugin(ToolsLazyPlugin *lazy)
+{
+   guint i;
+   ToolsServiceState *state = lazy->state;
+
+   if (lazy->rpcStubs != NULL) {
+      for (i = 0; lazy->rpcs[i] != NULL; i++) {
+         RpcChannel_UnregisterCallback(state->ctx.rpc, &lazy->rpcStubs[i]);
+      }
+      g_free(lazy->rpcStubs);
+      lazy->rpcStubs = NULL;
+   }
+
+   if (lazy->sigStubs != NULL) {
+      for (i = 0; lazy->signals[i] != NULL; i++) {
+         if (lazy->sigStubs[i] != 0) {
+            g_signal_handler_disconnect(state->ctx.serviceObj,
+                                        lazy->sigStubs[i]);
+         }
+      }
+      g_free(lazy->sigStubs);
+      lazy->sigStubs = NULL;
+   }
+
+   if (lazy->capsStub != 0) {
+      g_signal_handler_disconnect(state->ctx.serviceObj, lazy->capsStub);
+      lazy->capsStub = 0;
+   }
+}
+
+
+/**
+ * Loads a deferred plugin and registers its applications. The plugin's stubs
+ * are removed first, so this is only ever attempted once.
+ *
+ * If the host has already been told about the service's capabilities, the
+ * plugin's capabilities are sent too, unless the load was triggered by the
+ * capabilities signal itself.
+ *
+ * @param[in]  lazy     The deferred plugin.
+ * @param[in]  trigger  Name of the RPC or signal that triggered the load.
+ * @param[in]  sendCaps Whether to send the plugin's capabilities.
+ *
+ * @return The loaded plugin, or NULL if it failed to load.
+ */
+
+static ToolsPlugin *
+ToolsCoreLoadLazyPlugin(ToolsLazyPlugin *lazy,
+                        const gchar *trigger,
+                        gboolean sendCaps)
+{
+   GTimer *timer;
+   ToolsPlugin *plugin;
+   ToolsServiceState *state = lazy->state;
+
+   ASSERT(!lazy->loaded);
+   lazy->loaded = TRUE;
+   ToolsCoreUnregisterLazyPlugin(lazy);
+
+   timer = g_timer_new();
+   plugin = ToolsCoreOpenPlugin(lazy->fileName, lazy->path);
+   if (plugin != NULL && !ToolsCoreInitPlugin(state, plugin)) {
+      plugin = NULL;
+   }
+
+   if (plugin != NULL) {
+      ToolsCoreForEachApp(state, plugin, ToolsCoreRegisterProvider);
+      ToolsCoreForEachApp(state, plugin, ToolsCoreRegisterApp);
+
+      if (sendCaps && state->capsRegistered && state->ctx.rpc != NULL) {
+         ToolsPluginSignalCb *sig;
+         guint sigId = g_signal_lookup(TOOLS_CORE_SIG_CAPABILITIES,
+                                       G_OBJECT_TYPE(state->ctx.serviceObj));
+
+         sig = ToolsCoreFindSignalCb(state, plugin, sigId);
+         if (sig != NULL) {
+            GArray *(*capsCb)(gpointer, ToolsAppCtx *, gboolean, gpointer);
+            GArray *caps;
+
+            capsCb = sig->callback;
+            caps = capsCb(state->ctx.serviceObj, &state->ctx, TRUE,
+                          sig->clientData);
+            if (caps != NULL) {
+               ToolsCore_SetCapabilities(state->ctx.rpc, caps, TRUE);
+               g_array_free(caps, TRUE);
+            }
+         }
+      }
+   }
+
+   g_message("Deferred plugin '%s' %s on '%s' in %.1f ms.\n",
+             lazy->fileName,
+             plugin != NULL ? "loaded" : "failed to load",
+             trigger,
+             g_timer_elapsed(timer, NULL) * 1000.0);
+   g_timer_destroy(timer);
+
+   if (state->ctx.errorCode != 0) {
+      g_main_loop_quit(state->ctx.mainLoop);
+   }
+
+   return plugin;
+}
+
+
+/**
+ * Stub RPC handler for deferred plugins. Loads the plugin and dispatches the
+ * RPC again, so that it reaches the handler registered by the plugin.
+ *
+ * @param[in]  data     RPC data.
+ *
+ * @return The result of the plugin's handler.
+ */
+
+static gboolean
+ToolsCoreLazyRpcCb(RpcInData *data)
+{
+   char *cmd;
+   size_t nameLen = strlen(data->name);
+   gboolean ret;
+   RpcInData redispatch = *data;
+   ToolsLazyPlugin *lazy = data->clientData;
+
+   ToolsCoreLoadLazyPlugin(lazy, data->name, TRUE);
+
+   /*
+    * Rebuild the original command, since the dispatcher expects the RPC name
+    * to precede the arguments.
+    */
+   cmd = g_malloc(nameLen + data->argsSize + 1);
+   memcpy(cmd, data->name, nameLen);
+   memcpy(cmd + nameLen, data->args, data->argsSize);
+   cmd[nameLen + data->argsSize] = '\0';
+
+   redispatch.name = NULL;
+   redispatch.args = cmd;
+   redispatch.argsSize = nameLen + data->argsSize;
+   redispatch.clientData = lazy->state->ctx.rpc;
+
+   ret = RpcChannel_Dispatch(&redispatch);
+
+   data->result = redispatch.result;
+   data->resultLen = redispatch.resultLen;
+   data->freeResult = redispatch.freeResult;
+   g_free(cmd);
+   return ret;
+}
+
+
+/**
+ * Meta marshaller for the stub signal handlers of deferred plugins. Loads the
+ * plugin and forwards the current emission to the plugin's handler, since
+ * handlers connected during an emission are only called on the next one.
+ *
+ * The stub closure gets the signal's marshaller when connected, which is then
+ * used to call the plugin's handler.
+ *
+ * @param[in]  closure  The stub closure.
+ * @param[out] retval   Return value of the signal.
+ * @param[in]  nParams  Number of parameters.
+ * @param[in]  params   Signal parameters.
+ * @param[in]  hint     Signal invocation hint.
+ * @param[in]  data     The deferred plugin.
+ */
+
+static void
+ToolsCoreLazySignalCb(GClosure *closure,
+                      GValue *retval,
+                      guint nParams,
+                      const GValue *params,
+                      gpointer hint,
+                      gpointer data)
+{
+   GClosureMarshal marshal = closure->marshal;
+   GSignalInvocationHint *ihint = hint;
+   ToolsLazyPlugin *lazy = data;
+   ToolsPlugin *plugin;
+   ToolsPluginSignalCb *sig;
+   guint capsId = g_signal_lookup(TOOLS_CORE_SIG_CAPABILITIES,
+                                  G_OBJECT_TYPE(lazy->state->ctx.serviceObj));
+
+   plugin = ToolsCoreLoadLazyPlugin(lazy,
+                                    g_signal_name(ihint->signal_id),
+                                    ihint->signal_id != capsId);
+   if (plugin == NULL || marshal == NULL) {
+      return;
+   }
+
+   sig = ToolsCoreFindSignalCb(lazy->state, plugin, ihint->signal_id);
+   if (sig != NULL) {
+      GClosure *real = g_cclosure_new(sig->callback, sig->clientData, NULL);
+
+      g_closure_ref(real);
+      g_closure_sink(real);
+      g_closure_set_marshal(real, marshal);
+      g_closure_invoke(real, retval, nParams, params, hint);
+      g_closure_unref(real);
+   }
+}
+
+
+/**
+ * Stub capabilities handler for deferred plugins whose manifest lists their
+ * capabilities. Answers with those capabilities, without loading the plugin.
+ *
+ * @param[in]  src      Unused.
+ * @param[in]  ctx      Unused.
+ * @param[in]  set      Unused; the service zeroes the values when unsetting.
+ * @param[in]  data     The deferred plugin.
+ *
+ * @return A copy of the manifest's capabilities.
+ */
+
+static GArray *
+ToolsCoreLazyCapsCb(gpointer src,
+                    ToolsAppCtx *ctx,
+                    gboolean set,
+                    gpointer data)
+{
+   ToolsLazyPlugin *lazy = data;
+
+   return VMTools_WrapArray(lazy->caps->data,
+                            sizeof (ToolsAppCapability),
+                            lazy->caps->len);
+}
+
+
+/**
+ * Registers the stub RPC handlers and signal connections of a deferred
+ * plugin.
+ *
+ * @param[in]  lazy     The deferred plugin.
+ */
+
+static void
+ToolsCoreRegisterLazyPlugin(ToolsLazyPlugin *lazy)
+{
+   guint i;
+   ToolsServiceState *state = lazy->state;
+
+   if (state->ctx.rpc != NULL && lazy->rpcs != NULL) {
+      lazy->rpcStubs = g_new0(RpcChannelCallback, g_strv_length(lazy->rpcs));
+      for (i = 0; lazy->rpcs[i] != NULL; i++) {
+         lazy->rpcStubs[i].name = lazy->rpcs[i];
+         lazy->rpcStubs[i].callback = ToolsCoreLazyRpcCb;
+         lazy->rpcStubs[i].clientData = lazy;
+         RpcChannel_RegisterCallback(state->ctx.rpc, &lazy->rpcStubs[i]);
+      }
+   }
+
+   if (lazy->signals != NULL) {
+      lazy->sigStubs = g_new0(gulong, g_strv_length(lazy->signals));
+      for (i = 0; lazy->signals[i] != NULL; i++) {
+         guint sigId;
+         GQuark sigDetail;
+         GClosure *closure;
+
+         /* The manifest already answers for the plugin's capabilities. */
+         if (lazy->caps != NULL &&
+             strcmp(lazy->signals[i], TOOLS_CORE_SIG_CAPABILITIES) == 0) {
+            continue;
+         }
+
+         if (!g_signal_parse_name(lazy->signals[i],
+                                  G_OBJECT_TYPE(state->ctx.serviceObj),
+                                  &sigId,
+                                  &sigDetail,
+                                  FALSE)) {
+            g_warning("Deferred plugin '%s' lists unknown signal '%s'.\n",
+                      lazy->fileName, lazy->signals[i]);
+            continue;
+         }
+
+         closure = g_closure_new_simple(sizeof *closure, NULL);
+         g_closure_set_meta_marshal(closure, lazy, ToolsCoreLazySignalCb);
+         lazy->sigStubs[i] = g_signal_connect_closure(state->ctx.serviceObj,
+                                                      lazy->signals[i],
+                                                      closure,
+                                                      FALSE);
+      }
+   }
+
+   if (lazy->caps != NULL) {
+      lazy->capsStub = g_signal_connect(state->ctx.serviceObj,
+                                        TOOLS_CORE_SIG_CAPABILITIES,
+                                        G_CALLBACK(ToolsCoreLazyCapsCb),
+                                        lazy);
+   }
+}
+
+
+/**
+ * Frees memory associated with a deferred plugin, removing its stubs if it
+ * was never loaded.
+ *
+ * @param[in]  lazy     The deferred plugin.
+ */
+
+static void
+ToolsCoreFreeLazyPlugin(ToolsLazyPlugin *lazy)
+{
+   ToolsCoreUnregisterLazyPlugin(lazy);
+   g_strfreev(lazy->rpcs);
+   g_strfreev(lazy->signals);
+   g_strfreev(lazy->capNames);
+   if (lazy->caps != NULL) {
+      g_array_free(lazy->caps, TRUE);
+   }
+   g_free(lazy->path);
+   g_free(lazy->fileName);
+   g_free(lazy);
+}
+
+
+/**
+ * Reads the manifest of a plugin, if it has one. The manifest is a key file
+ * named after the plugin, with the module suffix replaced by ".manifest",
+ * listing the RPCs and signals that should cause the plugin to be loaded:
+ *
+ * @code
+ * [plugin]
+ * rpcs = Vix_1_Relayed_Command;Vix_1_Mount_Volumes
+ * signals = tcs_io_freeze
+ * @endcode
+ *
+ * Plugins that advertise capabilities should list them in a "capabilities"
+ * group, so that the host knows about them before the plugin is loaded. Each
+ * key is an old-style capability, i.e. the text following
+ * "tools.capability." in the RPC (which may include arguments), and its value
+ * the integer sent when setting it:
+ *
+ * @code
+ * [capabilities]
+ * resolution_set = 1
+ * resolution_server toolbox-dnd = 1
+ * @endcode
+ *
+ * Once the plugin is loaded, it reports its own capabilities. Listing
+ * "tcs_capabilities" in the signals instead loads the plugin when the
+ * capabilities are first requested, i.e. at startup.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  entry    File name of the plugin.
+ * @param[in]  path     Full path to the plugin.
+ *
+ * @return A deferred plugin, or NULL if the plugin should be loaded eagerly.
+ */
+
+static ToolsLazyPlugin *
+ToolsCoreReadManifest(ToolsServiceState *state,
+                      const gchar *entry,
+                      const gchar *path)
+{
+   gchar *manifestPath;
+   GKeyFile *manifest;
+   GError *err = NULL;
+   ToolsLazyPlugin *lazy = NULL;
+
+   manifestPath = g_strdup_printf("%.*s" PLUGIN_MANIFEST_SUFFIX,
+                                  (int) (strlen(path) -
+                                         strlen("." G_MODULE_SUFFIX)),
+                                  path);
+   if (!g_file_test(manifestPath, G_FILE_TEST_IS_REGULAR)) {
+      g_free(manifestPath);
+      return NULL;
+   }
+
+   manifest = g_key_file_new();
+   if (!g_key_file_load_from_file(manifest, manifestPath, G_KEY_FILE_NONE, &err)) {
+      g_warning("Error reading manifest of plugin '%s': %s\n",
+                entry, err->message);
+      g_clear_error(&err);
+      goto exit;
+   }
+
+   lazy = g_malloc0(sizeof *lazy);
+   lazy->rpcs = g_key_file_get_string_list(manifest, PLUGIN_MANIFEST_GROUP,
+                                           "rpcs", NULL, NULL);
+   lazy->signals = g_key_file_get_string_list(manifest, PLUGIN_MANIFEST_GROUP,
+                                              "signals", NULL, NULL);
+   lazy->capNames = g_key_file_get_keys(manifest, PLUGIN_MANIFEST_CAPS,
+                                        NULL, NULL);
+
+   if (lazy->rpcs == NULL && lazy->signals == NULL) {
+      g_warning("Manifest of plugin '%s' has no entry points, ignoring.\n",
+                entry);
+      ToolsCoreFreeLazyPlugin(lazy);
+      lazy = NULL;
+      goto exit;
+   }
+
+   if (lazy->capNames != NULL) {
+      guint i;
+
+      lazy->caps = g_array_new(FALSE, TRUE, sizeof (ToolsAppCapability));
+      for (i = 0; lazy->capNames[i] != NULL; i++) {
+         ToolsAppCapability cap = { TOOLS_CAP_OLD, NULL, 0, 0 };
+
+         cap.name = lazy->capNames[i];
+         cap.value = g_key_file_get_integer(manifest, PLUGIN_MANIFEST_CAPS,
+                                            cap.name, &err);
+         if (err != NULL) {
+            g_warning("Manifest of plugin '%s' has an invalid value for "
+                      "capability '%s': %s\n", entry, cap.name, err->message);
+            g_clear_error(&err);
+            continue;
+         }
+         g_array_append_val(lazy->caps, cap);
+      }
+   }
+
+   lazy->fileName = g_strdup(entry);
+   lazy->path = g_strdup(path);
+   lazy->state = state;
+
+exit:
+   g_key_file_free(manifest);
+   g_free(manifestPath);
+   return lazy;
+}
+
+
 /**
  * Loads all the plugins found in the given directory, adding the registration
- * data to the given array.
+ * data to the given array. Plugins with a manifest are not loaded, and are
+ * added to the service's list of deferred plugins instead.
  *
- * @param[in]  ctx         Application context.
+ * @param[in]  state       The service state.
  * @param[in]  pluginPath  Path where to look for plugins.
+ * @param[in]  lazyLoad    Whether to defer loading plugins with a manifest.
  * @param[out] regs        Array where to store plugin registration info.
  */
 
 static gboolean
-ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
+ToolsCoreLoadDirectory(ToolsServiceState *state,
                        const gchar *pluginPath,
+                       gboolean lazyLoad,
                        GPtrArray *regs)
 {
    gboolean ret = FALSE;
@@ -534,9 +1188,8 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
    for (i = 0; i < plugins->len; i++) {
       gchar *entry;
       gchar *path;
-      GModule *module = NULL;
-      ToolsPlugin *plugin = NULL;
-      ToolsPluginOnLoad onload;
+      ToolsPlugin *plugin;
+      ToolsLazyPlugin *lazy;
 
       entry = g_ptr_array_index(plugins, i);
       path = g_strdup_printf("%s%c%s", pluginPath, DIRSEPC, entry);
@@ -546,50 +1199,24 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
          goto next;
       }
 
-#ifdef USE_APPLOADER
-      /* Trying loading the plugins with system libraries */
-      if (!LoadDependencies(path, FALSE)) {
-         g_warning("Loading of library dependencies for %s failed.\n", entry);
-         goto next;
-      }
-#endif
-
-      module = g_module_open(path, G_MODULE_BIND_LOCAL);
-#ifdef USE_APPLOADER
-      if (module == NULL) {
-         /* Falling back to the shipped libraries */
-         if (!LoadDependencies(path, TRUE)) {
-            g_warning("Loading of shipped library dependencies for %s failed.\n",
-                     entry);
-            goto next;
+      lazy = lazyLoad ? ToolsCoreReadManifest(state, entry, path) : NULL;
+      if (lazy != NULL) {
+         if (state->lazyPlugins == NULL) {
+            state->lazyPlugins = g_ptr_array_new();
          }
-         module = g_module_open(path, G_MODULE_BIND_LOCAL);
-      }
-#endif
-      if (module == NULL) {
-         g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
+         g_ptr_array_add(state->lazyPlugins, lazy);
+         g_debug("Deferring load of plugin '%s'.\n", entry);
          goto next;
       }
 
-      if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) &onload)) {
-         g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
-         goto next;
+      plugin = ToolsCoreOpenPlugin(entry, path);
+      if (plugin != NULL) {
+         g_ptr_array_add(regs, plugin);
       }
 
-      plugin = g_malloc(sizeof *plugin);
-      plugin->fileName = entry;
-      plugin->data = NULL;
-      plugin->module = module;
-      plugin->onload = onload;
-      g_ptr_array_add(regs, plugin);
-
    next:
       g_free(path);
-      if (plugin == NULL && module != NULL) {
-         if (!g_module_close(module)) {
-            g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
-         }
-      }
+      g_free(entry);
    }
 
    g_ptr_array_free(plugins, TRUE);
@@ -614,6 +1241,17 @@ ToolsCore_DumpPluginInfo(ToolsServiceState *state)
    } else {
       ToolsCoreForEachPlugin(state, ToolsCoreDumpPluginInfo, ToolsCoreDumpAppInfo);
    }
+
+   if (state->lazyPlugins != NULL) {
+      guint i;
+      for (i = 0; i < state->lazyPlugins->len; i++) {
+         ToolsLazyPlugin *lazy = g_ptr_array_index(state->lazyPlugins, i);
+         if (!lazy->loaded) {
+            ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                               "Plugin: %s (deferred)\n", lazy->fileName);
+         }
+      }
+   }
 }
 
 
@@ -631,10 +1269,13 @@ gboolean
 ToolsCore_LoadPlugins(ToolsServiceState *state)
 {
    gboolean pluginDirExists;
+   gboolean lazyLoad;
    gboolean ret = FALSE;
    gchar *pluginRoot;
    guint i;
+   GError *err = NULL;
    GPtrArray *plugins = NULL;
+   GTimer *timer;
 
 #if defined(sun) && defined(__x86_64__)
    const char *subdir = "/amd64";
@@ -652,6 +1293,15 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
 
    ASSERT(g_module_supported());
 
+   timer = g_timer_new();
+
+   lazyLoad = g_key_file_get_boolean(state->ctx.config, state->name,
+                                     CONFNAME_LAZYLOAD, &err);
+   if (err != NULL) {
+      lazyLoad = TRUE;
+      g_clear_error(&err);
+   }
+
 #ifdef USE_APPLOADER
    {
       Bool ret = FALSE;
@@ -687,7 +1337,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (g_file_test(state->commonPath, G_FILE_TEST_IS_DIR) &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->commonPath, plugins)) {
+       !ToolsCoreLoadDirectory(state, state->commonPath, lazyLoad, plugins)) {
       goto exit;
    }
 
@@ -711,7 +1361,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (pluginDirExists &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->pluginPath, plugins)) {
+       !ToolsCoreLoadDirectory(state, state->pluginPath, lazyLoad, plugins)) {
       goto exit;
    }
 
@@ -725,25 +1375,17 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    for (i = 0; i < plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
 
-      plugin->data = plugin->onload(&state->ctx);
-
-      if (plugin->data == NULL) {
-         g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
-                plugin->fileName);
-         ToolsCoreFreePlugin(plugin);
-      } else if (state->ctx.errorCode != 0) {
-         /* Break early if a plugin has requested the container to quit. */
-         ToolsCoreFreePlugin(plugin);
+      /* Break early if a plugin has requested the container to quit. */
+      if (!ToolsCoreInitPlugin(state, plugin) && state->ctx.errorCode != 0) {
          break;
-      } else {
-         ASSERT(plugin->data->name != NULL);
-         g_module_make_resident(plugin->module);
-         g_ptr_array_add(state->plugins, plugin);
-         VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
-         g_debug("Plugin '%s' initialized.\n", plugin->data->name);
       }
    }
 
+   g_message("Loaded %u plugins in %.1f ms, %u deferred.\n",
+             state->plugins->len,
+             g_timer_elapsed(timer, NULL) * 1000.0,
+             state->lazyPlugins != NULL ? state->lazyPlugins->len : 0);
+
 
    /*
     * If there is a debug plugin, see if it exports standard plugin registration
@@ -765,6 +1407,7 @@ exit:
    if (plugins != NULL) {
       g_ptr_array_free(plugins, TRUE);
    }
+   g_timer_destroy(timer);
    g_free(pluginRoot);
    return ret;
 }
@@ -850,6 +1493,17 @@ ToolsCore_RegisterPlugins(ToolsServiceState *state)
     * individual app providers as necessary.
     */
    ToolsCoreForEachPlugin(state, NULL, ToolsCoreRegisterApp);
+
+   /*
+    * Finally, register the entry points of the deferred plugins, so that they
+    * are loaded when first needed.
+    */
+   if (state->lazyPlugins != NULL) {
+      guint i;
+      for (i = 0; i < state->lazyPlugins->len; i++) {
+         ToolsCoreRegisterLazyPlugin(g_ptr_array_index(state->lazyPlugins, i));
+      }
+   }
 }
 
 
@@ -871,10 +1525,10 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
 {
    guint i;
 
-   if (state->plugins == NULL) {
-      return;
-   }
-
+   /*
+    * Unset the capabilities before freeing the deferred plugins, since their
+    * stubs answer for the capabilities listed in their manifests.
+    */
    if (state->capsRegistered) {
       GArray *pcaps = NULL;
       g_signal_emit_by_name(state->ctx.serviceObj,
@@ -891,6 +1545,18 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
       }
    }
 
+   if (state->lazyPlugins != NULL) {
+      for (i = 0; i < state->lazyPlugins->len; i++) {
+         ToolsCoreFreeLazyPlugin(g_ptr_array_index(state->lazyPlugins, i));
+      }
+      g_ptr_array_free(state->lazyPlugins, TRUE);
+      state->lazyPlugins = NULL;
+   }
+
+   if (state->plugins == NULL) {
+      return;
+   }
+
    /*
     * Stop all app providers, and free the memory we allocated for the
     * internal app providers.
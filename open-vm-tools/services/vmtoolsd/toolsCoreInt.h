@@ -71,11 +71,17 @@ typedef struct ToolsServiceState {
    gchar         *configFile;
    time_t         configMtime;
    guint          configCheckTask;
+   guint          configWatchTask;
+   guint          configWatchRetry;
+   guint          configWatchBackoff;
+   guint          configReloadTask;
+   guint          lockStatsTask;
    gboolean       mainService;
    gboolean       capsRegistered;
    gchar         *commonPath;
    gchar         *pluginPath;
    GPtrArray     *plugins;
+   GPtrArray     *lazyPlugins;
 #if defined(_WIN32)
    gchar         *displayName;
 #else
@@ -100,6 +106,9 @@ ToolsCore_DumpPluginInfo(ToolsServiceState *state);
 void
 ToolsCore_DumpState(ToolsServiceState *state);
 
+gboolean
+ToolsCore_EnableLockStats(ToolsServiceState *state);
+
 const char *
 ToolsCore_GetTcloName(ToolsServiceState *state);
 
@@ -135,6 +144,12 @@ void
 ToolsCore_CFRunLoop(ToolsServiceState *state);
 #endif
 
+void
+ToolsCoreMetrics_Init(ToolsAppCtx *ctx);
+
+void
+ToolsCoreMetrics_Shutdown(ToolsAppCtx *ctx);
+
 void
 ToolsCorePool_Init(ToolsAppCtx *ctx);
 
@@ -32,6 +32,7 @@
 #include "str.h"
 #include "strutil.h"
 #include "toolsCoreInt.h"
+#include "userlock.h"
 #include "vm_tools_version.h"
 #include "vmware/tools/utils.h"
 
@@ -42,6 +43,9 @@
 #include "ioplGet.h"
 #endif
 
+#define LOCKSTATS_GUESTINFO_KEY     "guestinfo.vmtools.lockStats"
+#define LOCKSTATS_PUBLISH_PERIOD    (60 * 1000)    /* ms */
+
 /**
  * Take action after an RPC channel reset.
  *
@@ -240,6 +244,199 @@ ToolsCoreRpcSetOption(RpcInData *data)
 }
 
 
+/**
+ * Appends a JSON string literal to the given string, escaping the characters
+ * JSON doesn't allow to appear verbatim.
+ *
+ * @param[in]  json     The output string.
+ * @param[in]  str      The string to append.
+ */
+
+static void
+ToolsCoreLockStatsAppendString(GString *json,
+                               const char *str)
+{
+   g_string_append_c(json, '"');
+   for (; *str != '\0'; str++) {
+      if (*str == '"' || *str == '\\') {
+         g_string_append_c(json, '\\');
+         g_string_append_c(json, *str);
+      } else if ((unsigned char) *str < 0x20) {
+         g_string_append_printf(json, "\\u%04x", (unsigned char) *str);
+      } else {
+         g_string_append_c(json, *str);
+      }
+   }
+   g_string_append_c(json, '"');
+}
+
+
+/**
+ * Appends a JSON object describing a lock timing histogram.
+ *
+ * @param[in]  json     The output string.
+ * @param[in]  name     Name of the object.
+ * @param[in]  times    The timing data.
+ */
+
+static void
+ToolsCoreLockStatsAppendTimes(GString *json,
+                              const char *name,
+                              const MXUserTimeStats *times)
+{
+   g_string_append_printf(json,
+                          ",\"%s\":{\"count\":%"FMT64"u"
+                          ",\"min\":%"FMT64"u"
+                          ",\"max\":%"FMT64"u"
+                          ",\"mean\":%"FMT64"u"
+                          ",\"p50\":%"FMT64"u"
+                          ",\"p99\":%"FMT64"u}",
+                          name,
+                          times->numSamples,
+                          times->minTime,
+                          times->maxTime,
+                          times->meanTime,
+                          times->p50Time,
+                          times->p99Time);
+}
+
+
+/**
+ * MXUser_ForEachLockStats callback; appends a JSON object with the
+ * statistics of one lock to the output array.
+ *
+ * @param[in]  clientData  The output string.
+ * @param[in]  stats       The lock's statistics.
+ */
+
+static void
+ToolsCoreLockStatsAppend(void *clientData,
+                         const MXUserLockStats *stats)
+{
+   GString *json = clientData;
+
+   if (json->str[json->len - 1] != '[') {
+      g_string_append_c(json, ',');
+   }
+
+   g_string_append(json, "{\"name\":");
+   ToolsCoreLockStatsAppendString(json, stats->name);
+   g_string_append_printf(json,
+                          ",\"rank\":%u"
+                          ",\"attempts\":%"FMT64"u"
+                          ",\"contended\":%"FMT64"u"
+                          ",\"contentionTime\":%"FMT64"u"
+                          ",\"contentionRatio\":%.6f",
+                          (unsigned int) stats->rank,
+                          stats->numAttempts,
+                          stats->numSuccessesContended,
+                          stats->totalContentionTime,
+                          stats->contentionRatio);
+   ToolsCoreLockStatsAppendTimes(json, "acquire", &stats->acquire);
+   ToolsCoreLockStatsAppendTimes(json, "held", &stats->held);
+   g_string_append_c(json, '}');
+}
+
+
+/**
+ * Builds the JSON representation of the lock statistics of this process.
+ * Times are in nanoseconds.
+ *
+ * @return The JSON document, to be freed with g_free().
+ */
+
+static gchar *
+ToolsCoreLockStatsToJSON(void)
+{
+   GString *json = g_string_new("{\"locks\":[");
+
+   MXUser_ForEachLockStats(ToolsCoreLockStatsAppend, json);
+   g_string_append(json, "]}");
+
+   return g_string_free(json, FALSE);
+}
+
+
+/**
+ * Timer callback that publishes the lock statistics to the host through
+ * guestinfo, where "vmware-toolbox-cmd stat lockstats" can read them.
+ *
+ * @param[in]  _state   The service state.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+ToolsCoreLockStatsPublish(gpointer _state)
+{
+   ToolsServiceState *state = _state;
+   gchar *json;
+
+   if (state->ctx.rpc == NULL) {
+      return TRUE;
+   }
+
+   json = ToolsCoreLockStatsToJSON();
+   RpcChannel_SetGuestInfo(state->ctx.rpc, LOCKSTATS_GUESTINFO_KEY, json);
+   g_free(json);
+
+   return TRUE;
+}
+
+
+/**
+ * Turns on collection of lock statistics for the service. The main service
+ * also starts publishing them periodically. Statistics can't be turned off
+ * again without restarting the service.
+ *
+ * @param[in]  state    The service state.
+ *
+ * @return Whether lock statistics are available in this build.
+ */
+
+gboolean
+ToolsCore_EnableLockStats(ToolsServiceState *state)
+{
+   if (!MXUser_EnableStats(TRUE)) {
+      return FALSE;
+   }
+
+   if (state->mainService && state->lockStatsTask == 0) {
+      g_message("Lock statistics enabled.\n");
+      state->lockStatsTask = g_timeout_add(LOCKSTATS_PUBLISH_PERIOD,
+                                           ToolsCoreLockStatsPublish,
+                                           state);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Handles a "Lock_Stats" RPC. With the "enable" argument, turns on lock
+ * statistics; otherwise replies with the current statistics as JSON.
+ *
+ * @param[in]  data     The RPC data.
+ *
+ * @return Whether lock statistics are available.
+ */
+
+static gboolean
+ToolsCoreRpcLockStats(RpcInData *data)
+{
+   ToolsServiceState *state = data->clientData;
+
+   if (data->args != NULL && strcmp(data->args, "enable") == 0) {
+      gboolean ok = ToolsCore_EnableLockStats(state);
+
+      return RPCIN_SETRETVALS(data, ok ? "" : "Lock statistics not supported",
+                              ok);
+   }
+
+   return RPCIN_SETRETVALSF(data, ToolsCoreLockStatsToJSON(), TRUE);
+}
+
+
 /**
  * Initializes the RPC channel. Currently this instantiates an RpcIn loop.
  * This function should only be called once.
@@ -255,6 +452,7 @@ ToolsCore_InitRpc(ToolsServiceState *state)
    static RpcChannelCallback rpcs[] = {
       { "Capabilities_Register", ToolsCoreRpcCapReg, NULL, NULL, NULL, 0 },
       { "Set_Option", ToolsCoreRpcSetOption, NULL, NULL, NULL, 0 },
+      { "Lock_Stats", ToolsCoreRpcLockStats, NULL, NULL, NULL, 0 },
    };
 
    size_t i;
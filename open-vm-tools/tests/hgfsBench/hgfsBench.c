@@ -0,0 +1,1841 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsBench.c --
+ *
+ *   Benchmark for the HGFS server. Connects to the server through an
+ *   in-memory channel, the same way the guest backdoor channel does, and
+ *   drives HgfsServerSessionReceive with a stream of requests against a
+ *   local directory tree. The stream is either a synthetic V3 or V4
+ *   workload or a trace recorded by an earlier run.
+ *
+ *   Reports ops/s, per-op latency percentiles and syscalls per op.
+ *
+ *   With -n, sets a recursive directory watch instead and churns files
+ *   under it, reporting how many change notifications the server delivers.
+ *
+ *   With -l, opens files with a shared oplock and has another thread open
+ *   them for writing, reporting how long the host open waits for the
+ *   oplock break to be acknowledged. Lease breaks raise SIGIO, which is
+ *   caught and handed to the server, as vmtoolsd's main loop does.
+ *
+ *   Trace files are a sequence of records, each a 32-bit little endian
+ *   packet size followed by the request packet. Handles are handed out
+ *   in order by a fresh server, so a trace replays correctly against the
+ *   tree it was recorded with; V4 session ids are patched on the fly.
+ */
+
+#if !defined(linux)
+# error "hgfsBench.c needs to be ported to your OS."
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/perf_event.h>
+
+#include "vmware.h"
+#include "cpName.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerPolicy.h"
+#include "hostinfo.h"
+#include "vm_atomic.h"
+#include "str.h"
+#include "util.h"
+
+#define BENCH_PACKET_SIZE         HGFS_LARGE_PACKET_MAX
+#define BENCH_DEFAULT_FILES       64
+#define BENCH_DEFAULT_FILE_SIZE   65536
+#define BENCH_DEFAULT_IO_SIZE     HGFS_IO_MAX
+#define BENCH_DEFAULT_ITERATIONS  100
+#define BENCH_FILE_FMT            "%s/hgfsbench.%u"
+#define BENCH_NOTIFY_DIRS         16
+#define BENCH_NOTIFY_DIR_FMT      "%s/hgfsbench-notify.%u"
+#define BENCH_LEASE_TIMEOUT_MS    5000
+
+#define BENCH_TRACEPOINT_ID_PATHS                                        \
+   { "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",             \
+     "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id" }
+
+typedef struct BenchOpStats {
+   uint64 errors;
+   uint64 *samples;        // Latencies in ns
+   size_t numSamples;
+   size_t maxSamples;
+} BenchOpStats;
+
+typedef struct BenchLeaseWriter {
+   const char *path;
+   VmTimeType blocked;     // ns
+   int error;
+} BenchLeaseWriter;
+
+typedef struct HgfsBench {
+   HgfsServerSessionCallbacks *serverCbTable;
+   HgfsServerChannelCallbacks channelCbTable;
+   void *serverSession;
+
+   int version;            // Protocol header version, 3 or 4
+   Bool compound;          // Read small files with one compound request
+   Bool serverReplies;     // Let the server allocate the reply buffers
+   uint64 sessionId;       // V4 session id
+   uint32 nextId;
+   size_t replyLen;        // Set by the send callback
+   FILE *recordFile;
+
+   Atomic_uint32 notifyEvents;       // Events in notifications received
+   Atomic_uint32 notifyOverflows;    // Notifications of dropped events
+   Atomic_uint32 oplockBreaks;       // Oplock break requests received
+
+   int syscallFd;          // perf counter of syscalls, or -1
+   const char *syscallErr; // why syscallFd is -1
+   uint64 syscalls;
+   uint64 totalTime;
+   BenchOpStats ops[HGFS_OP_MAX];
+
+   char request[BENCH_PACKET_SIZE];
+   char reply[BENCH_PACKET_SIZE];
+} HgfsBench;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchOpName --
+ *
+ *      Returns a printable name for the ops the benchmark knows about.
+ *
+ * Results:
+ *      The name, or NULL if the op is not one the benchmark generates.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const char *
+HgfsBenchOpName(HgfsOp op)  // IN
+{
+   switch (op) {
+   case HGFS_OP_OPEN_V3:
+      return "OPEN_V3";
+   case HGFS_OP_READ_V3:
+      return "READ_V3";
+   case HGFS_OP_WRITE_V3:
+      return "WRITE_V3";
+   case HGFS_OP_CLOSE_V3:
+      return "CLOSE_V3";
+   case HGFS_OP_SEARCH_OPEN_V3:
+      return "SEARCH_OPEN_V3";
+   case HGFS_OP_SEARCH_READ_V3:
+      return "SEARCH_READ_V3";
+   case HGFS_OP_SEARCH_CLOSE_V3:
+      return "SEARCH_CLOSE_V3";
+   case HGFS_OP_GETATTR_V3:
+      return "GETATTR_V3";
+   case HGFS_OP_CREATE_SESSION_V4:
+      return "CREATE_SESSION_V4";
+   case HGFS_OP_DESTROY_SESSION_V4:
+      return "DESTROY_SESSION_V4";
+   case HGFS_OP_SET_WATCH_V4:
+      return "SET_WATCH_V4";
+   case HGFS_OP_SERVER_LOCK_CHANGE_V3:
+      return "SERVER_LOCK_CHANGE_V3";
+   case HGFS_OP_OPLOCK_BREAK_V4:
+      return "OPLOCK_BREAK_V4";
+   case HGFS_OP_COMPOUND_V4:
+      return "COMPOUND_V4";
+   default:
+      return NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchSyscallsInit --
+ *
+ *      Opens a perf counter of the syscalls made by this process, using
+ *      the raw_syscalls:sys_enter tracepoint.
+ *
+ * Results:
+ *      None. bench->syscallFd is -1 if the counter is not available
+ *      (tracefs not mounted, or perf_event_paranoid too strict), and
+ *      bench->syscallErr then says why.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsBenchSyscallsInit(HgfsBench *bench)  // IN/OUT
+{
+   static const char *idPaths[] = BENCH_TRACEPOINT_ID_PATHS;
+   struct perf_event_attr attr;
+   unsigned long long id = 0;
+   size_t i;
+
+   bench->syscallFd = -1;
+   bench->syscallErr = "raw_syscalls tracepoint not available";
+
+   for (i = 0; i < ARRAYSIZE(idPaths) && id == 0; i++) {
+      FILE *f = fopen(idPaths[i], "r");
+
+      if (f != NULL) {
+         if (fscanf(f, "%llu", &id) != 1) {
+            id = 0;
+         }
+         fclose(f);
+      }
+   }
+
+   if (id == 0) {
+      return;
+   }
+
+   memset(&attr, 0, sizeof attr);
+   attr.type = PERF_TYPE_TRACEPOINT;
+   attr.size = sizeof attr;
+   attr.config = id;
+   attr.disabled = 1;
+
+   /*
+    * Tracepoints fire in the kernel, so exclude_kernel must stay off or
+    * the counter never moves.
+    */
+   attr.exclude_hv = 1;
+
+   bench->syscallFd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+   if (bench->syscallFd < 0) {
+      bench->syscallErr = (errno == EACCES || errno == EPERM) ?
+                          "perf_event_open not permitted, check "
+                          "/proc/sys/kernel/perf_event_paranoid" :
+                          strerror(errno);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchSyscallsRead --
+ *
+ *      Reads the syscall counter.
+ *
+ * Results:
+ *      The number of syscalls counted so far, or 0 if there is no counter.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsBenchSyscallsRead(HgfsBench *bench)  // IN
+{
+   uint64 count;
+
+   if (bench->syscallFd < 0 ||
+       read(bench->syscallFd, &count, sizeof count) != sizeof count) {
+      return 0;
+   }
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchChannelSend --
+ *
+ *      Channel send callback. The reply is built in the reply buffer
+ *      handed in with the request, unless the server allocates reply
+ *      buffers, in which case it is copied there. Requests sent by the
+ *      server are counted and dropped.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      Completes the send.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchChannelSend(void *opaqueSession,  // IN: the benchmark
+                     HgfsPacket *packet,   // IN/OUT: Hgfs packet
+                     char *buffer,         // IN: reply
+                     size_t bufferLen,     // IN: reply size
+                     HgfsSendFlags flags)  // IN: send flags
+{
+   HgfsBench *bench = opaqueSession;
+
+   if (!packet->guestInitiated) {
+      HgfsHeader *header = (HgfsHeader *)buffer;
+      HgfsRequestNotifyV4 *notify =
+         (HgfsRequestNotifyV4 *)(buffer + sizeof (HgfsHeader));
+
+      if (bufferLen >= sizeof *header &&
+          header->op == HGFS_OP_OPLOCK_BREAK_V4) {
+         /* An oplock break, acknowledged by the lease workload. */
+         Atomic_Inc(&bench->oplockBreaks);
+      } else if (bufferLen >= sizeof (HgfsHeader) + sizeof *notify) {
+         /* A change notification, sent from the server's notifier. */
+         if (notify->flags & HGFS_NOTIFY_FLAG_OVERFLOW) {
+            Atomic_Inc(&bench->notifyOverflows);
+         } else {
+            Atomic_Add(&bench->notifyEvents, notify->count);
+         }
+      }
+      bench->serverCbTable->sendComplete(packet, bench->serverSession);
+      return TRUE;
+   }
+
+   if (buffer != bench->reply) {
+      ASSERT(bench->serverReplies);
+      bufferLen = MIN(bufferLen, sizeof bench->reply);
+      memcpy(bench->reply, buffer, bufferLen);
+   }
+
+   bench->replyLen = bufferLen;
+   if (!(flags & HGFS_SEND_NO_COMPLETE)) {
+      bench->serverCbTable->sendComplete(packet, bench->serverSession);
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchRecordLatency --
+ *
+ *      Accounts a request in the per-op statistics.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May grow the sample array.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsBenchRecordLatency(HgfsBench *bench,  // IN/OUT
+                       HgfsOp op,         // IN
+                       uint64 latency,    // IN: ns
+                       Bool failed)       // IN
+{
+   BenchOpStats *stats;
+
+   if (op >= HGFS_OP_MAX) {
+      return;
+   }
+
+   stats = &bench->ops[op];
+   if (stats->numSamples == stats->maxSamples) {
+      stats->maxSamples = MAX(1024, stats->maxSamples * 2);
+      stats->samples = Util_SafeRealloc(stats->samples,
+                                        stats->maxSamples *
+                                        sizeof *stats->samples);
+   }
+   stats->samples[stats->numSamples++] = latency;
+   if (failed) {
+      stats->errors++;
+   }
+   bench->totalTime += latency;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchSend --
+ *
+ *      Sends the request in bench->request to the server and waits for the
+ *      reply, timing the round trip. The request's header format decides
+ *      how the reply is decoded. V4 requests get the current session id.
+ *
+ * Results:
+ *      The HGFS status of the reply. The reply payload and its size are
+ *      returned in the optional out parameters.
+ *
+ * Side effects:
+ *      Records the request if a trace is being recorded.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+HgfsBenchSend(HgfsBench *bench,                // IN/OUT
+              size_t requestSize,              // IN
+              char const **replyPayload,       // OUT/OPT
+              size_t *replyPayloadSize)        // OUT/OPT
+{
+   HgfsRequest *request = (HgfsRequest *)bench->request;
+   HgfsHeader *header = (HgfsHeader *)bench->request;
+   Bool v4 = request->op == HGFS_V4_LEGACY_OPCODE;
+   HgfsPacket packet;
+   HgfsStatus status;
+   VmTimeType start;
+   size_t headerSize;
+   HgfsOp op;
+
+   ASSERT(requestSize <= sizeof bench->request);
+
+   if (v4) {
+      op = header->op;
+      header->packetSize = requestSize;
+      if (op != HGFS_OP_CREATE_SESSION_V4) {
+         header->sessionId = bench->sessionId;
+      }
+   } else {
+      op = request->op;
+   }
+
+   if (bench->recordFile != NULL) {
+      uint32 size = requestSize;
+
+      if (fwrite(&size, sizeof size, 1, bench->recordFile) != 1 ||
+          fwrite(bench->request, requestSize, 1, bench->recordFile) != 1) {
+         Warning("Failed to record request: %s\n", strerror(errno));
+      }
+   }
+
+   memset(&packet, 0, sizeof packet);
+   packet.iov[0].va = bench->request;
+   packet.iov[0].len = requestSize;
+   packet.iovCount = 1;
+   packet.metaPacket = bench->request;
+   packet.metaPacketSize = requestSize;
+   if (!bench->serverReplies) {
+      packet.replyPacket = bench->reply;
+      packet.replyPacketSize = sizeof bench->reply;
+   }
+   packet.guestInitiated = TRUE;
+
+   bench->replyLen = 0;
+   start = Hostinfo_SystemTimerNS();
+   bench->serverCbTable->receive(&packet, bench->serverSession);
+
+   if (v4) {
+      HgfsHeader *replyHeader = (HgfsHeader *)bench->reply;
+
+      headerSize = sizeof *replyHeader;
+      status = bench->replyLen >= headerSize ? replyHeader->status
+                                             : HGFS_STATUS_PROTOCOL_ERROR;
+   } else {
+      HgfsReply *reply = (HgfsReply *)bench->reply;
+
+      headerSize = sizeof *reply;
+      status = bench->replyLen >= headerSize ? reply->status
+                                             : HGFS_STATUS_PROTOCOL_ERROR;
+   }
+
+   HgfsBenchRecordLatency(bench, op, Hostinfo_SystemTimerNS() - start,
+                          status != HGFS_STATUS_SUCCESS);
+
+   if (replyPayload != NULL) {
+      *replyPayload = bench->reply + headerSize;
+   }
+   if (replyPayloadSize != NULL) {
+      *replyPayloadSize = bench->replyLen > headerSize ?
+                          bench->replyLen - headerSize : 0;
+   }
+
+   if (v4 && op == HGFS_OP_CREATE_SESSION_V4 &&
+       status == HGFS_STATUS_SUCCESS &&
+       bench->replyLen >= headerSize + sizeof (HgfsReplyCreateSessionV4)) {
+      HgfsReplyCreateSessionV4 *reply =
+         (HgfsReplyCreateSessionV4 *)(bench->reply + headerSize);
+
+      bench->sessionId = reply->sessionId;
+   }
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchRequest --
+ *
+ *      Writes the header of a new request into bench->request, in the
+ *      benchmark's protocol version.
+ *
+ * Results:
+ *      Pointer to the request payload. The header size is returned in
+ *      headerSize.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsBenchRequest(HgfsBench *bench,     // IN/OUT
+                 HgfsOp op,            // IN
+                 size_t *headerSize)   // OUT
+{
+   memset(bench->request, 0, sizeof (HgfsHeader) + sizeof (HgfsRequestOpenV3));
+
+   if (bench->version == 4) {
+      HgfsHeader *header = (HgfsHeader *)bench->request;
+
+      header->version = 1;
+      header->dummy = HGFS_V4_LEGACY_OPCODE;
+      header->headerSize = sizeof *header;
+      header->requestId = bench->nextId++;
+      header->op = op;
+      *headerSize = sizeof *header;
+   } else {
+      HgfsRequest *request = (HgfsRequest *)bench->request;
+
+      request->id = bench->nextId++;
+      request->op = op;
+      *headerSize = sizeof *request;
+   }
+
+   return bench->request + *headerSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchFileName --
+ *
+ *      Fills in a V3 file name with the cross-platform name of a local
+ *      path, as seen through the guest policy's root share.
+ *
+ * Results:
+ *      Size of the file name structure, or 0 if the name doesn't fit.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static size_t
+HgfsBenchFileName(HgfsFileNameV3 *fileName,  // OUT
+                  const char *path,          // IN: absolute local path
+                  size_t bufferSize)         // IN: space for the name
+{
+   char shareName[PATH_MAX + sizeof HGFS_SERVER_POLICY_ROOT_SHARE_NAME];
+   int len;
+
+   Str_Sprintf(shareName, sizeof shareName, "%s%s",
+               HGFS_SERVER_POLICY_ROOT_SHARE_NAME, path);
+
+   if (bufferSize < sizeof *fileName) {
+      return 0;
+   }
+
+   len = CPName_ConvertTo(shareName,
+                          bufferSize - offsetof(HgfsFileNameV3, name),
+                          fileName->name);
+   if (len < 0) {
+      return 0;
+   }
+
+   fileName->length = len;
+   fileName->flags = 0;
+   fileName->caseType = HGFS_FILE_NAME_DEFAULT_CASE;
+   fileName->fid = HGFS_INVALID_HANDLE;
+
+   return sizeof *fileName + len;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchGetattr --
+ *
+ *      Gets the attributes of a file by name.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchGetattr(HgfsBench *bench,   // IN/OUT
+                 const char *path)   // IN
+{
+   size_t size;
+   HgfsRequestGetattrV3 *req = HgfsBenchRequest(bench, HGFS_OP_GETATTR_V3,
+                                                &size);
+   size_t nameSize = HgfsBenchFileName(&req->fileName, path,
+                                       sizeof bench->request - size -
+                                       offsetof(HgfsRequestGetattrV3, fileName));
+
+   if (nameSize == 0) {
+      return FALSE;
+   }
+   size += offsetof(HgfsRequestGetattrV3, fileName) + nameSize;
+
+   return HgfsBenchSend(bench, size, NULL, NULL) == HGFS_STATUS_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchOpen --
+ *
+ *      Opens an existing file.
+ *
+ * Results:
+ *      TRUE on success, with the file's handle in *handle.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchOpen(HgfsBench *bench,             // IN/OUT
+              const char *path,             // IN
+              HgfsOpenMode mode,            // IN
+              HgfsHandle *handle,           // OUT
+              HgfsServerLock *serverLock)   // IN/OUT/OPT: oplock wanted/granted
+{
+   size_t size;
+   char const *reply;
+   size_t replySize;
+   HgfsRequestOpenV3 *req = HgfsBenchRequest(bench, HGFS_OP_OPEN_V3, &size);
+   size_t nameSize = HgfsBenchFileName(&req->fileName, path,
+                                       sizeof bench->request - size -
+                                       offsetof(HgfsRequestOpenV3, fileName));
+
+   if (nameSize == 0) {
+      return FALSE;
+   }
+   size += offsetof(HgfsRequestOpenV3, fileName) + nameSize;
+
+   req->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+               HGFS_OPEN_VALID_FILE_NAME;
+   req->mode = mode;
+   req->flags = HGFS_OPEN;
+   if (serverLock != NULL) {
+      req->mask |= HGFS_OPEN_VALID_SERVER_LOCK;
+      req->desiredLock = *serverLock;
+   }
+
+   if (HgfsBenchSend(bench, size, &reply, &replySize) != HGFS_STATUS_SUCCESS ||
+       replySize < sizeof (HgfsReplyOpenV3)) {
+      return FALSE;
+   }
+
+   *handle = ((HgfsReplyOpenV3 *)reply)->file;
+   if (serverLock != NULL) {
+      *serverLock = ((HgfsReplyOpenV3 *)reply)->acquiredLock;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchClose --
+ *
+ *      Closes a file or a search.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchClose(HgfsBench *bench,    // IN/OUT
+               HgfsOp op,           // IN: CLOSE_V3 or SEARCH_CLOSE_V3
+               HgfsHandle handle)   // IN
+{
+   size_t size;
+   HgfsRequestCloseV3 *req = HgfsBenchRequest(bench, op, &size);
+
+   ASSERT_ON_COMPILE(offsetof(HgfsRequestCloseV3, file) ==
+                     offsetof(HgfsRequestSearchCloseV3, search));
+
+   req->file = handle;
+   size += sizeof *req;
+
+   return HgfsBenchSend(bench, size, NULL, NULL) == HGFS_STATUS_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchReadFile --
+ *
+ *      Opens a file and reads it to the end.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchReadFile(HgfsBench *bench,  // IN/OUT
+                  const char *path,  // IN
+                  uint32 ioSize)     // IN
+{
+   HgfsHandle handle;
+   uint64 offset = 0;
+   Bool ok = TRUE;
+
+   if (!HgfsBenchOpen(bench, path, HGFS_OPEN_MODE_READ_ONLY, &handle, NULL)) {
+      return FALSE;
+   }
+
+   for (;;) {
+      size_t size;
+      char const *reply;
+      size_t replySize;
+      HgfsRequestReadV3 *req = HgfsBenchRequest(bench, HGFS_OP_READ_V3, &size);
+      uint32 actualSize;
+
+      req->file = handle;
+      req->offset = offset;
+      req->requiredSize = ioSize;
+      size += sizeof *req;
+
+      if (HgfsBenchSend(bench, size, &reply, &replySize) != HGFS_STATUS_SUCCESS ||
+          replySize < offsetof(HgfsReplyReadV3, payload)) {
+         ok = FALSE;
+         break;
+      }
+
+      actualSize = ((HgfsReplyReadV3 *)reply)->actualSize;
+      if (actualSize == 0) {
+         break;
+      }
+      offset += actualSize;
+   }
+
+   return HgfsBenchClose(bench, HGFS_OP_CLOSE_V3, handle) && ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchCompoundAdd --
+ *
+ *      Appends a sub-request to the compound request in bench->request.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Advances *size past the new entry.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsBenchCompoundAdd(HgfsBench *bench,      // IN/OUT
+                     size_t *size,          // IN/OUT: request size
+                     HgfsOp op,             // IN
+                     void const *payload,   // IN
+                     size_t payloadSize)    // IN
+{
+   HgfsCompoundEntryV4 *entry = (HgfsCompoundEntryV4 *)(bench->request + *size);
+
+   ASSERT(*size + sizeof *entry + HGFS_COMPOUND_ALIGN(payloadSize) <=
+          sizeof bench->request);
+
+   memset(entry, 0, sizeof *entry + HGFS_COMPOUND_ALIGN(payloadSize));
+   entry->op = op;
+   entry->size = payloadSize;
+   memcpy(entry + 1, payload, payloadSize);
+   *size += sizeof *entry + HGFS_COMPOUND_ALIGN(payloadSize);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchReadSmallFile --
+ *
+ *      Gets the attributes of a file smaller than ioSize and reads it with
+ *      a single compound request: getattr, open, read and close.
+ *
+ * Results:
+ *      TRUE if all the sub-requests succeeded and the file was read to
+ *      the end.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchReadSmallFile(HgfsBench *bench,  // IN/OUT
+                       const char *path,  // IN
+                       uint32 ioSize)     // IN
+{
+   union {
+      HgfsRequestGetattrV3 getattr;
+      HgfsRequestOpenV3 open;
+      char buffer[sizeof (HgfsRequestOpenV3) + PATH_MAX];
+   } name;
+   HgfsRequestReadV3 read;
+   HgfsRequestCloseV3 close;
+   HgfsRequestCompoundV4 *req;
+   HgfsReplyCompoundV4 const *compound;
+   char const *reply;
+   size_t replySize;
+   size_t offset;
+   size_t nameSize;
+   size_t size;
+   uint32 i;
+
+   req = HgfsBenchRequest(bench, HGFS_OP_COMPOUND_V4, &size);
+   memset(req, 0, sizeof *req);
+   req->count = 4;
+   req->maxReplySize = sizeof bench->reply - sizeof (HgfsHeader);
+   size += sizeof *req;
+
+   memset(&name, 0, sizeof name);
+   nameSize = HgfsBenchFileName(&name.getattr.fileName, path,
+                                sizeof name -
+                                offsetof(HgfsRequestGetattrV3, fileName));
+   if (nameSize == 0) {
+      return FALSE;
+   }
+   HgfsBenchCompoundAdd(bench, &size, HGFS_OP_GETATTR_V3, &name,
+                        offsetof(HgfsRequestGetattrV3, fileName) + nameSize);
+
+   memset(&name, 0, sizeof name);
+   HgfsBenchFileName(&name.open.fileName, path,
+                     sizeof name - offsetof(HgfsRequestOpenV3, fileName));
+   name.open.mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                    HGFS_OPEN_VALID_FILE_NAME;
+   name.open.mode = HGFS_OPEN_MODE_READ_ONLY;
+   name.open.flags = HGFS_OPEN;
+   HgfsBenchCompoundAdd(bench, &size, HGFS_OP_OPEN_V3, &name,
+                        offsetof(HgfsRequestOpenV3, fileName) + nameSize);
+
+   memset(&read, 0, sizeof read);
+   read.file = HGFS_COMPOUND_LAST_HANDLE;
+   read.requiredSize = ioSize;
+   HgfsBenchCompoundAdd(bench, &size, HGFS_OP_READ_V3, &read, sizeof read);
+
+   memset(&close, 0, sizeof close);
+   close.file = HGFS_COMPOUND_LAST_HANDLE;
+   HgfsBenchCompoundAdd(bench, &size, HGFS_OP_CLOSE_V3, &close, sizeof close);
+
+   if (HgfsBenchSend(bench, size, &reply, &replySize) != HGFS_STATUS_SUCCESS ||
+       replySize < sizeof *compound) {
+      return FALSE;
+   }
+
+   compound = (HgfsReplyCompoundV4 const *)reply;
+   if (compound->count != 4) {
+      return FALSE;
+   }
+
+   for (i = 0, offset = sizeof *compound; i < compound->count; i++) {
+      HgfsCompoundReplyEntryV4 const *entry =
+         (HgfsCompoundReplyEntryV4 const *)(reply + offset);
+
+      if (offset + sizeof *entry > replySize ||
+          entry->size > replySize - offset - sizeof *entry ||
+          entry->status != HGFS_STATUS_SUCCESS) {
+         return FALSE;
+      }
+      if (entry->op == HGFS_OP_READ_V3 &&
+          (entry->size < offsetof(HgfsReplyReadV3, payload) ||
+           ((HgfsReplyReadV3 const *)(entry + 1))->actualSize >= ioSize)) {
+         /* Not the whole file. */
+         return FALSE;
+      }
+      offset += sizeof *entry + HGFS_COMPOUND_ALIGN(entry->size);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchWriteFile --
+ *
+ *      Opens a file and overwrites its first fileSize bytes.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchWriteFile(HgfsBench *bench,  // IN/OUT
+                   const char *path,  // IN
+                   uint32 fileSize,   // IN
+                   uint32 ioSize)     // IN
+{
+   HgfsHandle handle;
+   uint64 offset;
+   Bool ok = TRUE;
+
+   if (!HgfsBenchOpen(bench, path, HGFS_OPEN_MODE_READ_WRITE, &handle,
+                      NULL)) {
+      return FALSE;
+   }
+
+   for (offset = 0; offset < fileSize; offset += ioSize) {
+      size_t size;
+      HgfsRequestWriteV3 *req = HgfsBenchRequest(bench, HGFS_OP_WRITE_V3,
+                                                 &size);
+      uint32 chunk = MIN(ioSize, fileSize - offset);
+
+      req->file = handle;
+      req->flags = 0;
+      req->offset = offset;
+      req->requiredSize = chunk;
+      memset(req->payload, 'w', chunk);
+      size += offsetof(HgfsRequestWriteV3, payload) + chunk;
+
+      if (HgfsBenchSend(bench, size, NULL, NULL) != HGFS_STATUS_SUCCESS) {
+         ok = FALSE;
+         break;
+      }
+   }
+
+   return HgfsBenchClose(bench, HGFS_OP_CLOSE_V3, handle) && ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchListDir --
+ *
+ *      Reads all entries of a directory.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchListDir(HgfsBench *bench,  // IN/OUT
+                 const char *path)  // IN
+{
+   size_t size;
+   char const *reply;
+   size_t replySize;
+   HgfsHandle search;
+   uint32 offset;
+   Bool ok = TRUE;
+   HgfsRequestSearchOpenV3 *req = HgfsBenchRequest(bench,
+                                                   HGFS_OP_SEARCH_OPEN_V3,
+                                                   &size);
+   size_t nameSize = HgfsBenchFileName(&req->dirName, path,
+                                       sizeof bench->request - size -
+                                       offsetof(HgfsRequestSearchOpenV3,
+                                                dirName));
+
+   if (nameSize == 0) {
+      return FALSE;
+   }
+   size += offsetof(HgfsRequestSearchOpenV3, dirName) + nameSize;
+
+   if (HgfsBenchSend(bench, size, &reply, &replySize) != HGFS_STATUS_SUCCESS ||
+       replySize < sizeof (HgfsReplySearchOpenV3)) {
+      return FALSE;
+   }
+   search = ((HgfsReplySearchOpenV3 *)reply)->search;
+
+   for (offset = 0; ; offset++) {
+      HgfsRequestSearchReadV3 *readReq =
+         HgfsBenchRequest(bench, HGFS_OP_SEARCH_READ_V3, &size);
+      HgfsDirEntry *dirent;
+
+      readReq->search = search;
+      readReq->offset = offset;
+      size += sizeof *readReq;
+
+      if (HgfsBenchSend(bench, size, &reply, &replySize) != HGFS_STATUS_SUCCESS ||
+          replySize < offsetof(HgfsReplySearchReadV3, payload)) {
+         ok = FALSE;
+         break;
+      }
+      if (((HgfsReplySearchReadV3 *)reply)->count == 0) {
+         break;
+      }
+
+      /* The end of the directory is an entry with an empty name. */
+      dirent = (HgfsDirEntry *)((HgfsReplySearchReadV3 *)reply)->payload;
+      if (replySize < offsetof(HgfsReplySearchReadV3, payload) + sizeof *dirent ||
+          dirent->fileName.length == 0) {
+         break;
+      }
+   }
+
+   return HgfsBenchClose(bench, HGFS_OP_SEARCH_CLOSE_V3, search) && ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchCreateSession --
+ *
+ *      Creates the V4 session used by the rest of the requests.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchCreateSession(HgfsBench *bench)  // IN/OUT
+{
+   size_t size;
+   HgfsRequestCreateSessionV4 *req =
+      HgfsBenchRequest(bench, HGFS_OP_CREATE_SESSION_V4, &size);
+
+   req->numCapabilities = 0;
+   req->maxPacketSize = BENCH_PACKET_SIZE;
+   size += offsetof(HgfsRequestCreateSessionV4, capabilities);
+
+   return HgfsBenchSend(bench, size, NULL, NULL) == HGFS_STATUS_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchMakeTree --
+ *
+ *      Creates the files the synthetic workload works on.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      Creates or truncates numFiles files in dir.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchMakeTree(const char *dir,   // IN
+                  uint32 numFiles,   // IN
+                  uint32 fileSize)   // IN
+{
+   char *buf = Util_SafeMalloc(fileSize + 1);
+   Bool ok = TRUE;
+   uint32 i;
+
+   memset(buf, 'r', fileSize + 1);
+
+   for (i = 0; i < numFiles && ok; i++) {
+      char path[PATH_MAX];
+      int fd;
+
+      Str_Sprintf(path, sizeof path, BENCH_FILE_FMT, dir, i);
+      fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+      if (fd < 0) {
+         fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+         ok = FALSE;
+      } else {
+         if (write(fd, buf, fileSize) != (ssize_t)fileSize) {
+            fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+            ok = FALSE;
+         }
+         close(fd);
+      }
+   }
+
+   free(buf);
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchRunSynthetic --
+ *
+ *      Runs the synthetic workload. Each iteration lists the directory,
+ *      then for every file gets its attributes and reads it, and rewrites
+ *      one of the files.
+ *
+ * Results:
+ *      Number of failed file operations.
+ *
+ * Side effects:
+ *      Rewrites files in dir.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsBenchRunSynthetic(HgfsBench *bench,    // IN/OUT
+                      const char *dir,     // IN
+                      uint32 numFiles,     // IN
+                      uint32 fileSize,     // IN
+                      uint32 ioSize,       // IN
+                      uint32 iterations)   // IN
+{
+   uint32 failures = 0;
+   uint32 iter;
+
+   if (bench->version == 4 && !HgfsBenchCreateSession(bench)) {
+      fprintf(stderr, "Cannot create a V4 session.\n");
+      return 1;
+   }
+
+   for (iter = 0; iter < iterations; iter++) {
+      char path[PATH_MAX];
+      uint32 i;
+
+      failures += !HgfsBenchListDir(bench, dir);
+
+      for (i = 0; i < numFiles; i++) {
+         Str_Sprintf(path, sizeof path, BENCH_FILE_FMT, dir, i);
+         if (bench->compound && fileSize < ioSize) {
+            failures += !HgfsBenchReadSmallFile(bench, path, ioSize);
+         } else {
+            failures += !HgfsBenchGetattr(bench, path);
+            failures += !HgfsBenchReadFile(bench, path, ioSize);
+         }
+      }
+
+      if (numFiles > 0) {
+         Str_Sprintf(path, sizeof path, BENCH_FILE_FMT, dir, iter % numFiles);
+         failures += !HgfsBenchWriteFile(bench, path, fileSize, ioSize);
+      }
+   }
+
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchRunTrace --
+ *
+ *      Replays the requests recorded in a trace file.
+ *
+ * Results:
+ *      Number of requests that could not be replayed.
+ *
+ * Side effects:
+ *      Whatever the recorded requests do to the tree.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsBenchRunTrace(HgfsBench *bench,       // IN/OUT
+                  const char *tracePath)  // IN
+{
+   FILE *trace = fopen(tracePath, "rb");
+   uint32 failures = 0;
+   uint32 size;
+
+   if (trace == NULL) {
+      fprintf(stderr, "Cannot open %s: %s\n", tracePath, strerror(errno));
+      return 1;
+   }
+
+   while (fread(&size, sizeof size, 1, trace) == 1) {
+      if (size < sizeof (HgfsRequest) || size > sizeof bench->request ||
+          fread(bench->request, size, 1, trace) != 1) {
+         fprintf(stderr, "Truncated or corrupt trace %s.\n", tracePath);
+         failures++;
+         break;
+      }
+      HgfsBenchSend(bench, size, NULL, NULL);
+   }
+
+   fclose(trace);
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchSetWatch --
+ *
+ *      Sets a recursive watch for all events on a directory.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchSetWatch(HgfsBench *bench,   // IN/OUT
+                  const char *path)   // IN
+{
+   size_t size;
+   HgfsRequestSetWatchV4 *req = HgfsBenchRequest(bench, HGFS_OP_SET_WATCH_V4,
+                                                 &size);
+   size_t nameSize = HgfsBenchFileName(&req->fileName, path,
+                                       sizeof bench->request - size -
+                                       offsetof(HgfsRequestSetWatchV4, fileName));
+
+   if (nameSize == 0) {
+      return FALSE;
+   }
+   size += offsetof(HgfsRequestSetWatchV4, fileName) + nameSize;
+
+   req->events = HGFS_NOTIFY_EVENTS_DROPPED - 1;
+   req->flags = HGFS_NOTIFY_FLAG_WATCH_TREE;
+
+   return HgfsBenchSend(bench, size, NULL, NULL) == HGFS_STATUS_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchRunNotify --
+ *
+ *      Watches the directory tree and churns files in it for the given
+ *      time: each round creates, writes and closes a file in one of the
+ *      subdirectories and deletes every other file again.
+ *
+ * Results:
+ *      Number of churn operations done, or 0 if the watch failed.
+ *
+ * Side effects:
+ *      Creates subdirectories and files in dir.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsBenchRunNotify(HgfsBench *bench,    // IN/OUT
+                   const char *dir,     // IN
+                   uint32 numFiles,     // IN: files per subdirectory
+                   uint32 seconds)      // IN
+{
+   char path[PATH_MAX];
+   VmTimeType end;
+   uint64 ops = 0;
+   uint32 i;
+
+   for (i = 0; i < BENCH_NOTIFY_DIRS; i++) {
+      Str_Sprintf(path, sizeof path, BENCH_NOTIFY_DIR_FMT, dir, i);
+      if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+         fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+         return 0;
+      }
+   }
+
+   if (!HgfsBenchCreateSession(bench) || !HgfsBenchSetWatch(bench, dir)) {
+      fprintf(stderr, "Cannot watch %s; the server has no notification "
+              "support.\n", dir);
+      return 0;
+   }
+
+   end = Hostinfo_SystemTimerNS() + (VmTimeType)seconds * 1000000000;
+   while (Hostinfo_SystemTimerNS() < end) {
+      for (i = 0; i < 1000; i++, ops++) {
+         int fd;
+
+         Str_Sprintf(path, sizeof path, BENCH_NOTIFY_DIR_FMT"/churn.%u", dir,
+                     (uint32)(ops % BENCH_NOTIFY_DIRS),
+                     (uint32)(ops / BENCH_NOTIFY_DIRS % MAX(numFiles, 1)));
+         fd = open(path, O_CREAT | O_WRONLY, 0644);
+         if (fd >= 0) {
+            if (write(fd, path, 1) != 1) {
+               Warning("Failed to write %s\n", path);
+            }
+            close(fd);
+         }
+         if (ops % 2 == 0) {
+            unlink(path);
+         }
+      }
+   }
+
+   /* Let the notifier deliver what is still queued. */
+   usleep(500 * 1000);
+
+   return ops;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchServerLockChange --
+ *
+ *      Releases or downgrades the oplock held on a file, which also
+ *      acknowledges an oplock break.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchServerLockChange(HgfsBench *bench,              // IN/OUT
+                          HgfsHandle handle,             // IN
+                          HgfsOpportunisticLock lock)    // IN: lock to keep
+{
+   size_t size;
+   HgfsRequestServerLockChangeV2 *req =
+      HgfsBenchRequest(bench, HGFS_OP_SERVER_LOCK_CHANGE_V3, &size);
+
+   req->fid = handle;
+   req->serverLock = lock;
+   size += sizeof *req;
+
+   return HgfsBenchSend(bench, size, NULL, NULL) == HGFS_STATUS_SUCCESS;
+}
+
+
+/* Set when a lease break raised SIGIO. */
+static volatile sig_atomic_t gBenchLeaseBreak;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchSigIO --
+ *
+ *      SIGIO handler; the lease breaks are processed by the polling thread.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsBenchSigIO(int signum)  // IN: unused
+{
+   gBenchLeaseBreak = 1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchLeaseWriter --
+ *
+ *      Thread body opening a file for writing, as a host application
+ *      would, and timing how long the open waits for the lease break.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsBenchLeaseWriter(void *data)  // IN/OUT: BenchLeaseWriter
+{
+   BenchLeaseWriter *writer = data;
+   VmTimeType start = Hostinfo_SystemTimerNS();
+   int fd = open(writer->path, O_WRONLY);
+
+   writer->blocked = Hostinfo_SystemTimerNS() - start;
+   writer->error = fd < 0 ? errno : 0;
+   if (fd >= 0) {
+      close(fd);
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchRunLeases --
+ *
+ *      Opens each file with a shared oplock, then opens it for writing
+ *      from another thread. The write open breaks the oplock; the break
+ *      is acknowledged as soon as it arrives. The time the write open
+ *      waited is accounted as OPLOCK_BREAK_V4.
+ *
+ * Results:
+ *      Number of failures.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsBenchRunLeases(HgfsBench *bench,    // IN/OUT
+                   const char *dir,     // IN
+                   uint32 numFiles,     // IN
+                   uint32 rounds)       // IN
+{
+   char path[PATH_MAX];
+   struct sigaction sa;
+   uint32 failures = 0;
+   uint32 i;
+
+   memset(&sa, 0, sizeof sa);
+   sa.sa_handler = HgfsBenchSigIO;
+   sigemptyset(&sa.sa_mask);
+   if (sigaction(SIGIO, &sa, NULL) == -1) {
+      fprintf(stderr, "Cannot catch SIGIO: %s\n", strerror(errno));
+      return 1;
+   }
+   HgfsServer_EnableOplocks(TRUE);
+
+   if (!HgfsBenchCreateSession(bench)) {
+      return 1;
+   }
+
+   for (i = 0; i < rounds; i++) {
+      HgfsServerLock lock = HGFS_LOCK_SHARED;
+      BenchLeaseWriter writer;
+      pthread_t thread;
+      HgfsHandle handle;
+      uint32 breaks;
+      uint32 waited;
+
+      Str_Sprintf(path, sizeof path, BENCH_FILE_FMT, dir, i % MAX(numFiles, 1));
+      if (!HgfsBenchOpen(bench, path, HGFS_OPEN_MODE_READ_ONLY, &handle,
+                         &lock)) {
+         failures++;
+         continue;
+      }
+      if (lock == HGFS_LOCK_NONE) {
+         fprintf(stderr, "No oplock granted on %s; the server or the host "
+                 "file system has no lease support.\n", path);
+         HgfsBenchClose(bench, HGFS_OP_CLOSE_V3, handle);
+         return failures + 1;
+      }
+
+      breaks = Atomic_Read(&bench->oplockBreaks);
+      writer.path = path;
+      if (pthread_create(&thread, NULL, HgfsBenchLeaseWriter, &writer) != 0) {
+         HgfsBenchClose(bench, HGFS_OP_CLOSE_V3, handle);
+         return failures + 1;
+      }
+
+      for (waited = 0;
+           Atomic_Read(&bench->oplockBreaks) == breaks &&
+           waited < BENCH_LEASE_TIMEOUT_MS;
+           waited++) {
+         if (gBenchLeaseBreak) {
+            gBenchLeaseBreak = 0;
+            HgfsServer_ProcessOplockBreaks();
+         } else {
+            usleep(1000);
+         }
+      }
+      if (Atomic_Read(&bench->oplockBreaks) == breaks) {
+         Warning("No oplock break received for %s\n", path);
+      } else if (!HgfsBenchServerLockChange(bench, handle, HGFS_OPLOCK_NONE)) {
+         Warning("Failed to acknowledge the oplock break for %s\n", path);
+      }
+
+      pthread_join(thread, NULL);
+      HgfsBenchRecordLatency(bench, HGFS_OP_OPLOCK_BREAK_V4, writer.blocked,
+                             Atomic_Read(&bench->oplockBreaks) == breaks ||
+                             writer.error != 0);
+      failures += Atomic_Read(&bench->oplockBreaks) == breaks;
+
+      if (!HgfsBenchClose(bench, HGFS_OP_CLOSE_V3, handle)) {
+         failures++;
+      }
+   }
+
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchCompareSamples --
+ *
+ *      qsort comparison function for latency samples.
+ *
+ * Results:
+ *      <0, 0, >0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsBenchCompareSamples(const void *a,  // IN
+                        const void *b)  // IN
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchReport --
+ *
+ *      Prints the per-op latency percentiles and the totals.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sorts the latency samples.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsBenchReport(HgfsBench *bench,    // IN/OUT
+                uint64 wallTime)     // IN: ns
+{
+   HgfsServerBufferStats bufferStats;
+   uint64 totalOps = 0;
+   uint32 op;
+
+   printf("%-20s %9s %7s %10s %10s %10s %10s\n",
+          "op", "count", "errors", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      BenchOpStats *stats = &bench->ops[op];
+      const char *name = HgfsBenchOpName(op);
+      char opName[32];
+      size_t n = stats->numSamples;
+
+      if (n == 0) {
+         continue;
+      }
+      if (name == NULL) {
+         Str_Sprintf(opName, sizeof opName, "op %u", op);
+         name = opName;
+      }
+
+      qsort(stats->samples, n, sizeof *stats->samples, HgfsBenchCompareSamples);
+      printf("%-20s %9"FMTSZ"u %7"FMT64"u %10.2f %10.2f %10.2f %10.2f\n",
+             name, n, stats->errors,
+             stats->samples[(n - 1) * 50 / 100] / 1000.0,
+             stats->samples[(n - 1) * 90 / 100] / 1000.0,
+             stats->samples[(n - 1) * 99 / 100] / 1000.0,
+             stats->samples[n - 1] / 1000.0);
+      totalOps += n;
+   }
+
+   if (totalOps == 0) {
+      printf("No requests sent.\n");
+      return;
+   }
+
+   printf("\n%"FMT64"u ops in %.3fs (%.3fs in the server): %.0f ops/s\n",
+          totalOps, wallTime / 1e9, bench->totalTime / 1e9,
+          totalOps / (wallTime / 1e9));
+   if (bench->syscallFd >= 0) {
+      printf("%.2f syscalls/op\n", (double)bench->syscalls / totalOps);
+   } else {
+      printf("syscalls/op: n/a (%s)\n", bench->syscallErr);
+   }
+
+   HgfsServer_GetBufferStats(&bufferStats);
+   printf("reply/bounce buffers: %"FMT64"u reused, %"FMT64"u allocated, "
+          "%"FMT64"u bounce copies, %"FMT64"u mapped in place\n",
+          bufferStats.poolHits, bufferStats.poolMisses,
+          bufferStats.bounceBuffers, bufferStats.mappedInPlace);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBenchUsage --
+ *
+ *      Prints the usage message.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsBenchUsage(const char *progName)  // IN
+{
+   fprintf(stderr,
+           "Usage: %s [options] <directory>\n"
+           "\n"
+           "Benchmarks the HGFS server against the files in <directory>.\n"
+           "\n"
+           "Options:\n"
+           "   -p <3|4>     protocol header version (default 4)\n"
+           "   -f <count>   number of files to create (default %u)\n"
+           "   -s <bytes>   size of each file (default %u)\n"
+           "   -b <bytes>   read and write request size (default %u)\n"
+           "   -i <count>   iterations of the workload (default %u)\n"
+           "   -r <trace>   replay the requests recorded in <trace>\n"
+           "   -w <trace>   record the requests sent to <trace>\n"
+           "   -c           read files smaller than the request size with one\n"
+           "                compound getattr+open+read+close request\n"
+           "   -a           let the server allocate reply buffers, as it does\n"
+           "                for the socket channel\n"
+           "   -n <secs>    churn files under a recursive watch for <secs>\n"
+           "                seconds and count the change notifications\n"
+           "   -l <count>   break <count> shared oplocks by opening the files\n"
+           "                for writing, and time the oplock breaks\n",
+           progName, BENCH_DEFAULT_FILES, BENCH_DEFAULT_FILE_SIZE,
+           BENCH_DEFAULT_IO_SIZE, BENCH_DEFAULT_ITERATIONS);
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   static HgfsBench bench;
+   uint32 numFiles = BENCH_DEFAULT_FILES;
+   uint32 fileSize = BENCH_DEFAULT_FILE_SIZE;
+   uint32 ioSize = BENCH_DEFAULT_IO_SIZE;
+   uint32 iterations = BENCH_DEFAULT_ITERATIONS;
+   const char *replayPath = NULL;
+   const char *recordPath = NULL;
+   uint32 notifySeconds = 0;
+   uint32 leaseRounds = 0;
+   uint64 churnOps = 0;
+   char dir[PATH_MAX];
+   uint32 failures;
+   uint64 syscallsStart;
+   VmTimeType start;
+   VmTimeType wallTime;
+   uint32 op;
+   int opt;
+
+   bench.version = 4;
+
+   while ((opt = getopt(argc, argv, "p:f:s:b:i:r:w:n:l:ca")) != -1) {
+      switch (opt) {
+      case 'p':
+         bench.version = atoi(optarg);
+         break;
+      case 'f':
+         numFiles = strtoul(optarg, NULL, 0);
+         break;
+      case 's':
+         fileSize = strtoul(optarg, NULL, 0);
+         break;
+      case 'b':
+         ioSize = strtoul(optarg, NULL, 0);
+         break;
+      case 'i':
+         iterations = strtoul(optarg, NULL, 0);
+         break;
+      case 'r':
+         replayPath = optarg;
+         break;
+      case 'w':
+         recordPath = optarg;
+         break;
+      case 'n':
+         notifySeconds = strtoul(optarg, NULL, 0);
+         break;
+      case 'l':
+         leaseRounds = strtoul(optarg, NULL, 0);
+         break;
+      case 'c':
+         bench.compound = TRUE;
+         break;
+      case 'a':
+         bench.serverReplies = TRUE;
+         break;
+      default:
+         HgfsBenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (optind != argc - 1 || (bench.version != 3 && bench.version != 4) ||
+       ioSize == 0 || ioSize > HGFS_LARGE_IO_MAX ||
+       ((notifySeconds > 0 || leaseRounds > 0) && bench.version != 4)) {
+      HgfsBenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (realpath(argv[optind], dir) == NULL) {
+      fprintf(stderr, "Cannot resolve %s: %s\n", argv[optind], strerror(errno));
+      return EXIT_FAILURE;
+   }
+
+   if (notifySeconds == 0 && !HgfsBenchMakeTree(dir, numFiles, fileSize)) {
+      return EXIT_FAILURE;
+   }
+
+   if (recordPath != NULL) {
+      bench.recordFile = fopen(recordPath, "wb");
+      if (bench.recordFile == NULL) {
+         fprintf(stderr, "Cannot create %s: %s\n", recordPath, strerror(errno));
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (!HgfsServerPolicy_Init(NULL, NULL) ||
+       !HgfsServer_InitState(&bench.serverCbTable, NULL)) {
+      fprintf(stderr, "Cannot initialize the HGFS server.\n");
+      return EXIT_FAILURE;
+   }
+
+   /* Only shared memory channels get change notification and oplocks. */
+   bench.channelCbTable.send = HgfsBenchChannelSend;
+   if (!bench.serverCbTable->connect(&bench, &bench.channelCbTable,
+                                     notifySeconds > 0 || leaseRounds > 0 ?
+                                     HGFS_CHANNEL_SHARED_MEM : 0,
+                                     &bench.serverSession)) {
+      fprintf(stderr, "Cannot connect to the HGFS server.\n");
+      return EXIT_FAILURE;
+   }
+
+   HgfsBenchSyscallsInit(&bench);
+   if (bench.syscallFd >= 0) {
+      ioctl(bench.syscallFd, PERF_EVENT_IOC_ENABLE, 0);
+   }
+   syscallsStart = HgfsBenchSyscallsRead(&bench);
+   start = Hostinfo_SystemTimerNS();
+
+   if (notifySeconds > 0) {
+      churnOps = HgfsBenchRunNotify(&bench, dir, numFiles, notifySeconds);
+      failures = churnOps == 0;
+   } else if (leaseRounds > 0) {
+      failures = HgfsBenchRunLeases(&bench, dir, numFiles, leaseRounds);
+   } else if (replayPath != NULL) {
+      failures = HgfsBenchRunTrace(&bench, replayPath);
+   } else {
+      failures = HgfsBenchRunSynthetic(&bench, dir, numFiles, fileSize, ioSize,
+                                       iterations);
+   }
+
+   wallTime = Hostinfo_SystemTimerNS() - start;
+   bench.syscalls = HgfsBenchSyscallsRead(&bench) - syscallsStart;
+
+   bench.serverCbTable->disconnect(bench.serverSession);
+   bench.serverCbTable->close(bench.serverSession);
+   HgfsServer_ExitState();
+   HgfsServerPolicy_Cleanup();
+
+   if (bench.recordFile != NULL) {
+      fclose(bench.recordFile);
+   }
+   if (bench.syscallFd >= 0) {
+      close(bench.syscallFd);
+   }
+
+   HgfsBenchReport(&bench, wallTime);
+
+   if (churnOps > 0) {
+      uint32 events = Atomic_Read(&bench.notifyEvents);
+
+      printf("%"FMT64"u file changes in %us: %.0f changes/s, "
+             "%u events notified (%.0f events/s), %u overflows\n",
+             churnOps, notifySeconds, (double)churnOps / notifySeconds,
+             events, (double)events / notifySeconds,
+             Atomic_Read(&bench.notifyOverflows));
+   }
+
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      free(bench.ops[op].samples);
+   }
+
+   if (failures > 0) {
+      fprintf(stderr, "%u operations failed.\n", failures);
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
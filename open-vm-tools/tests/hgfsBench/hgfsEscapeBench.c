@@ -0,0 +1,303 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsEscapeBench.c --
+ *
+ *   Microbenchmark for the name scanning done on deep paths with long
+ *   components. Builds a path of BENCH_DEPTH components of BENCH_COMP_LEN
+ *   characters, with and without escape characters, checks
+ *   CPName_ConvertTo, CPName_GetComponent and HgfsEscape_GetSize against
+ *   byte at a time reference versions of the loops they used to be, and
+ *   times both.
+ *
+ *   Usage: vmware-hgfsescapebench [iterations]
+ */
+
+#if !defined(linux)
+# error "hgfsEscapeBench.c needs to be ported to your OS."
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vmware.h"
+#include "cpName.h"
+#include "hgfsEscape.h"
+
+#define BENCH_DEPTH      64
+#define BENCH_COMP_LEN   255
+#define BENCH_NAME_SIZE  (BENCH_DEPTH * (BENCH_COMP_LEN + 1) + 1)
+
+/* The escaping rules of hgfsEscape.c for Linux names. */
+#define REF_ILLEGAL_CHARS            "/"
+#define REF_SUBSTITUTE_CHARS         "!"
+#define REF_ESCAPE_CHAR              '%'
+#define REF_ESCAPE_SUBSTITUTE_CHAR   ']'
+
+
+
+
+static int
+RefGetComponent(char const *begin,
+                char const *end,
+                char const **next)
+{
+   char const *walk;
+   char const *myNext;
+
+   for (walk = begin; ; walk++) {
+      if (walk == end) {
+         myNext = end;
+         break;
+      }
+      if (*walk == '\0') {
+         if (walk == begin) {
+            return -1;
+         }
+         myNext = walk + 1;
+         while ((*myNext == '\0') && (myNext != end)) {
+            myNext++;
+         }
+         if (myNext == end) {
+            return -1;
+         }
+         break;
+      }
+   }
+
+   *next = myNext;
+   return (int)(walk - begin);
+}
+
+
+/*
+ * Byte at a time reference for the escape character count of one component,
+ * with the escaping rules hgfsEscape.c uses on Linux.
+ */
+static uint32
+RefCountEscapeChars(char const *bufIn,
+                    uint32 sizeIn)
+{
+   uint32 count = 0;
+   uint32 i;
+
+   for (i = 0; i < sizeIn; i++) {
+      if (strchr(REF_ILLEGAL_CHARS, bufIn[i]) != NULL) {
+         count++;
+      } else if (bufIn[i] == REF_ESCAPE_CHAR && i > 0) {
+         if ((bufIn[i - 1] == REF_ESCAPE_SUBSTITUTE_CHAR && i > 1 &&
+              (bufIn[i - 2] == REF_ESCAPE_SUBSTITUTE_CHAR ||
+               strchr(REF_SUBSTITUTE_CHARS, bufIn[i - 2]) != NULL)) ||
+             strchr(REF_SUBSTITUTE_CHARS, bufIn[i - 1]) != NULL) {
+            count++;
+         }
+      }
+   }
+
+   return count;
+}
+
+
+static int
+RefEscapeGetSize(char const *bufIn,
+                 uint32 sizeIn)
+{
+   uint32 result = 0;
+   const char *currentComponent = bufIn;
+   const char *end = bufIn + sizeIn;
+   const char *next;
+
+   while (currentComponent - bufIn < sizeIn) {
+      int componentSize = RefGetComponent(currentComponent, end, &next);
+
+      if (componentSize < 0) {
+         return -1;
+      }
+      result += RefCountEscapeChars(currentComponent, componentSize);
+      currentComponent = next;
+   }
+   return (result == 0) ? 0 : result + sizeIn;
+}
+
+
+static int
+RefConvertTo(char const *nameIn,
+             size_t bufOutSize,
+             char *bufOut)
+{
+   char *origOut = bufOut;
+   char const *endOut = bufOut + bufOutSize;
+   size_t cpNameLength;
+
+   while (*nameIn == '/') {
+      nameIn++;
+   }
+   while (*nameIn != '\0' && bufOut < endOut) {
+      if (*nameIn == '/') {
+         *bufOut = '\0';
+         do {
+            nameIn++;
+         } while (*nameIn == '/');
+      } else {
+         *bufOut = *nameIn;
+         nameIn++;
+      }
+      bufOut++;
+   }
+   if (bufOut == endOut) {
+      return -1;
+   }
+   *bufOut = '\0';
+
+   cpNameLength = bufOut - origOut;
+   while ((cpNameLength >= 1) && (origOut[cpNameLength - 1] == 0)) {
+      cpNameLength--;
+   }
+   return HgfsEscape_Undo(origOut, cpNameLength);
+}
+
+
+static double
+Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ * Builds a path of BENCH_DEPTH components of BENCH_COMP_LEN characters each.
+ * Every escapeEvery-th character of a component is an escape character, or
+ * none if escapeEvery is 0.
+ */
+static void
+BuildPath(char *path,
+          int escapeEvery)
+{
+   int i, j;
+
+   for (i = 0; i < BENCH_DEPTH; i++) {
+      *path++ = '/';
+      for (j = 0; j < BENCH_COMP_LEN; j++) {
+         if (escapeEvery != 0 && j % escapeEvery == escapeEvery - 1) {
+            *path++ = REF_ESCAPE_CHAR;
+         } else {
+            *path++ = 'a' + (i + j) % 26;
+         }
+      }
+   }
+   *path = '\0';
+}
+
+
+#define BENCH(label, iters, ref, new)                                        \
+   do {                                                                      \
+      double t0, t1, t2;                                                     \
+      int n;                                                                 \
+                                                                             \
+      t0 = Now();                                                            \
+      for (n = 0; n < (iters); n++) {                                        \
+         ref;                                                                \
+      }                                                                      \
+      t1 = Now();                                                            \
+      for (n = 0; n < (iters); n++) {                                        \
+         new;                                                                \
+      }                                                                      \
+      t2 = Now();                                                            \
+      printf("%-24s %9.0f ns %9.0f ns  %5.1fx\n", label,                     \
+             (t1 - t0) * 1e9 / (iters), (t2 - t1) * 1e9 / (iters),           \
+             (t1 - t0) / (t2 - t1));                                         \
+   } while (0)
+
+
+int
+main(int argc,
+     char **argv)
+{
+   static char path[BENCH_NAME_SIZE];
+   static char cpName[BENCH_NAME_SIZE];
+   static char refCpName[BENCH_NAME_SIZE];
+   int iters = argc > 1 ? atoi(argv[1]) : 20000;
+   int escapeEvery;
+
+   printf("%d components of %d characters\n", BENCH_DEPTH, BENCH_COMP_LEN);
+   printf("%-24s %12s %12s\n", "", "byte loop", "bulk scan");
+
+   for (escapeEvery = 0; escapeEvery <= 64; escapeEvery += 64) {
+      volatile int sink;
+      int cpNameLen;
+      int refLen;
+
+      printf("%s:\n", escapeEvery == 0 ? "Plain names" :
+                                         "One escape character per 64");
+      BuildPath(path, escapeEvery);
+
+      cpNameLen = CPName_ConvertTo(path, sizeof cpName, cpName);
+      refLen = RefConvertTo(path, sizeof refCpName, refCpName);
+      if (cpNameLen != refLen || memcmp(cpName, refCpName, cpNameLen) != 0) {
+         printf("CPName_ConvertTo mismatch\n");
+         return 1;
+      }
+      BENCH("CPName_ConvertTo", iters,
+            sink = RefConvertTo(path, sizeof refCpName, refCpName),
+            sink = CPName_ConvertTo(path, sizeof cpName, cpName));
+
+      /* CPName_ConvertTo unescapes, so convert once more for the rest. */
+      RefConvertTo(path, sizeof cpName, cpName);
+      cpNameLen = BENCH_DEPTH * (BENCH_COMP_LEN + 1) - 1;
+
+      {
+         char const *end = cpName + cpNameLen;
+         char const *walk;
+         char const *next;
+         char const *refNext = NULL;
+
+         for (walk = cpName; walk < end; walk = next) {
+            if (CPName_GetComponent(walk, end, &next) !=
+                RefGetComponent(walk, end, &refNext) || next != refNext) {
+               printf("CPName_GetComponent mismatch\n");
+               return 1;
+            }
+         }
+         BENCH("CPName_GetComponent", iters,
+               for (walk = cpName; walk < end; walk = next) {
+                  sink = RefGetComponent(walk, end, &next);
+               },
+               for (walk = cpName; walk < end; walk = next) {
+                  sink = CPName_GetComponent(walk, end, &next);
+               });
+      }
+
+      if (HgfsEscape_GetSize(cpName, cpNameLen) !=
+          RefEscapeGetSize(cpName, cpNameLen)) {
+         printf("HgfsEscape_GetSize mismatch\n");
+         return 1;
+      }
+      BENCH("HgfsEscape_GetSize", iters,
+            sink = RefEscapeGetSize(cpName, cpNameLen),
+            sink = HgfsEscape_GetSize(cpName, cpNameLen));
+      (void)sink;
+   }
+
+   return 0;
+}
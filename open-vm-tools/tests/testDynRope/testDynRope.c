@@ -0,0 +1,161 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * testDynRope.c --
+ *
+ *   Self-test for the DynRope functions. Builds ropes from random appends,
+ *   some large enough to span several chunks and some moved in from a
+ *   DynBuf, and checks the size, the I/O vector from DynRope_GetIOV
+ *   (including a truncated one) and DynRope_Flatten against the same data
+ *   appended to a plain DynBuf.
+ *
+ *   Usage: vmware-testdynrope [iterations]
+ *
+ *   Exits with a non-zero status if any rope differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "vmware.h"
+#include "dynbuf.h"
+
+/* Chunk sizes used by lib/misc/dynbuf.c, to hit the chunk boundaries. */
+#define TEST_MIN_CHUNK (1 << 10)
+#define TEST_MAX_CHUNK (1 << 20)
+
+
+int
+main(int argc, char **argv)
+{
+   static char data[3 * TEST_MAX_CHUNK];
+   int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+   int failures = 0;
+   int iter;
+   size_t i;
+
+   for (i = 0; i < sizeof data; i++) {
+      data[i] = rand();
+   }
+
+   for (iter = 0; iter < iterations; iter++) {
+      size_t appends = 1 + rand() % 16;
+      struct iovec *iov;
+      size_t numIov;
+      size_t offset;
+      DynRope r;
+      DynBuf ref;
+      DynBuf flat;
+
+      DynRope_Init(&r);
+      DynBuf_Init(&ref);
+      DynBuf_Init(&flat);
+
+      for (i = 0; i < appends; i++) {
+         char const *src;
+         size_t len;
+
+         switch (rand() % 4) {
+         case 0:
+            len = rand() % 16;
+            break;
+         case 1:
+            len = rand() % (2 * TEST_MIN_CHUNK);
+            break;
+         case 2:
+            len = rand() % sizeof data;
+            break;
+         default:
+            len = TEST_MIN_CHUNK;
+            break;
+         }
+         src = data + rand() % (sizeof data - len + 1);
+
+         if (rand() % 3 == 0) {
+            DynBuf b;
+
+            DynBuf_Init(&b);
+            DynBuf_SafeAppend(&b, src, len);
+            if (!DynRope_AppendDynBuf(&r, &b) || DynBuf_GetSize(&b) != 0) {
+               printf("DynRope_AppendDynBuf of %u bytes failed\n",
+                      (unsigned)len);
+               failures++;
+            }
+            DynBuf_Destroy(&b);
+         } else if (!DynRope_Append(&r, src, len)) {
+            printf("DynRope_Append of %u bytes failed\n", (unsigned)len);
+            failures++;
+         }
+         DynBuf_SafeAppend(&ref, src, len);
+      }
+
+      if (DynRope_GetSize(&r) != DynBuf_GetSize(&ref)) {
+         printf("Size %u, expected %u\n", (unsigned)DynRope_GetSize(&r),
+                (unsigned)DynBuf_GetSize(&ref));
+         failures++;
+      }
+
+      /* A short vector must stop at maxEntries. */
+      numIov = DynRope_GetNumChunks(&r);
+      iov = malloc((numIov + 1) * sizeof *iov);
+      if (numIov > 0 && DynRope_GetIOV(&r, iov, numIov - 1) != numIov - 1) {
+         printf("Short I/O vector overran\n");
+         failures++;
+      }
+      if (DynRope_GetIOV(&r, iov, numIov + 1) != numIov) {
+         printf("I/O vector has the wrong number of entries\n");
+         failures++;
+      }
+      for (i = 0, offset = 0; i < numIov; i++) {
+         if (offset + iov[i].iov_len > DynBuf_GetSize(&ref) ||
+             memcmp(iov[i].iov_base, (char *)DynBuf_Get(&ref) + offset,
+                    iov[i].iov_len) != 0) {
+            printf("I/O vector entry %u differs\n", (unsigned)i);
+            failures++;
+            break;
+         }
+         offset += iov[i].iov_len;
+      }
+      free(iov);
+
+      /* Flatten appends after whatever the DynBuf already holds. */
+      DynBuf_SafeAppend(&flat, "prefix", 6);
+      if (!DynRope_Flatten(&r, &flat) ||
+          DynBuf_GetSize(&flat) != 6 + DynBuf_GetSize(&ref) ||
+          memcmp(DynBuf_Get(&flat), "prefix", 6) != 0 ||
+          memcmp((char *)DynBuf_Get(&flat) + 6, DynBuf_Get(&ref),
+                 DynBuf_GetSize(&ref)) != 0) {
+         printf("Flattened rope differs\n");
+         failures++;
+      }
+
+      DynBuf_Destroy(&flat);
+      DynBuf_Destroy(&ref);
+      DynRope_Destroy(&r);
+      if (DynRope_GetSize(&r) != 0 || DynRope_GetNumChunks(&r) != 0) {
+         printf("Destroyed rope is not empty\n");
+         failures++;
+      }
+   }
+
+   printf("%d ropes, %d failures\n", iterations, failures);
+   return failures != 0;
+}
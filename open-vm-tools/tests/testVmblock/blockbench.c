@@ -0,0 +1,160 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * blockbench.c --
+ *
+ *   Benchmark for the vmblock block table. Links the table the way
+ *   vmblock-fuse builds it and adds, looks up and removes blocks the way a
+ *   large DnD operation does, without needing a mounted file system.
+ *
+ *   Usage: vmware-testvmblock-blockbench [number of blocks]
+ */
+
+#if !defined(vmblock_fuse)
+# error "blockbench.c must be built with the vmblock-fuse definitions."
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "os.h"
+#include "block.h"
+
+#define DEFAULT_BLOCKS     20000
+#define LOOKUP_ROUNDS      5
+#define BLOCK_NAME_FMT     "/tmp/VMwareDnD/abc%08d/file%d.txt"
+
+/* Required by os.h's LOG(), normally defined by vmblock-fuse's main.c. */
+int LOGLEVEL_THRESHOLD = 0;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Returns the monotonic time in seconds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Adds the requested number of blocks, split between two blockers, looks
+ *    each of them up LOOKUP_ROUNDS times, and removes them by blocker. The
+ *    results of the operations are checked along the way.
+ *
+ * Results:
+ *    0 on success, 1 if an operation returned an unexpected result.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   int numBlocks = argc > 1 ? atoi(argv[1]) : DEFAULT_BLOCKS;
+   os_blocker_id_t blockers[2] = { strdup("blocker0"), strdup("blocker1") };
+   char name[OS_PATH_MAX];
+   unsigned int removed;
+   double start;
+   double added;
+   double lookedUp;
+   double done;
+   BlockHandle cookie;
+   int found = 0;
+   int round;
+   int i;
+
+   if (numBlocks <= 0 || BlockInit() != 0) {
+      fprintf(stderr, "Usage: %s [number of blocks]\n", argv[0]);
+      return 1;
+   }
+
+   start = Now();
+   for (i = 0; i < numBlocks; i++) {
+      snprintf(name, sizeof name, BLOCK_NAME_FMT, i, i);
+      if (BlockAddFileBlock(name, blockers[i % 2]) != 0) {
+         fprintf(stderr, "Adding block %s failed.\n", name);
+         return 1;
+      }
+   }
+   added = Now();
+
+   for (round = 0; round < LOOKUP_ROUNDS; round++) {
+      for (i = 0; i < numBlocks; i++) {
+         snprintf(name, sizeof name, BLOCK_NAME_FMT, i, i);
+         cookie = BlockLookup(name, OS_UNKNOWN_BLOCKER);
+         if (cookie != NULL) {
+            BlockDropReference(cookie);
+            found++;
+         }
+      }
+   }
+   lookedUp = Now();
+
+   if (found != numBlocks * LOOKUP_ROUNDS) {
+      fprintf(stderr, "Found %d blocks, expected %d.\n", found,
+              numBlocks * LOOKUP_ROUNDS);
+      return 1;
+   }
+
+   snprintf(name, sizeof name, BLOCK_NAME_FMT, 0, 0);
+   cookie = BlockLookup(name, blockers[1]);
+   if (cookie != NULL) {
+      BlockDropReference(cookie);
+   }
+   if (BlockAddFileBlock(name, blockers[0]) != OS_EEXIST || cookie != NULL) {
+      fprintf(stderr, "Block %s is not owned by its blocker.\n", name);
+      return 1;
+   }
+
+   removed = BlockRemoveAllBlocks(blockers[0]);
+   removed += BlockRemoveAllBlocks(blockers[1]);
+   done = Now();
+
+   if (removed != numBlocks) {
+      fprintf(stderr, "Removed %u blocks, expected %d.\n", removed, numBlocks);
+      return 1;
+   }
+
+   printf("%d blocks: add %.3fs, %d lookups %.3fs, remove %.3fs\n",
+          numBlocks, added - start, numBlocks * LOOKUP_ROUNDS,
+          lookedUp - added, done - lookedUp);
+
+   BlockCleanup();
+   free(blockers[0]);
+   free(blockers[1]);
+   return 0;
+}
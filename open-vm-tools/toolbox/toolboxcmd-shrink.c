@@ -344,6 +344,7 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
    unsigned char *err;
    WiperPartition *part = NULL;
    WiperPartition_List plist;
+   WiperBackend backend = WIPER_BACKEND_ZERO_FILL;
    int rc;
 
 #if defined(_WIN32)
@@ -399,14 +400,26 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
       goto out;
    }
 
+#if !defined(_WIN32)
+   /*
+    * Use the fastest way of reclaiming free space the partition supports;
+    * filling it with zeroes is the last resort.
+    */
+   backend = Wiper_GetBestBackend(part);
+   g_debug("Using wiper backend %d for %s\n", backend, part->mountPoint);
+#endif
+
    /*
     * During the initial 'wipe' process, the Toolbox CLI first fills the
     * entire guest's disk space with files filled with zeroes. During this step,
     * user may notice few warning messages related to 'low disk space' in the
     * guest operating system. We need to print a warning message to disregard
-    * such warnings in the guest operating system.
+    * such warnings in the guest operating system. Trimming doesn't use up any
+    * disk space, so there's nothing to warn about in that case.
     */
-   if (performShrink) {
+   if (backend == WIPER_BACKEND_TRIM) {
+      g_debug("%s will be trimmed, skipping disk space warning\n", mountPoint);
+   } else if (performShrink) {
       ToolsCmd_Print("%s", SU_(disk.shrink.ignoreFreeSpaceWarnings,
                                "Please disregard any warnings about disk space "
                                "for the duration of shrink process.\n"));
@@ -416,7 +429,11 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
                                "for the duration of wipe process.\n"));
    }
 
+#if defined(_WIN32)
    wiper = Wiper_Start(part, MAX_WIPER_FILE_SIZE);
+#else
+   wiper = Wiper_StartWithBackend(part, backend);
+#endif
 
 #if defined(_WIN32)
    /*
@@ -23,10 +23,17 @@
  */
 
 #include <time.h>
+#if !defined(_WIN32)
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
 #include "toolboxCmdInt.h"
 #include "backdoor.h"
 #include "backdoor_def.h"
 #include "vmware/tools/i18n.h"
+#include "vmware/tools/metricsDefs.h"
+#include "vmware/tools/utils.h"
 
 
 /*
@@ -480,6 +487,247 @@ StatGetCpuLimit(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StatGetGuestInfo --
+ *
+ *      Prints the value a tools service last published under the given
+ *      guestinfo key.
+ *
+ * Results:
+ *      EXIT_SUCCESS on success.
+ *      EX_UNAVAILABLE if nothing has been published.
+ *
+ * Side effects:
+ *      Prints errMsg to stderr on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+StatGetGuestInfo(const char *key,    // IN: guestinfo key to read
+                 const char *errMsg) // IN: message printed on failure
+{
+   gchar *rpc = g_strdup_printf("info-get %s", key);
+   char *result = NULL;
+   size_t resultLen;
+   int exitStatus = EXIT_SUCCESS;
+
+   if (ToolsCmd_SendRPC(rpc, strlen(rpc), &result, &resultLen) &&
+       resultLen > 0) {
+      g_print("%s\n", result);
+   } else {
+      ToolsCmd_PrintErr("%s", errMsg);
+      exitStatus = EX_UNAVAILABLE;
+   }
+   free(result);
+   g_free(rpc);
+   return exitStatus;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StatGetLockStats --
+ *
+ *      Prints the lock statistics last published by the tools service.
+ *      The service publishes them through guestinfo once they have been
+ *      enabled with the "lock-stats" option in its section of tools.conf.
+ *
+ * Results:
+ *      EXIT_SUCCESS on success.
+ *      EX_UNAVAILABLE if no statistics have been published.
+ *
+ * Side effects:
+ *      Prints to stderr on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+StatGetLockStats(void)
+{
+   return StatGetGuestInfo("guestinfo.vmtools.lockStats",
+                           SU_(stat.lockstats.failed,
+                               "Lock statistics are not available.\n"));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StatGetHgfsStats --
+ *
+ *      Prints the HGFS server per-op statistics last published by the tools
+ *      service. The service publishes them through guestinfo once they have
+ *      been enabled with the "op-stats" option in the [hgfsServer] section
+ *      of tools.conf.
+ *
+ * Results:
+ *      EXIT_SUCCESS on success.
+ *      EX_UNAVAILABLE if no statistics have been published.
+ *
+ * Side effects:
+ *      Prints to stderr on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+StatGetHgfsStats(void)
+{
+   return StatGetGuestInfo("guestinfo.vmtools.hgfsStats",
+                           SU_(stat.hgfsstats.failed,
+                               "HGFS statistics are not available.\n"));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StatGetMetrics --
+ *
+ *      Prints the metrics exported by a tools service through its metrics
+ *      file. The file is read directly, so this doesn't need the service
+ *      to respond to anything. 'arg' is either the name of the service, in
+ *      which case the file is found the same way the service finds it (the
+ *      "metrics.path" option in the service's section of tools.conf, or a
+ *      file named after the service in TOOLS_METRICS_DIR), or the path of
+ *      the metrics file.
+ *
+ * Results:
+ *      EXIT_SUCCESS on success.
+ *      EX_UNAVAILABLE if the metrics file can't be read.
+ *
+ * Side effects:
+ *      Prints to stderr on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+StatGetMetrics(const char *arg) // IN: Name of the service, or file path
+{
+#if defined(_WIN32)
+   ToolsCmd_PrintErr("%s",
+                     SU_(stat.metrics.failed,
+                         "Metrics are not available.\n"));
+   return EX_UNAVAILABLE;
+#else
+   int fd;
+   uint32 i;
+   uint32 count;
+   struct stat st;
+   void *mem = MAP_FAILED;
+   const ToolsMetricsHeader *hdr;
+   const ToolsMetric *metrics;
+   int exitStatus = EX_UNAVAILABLE;
+   gchar *path = NULL;
+
+   if (strchr(arg, '/') != NULL) {
+      path = g_strdup(arg);
+   } else {
+      GKeyFile *conf = NULL;
+
+      VMTools_LoadConfig(NULL, G_KEY_FILE_NONE, &conf, NULL);
+      if (conf != NULL) {
+         path = g_key_file_get_string(conf, arg, "metrics.path", NULL);
+         g_key_file_free(conf);
+      }
+      if (path == NULL) {
+         path = g_strdup_printf("%s/%s%s", TOOLS_METRICS_DIR, arg,
+                                TOOLS_METRICS_SUFFIX);
+      }
+   }
+
+   fd = open(path, O_RDONLY);
+   if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < sizeof *hdr) {
+      goto exit;
+   }
+
+   mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   if (mem == MAP_FAILED) {
+      goto exit;
+   }
+
+   hdr = mem;
+   if (hdr->magic != TOOLS_METRICS_MAGIC ||
+       hdr->version != TOOLS_METRICS_VERSION ||
+       hdr->metricSize != sizeof *metrics ||
+       sizeof *hdr + (uint64) hdr->capacity * sizeof *metrics > st.st_size) {
+      goto exit;
+   }
+
+   metrics = (const ToolsMetric *) (hdr + 1);
+   count = MIN(Atomic_Read32((Atomic_uint32 *) &hdr->count), hdr->capacity);
+
+   for (i = 0; i < count; i++) {
+      const ToolsMetric *m = &metrics[i];
+      uint64 value = Atomic_Read64(&m->value);
+
+      switch (m->type) {
+      case TOOLS_METRIC_COUNTER:
+         g_print("%.*s counter %"FMT64"u\n", TOOLS_METRICS_NAME_LEN, m->name,
+                 value);
+         break;
+
+      case TOOLS_METRIC_GAUGE:
+         g_print("%.*s gauge %"FMT64"d\n", TOOLS_METRICS_NAME_LEN, m->name,
+                 (int64) value);
+         break;
+
+      case TOOLS_METRIC_HISTOGRAM:
+         {
+            uint32 b;
+
+            g_print("%.*s histogram count=%"FMT64"u sum=%"FMT64"u\n",
+                    TOOLS_METRICS_NAME_LEN, m->name, value,
+                    Atomic_Read64(&m->sum));
+            for (b = 0; b < TOOLS_METRICS_HIST_BUCKETS; b++) {
+               uint64 n = Atomic_Read64(&m->buckets[b]);
+
+               if (n == 0) {
+                  continue;
+               }
+               if (b == 0) {
+                  g_print("   [0]: %"FMT64"u\n", n);
+               } else if (b == TOOLS_METRICS_HIST_BUCKETS - 1) {
+                  g_print("   [%"FMT64"u, inf): %"FMT64"u\n",
+                          CONST64U(1) << (b - 1), n);
+               } else {
+                  g_print("   [%"FMT64"u, %"FMT64"u): %"FMT64"u\n",
+                          CONST64U(1) << (b - 1), CONST64U(1) << b, n);
+               }
+            }
+         }
+         break;
+
+      default:
+         break;
+      }
+   }
+   exitStatus = EXIT_SUCCESS;
+
+exit:
+   if (exitStatus != EXIT_SUCCESS) {
+      ToolsCmd_PrintErr("%s",
+                        SU_(stat.metrics.failed,
+                            "Metrics are not available.\n"));
+   }
+   if (mem != MAP_FAILED) {
+      munmap(mem, st.st_size);
+   }
+   if (fd >= 0) {
+      close(fd);
+   }
+   g_free(path);
+   return exitStatus;
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -520,6 +768,12 @@ Stat_Command(char **argv,      // IN: Command line arguments
       return StatGetCpuLimit();
    } else if (toolbox_strcmp(argv[optind], "speed") == 0) {
       return StatProcessorSpeed();
+   } else if (toolbox_strcmp(argv[optind], "lockstats") == 0) {
+      return StatGetLockStats();
+   } else if (toolbox_strcmp(argv[optind], "hgfs") == 0) {
+      return StatGetHgfsStats();
+   } else if (toolbox_strcmp(argv[optind], "metrics") == 0) {
+      return StatGetMetrics(optind + 1 < argc ? argv[optind + 1] : "vmsvc");
    } else {
       ToolsCmd_UnknownEntityError(argv[0],
                                   SU_(arg.subcommand, "subcommand"),
@@ -554,6 +808,11 @@ Stat_Help(const char *progName, // IN: The name of the program obtained from arg
                           "Subcommands:\n"
                           "   hosttime: print the host time\n"
                           "   speed: print the CPU speed in MHz\n"
+                          "   lockstats: print the tools service lock statistics\n"
+                          "   hgfs: print the shared folders server statistics\n"
+                          "   metrics [service|path]: print the metrics exported by a\n"
+                          "      tools service (\"vmsvc\" by default), or read from a\n"
+                          "      metrics file\n"
                           "ESX guests only subcommands:\n"
                           "   sessionid: print the current session id\n"
                           "   balloon: print memory ballooning information\n"